@@ -27,7 +27,12 @@
 
 #include "InternalUtils.hpp"
 #include <Diluculum/LuaUtils.hpp>
+#include <clocale>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <cstring>
+#include <limits>
 #include <boost/lexical_cast.hpp>
 
 namespace Diluculum
@@ -139,6 +144,74 @@ namespace Diluculum
          return reinterpret_cast<const char*>(f->getData());
       }
 
+
+
+      // - ReserveLuaStack -----------------------------------------------------
+      void ReserveLuaStack (lua_State* ls, int needed, int& reserved)
+      {
+         // The stack is grown by (at least) this many extra slots at a time
+         const int chunk = 64;
+
+         const int top = lua_gettop (ls);
+         if (top + needed <= reserved)
+            return;
+
+         if (!lua_checkstack (ls, needed + chunk))
+         {
+            throw LuaTypeError(
+               "Lua stack overflow while converting a value: it is too "
+               "deeply nested.");
+         }
+
+         reserved = top + needed + chunk;
+      }
+
+
+
+      // - FormatNumber --------------------------------------------------------
+      std::string FormatNumber (double number)
+      {
+         // '%g' drops trailing zeros, so if fewer than 15 digits are enough
+         // for a normal number, '%.15g' already gives them. Subnormal numbers
+         // are less precise, and may need just one.
+         const int minPrecision =
+            std::fabs (number) < std::numeric_limits<double>::min() ? 1 : 15;
+
+         char digits[32];
+         for (int precision = minPrecision; precision <= 17; ++precision)
+         {
+            sprintf (digits, "%.*g", precision, number);
+            if (strtod (digits, 0) == number)
+               break;
+         }
+
+         // Both 'sprintf()' and 'strtod()' use the decimal point of the
+         // current locale, which is fine for the round trip above, but not
+         // for the result
+         std::string result (digits);
+         const char* point = localeconv()->decimal_point;
+         const std::size_t pos = result.find (point);
+         if (pos != std::string::npos && std::strcmp (point, ".") != 0)
+            result.replace (pos, std::strlen (point), ".");
+
+         return result;
+      }
+
+
+
+      // - ParseNumber ---------------------------------------------------------
+      double ParseNumber (const std::string& str)
+      {
+         const char* point = localeconv()->decimal_point;
+         const std::size_t pos = str.find ('.');
+         if (pos == std::string::npos || std::strcmp (point, ".") == 0)
+            return strtod (str.c_str(), 0);
+
+         std::string localized (str);
+         localized.replace (pos, 1, point);
+         return strtod (localized.c_str(), 0);
+      }
+
    } // namespace Impl
 
 } // namespace Diluculum
@@ -27,6 +27,7 @@
 #ifndef _DILUCULUM_INTERNAL_UTILS_HPP_
 #define _DILUCULUM_INTERNAL_UTILS_HPP_
 
+#include <string>
 #include <Diluculum/LuaState.hpp>
 
 
@@ -75,6 +76,29 @@ namespace Diluculum
        */
       const char* LuaFunctionReader(lua_State* luaState, void* func,
                                     size_t* size);
+
+      /** Makes sure that there are at least \c needed free slots above the
+       *  top of the Lua stack. To avoid calling \c lua_checkstack() too
+       *  often when walking deeply nested tables, the stack is grown in
+       *  chunks larger than needed.
+       *  @param reserved The stack index up to which space was already
+       *         reserved (start with 0). Updated when more space is reserved.
+       *  @throw LuaTypeError If the stack cannot grow that much.
+       */
+      void ReserveLuaStack (lua_State* ls, int needed, int& reserved);
+
+      /** Returns \c number written with the fewest significant digits (up to
+       *  17) that read back to the same value, in \c printf()'s \c %g
+       *  format. The decimal point is always a \c '.', whatever the C locale.
+       *  @note \c number must be finite.
+       */
+      std::string FormatNumber (double number);
+
+      /** Reads a number from \c str, which must be in the format accepted by
+       *  \c strtod() in the C locale (a \c '.' as decimal point), whatever
+       *  the current C locale.
+       */
+      double ParseNumber (const std::string& str);
    }
 
 } // namespace Diluculum
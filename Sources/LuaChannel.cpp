@@ -0,0 +1,310 @@
+/******************************************************************************\
+* LuaChannel.cpp                                                               *
+* Message-passing channels between Lua states.                                 *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#include <deque>
+#include <new>
+#include <string>
+#include <boost/cstdint.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread_time.hpp>
+#include <Diluculum/LuaChannel.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaSerialization.hpp>
+#include <Diluculum/LuaWrappers.hpp>
+
+
+namespace Diluculum
+{
+   // - LuaChannel::Queue ------------------------------------------------------
+   class LuaChannel::Queue
+   {
+      public:
+         /** Appends a serialized value to the queue. \c payload is swapped
+          *  into the queue (thus, it will be empty after this call), so that
+          *  no copy is made inside the critical section.
+          */
+         void push (std::string& payload)
+         {
+            {
+               boost::mutex::scoped_lock lock (mutex_);
+               items_.push_back (std::string());
+               items_.back().swap (payload);
+            }
+            notEmpty_.notify_one();
+         }
+
+         /** Removes the first serialized value from the queue and stores it in
+          *  \c payload. See \c LuaChannel::receive() for the meaning of
+          *  \c timeout and of the return value.
+          */
+         bool pop (std::string& payload, double timeout)
+         {
+            boost::mutex::scoped_lock lock (mutex_);
+
+            // Timeouts too large to be represented as a deadline (and NaNs)
+            // are taken as "wait forever"
+            if (timeout < 0.0 || !(timeout <= MaxTimeout))
+            {
+               while (items_.empty())
+                  notEmpty_.wait (lock);
+            }
+            else
+            {
+               const boost::system_time deadline = boost::get_system_time()
+                  + boost::posix_time::microseconds (
+                     static_cast<boost::int64_t>(timeout * 1e6));
+
+               while (items_.empty())
+               {
+                  if (!notEmpty_.timed_wait (lock, deadline))
+                  {
+                     if (items_.empty())
+                        return false;
+                     break;
+                  }
+               }
+            }
+
+            payload.swap (items_.front());
+            items_.pop_front();
+            return true;
+         }
+
+         /// Returns the number of values in the queue.
+         size_t size() const
+         {
+            boost::mutex::scoped_lock lock (mutex_);
+            return items_.size();
+         }
+
+      private:
+         /** The largest timeout, in seconds, for which a deadline is
+          *  computed. Larger timeouts mean "wait forever". (This is more than
+          *  30 years, and keeps the deadline far from overflowing.)
+          */
+         static const double MaxTimeout;
+
+         /// Protects \c items_.
+         mutable boost::mutex mutex_;
+
+         /// Signaled whenever a value is added to \c items_.
+         boost::condition_variable notEmpty_;
+
+         /// The serialized values, in the order they were sent.
+         std::deque<std::string> items_;
+   };
+
+
+
+   const double LuaChannel::Queue::MaxTimeout = 1e9;
+
+
+
+   namespace
+   {
+      /// The name of the metatable used for channels in the Lua registry.
+      const char* const ChannelMetatableName = "Diluculum.LuaChannel";
+
+
+
+      // - Lua-side channel methods --------------------------------------------
+
+      /** Returns the queue of the channel at index \c index, raising a Lua
+       *  error if the value there is not a channel.
+       */
+      LuaChannel::Queue* CheckChannel (lua_State* ls, int index)
+      {
+         void* ud = luaL_checkudata (ls, index, ChannelMetatableName);
+         return static_cast<boost::shared_ptr<LuaChannel::Queue>*>(ud)->get();
+      }
+
+      /// Implements <tt>channel:send(v)</tt>.
+      int ChannelSend (lua_State* ls)
+      {
+         LuaChannel::Queue* queue = CheckChannel (ls, 1);
+         luaL_checkany (ls, 2);
+
+         try
+         {
+            std::string payload;
+            StringSink sink (payload);
+            SerializeFromStack (ls, 2, sink);
+            queue->push (payload);
+            return 0;
+         }
+         catch (LuaError& e)
+         {
+            Impl::ReportErrorFromCFunction (ls, e.what());
+            return 0;
+         }
+         catch(...)
+         {
+            Impl::ReportErrorFromCFunction (
+               ls, "Unknown exception caught by wrapper.");
+            return 0;
+         }
+      }
+
+      /// Implements <tt>channel:receive(timeout)</tt>.
+      int ChannelReceive (lua_State* ls)
+      {
+         LuaChannel::Queue* queue = CheckChannel (ls, 1);
+         const double timeout =
+            lua_isnoneornil (ls, 2) ? -1.0 : luaL_checknumber (ls, 2);
+         lua_settop (ls, 0);
+
+         try
+         {
+            std::string payload;
+            if (!queue->pop (payload, timeout))
+            {
+               lua_pushnil (ls);
+               lua_pushliteral (ls, "timeout");
+               return 2;
+            }
+
+            MemorySource source (payload);
+            DeserializeToStack (ls, source);
+            return 1;
+         }
+         catch (LuaError& e)
+         {
+            Impl::ReportErrorFromCFunction (ls, e.what());
+            return 0;
+         }
+         catch(...)
+         {
+            Impl::ReportErrorFromCFunction (
+               ls, "Unknown exception caught by wrapper.");
+            return 0;
+         }
+      }
+
+      /// The \c __gc metamethod of channels.
+      int ChannelGC (lua_State* ls)
+      {
+         typedef boost::shared_ptr<LuaChannel::Queue> queue_ptr_t;
+         static_cast<queue_ptr_t*>(lua_touserdata (ls, 1))->~queue_ptr_t();
+         return 0;
+      }
+
+   } // (anonymous) namespace
+
+
+
+   // - LuaChannel::LuaChannel -------------------------------------------------
+   LuaChannel::LuaChannel()
+      : queue_(new Queue())
+   { }
+
+
+   LuaChannel::LuaChannel (const boost::shared_ptr<Queue>& queue)
+      : queue_(queue)
+   { }
+
+
+
+   // - LuaChannel::send -------------------------------------------------------
+   void LuaChannel::send (const LuaValue& value)
+   {
+      std::string payload;
+      StringSink sink (payload);
+      Serialize (value, sink);
+      queue_->push (payload);
+   }
+
+
+
+   // - LuaChannel::receive ----------------------------------------------------
+   bool LuaChannel::receive (LuaValue& value, double timeout)
+   {
+      std::string payload;
+      if (!queue_->pop (payload, timeout))
+         return false;
+
+      MemorySource source (payload);
+      value = Deserialize (source);
+      return true;
+   }
+
+
+
+   // - LuaChannel::size -------------------------------------------------------
+   size_t LuaChannel::size() const
+   {
+      return queue_->size();
+   }
+
+
+
+   // - PushLuaChannel ---------------------------------------------------------
+   void PushLuaChannel (lua_State* state, const LuaChannel& channel)
+   {
+      typedef boost::shared_ptr<LuaChannel::Queue> queue_ptr_t;
+
+      void* ud = lua_newuserdata (state, sizeof(queue_ptr_t));
+      new(ud) queue_ptr_t (channel.queue_);
+
+      if (luaL_newmetatable (state, ChannelMetatableName))
+      {
+         lua_newtable (state);
+         lua_pushcfunction (state, ChannelSend);
+         lua_setfield (state, -2, "send");
+         lua_pushcfunction (state, ChannelReceive);
+         lua_setfield (state, -2, "receive");
+         lua_setfield (state, -2, "__index");
+
+         lua_pushcfunction (state, ChannelGC);
+         lua_setfield (state, -2, "__gc");
+      }
+
+      lua_setmetatable (state, -2);
+   }
+
+
+
+   // - ToLuaChannel -----------------------------------------------------------
+   LuaChannel ToLuaChannel (lua_State* state, int index)
+   {
+      void* ud = lua_touserdata (state, index);
+      bool isChannel = false;
+
+      if (ud != 0 && lua_getmetatable (state, index))
+      {
+         luaL_getmetatable (state, ChannelMetatableName);
+         isChannel = lua_rawequal (state, -1, -2) != 0;
+         lua_pop (state, 2);
+      }
+
+      if (!isChannel)
+         throw TypeMismatchError ("channel", luaL_typename (state, index));
+
+      return LuaChannel (
+         *static_cast<boost::shared_ptr<LuaChannel::Queue>*>(ud));
+   }
+
+} // namespace Diluculum
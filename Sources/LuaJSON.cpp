@@ -0,0 +1,1148 @@
+/******************************************************************************\
+* LuaJSON.cpp                                                                  *
+* Conversion between JSON and Lua values.                                      *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <boost/cstdint.hpp>
+#include <boost/lexical_cast.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaJSON.hpp>
+#include <Diluculum/LuaWrappers.hpp>
+#include "InternalUtils.hpp"
+
+
+namespace Diluculum
+{
+   namespace
+   {
+      /** The maximum nesting depth of arrays and objects. This protects the C
+       *  stack from malicious JSON (when parsing) and from cyclic tables
+       *  (when converting to JSON).
+       */
+      const int MaxDepth = 1000;
+
+      /** The maximum number of elements (or key/value pairs) of an array (or
+       *  object) kept on the Lua stack before creating the table that will
+       *  hold them. Up to this size, tables are created with the exact size
+       *  they need.
+       */
+      const int MaxPending = 32;
+
+      /// The largest number that, together with all smaller ones, is exact.
+      const double MaxExactInteger = 9007199254740992.0; // 2^53
+
+      /// A word with all bytes equal to one.
+      const boost::uint64_t OnesWord = ~static_cast<boost::uint64_t>(0) / 255;
+
+      /// A word with the highest bit of all bytes set.
+      const boost::uint64_t HighBitsWord = OnesWord * 0x80;
+
+      /** Checks whether any byte in the word \c w is equal to \c c. This and
+       *  \c HasByteLessThan() let us scan strings eight bytes at a time, with
+       *  no dependency on any specific instruction set.
+       */
+      inline bool HasByte (boost::uint64_t w, unsigned char c)
+      {
+         const boost::uint64_t x = w ^ (OnesWord * c);
+         return ((x - OnesWord) & ~x & HighBitsWord) != 0;
+      }
+
+      /** Checks whether any byte in \c w is less than \c n (which must be
+       *  at most 128).
+       */
+      inline bool HasByteLessThan (boost::uint64_t w, unsigned char n)
+      {
+         return ((w - OnesWord * n) & ~w & HighBitsWord) != 0;
+      }
+
+      /** Checks whether any of the eight bytes starting at \c p is a quote, a
+       *  backslash or a control character (which are the only ones needing
+       *  special treatment in JSON strings).
+       */
+      inline bool NeedsAttention (const char* p)
+      {
+         boost::uint64_t w;
+         memcpy (&w, p, sizeof(w));
+         return HasByte (w, '"') || HasByte (w, '\\')
+            || HasByteLessThan (w, 0x20);
+      }
+
+      /// Appends the UTF-8 encoding of the code point \c cp to \c out.
+      void AppendUTF8 (std::string& out, unsigned long cp)
+      {
+         if (cp < 0x80)
+         {
+            out += static_cast<char>(cp);
+         }
+         else if (cp < 0x800)
+         {
+            out += static_cast<char>(0xC0 | (cp >> 6));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+         }
+         else if (cp < 0x10000)
+         {
+            out += static_cast<char>(0xE0 | (cp >> 12));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+         }
+         else
+         {
+            out += static_cast<char>(0xF0 | (cp >> 18));
+            out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (cp & 0x3F));
+         }
+      }
+
+
+
+      // - JSONReader ----------------------------------------------------------
+      /// The lexical part of the JSON parser.
+      class JSONReader
+      {
+         public:
+            JSONReader (const char* json, std::size_t size)
+               : begin_(json), p_(json), end_(json + size)
+            { }
+
+            /** Skips whitespace and returns the next character, without
+             *  consuming it. Returns \c '\0' at the end of the input.
+             */
+            char peek()
+            {
+               while (p_ != end_
+                      && (*p_ == ' ' || *p_ == '\n' || *p_ == '\r'
+                          || *p_ == '\t'))
+               {
+                  ++p_;
+               }
+
+               return p_ != end_ ? *p_ : '\0';
+            }
+
+            /// Consumes the character returned by \c peek().
+            void advance() { ++p_; }
+
+            /// Consumes \c c (after any whitespace), or fails.
+            void expect (char c)
+            {
+               if (peek() != c)
+                  fail (std::string ("expected '") + c + "'");
+               advance();
+            }
+
+            /// Consumes the literal \c word, or fails.
+            void literal (const char* word)
+            {
+               const std::size_t len = strlen (word);
+               if (static_cast<std::size_t>(end_ - p_) < len
+                   || memcmp (p_, word, len) != 0)
+               {
+                  fail ("invalid value");
+               }
+               p_ += len;
+            }
+
+            /// Fails unless there is nothing but whitespace left.
+            void finish()
+            {
+               if (peek() != '\0' || p_ != end_)
+                  fail ("unexpected data after the value");
+            }
+
+            /// Throws a \c SerializationError describing a syntax error.
+            void fail (const std::string& what)
+            {
+               throw SerializationError (
+                  ("Invalid JSON at byte "
+                   + boost::lexical_cast<std::string>(p_ - begin_)
+                   + ": " + what + ".").c_str());
+            }
+
+            /** Reads a string, whose opening quote is the next character.
+             *  Strings without escape sequences are not copied: the returned
+             *  pointer points into the input. Otherwise, it points to a
+             *  buffer that is valid until the next call.
+             */
+            const char* string (std::size_t& len)
+            {
+               const char* run = ++p_;
+               bool copied = false;
+
+               for (;;)
+               {
+                  while (end_ - p_ >= 8 && !NeedsAttention (p_))
+                     p_ += 8;
+
+                  if (p_ == end_)
+                     fail ("unterminated string");
+
+                  const unsigned char c = *p_;
+                  if (c == '"')
+                  {
+                     if (!copied)
+                     {
+                        len = p_++ - run;
+                        return run;
+                     }
+
+                     buffer_.append (run, p_++ - run);
+                     len = buffer_.size();
+                     return buffer_.data();
+                  }
+                  else if (c == '\\')
+                  {
+                     if (!copied)
+                        buffer_.clear();
+                     copied = true;
+                     buffer_.append (run, p_++ - run);
+                     escape();
+                     run = p_;
+                  }
+                  else if (c < 0x20)
+                  {
+                     fail ("control character in string");
+                  }
+                  else
+                  {
+                     ++p_;
+                  }
+               }
+            }
+
+            /// Reads a number.
+            lua_Number number()
+            {
+               const char* start = p_;
+
+               if (p_ != end_ && *p_ == '-')
+                  ++p_;
+
+               if (p_ == end_ || !IsDigit (*p_))
+                  fail ("invalid value");
+
+               // Common case: small integers are computed right here
+               boost::uint64_t mantissa = 0;
+               const char* digits = p_;
+               if (*p_ == '0')
+               {
+                  ++p_;
+               }
+               else
+               {
+                  while (p_ != end_ && IsDigit (*p_))
+                     mantissa = mantissa * 10 + (*p_++ - '0');
+               }
+
+               bool isInteger = p_ - digits <= 15;
+
+               if (p_ != end_ && *p_ == '.')
+               {
+                  isInteger = false;
+                  ++p_;
+                  skipDigits();
+               }
+
+               if (p_ != end_ && (*p_ == 'e' || *p_ == 'E'))
+               {
+                  isInteger = false;
+                  ++p_;
+                  if (p_ != end_ && (*p_ == '+' || *p_ == '-'))
+                     ++p_;
+                  skipDigits();
+               }
+
+               if (isInteger)
+               {
+                  const lua_Number n = static_cast<lua_Number>(mantissa);
+                  return *start == '-' ? -n : n;
+               }
+
+               buffer_.assign (start, p_ - start);
+               return Impl::ParseNumber (buffer_);
+            }
+
+         private:
+            /// Checks whether \c c is a decimal digit.
+            static bool IsDigit (char c) { return c >= '0' && c <= '9'; }
+
+            /// Consumes one or more digits, or fails.
+            void skipDigits()
+            {
+               if (p_ == end_ || !IsDigit (*p_))
+                  fail ("invalid number");
+               while (p_ != end_ && IsDigit (*p_))
+                  ++p_;
+            }
+
+            /// Reads four hexadecimal digits.
+            unsigned long hex4()
+            {
+               if (end_ - p_ < 4)
+                  fail ("invalid escape sequence");
+
+               unsigned long n = 0;
+               for (int i = 0; i < 4; ++i, ++p_)
+               {
+                  const char c = *p_;
+                  n <<= 4;
+                  if (c >= '0' && c <= '9')
+                     n |= c - '0';
+                  else if (c >= 'a' && c <= 'f')
+                     n |= c - 'a' + 10;
+                  else if (c >= 'A' && c <= 'F')
+                     n |= c - 'A' + 10;
+                  else
+                     fail ("invalid escape sequence");
+               }
+               return n;
+            }
+
+            /** Reads an escape sequence (whose backslash was already consumed),
+             *  appending the character it represents to \c buffer_.
+             */
+            void escape()
+            {
+               if (p_ == end_)
+                  fail ("unterminated string");
+
+               switch (*p_++)
+               {
+                  case '"': buffer_ += '"'; break;
+                  case '\\': buffer_ += '\\'; break;
+                  case '/': buffer_ += '/'; break;
+                  case 'b': buffer_ += '\b'; break;
+                  case 'f': buffer_ += '\f'; break;
+                  case 'n': buffer_ += '\n'; break;
+                  case 'r': buffer_ += '\r'; break;
+                  case 't': buffer_ += '\t'; break;
+
+                  case 'u':
+                  {
+                     unsigned long cp = hex4();
+
+                     // Characters outside the BMP come as surrogate pairs;
+                     // an unpaired surrogate is not a character at all
+                     if (cp >= 0xDC00 && cp <= 0xDFFF)
+                        fail ("invalid escape sequence");
+
+                     if (cp >= 0xD800 && cp <= 0xDBFF)
+                     {
+                        if (end_ - p_ < 2 || p_[0] != '\\' || p_[1] != 'u')
+                           fail ("invalid escape sequence");
+
+                        p_ += 2;
+                        const unsigned long low = hex4();
+                        if (low < 0xDC00 || low > 0xDFFF)
+                           fail ("invalid escape sequence");
+
+                        cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                     }
+
+                     AppendUTF8 (buffer_, cp);
+                     break;
+                  }
+
+                  default:
+                     --p_;
+                     fail ("invalid escape sequence");
+               }
+            }
+
+            /// The start of the input.
+            const char* begin_;
+
+            /// The next character to read.
+            const char* p_;
+
+            /// One past the end of the input.
+            const char* end_;
+
+            /// Holds strings with escape sequences and numbers being parsed.
+            std::string buffer_;
+      };
+
+
+
+      /// Fails if \c depth is too deep for parsing an array or object.
+      void CheckParsingDepth (JSONReader& reader, int depth)
+      {
+         if (depth >= MaxDepth)
+            reader.fail ("arrays or objects nested too deeply");
+      }
+
+      /// Throws if \c depth is too deep for converting a table to JSON.
+      void CheckConversionDepth (int depth)
+      {
+         if (depth >= MaxDepth)
+         {
+            throw LuaTypeError ("Tables nested too deeply (or cyclic tables) "
+                                "cannot be converted to JSON.");
+         }
+      }
+
+      /** Creates a table holding the \c count values above \c base on the Lua
+       *  stack, and leaves just it there, returning its index.
+       */
+      int FlushPendingValues (lua_State* ls, int base, int count)
+      {
+         if (!lua_checkstack (ls, 1))
+            throw LuaMemoryError ("Cannot grow the Lua stack.");
+
+         const int table = base + 1;
+         lua_createtable (ls, count, 0);
+         lua_insert (ls, table);
+         for (int i = count; i >= 1; --i)
+            lua_rawseti (ls, table, i);
+
+         return table;
+      }
+
+      /** Creates a table holding the \c count key/value pairs above \c base on
+       *  the Lua stack, and leaves just it there, returning its index. Pairs
+       *  are inserted in order, so that repeated keys keep their last value.
+       */
+      int FlushPendingPairs (lua_State* ls, int base, int count)
+      {
+         if (!lua_checkstack (ls, 3))
+            throw LuaMemoryError ("Cannot grow the Lua stack.");
+
+         const int table = base + 1;
+         lua_createtable (ls, 0, count);
+         lua_insert (ls, table);
+         for (int i = 0; i < count; ++i)
+         {
+            lua_pushvalue (ls, table + 1 + 2 * i);
+            lua_pushvalue (ls, table + 2 + 2 * i);
+            lua_rawset (ls, table);
+         }
+         lua_settop (ls, table);
+
+         return table;
+      }
+
+
+
+      // - ParseToStack --------------------------------------------------------
+      void ParseToStack (JSONReader& reader, lua_State* ls, int nullIndex,
+                         int depth)
+      {
+         if (!lua_checkstack (ls, 3))
+            throw LuaMemoryError ("Cannot grow the Lua stack.");
+
+         switch (reader.peek())
+         {
+            case '[':
+            {
+               CheckParsingDepth (reader, depth);
+               reader.advance();
+
+               if (reader.peek() == ']')
+               {
+                  reader.advance();
+                  lua_newtable (ls);
+                  break;
+               }
+
+               // Elements are left on the stack until we know how many they
+               // are (or until there are too many of them)
+               const int base = lua_gettop (ls);
+               int table = 0;
+               int count = 0;
+               for (;;)
+               {
+                  if (table == 0 && (count == MaxPending
+                                     || !lua_checkstack (ls, 2 * MaxPending)))
+                  {
+                     table = FlushPendingValues (ls, base, count);
+                  }
+
+                  ParseToStack (reader, ls, nullIndex, depth + 1);
+                  ++count;
+                  if (table != 0)
+                     lua_rawseti (ls, table, count);
+
+                  const char c = reader.peek();
+                  if (c == ']')
+                     break;
+                  else if (c != ',')
+                     reader.fail ("expected ',' or ']'");
+                  reader.advance();
+               }
+               reader.advance();
+
+               if (table == 0)
+                  FlushPendingValues (ls, base, count);
+               break;
+            }
+
+            case '{':
+            {
+               CheckParsingDepth (reader, depth);
+               reader.advance();
+
+               if (reader.peek() == '}')
+               {
+                  reader.advance();
+                  lua_newtable (ls);
+                  break;
+               }
+
+               const int base = lua_gettop (ls);
+               int table = 0;
+               int count = 0;
+               for (;;)
+               {
+                  if (table == 0 && (count == MaxPending
+                                     || !lua_checkstack (ls, 2 * MaxPending)))
+                  {
+                     table = FlushPendingPairs (ls, base, count);
+                  }
+
+                  if (reader.peek() != '"')
+                     reader.fail ("expected a string");
+
+                  std::size_t len;
+                  const char* key = reader.string (len);
+                  lua_pushlstring (ls, key, len);
+
+                  reader.expect (':');
+                  ParseToStack (reader, ls, nullIndex, depth + 1);
+                  ++count;
+                  if (table != 0)
+                     lua_rawset (ls, table);
+
+                  const char c = reader.peek();
+                  if (c == '}')
+                     break;
+                  else if (c != ',')
+                     reader.fail ("expected ',' or '}'");
+                  reader.advance();
+               }
+               reader.advance();
+
+               if (table == 0)
+                  FlushPendingPairs (ls, base, count);
+               break;
+            }
+
+            case '"':
+            {
+               std::size_t len;
+               const char* str = reader.string (len);
+               lua_pushlstring (ls, str, len);
+               break;
+            }
+
+            case 't':
+               reader.literal ("true");
+               lua_pushboolean (ls, true);
+               break;
+
+            case 'f':
+               reader.literal ("false");
+               lua_pushboolean (ls, false);
+               break;
+
+            case 'n':
+               reader.literal ("null");
+               if (nullIndex != 0)
+                  lua_pushvalue (ls, nullIndex);
+               else
+                  lua_pushnil (ls);
+               break;
+
+            default:
+               lua_pushnumber (ls, reader.number());
+         }
+      }
+
+
+
+      // - ParseToLuaValue -----------------------------------------------------
+      LuaValue ParseToLuaValue (JSONReader& reader, const LuaValue& null,
+                                int depth)
+      {
+         switch (reader.peek())
+         {
+            case '[':
+            {
+               CheckParsingDepth (reader, depth);
+               reader.advance();
+
+               LuaValueMap table;
+               if (reader.peek() == ']')
+               {
+                  reader.advance();
+                  return table;
+               }
+
+               for (int i = 1; ; ++i)
+               {
+                  const LuaValue value = ParseToLuaValue (reader, null,
+                                                          depth + 1);
+                  if (value.type() != LUA_TNIL)
+                     table.insert (table.end(), std::make_pair (i, value));
+
+                  const char c = reader.peek();
+                  if (c == ']')
+                     break;
+                  else if (c != ',')
+                     reader.fail ("expected ',' or ']'");
+                  reader.advance();
+               }
+               reader.advance();
+
+               return table;
+            }
+
+            case '{':
+            {
+               CheckParsingDepth (reader, depth);
+               reader.advance();
+
+               LuaValueMap table;
+               if (reader.peek() == '}')
+               {
+                  reader.advance();
+                  return table;
+               }
+
+               for (;;)
+               {
+                  if (reader.peek() != '"')
+                     reader.fail ("expected a string");
+
+                  std::size_t len;
+                  const char* str = reader.string (len);
+                  const LuaValue key = std::string (str, len);
+
+                  reader.expect (':');
+                  const LuaValue value = ParseToLuaValue (reader, null,
+                                                          depth + 1);
+                  if (value.type() != LUA_TNIL)
+                     table[key] = value;
+                  else
+                     table.erase (key);
+
+                  const char c = reader.peek();
+                  if (c == '}')
+                     break;
+                  else if (c != ',')
+                     reader.fail ("expected ',' or '}'");
+                  reader.advance();
+               }
+               reader.advance();
+
+               return table;
+            }
+
+            case '"':
+            {
+               std::size_t len;
+               const char* str = reader.string (len);
+               return std::string (str, len);
+            }
+
+            case 't':
+               reader.literal ("true");
+               return true;
+
+            case 'f':
+               reader.literal ("false");
+               return false;
+
+            case 'n':
+               reader.literal ("null");
+               return null;
+
+            default:
+               return reader.number();
+         }
+      }
+
+
+
+      /// Appends \c str, as a quoted JSON string, to \c out.
+      void AppendString (std::string& out, const char* str, std::size_t len)
+      {
+         const char* p = str;
+         const char* const end = str + len;
+         const char* run = p;
+
+         out += '"';
+         for (;;)
+         {
+            while (end - p >= 8 && !NeedsAttention (p))
+               p += 8;
+
+            if (p == end)
+               break;
+
+            const unsigned char c = *p;
+            if (c != '"' && c != '\\' && c >= 0x20)
+            {
+               ++p;
+               continue;
+            }
+
+            out.append (run, p - run);
+            switch (c)
+            {
+               case '"': out += "\\\""; break;
+               case '\\': out += "\\\\"; break;
+               case '\b': out += "\\b"; break;
+               case '\f': out += "\\f"; break;
+               case '\n': out += "\\n"; break;
+               case '\r': out += "\\r"; break;
+               case '\t': out += "\\t"; break;
+
+               default:
+               {
+                  char escaped[8];
+                  sprintf (escaped, "\\u%04x", c);
+                  out += escaped;
+               }
+            }
+            run = ++p;
+         }
+         out.append (run, p - run);
+         out += '"';
+      }
+
+      /** Appends \c number to \c out, using as few digits as possible without
+       *  losing precision.
+       */
+      void AppendNumber (std::string& out, lua_Number number)
+      {
+         const double d = number;
+
+         if (d != d || d - d != 0.0)
+         {
+            throw LuaTypeError (
+               "NaN and infinite numbers cannot be converted to JSON.");
+         }
+
+         if (d == std::floor (d) && std::fabs (d) <= MaxExactInteger)
+         {
+            char digits[24];
+            char* const end = digits + sizeof(digits);
+            char* p = end;
+            boost::uint64_t n = static_cast<boost::uint64_t>(std::fabs (d));
+            do
+            {
+               *--p = static_cast<char>('0' + n % 10);
+               n /= 10;
+            }
+            while (n != 0);
+
+            if (d < 0.0)
+               *--p = '-';
+            out.append (p, end - p);
+         }
+         else
+         {
+            out += Impl::FormatNumber (d);
+         }
+      }
+
+      /// Throws a \c LuaTypeError complaining about a key type.
+      void ThrowInvalidKey (const std::string& typeName)
+      {
+         throw LuaTypeError (
+            ("Tables with keys of type '" + typeName
+             + "' cannot be converted to JSON.").c_str());
+      }
+
+      /// Throws a \c LuaTypeError complaining about a value type.
+      void ThrowUnsupportedType (const std::string& typeName)
+      {
+         throw LuaTypeError (
+            ("Values of type '" + typeName
+             + "' cannot be converted to JSON.").c_str());
+      }
+
+
+
+      // - EncodeFromStack -----------------------------------------------------
+      void EncodeFromStack (std::string& out, lua_State* ls, int index,
+                            int nullIndex, int depth)
+      {
+         if (nullIndex != 0 && lua_rawequal (ls, index, nullIndex))
+         {
+            out += "null";
+            return;
+         }
+
+         switch (lua_type (ls, index))
+         {
+            case LUA_TNIL:
+               out += "null";
+               break;
+
+            case LUA_TBOOLEAN:
+               out += lua_toboolean (ls, index) ? "true" : "false";
+               break;
+
+            case LUA_TNUMBER:
+               AppendNumber (out, lua_tonumber (ls, index));
+               break;
+
+            case LUA_TSTRING:
+            {
+               std::size_t len;
+               const char* str = lua_tolstring (ls, index, &len);
+               AppendString (out, str, len);
+               break;
+            }
+
+            case LUA_TTABLE:
+            {
+               CheckConversionDepth (depth);
+
+               // See 'ToLuaValue()' for why a positive index is needed here
+               if (index < 0)
+                  index = lua_gettop (ls) + index + 1;
+
+               if (!lua_checkstack (ls, 2))
+                  throw LuaMemoryError ("Cannot grow the Lua stack.");
+
+               // Is this an array (keys are exactly 1, 2... n)?
+               int count = 0;
+               lua_Number maxKey = 0;
+               bool isArray = true;
+               lua_pushnil (ls);
+               while (lua_next (ls, index) != 0)
+               {
+                  ++count;
+                  if (isArray)
+                  {
+                     const lua_Number key = lua_tonumber (ls, -2);
+                     if (lua_type (ls, -2) == LUA_TNUMBER && key >= 1
+                         && key == std::floor (key))
+                     {
+                        maxKey = std::max (maxKey, key);
+                     }
+                     else
+                     {
+                        isArray = false;
+                     }
+                  }
+                  lua_pop (ls, 1);
+               }
+
+               if (isArray && count > 0 && maxKey == count)
+               {
+                  out += '[';
+                  for (int i = 1; i <= count; ++i)
+                  {
+                     if (i > 1)
+                        out += ',';
+                     lua_rawgeti (ls, index, i);
+                     EncodeFromStack (out, ls, -1, nullIndex, depth + 1);
+                     lua_pop (ls, 1);
+                  }
+                  out += ']';
+                  break;
+               }
+
+               out += '{';
+               bool first = true;
+               lua_pushnil (ls);
+               while (lua_next (ls, index) != 0)
+               {
+                  if (!first)
+                     out += ',';
+                  first = false;
+
+                  // Careful: 'lua_tolstring()' on a number key would confuse
+                  // 'lua_next()'
+                  if (lua_type (ls, -2) == LUA_TSTRING)
+                  {
+                     std::size_t len;
+                     const char* key = lua_tolstring (ls, -2, &len);
+                     AppendString (out, key, len);
+                  }
+                  else if (lua_type (ls, -2) == LUA_TNUMBER)
+                  {
+                     std::string key;
+                     AppendNumber (key, lua_tonumber (ls, -2));
+                     AppendString (out, key.data(), key.size());
+                  }
+                  else
+                  {
+                     ThrowInvalidKey (luaL_typename (ls, -2));
+                  }
+
+                  out += ':';
+                  EncodeFromStack (out, ls, -1, nullIndex, depth + 1);
+                  lua_pop (ls, 1);
+               }
+               out += '}';
+               break;
+            }
+
+            default:
+               ThrowUnsupportedType (luaL_typename (ls, index));
+         }
+      }
+
+
+
+      // - EncodeLuaValue ------------------------------------------------------
+      void EncodeLuaValue (std::string& out, const LuaValue& value,
+                           const LuaValue& null, int depth)
+      {
+         if (null.type() != LUA_TNIL && value == null)
+         {
+            out += "null";
+            return;
+         }
+
+         switch (value.type())
+         {
+            case LUA_TNIL:
+               out += "null";
+               break;
+
+            case LUA_TBOOLEAN:
+               out += value.asBoolean() ? "true" : "false";
+               break;
+
+            case LUA_TNUMBER:
+               AppendNumber (out, value.asNumber());
+               break;
+
+            case LUA_TSTRING:
+            {
+               const std::string& str = value.asString();
+               AppendString (out, str.data(), str.size());
+               break;
+            }
+
+            case LUA_TTABLE:
+            {
+               CheckConversionDepth (depth);
+
+               typedef LuaValueMap::const_iterator iter_t;
+               const LuaValueMap& table = value.asConstTable();
+
+               // Is this an array (keys are exactly 1, 2... n)?
+               bool isArray = !table.empty();
+               int i = 1;
+               for (iter_t p = table.begin(); isArray && p != table.end(); ++p)
+                  isArray = p->first == LuaValue (i++);
+
+               if (isArray)
+               {
+                  out += '[';
+                  for (iter_t p = table.begin(); p != table.end(); ++p)
+                  {
+                     if (p != table.begin())
+                        out += ',';
+                     EncodeLuaValue (out, p->second, null, depth + 1);
+                  }
+                  out += ']';
+                  break;
+               }
+
+               out += '{';
+               bool first = true;
+               for (iter_t p = table.begin(); p != table.end(); ++p)
+               {
+                  if (p->first == Nil) // Ignore 'Nil'-indexed entries
+                     continue;
+
+                  if (!first)
+                     out += ',';
+                  first = false;
+
+                  if (p->first.type() == LUA_TSTRING)
+                  {
+                     const std::string& key = p->first.asString();
+                     AppendString (out, key.data(), key.size());
+                  }
+                  else if (p->first.type() == LUA_TNUMBER)
+                  {
+                     std::string key;
+                     AppendNumber (key, p->first.asNumber());
+                     AppendString (out, key.data(), key.size());
+                  }
+                  else
+                  {
+                     ThrowInvalidKey (p->first.typeName());
+                  }
+
+                  out += ':';
+                  EncodeLuaValue (out, p->second, null, depth + 1);
+               }
+               out += '}';
+               break;
+            }
+
+            default:
+               ThrowUnsupportedType (value.typeName());
+         }
+      }
+
+
+
+      // - Lua-side JSON functions ---------------------------------------------
+
+      /// Implements <tt>decode (s, null)</tt>.
+      int DecodeJSONFunction (lua_State* ls)
+      {
+         std::size_t len;
+         const char* json = luaL_checklstring (ls, 1, &len);
+         const int nullIndex = lua_isnoneornil (ls, 2) ? 0 : 2;
+
+         try
+         {
+            PushJSON (ls, json, len, nullIndex);
+            return 1;
+         }
+         catch (LuaError& e)
+         {
+            Impl::ReportErrorFromCFunction (ls, e.what());
+            return 0;
+         }
+         catch(...)
+         {
+            Impl::ReportErrorFromCFunction (
+               ls, "Unknown exception caught by wrapper.");
+            return 0;
+         }
+      }
+
+      /// Implements <tt>encode (v, null)</tt>.
+      int EncodeJSONFunction (lua_State* ls)
+      {
+         luaL_checkany (ls, 1);
+         const int nullIndex = lua_isnoneornil (ls, 2) ? 0 : 2;
+
+         try
+         {
+            const std::string json = ToJSON (ls, 1, nullIndex);
+            lua_pushlstring (ls, json.data(), json.size());
+            return 1;
+         }
+         catch (LuaError& e)
+         {
+            Impl::ReportErrorFromCFunction (ls, e.what());
+            return 0;
+         }
+         catch(...)
+         {
+            Impl::ReportErrorFromCFunction (
+               ls, "Unknown exception caught by wrapper.");
+            return 0;
+         }
+      }
+
+   } // (anonymous) namespace
+
+
+
+   // - PushJSON ---------------------------------------------------------------
+   void PushJSON (lua_State* ls, const char* json, std::size_t size,
+                  int nullIndex)
+   {
+      const int top = lua_gettop (ls);
+      if (nullIndex < 0 && nullIndex > LUA_REGISTRYINDEX)
+         nullIndex = top + nullIndex + 1;
+
+      try
+      {
+         JSONReader reader (json, size);
+         ParseToStack (reader, ls, nullIndex, 0);
+         reader.finish();
+      }
+      catch (...)
+      {
+         lua_settop (ls, top);
+         throw;
+      }
+   }
+
+
+
+   // - ToJSON -----------------------------------------------------------------
+   std::string ToJSON (lua_State* ls, int index, int nullIndex)
+   {
+      const int top = lua_gettop (ls);
+      if (index < 0 && index > LUA_REGISTRYINDEX)
+         index = top + index + 1;
+      if (nullIndex < 0 && nullIndex > LUA_REGISTRYINDEX)
+         nullIndex = top + nullIndex + 1;
+
+      std::string out;
+      try
+      {
+         EncodeFromStack (out, ls, index, nullIndex, 0);
+      }
+      catch (...)
+      {
+         lua_settop (ls, top);
+         throw;
+      }
+
+      return out;
+   }
+
+
+   std::string ToJSON (const LuaValue& value, const LuaValue& null)
+   {
+      std::string out;
+      EncodeLuaValue (out, value, null, 0);
+      return out;
+   }
+
+
+
+   // - FromJSON ---------------------------------------------------------------
+   LuaValue FromJSON (const std::string& json, const LuaValue& null)
+   {
+      JSONReader reader (json.data(), json.size());
+      const LuaValue value = ParseToLuaValue (reader, null, 0);
+      reader.finish();
+      return value;
+   }
+
+
+
+   // - RegisterJSONFunctions --------------------------------------------------
+   void RegisterJSONFunctions (LuaVariable table)
+   {
+      if (table.value().type() != LUA_TTABLE)
+         table = EmptyLuaValueMap;
+
+      table["decode"] = DecodeJSONFunction;
+      table["encode"] = EncodeJSONFunction;
+   }
+
+} // namespace Diluculum
@@ -0,0 +1,569 @@
+/******************************************************************************\
+* LuaMsgPack.cpp                                                               *
+* Conversion between MessagePack and Lua values.                               *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <boost/cstdint.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaMsgPack.hpp>
+
+
+namespace Diluculum
+{
+   namespace
+   {
+      /** The maximum nesting depth of arrays and maps. This protects the C
+       *  stack from malicious data (when decoding) and from cyclic tables
+       *  (when encoding).
+       */
+      const int MaxDepth = 1000;
+
+      /// How many bytes are buffered before being passed to the \c Sink.
+      const std::size_t FlushThreshold = 4096;
+
+
+
+      // - MsgPackReader -------------------------------------------------------
+      /// Reads the big-endian primitives of MessagePack from a buffer.
+      class MsgPackReader
+      {
+         public:
+            MsgPackReader (const char* data, std::size_t size)
+               : p_(reinterpret_cast<const unsigned char*>(data)),
+                 end_(p_ + size)
+            { }
+
+            /// Returns the number of bytes not read yet.
+            std::size_t remaining() const { return end_ - p_; }
+
+            /// Returns a pointer to the next \c size bytes, and skips them.
+            const char* take (std::size_t size)
+            {
+               if (size > remaining())
+                  throw SerializationError ("MessagePack data is truncated.");
+
+               const char* data = reinterpret_cast<const char*>(p_);
+               p_ += size;
+               return data;
+            }
+
+            /// Reads a big-endian unsigned integer of \c size bytes.
+            boost::uint64_t uint (std::size_t size)
+            {
+               const unsigned char* bytes =
+                  reinterpret_cast<const unsigned char*>(take (size));
+
+               boost::uint64_t n = 0;
+               for (std::size_t i = 0; i < size; ++i)
+                  n = (n << 8) | bytes[i];
+               return n;
+            }
+
+            /// Reads a big-endian signed integer of \c size bytes.
+            lua_Number sint (std::size_t size)
+            {
+               const boost::uint64_t n = uint (size);
+               const boost::uint64_t signBit =
+                  static_cast<boost::uint64_t>(1) << (8 * size - 1);
+
+               if ((n & signBit) == 0)
+                  return static_cast<lua_Number>(n);
+
+               // Two's complement, without relying on signed overflow
+               const boost::uint64_t magnitude = (~n + 1) & (signBit * 2 - 1);
+               return -static_cast<lua_Number>(magnitude);
+            }
+
+            /// Reads a big-endian IEEE float.
+            lua_Number float32()
+            {
+               const boost::uint32_t bits =
+                  static_cast<boost::uint32_t>(uint (4));
+               float f;
+               memcpy (&f, &bits, sizeof(f));
+               return f;
+            }
+
+            /// Reads a big-endian IEEE double.
+            lua_Number float64()
+            {
+               const boost::uint64_t bits = uint (8);
+               double d;
+               memcpy (&d, &bits, sizeof(d));
+               return d;
+            }
+
+         private:
+            /// The next byte to read.
+            const unsigned char* p_;
+
+            /// One past the last byte available.
+            const unsigned char* end_;
+      };
+
+
+
+      /** Throws a \c SerializationError complaining about an unsupported or
+       *  invalid type byte.
+       */
+      void ThrowInvalidType (unsigned char type)
+      {
+         throw SerializationError (
+            type == 0xC1
+            ? "Invalid type byte in MessagePack data."
+            : "MessagePack extension types are not supported.");
+      }
+
+      /// Throws if \c depth is too deep for decoding an array or map.
+      void CheckDecodingDepth (int depth)
+      {
+         if (depth >= MaxDepth)
+         {
+            throw SerializationError (
+               "Arrays or maps nested too deeply in MessagePack data.");
+         }
+      }
+
+      /** Returns how many table slots to preallocate for \c count elements.
+       *  Each element takes at least one byte, so a corrupt count cannot
+       *  force an allocation larger than the data itself.
+       */
+      int PreallocationSize (const MsgPackReader& reader, boost::uint64_t count)
+      {
+         return static_cast<int>(
+            std::min<boost::uint64_t> (count, reader.remaining()));
+      }
+
+      void DecodeToStack (MsgPackReader& reader, lua_State* ls, int depth);
+
+      /// Decodes an array with \c count elements.
+      void DecodeArray (MsgPackReader& reader, lua_State* ls,
+                        boost::uint64_t count, int depth)
+      {
+         CheckDecodingDepth (depth);
+
+         lua_createtable (ls, PreallocationSize (reader, count), 0);
+         for (boost::uint64_t i = 1; i <= count; ++i)
+         {
+            DecodeToStack (reader, ls, depth + 1);
+            lua_rawseti (ls, -2, static_cast<int>(i));
+         }
+      }
+
+      /// Decodes a map with \c count key/value pairs.
+      void DecodeMap (MsgPackReader& reader, lua_State* ls,
+                      boost::uint64_t count, int depth)
+      {
+         CheckDecodingDepth (depth);
+
+         lua_createtable (ls, 0, PreallocationSize (reader, count));
+         for (boost::uint64_t i = 0; i < count; ++i)
+         {
+            DecodeToStack (reader, ls, depth + 1);
+            if (lua_isnil (ls, -1)
+                || (lua_isnumber (ls, -1)
+                    && lua_tonumber (ls, -1) != lua_tonumber (ls, -1)))
+            {
+               throw SerializationError (
+                  "Invalid map key (nil or NaN) in MessagePack data.");
+            }
+
+            DecodeToStack (reader, ls, depth + 1);
+            lua_rawset (ls, -3);
+         }
+      }
+
+      /// Decodes a string (or binary data) of \c size bytes.
+      void DecodeString (MsgPackReader& reader, lua_State* ls,
+                         boost::uint64_t size)
+      {
+         if (size > reader.remaining())
+            throw SerializationError ("MessagePack data is truncated.");
+
+         const std::size_t len = static_cast<std::size_t>(size);
+         lua_pushlstring (ls, reader.take (len), len);
+      }
+
+
+
+      // - DecodeToStack -------------------------------------------------------
+      void DecodeToStack (MsgPackReader& reader, lua_State* ls, int depth)
+      {
+         if (!lua_checkstack (ls, 3))
+            throw LuaMemoryError ("Cannot grow the Lua stack.");
+
+         const unsigned char type =
+            static_cast<unsigned char>(reader.uint (1));
+
+         if (type <= 0x7F)                    // positive fixint
+            lua_pushnumber (ls, type);
+         else if (type <= 0x8F)               // fixmap
+            DecodeMap (reader, ls, type & 0x0F, depth);
+         else if (type <= 0x9F)               // fixarray
+            DecodeArray (reader, ls, type & 0x0F, depth);
+         else if (type <= 0xBF)               // fixstr
+            DecodeString (reader, ls, type & 0x1F);
+         else if (type >= 0xE0)               // negative fixint
+            lua_pushnumber (ls, static_cast<int>(type) - 256);
+         else
+         {
+            switch (type)
+            {
+               case 0xC0:
+                  lua_pushnil (ls);
+                  break;
+
+               case 0xC2:
+               case 0xC3:
+                  lua_pushboolean (ls, type == 0xC3);
+                  break;
+
+               case 0xC4: case 0xD9:          // bin 8, str 8
+                  DecodeString (reader, ls, reader.uint (1));
+                  break;
+
+               case 0xC5: case 0xDA:          // bin 16, str 16
+                  DecodeString (reader, ls, reader.uint (2));
+                  break;
+
+               case 0xC6: case 0xDB:          // bin 32, str 32
+                  DecodeString (reader, ls, reader.uint (4));
+                  break;
+
+               case 0xCA:
+                  lua_pushnumber (ls, reader.float32());
+                  break;
+
+               case 0xCB:
+                  lua_pushnumber (ls, reader.float64());
+                  break;
+
+               case 0xCC: case 0xCD: case 0xCE: case 0xCF:  // uint 8...64
+                  lua_pushnumber (ls, static_cast<lua_Number>(
+                     reader.uint (1 << (type - 0xCC))));
+                  break;
+
+               case 0xD0: case 0xD1: case 0xD2: case 0xD3:  // int 8...64
+                  lua_pushnumber (ls, reader.sint (1 << (type - 0xD0)));
+                  break;
+
+               case 0xDC:
+                  DecodeArray (reader, ls, reader.uint (2), depth);
+                  break;
+
+               case 0xDD:
+                  DecodeArray (reader, ls, reader.uint (4), depth);
+                  break;
+
+               case 0xDE:
+                  DecodeMap (reader, ls, reader.uint (2), depth);
+                  break;
+
+               case 0xDF:
+                  DecodeMap (reader, ls, reader.uint (4), depth);
+                  break;
+
+               default:
+                  ThrowInvalidType (type);
+            }
+         }
+      }
+
+
+
+      // - MsgPackWriter -------------------------------------------------------
+      /** Writes the big-endian primitives of MessagePack, buffering them
+       *  before passing them to a \c Sink.
+       */
+      class MsgPackWriter
+      {
+         public:
+            explicit MsgPackWriter (Sink& sink)
+               : sink_(sink)
+            { }
+
+            /// Writes a single byte.
+            void byte (unsigned char b) { buffer_ += static_cast<char>(b); }
+
+            /// Writes a type byte followed by a big-endian integer.
+            void uint (unsigned char type, boost::uint64_t n, std::size_t size)
+            {
+               byte (type);
+               for (std::size_t i = size; i > 0; --i)
+                  byte (static_cast<unsigned char>(n >> (8 * (i - 1))));
+            }
+
+            /// Writes \c size bytes, as they are.
+            void raw (const char* data, std::size_t size)
+            {
+               buffer_.append (data, size);
+            }
+
+            /** Writes a header for a string, array or map. \c fixType is the
+             *  type byte of the "fix" form (without the size bits), and
+             *  \c fixMax the maximum size it can hold. \c type16 is the type
+             *  byte of the 16-bit form, which is followed by the 32-bit form.
+             */
+            void header (std::size_t size, unsigned char fixType,
+                         std::size_t fixMax, unsigned char type8,
+                         unsigned char type16)
+            {
+               if (size <= fixMax)
+                  byte (static_cast<unsigned char>(fixType | size));
+               else if (type8 != 0 && size <= 0xFF)
+                  uint (type8, size, 1);
+               else if (size <= 0xFFFF)
+                  uint (type16, size, 2);
+               else if (size <= 0xFFFFFFFFul)
+                  uint (type16 + 1, size, 4);
+               else
+                  throw LuaTypeError ("Value too large for MessagePack.");
+            }
+
+            /// Calls \c flush() if enough data is buffered.
+            void flushIfFull()
+            {
+               if (buffer_.size() >= FlushThreshold)
+                  flush();
+            }
+
+            /// Passes all buffered data to the \c Sink.
+            void flush()
+            {
+               if (!buffer_.empty())
+               {
+                  sink_.write (buffer_.data(), buffer_.size());
+                  buffer_.clear();
+               }
+            }
+
+         private:
+            /// The \c Sink where data is written to.
+            Sink& sink_;
+
+            /// The data not passed to \c sink_ yet.
+            std::string buffer_;
+      };
+
+
+
+      /// Encodes a number, as an integer whenever this is exact.
+      void EncodeNumber (MsgPackWriter& writer, lua_Number number)
+      {
+         const double d = number;
+         const double TwoTo63 = 9223372036854775808.0;
+
+         if (d != std::floor (d) || d < -TwoTo63 || d >= TwoTo63)
+         {
+            boost::uint64_t bits;
+            memcpy (&bits, &d, sizeof(bits));
+            writer.uint (0xCB, bits, 8);
+         }
+         else if (d >= 0)
+         {
+            const boost::uint64_t n = static_cast<boost::uint64_t>(d);
+            if (n <= 0x7F)
+               writer.byte (static_cast<unsigned char>(n));
+            else if (n <= 0xFF)
+               writer.uint (0xCC, n, 1);
+            else if (n <= 0xFFFF)
+               writer.uint (0xCD, n, 2);
+            else if (n <= 0xFFFFFFFFul)
+               writer.uint (0xCE, n, 4);
+            else
+               writer.uint (0xCF, n, 8);
+         }
+         else
+         {
+            // Two's complement of the magnitude, without signed overflow
+            const boost::uint64_t magnitude =
+               static_cast<boost::uint64_t>(-d);
+            const boost::uint64_t n = ~magnitude + 1;
+            if (magnitude <= 32)
+               writer.byte (static_cast<unsigned char>(n));
+            else if (magnitude <= 0x80)
+               writer.uint (0xD0, n, 1);
+            else if (magnitude <= 0x8000)
+               writer.uint (0xD1, n, 2);
+            else if (magnitude <= 0x80000000ul)
+               writer.uint (0xD2, n, 4);
+            else
+               writer.uint (0xD3, n, 8);
+         }
+      }
+
+
+
+      // - EncodeFromStack -----------------------------------------------------
+      void EncodeFromStack (MsgPackWriter& writer, lua_State* ls, int index,
+                            int depth)
+      {
+         writer.flushIfFull();
+
+         switch (lua_type (ls, index))
+         {
+            case LUA_TNIL:
+               writer.byte (0xC0);
+               break;
+
+            case LUA_TBOOLEAN:
+               writer.byte (lua_toboolean (ls, index) ? 0xC3 : 0xC2);
+               break;
+
+            case LUA_TNUMBER:
+               EncodeNumber (writer, lua_tonumber (ls, index));
+               break;
+
+            case LUA_TSTRING:
+            {
+               std::size_t len;
+               const char* str = lua_tolstring (ls, index, &len);
+               writer.header (len, 0xA0, 31, 0xD9, 0xDA);
+               writer.raw (str, len);
+               break;
+            }
+
+            case LUA_TTABLE:
+            {
+               if (depth >= MaxDepth)
+               {
+                  throw LuaTypeError ("Tables nested too deeply (or cyclic "
+                                      "tables) cannot be encoded.");
+               }
+
+               // See 'ToLuaValue()' for why a positive index is needed here
+               if (index < 0)
+                  index = lua_gettop (ls) + index + 1;
+
+               if (!lua_checkstack (ls, 2))
+                  throw LuaMemoryError ("Cannot grow the Lua stack.");
+
+               // Is this an array (keys are exactly 1, 2... n)?
+               std::size_t count = 0;
+               lua_Number maxKey = 0;
+               bool isArray = true;
+               lua_pushnil (ls);
+               while (lua_next (ls, index) != 0)
+               {
+                  ++count;
+                  if (isArray)
+                  {
+                     const lua_Number key = lua_tonumber (ls, -2);
+                     if (lua_type (ls, -2) == LUA_TNUMBER && key >= 1
+                         && key == std::floor (key))
+                     {
+                        maxKey = std::max (maxKey, key);
+                     }
+                     else
+                     {
+                        isArray = false;
+                     }
+                  }
+                  lua_pop (ls, 1);
+               }
+
+               if (isArray && count > 0 && maxKey == count)
+               {
+                  writer.header (count, 0x90, 15, 0, 0xDC);
+                  for (std::size_t i = 1; i <= count; ++i)
+                  {
+                     lua_rawgeti (ls, index, static_cast<int>(i));
+                     EncodeFromStack (writer, ls, -1, depth + 1);
+                     lua_pop (ls, 1);
+                  }
+               }
+               else
+               {
+                  writer.header (count, 0x80, 15, 0, 0xDE);
+                  lua_pushnil (ls);
+                  while (lua_next (ls, index) != 0)
+                  {
+                     EncodeFromStack (writer, ls, -2, depth + 1);
+                     EncodeFromStack (writer, ls, -1, depth + 1);
+                     lua_pop (ls, 1);
+                  }
+               }
+               break;
+            }
+
+            default:
+               throw LuaTypeError (
+                  ("Values of type '" + std::string (luaL_typename (ls, index))
+                   + "' cannot be encoded as MessagePack.").c_str());
+         }
+      }
+
+   } // (anonymous) namespace
+
+
+
+   // - PushMsgPack ------------------------------------------------------------
+   void PushMsgPack (lua_State* ls, const char* data, std::size_t size)
+   {
+      const int top = lua_gettop (ls);
+
+      try
+      {
+         MsgPackReader reader (data, size);
+         DecodeToStack (reader, ls, 0);
+         if (reader.remaining() != 0)
+         {
+            throw SerializationError (
+               "Unexpected data after a MessagePack object.");
+         }
+      }
+      catch (...)
+      {
+         lua_settop (ls, top);
+         throw;
+      }
+   }
+
+
+
+   // - ToMsgPack --------------------------------------------------------------
+   void ToMsgPack (lua_State* ls, int index, Sink& sink)
+   {
+      const int top = lua_gettop (ls);
+      if (index < 0 && index > LUA_REGISTRYINDEX)
+         index = top + index + 1;
+
+      try
+      {
+         MsgPackWriter writer (sink);
+         EncodeFromStack (writer, ls, index, 0);
+         writer.flush();
+      }
+      catch (...)
+      {
+         lua_settop (ls, top);
+         throw;
+      }
+   }
+
+} // namespace Diluculum
@@ -0,0 +1,1356 @@
+/******************************************************************************\
+* LuaSerialization.cpp                                                         *
+* Serialization of Lua values, in binary form and as Lua source code.          *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
+#include <boost/cstdint.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaSerialization.hpp>
+#include "InternalUtils.hpp"
+
+
+namespace Diluculum
+{
+   // - MemorySource::read -----------------------------------------------------
+   void MemorySource::read (void* data, std::size_t size)
+   {
+      if (size > remaining())
+         throw SerializationError ("Serialized data is truncated.");
+
+      memcpy (data, pos_, size);
+      pos_ += size;
+   }
+
+
+
+   namespace
+   {
+      /// The version of the serialization format written by this code.
+      const unsigned char FormatVersion = 1;
+
+      /// The tags identifying the type of each serialized value.
+      enum Tag
+      {
+         TAG_NIL,
+         TAG_FALSE,
+         TAG_TRUE,
+         TAG_INTEGER,
+         TAG_NUMBER,
+         TAG_STRING,
+         TAG_TABLE,
+         TAG_C_FUNCTION,   // reserved; C functions are never serialized
+         TAG_LUA_FUNCTION,
+         TAG_USERDATA
+      };
+
+      /** The maximum nesting depth of tables. This protects the C stack from
+       *  cyclic tables (when serializing) and from malicious data (when
+       *  deserializing).
+       */
+      const int MaxDepth = 1000;
+
+      /** The maximum number of elements preallocated for a table being
+       *  deserialized. Larger tables are still fine; they just grow as usual,
+       *  instead of letting a corrupt count force a huge allocation.
+       */
+      const boost::uint64_t MaxPreallocation = 1 << 16;
+
+      /// The largest number that, together with all smaller ones, is exact.
+      const double MaxExactInteger = 9007199254740992.0; // 2^53
+
+      /** The limits of values written as a single expression by
+       *  \c ToLuaSource(): the number of keys and values, the number of
+       *  registers needed to build them, and the nesting depth of their table
+       *  constructors. Lua 5.1 allows 2^18 constants and 250 registers per
+       *  function, and about 200 nested expressions.
+       */
+      const std::size_t MaxInlineSize = 4096;
+      const int MaxInlineRegisters = 200;
+      const int MaxInlineDepth = 100;
+
+      /** The number of constants in each function of the chunks written by
+       *  \c ToLuaSource() for values that are not written as a single
+       *  expression.
+       */
+      const std::size_t MaxSegmentConstants = 1 << 16;
+
+      /** The number of array items in a table constructor that Lua keeps in
+       *  registers before storing them in the table (\c LFIELDS_PER_FLUSH).
+       */
+      const int FieldsPerFlush = 50;
+
+      /** Writes the primitives of the serialization format to a \c Sink,
+       *  buffering small writes so that the \c Sink is not called once for
+       *  every single byte.
+       */
+      class Writer
+      {
+         public:
+            explicit Writer (Sink& sink)
+               : sink_(sink), size_(0)
+            { }
+
+            /// Writes a single byte.
+            void byte (unsigned char b)
+            {
+               if (size_ == sizeof(buffer_))
+                  flush();
+               buffer_[size_++] = b;
+            }
+
+            /// Writes an unsigned LEB128 integer.
+            void varint (boost::uint64_t n)
+            {
+               while (n >= 0x80)
+               {
+                  byte (static_cast<unsigned char>(n | 0x80));
+                  n >>= 7;
+               }
+               byte (static_cast<unsigned char>(n));
+            }
+
+            /// Writes \c size bytes, as they are.
+            void raw (const void* data, std::size_t size)
+            {
+               if (size <= sizeof(buffer_) - size_)
+               {
+                  memcpy (buffer_ + size_, data, size);
+                  size_ += size;
+               }
+               else
+               {
+                  flush();
+                  sink_.write (data, size);
+               }
+            }
+
+            /// Writes a null-terminated string (without the terminator).
+            void text (const char* str)
+            {
+               raw (str, strlen (str));
+            }
+
+            /// Writes a length-prefixed block of bytes.
+            void block (const void* data, std::size_t size)
+            {
+               varint (size);
+               raw (data, size);
+            }
+
+            /// Passes all buffered data to the \c Sink.
+            void flush()
+            {
+               if (size_ > 0)
+               {
+                  sink_.write (buffer_, size_);
+                  size_ = 0;
+               }
+            }
+
+         private:
+            /// The \c Sink where data is written to.
+            Sink& sink_;
+
+            /// The data not passed to \c sink_ yet.
+            unsigned char buffer_[1024];
+
+            /// The number of bytes used in \c buffer_.
+            std::size_t size_;
+      };
+
+
+
+      /// Reads the primitives written by a \c Writer from a \c Source.
+      class Reader
+      {
+         public:
+            explicit Reader (Source& source)
+               : source_(source)
+            { }
+
+            /// Reads a single byte.
+            unsigned char byte()
+            {
+               unsigned char b;
+               source_.read (&b, 1);
+               return b;
+            }
+
+            /// Reads an unsigned LEB128 integer.
+            boost::uint64_t varint()
+            {
+               boost::uint64_t n = 0;
+               for (int shift = 0; shift < 64; shift += 7)
+               {
+                  const unsigned char b = byte();
+                  n |= static_cast<boost::uint64_t>(b & 0x7F) << shift;
+                  if ((b & 0x80) == 0)
+                     return n;
+               }
+
+               throw SerializationError (
+                  "Malformed variable-length integer in serialized data.");
+            }
+
+            /// Reads a length or count.
+            std::size_t length()
+            {
+               const boost::uint64_t n = varint();
+               if (n > std::numeric_limits<std::size_t>::max())
+               {
+                  throw SerializationError (
+                     "Length too large in serialized data.");
+               }
+               return static_cast<std::size_t>(n);
+            }
+
+            /// Reads \c size bytes, as they are.
+            void raw (void* data, std::size_t size)
+            {
+               source_.read (data, size);
+            }
+
+            /** Reads a length-prefixed block of bytes into \c out, replacing
+             *  its previous contents. The block is read in chunks, so that a
+             *  corrupt length results in a \c SerializationError instead of a
+             *  huge allocation.
+             */
+            void block (std::string& out)
+            {
+               const std::size_t ChunkSize = 64 * 1024;
+
+               std::size_t size = length();
+               out.clear();
+               while (size > 0)
+               {
+                  const std::size_t chunk = std::min (size, ChunkSize);
+                  const std::size_t used = out.size();
+                  out.resize (used + chunk);
+                  source_.read (&out[used], chunk);
+                  size -= chunk;
+               }
+            }
+
+         private:
+            /// The \c Source where data is read from.
+            Source& source_;
+      };
+
+
+
+      /// Writes the header that starts all serialized data.
+      void WriteHeader (Writer& writer)
+      {
+         writer.byte ('D');
+         writer.byte ('l');
+         writer.byte (FormatVersion);
+      }
+
+      /// Reads and checks the header written by \c WriteHeader().
+      void ReadHeader (Reader& reader)
+      {
+         if (reader.byte() != 'D' || reader.byte() != 'l')
+         {
+            throw SerializationError (
+               "Data is not in Diluculum's serialization format.");
+         }
+
+         if (reader.byte() != FormatVersion)
+         {
+            throw SerializationError (
+               "Unsupported version of Diluculum's serialization format.");
+         }
+      }
+
+      /** Writes a number, as a zigzag-encoded variable-length integer if it
+       *  has an exact integer representation, or as a little-endian IEEE
+       *  double otherwise. Negative zero goes the second way, so that it
+       *  keeps its sign.
+       */
+      void WriteNumber (Writer& writer, lua_Number number)
+      {
+         const double d = number;
+
+         if (d == std::floor (d) && d >= -MaxExactInteger
+             && d <= MaxExactInteger && (d != 0.0 || 1.0 / d > 0.0))
+         {
+            writer.byte (TAG_INTEGER);
+            if (d < 0.0)
+            {
+               const boost::uint64_t n = static_cast<boost::uint64_t>(-d - 1.0);
+               writer.varint ((n << 1) | 1);
+            }
+            else
+            {
+               writer.varint (static_cast<boost::uint64_t>(d) << 1);
+            }
+         }
+         else
+         {
+            boost::uint64_t bits;
+            memcpy (&bits, &d, sizeof(bits));
+
+            unsigned char bytes[sizeof(bits)];
+            for (std::size_t i = 0; i < sizeof(bits); ++i)
+               bytes[i] = static_cast<unsigned char>(bits >> (8 * i));
+
+            writer.byte (TAG_NUMBER);
+            writer.raw (bytes, sizeof(bytes));
+         }
+      }
+
+      /** Reads a number written by \c WriteNumber(). \c tag is the tag that
+       *  was already read.
+       */
+      lua_Number ReadNumber (Reader& reader, unsigned char tag)
+      {
+         if (tag == TAG_INTEGER)
+         {
+            const boost::uint64_t n = reader.varint();
+            if (n & 1)
+               return -static_cast<lua_Number>(n >> 1) - 1;
+            else
+               return static_cast<lua_Number>(n >> 1);
+         }
+         else
+         {
+            unsigned char bytes[sizeof(boost::uint64_t)];
+            reader.raw (bytes, sizeof(bytes));
+
+            boost::uint64_t bits = 0;
+            for (std::size_t i = 0; i < sizeof(bits); ++i)
+               bits |= static_cast<boost::uint64_t>(bytes[i]) << (8 * i);
+
+            double d;
+            memcpy (&d, &bits, sizeof(d));
+            return d;
+         }
+      }
+
+      /** Throws a \c LuaTypeError complaining that values of type
+       *  \c typeName cannot be serialized.
+       */
+      void ThrowUnsupportedType (const std::string& typeName)
+      {
+         throw LuaTypeError (
+            ("Values of type '" + typeName + "' cannot be serialized.")
+            .c_str());
+      }
+
+      /// Throws if \c depth is too deep for serializing a table.
+      void CheckSerializationDepth (int depth)
+      {
+         if (depth >= MaxDepth)
+         {
+            throw LuaTypeError ("Tables nested too deeply (or cyclic tables) "
+                                "cannot be serialized.");
+         }
+      }
+
+      /// Throws if \c depth is too deep for deserializing a table.
+      void CheckDeserializationDepth (int depth)
+      {
+         if (depth >= MaxDepth)
+         {
+            throw SerializationError (
+               "Tables nested too deeply in serialized data.");
+         }
+      }
+
+      /// Throws a \c SerializationError complaining about a table key.
+      void ThrowInvalidKey()
+      {
+         throw SerializationError (
+            "Invalid table key (nil or NaN) in serialized data.");
+      }
+
+      /// The \c lua_Writer used to dump Lua functions into a \c std::string.
+      int StringWriter (lua_State*, const void* data, size_t size,
+                        void* str)
+      {
+         static_cast<std::string*>(str)->append (
+            static_cast<const char*>(data), size);
+         return 0;
+      }
+
+      /** Checks whether the value at \c index is a number in the array section
+       *  (keys <tt>1..arraySize</tt>) of a table.
+       */
+      bool IsArrayKey (lua_State* ls, int index, int arraySize)
+      {
+         if (lua_type (ls, index) != LUA_TNUMBER)
+            return false;
+
+         const lua_Number key = lua_tonumber (ls, index);
+         return key >= 1 && key <= arraySize && key == std::floor (key);
+      }
+
+      /// Like \c IsArrayKey(), but for keys stored in a \c LuaValueMap.
+      bool IsArrayKey (const LuaValue& key, std::size_t arraySize)
+      {
+         if (key.type() != LUA_TNUMBER)
+            return false;
+
+         const lua_Number k = key.asNumber();
+         return k >= 1 && k <= arraySize && k == std::floor (k);
+      }
+
+
+
+      // - EncodeFromStack -----------------------------------------------------
+      void EncodeFromStack (Writer& writer, lua_State* ls, int index,
+                            int depth)
+      {
+         switch (lua_type (ls, index))
+         {
+            case LUA_TNIL:
+               writer.byte (TAG_NIL);
+               break;
+
+            case LUA_TBOOLEAN:
+               writer.byte (lua_toboolean (ls, index) ? TAG_TRUE : TAG_FALSE);
+               break;
+
+            case LUA_TNUMBER:
+               WriteNumber (writer, lua_tonumber (ls, index));
+               break;
+
+            case LUA_TSTRING:
+            {
+               size_t len;
+               const char* str = lua_tolstring (ls, index, &len);
+               writer.byte (TAG_STRING);
+               writer.block (str, len);
+               break;
+            }
+
+            case LUA_TTABLE:
+            {
+               CheckSerializationDepth (depth);
+
+               // See 'ToLuaValue()' for why a positive index is needed here
+               if (index < 0)
+                  index = lua_gettop (ls) + index + 1;
+
+               if (!lua_checkstack (ls, 2))
+                  throw LuaMemoryError ("Cannot grow the Lua stack.");
+
+               // The array section goes up to the first hole
+               const int len = static_cast<int>(lua_objlen (ls, index));
+               int arraySize = 0;
+               while (arraySize < len)
+               {
+                  lua_rawgeti (ls, index, arraySize + 1);
+                  const bool isNil = lua_isnil (ls, -1);
+                  lua_pop (ls, 1);
+                  if (isNil)
+                     break;
+                  ++arraySize;
+               }
+
+               std::size_t hashSize = 0;
+               lua_pushnil (ls);
+               while (lua_next (ls, index) != 0)
+               {
+                  if (!IsArrayKey (ls, -2, arraySize))
+                     ++hashSize;
+                  lua_pop (ls, 1);
+               }
+
+               writer.byte (TAG_TABLE);
+
+               writer.varint (arraySize);
+               for (int i = 1; i <= arraySize; ++i)
+               {
+                  lua_rawgeti (ls, index, i);
+                  EncodeFromStack (writer, ls, -1, depth + 1);
+                  lua_pop (ls, 1);
+               }
+
+               writer.varint (hashSize);
+               lua_pushnil (ls);
+               while (lua_next (ls, index) != 0)
+               {
+                  if (!IsArrayKey (ls, -2, arraySize))
+                  {
+                     EncodeFromStack (writer, ls, -2, depth + 1);
+                     EncodeFromStack (writer, ls, -1, depth + 1);
+                  }
+                  lua_pop (ls, 1);
+               }
+               break;
+            }
+
+            case LUA_TFUNCTION:
+            {
+               if (lua_iscfunction (ls, index))
+                  ThrowUnsupportedType ("C function");
+
+               std::string bytecode;
+               lua_pushvalue (ls, index);
+               lua_dump (ls, StringWriter, &bytecode);
+               lua_pop (ls, 1);
+               writer.byte (TAG_LUA_FUNCTION);
+               writer.block (bytecode.data(), bytecode.size());
+               break;
+            }
+
+            case LUA_TUSERDATA:
+               writer.byte (TAG_USERDATA);
+               writer.block (lua_touserdata (ls, index),
+                             lua_objlen (ls, index));
+               break;
+
+            default:
+               ThrowUnsupportedType (luaL_typename (ls, index));
+         }
+      }
+
+
+
+      // - EncodeLuaValue ------------------------------------------------------
+      void EncodeLuaValue (Writer& writer, const LuaValue& value, int depth)
+      {
+         switch (value.type())
+         {
+            case LUA_TNIL:
+               writer.byte (TAG_NIL);
+               break;
+
+            case LUA_TBOOLEAN:
+               writer.byte (value.asBoolean() ? TAG_TRUE : TAG_FALSE);
+               break;
+
+            case LUA_TNUMBER:
+               WriteNumber (writer, value.asNumber());
+               break;
+
+            case LUA_TSTRING:
+            {
+               const std::string& str = value.asString();
+               writer.byte (TAG_STRING);
+               writer.block (str.data(), str.size());
+               break;
+            }
+
+            case LUA_TTABLE:
+            {
+               CheckSerializationDepth (depth);
+
+               typedef LuaValueMap::const_iterator iter_t;
+               const LuaValueMap& table = value.asConstTable();
+
+               // Numeric keys are sorted, so the array section is the run of
+               // keys 1, 2, 3... starting at key 1.
+               std::size_t arraySize = 0;
+               iter_t p = table.find (1);
+               while (p != table.end() && p->first == LuaValue (arraySize + 1))
+               {
+                  ++arraySize;
+                  ++p;
+               }
+
+               std::size_t hashSize = 0;
+               for (p = table.begin(); p != table.end(); ++p)
+               {
+                  if (p->first != Nil && !IsArrayKey (p->first, arraySize))
+                     ++hashSize;
+               }
+
+               writer.byte (TAG_TABLE);
+
+               writer.varint (arraySize);
+               p = table.find (1);
+               for (std::size_t i = 0; i < arraySize; ++i, ++p)
+                  EncodeLuaValue (writer, p->second, depth + 1);
+
+               writer.varint (hashSize);
+               for (p = table.begin(); p != table.end(); ++p)
+               {
+                  // Ignore 'Nil'-indexed entries
+                  if (p->first != Nil && !IsArrayKey (p->first, arraySize))
+                  {
+                     EncodeLuaValue (writer, p->first, depth + 1);
+                     EncodeLuaValue (writer, p->second, depth + 1);
+                  }
+               }
+               break;
+            }
+
+            case LUA_TFUNCTION:
+            {
+               const LuaFunction& f = value.asFunction();
+               if (f.isCFunction())
+                  ThrowUnsupportedType ("C function");
+
+               writer.byte (TAG_LUA_FUNCTION);
+               writer.block (f.getData(), f.getSize());
+               break;
+            }
+
+            case LUA_TUSERDATA:
+            {
+               const LuaUserData& ud = value.asUserData();
+               writer.byte (TAG_USERDATA);
+               writer.block (ud.getData(), ud.getSize());
+               break;
+            }
+
+            default:
+               ThrowUnsupportedType (value.typeName());
+         }
+      }
+
+
+
+      // - DecodeToStack -------------------------------------------------------
+      void DecodeToStack (Reader& reader, lua_State* ls, std::string& buffer,
+                          int depth)
+      {
+         if (!lua_checkstack (ls, 3))
+            throw LuaMemoryError ("Cannot grow the Lua stack.");
+
+         const unsigned char tag = reader.byte();
+
+         switch (tag)
+         {
+            case TAG_NIL:
+               lua_pushnil (ls);
+               break;
+
+            case TAG_FALSE:
+            case TAG_TRUE:
+               lua_pushboolean (ls, tag == TAG_TRUE);
+               break;
+
+            case TAG_INTEGER:
+            case TAG_NUMBER:
+               lua_pushnumber (ls, ReadNumber (reader, tag));
+               break;
+
+            case TAG_STRING:
+               reader.block (buffer);
+               lua_pushlstring (ls, buffer.data(), buffer.size());
+               break;
+
+            case TAG_TABLE:
+            {
+               CheckDeserializationDepth (depth);
+
+               const std::size_t arraySize = reader.length();
+               lua_createtable (
+                  ls, static_cast<int>(std::min<boost::uint64_t>(
+                     arraySize, MaxPreallocation)), 0);
+
+               for (std::size_t i = 1; i <= arraySize; ++i)
+               {
+                  DecodeToStack (reader, ls, buffer, depth + 1);
+                  lua_rawseti (ls, -2, static_cast<int>(i));
+               }
+
+               const std::size_t hashSize = reader.length();
+               for (std::size_t i = 0; i < hashSize; ++i)
+               {
+                  DecodeToStack (reader, ls, buffer, depth + 1);
+                  if (lua_isnil (ls, -1)
+                      || (lua_isnumber (ls, -1)
+                          && lua_tonumber (ls, -1) != lua_tonumber (ls, -1)))
+                  {
+                     ThrowInvalidKey();
+                  }
+
+                  DecodeToStack (reader, ls, buffer, depth + 1);
+                  lua_rawset (ls, -3);
+               }
+               break;
+            }
+
+            case TAG_LUA_FUNCTION:
+               reader.block (buffer);
+               Impl::ThrowOnLuaError (
+                  ls, luaL_loadbuffer (ls, buffer.data(), buffer.size(),
+                                       "Diluculum Lua chunk"));
+               break;
+
+            case TAG_USERDATA:
+               reader.block (buffer);
+               memcpy (lua_newuserdata (ls, buffer.size()), buffer.data(),
+                       buffer.size());
+               break;
+
+            default:
+               throw SerializationError ("Invalid tag in serialized data.");
+         }
+      }
+
+
+
+      // - DecodeToLuaValue ----------------------------------------------------
+      LuaValue DecodeToLuaValue (Reader& reader, int depth)
+      {
+         const unsigned char tag = reader.byte();
+
+         switch (tag)
+         {
+            case TAG_NIL:
+               return Nil;
+
+            case TAG_FALSE:
+            case TAG_TRUE:
+               return tag == TAG_TRUE;
+
+            case TAG_INTEGER:
+            case TAG_NUMBER:
+               return ReadNumber (reader, tag);
+
+            case TAG_STRING:
+            {
+               std::string str;
+               reader.block (str);
+               return str;
+            }
+
+            case TAG_TABLE:
+            {
+               CheckDeserializationDepth (depth);
+
+               LuaValueMap table;
+
+               const std::size_t arraySize = reader.length();
+               for (std::size_t i = 1; i <= arraySize; ++i)
+               {
+                  table.insert (table.end(), std::make_pair (
+                     LuaValue (i), DecodeToLuaValue (reader, depth + 1)));
+               }
+
+               const std::size_t hashSize = reader.length();
+               for (std::size_t i = 0; i < hashSize; ++i)
+               {
+                  LuaValue key = DecodeToLuaValue (reader, depth + 1);
+                  if (key == Nil
+                      || (key.type() == LUA_TNUMBER
+                          && key.asNumber() != key.asNumber()))
+                  {
+                     ThrowInvalidKey();
+                  }
+
+                  table[key] = DecodeToLuaValue (reader, depth + 1);
+               }
+
+               return table;
+            }
+
+            case TAG_LUA_FUNCTION:
+            {
+               std::string bytecode;
+               reader.block (bytecode);
+               return LuaFunction (bytecode.data(), bytecode.size());
+            }
+
+            case TAG_USERDATA:
+            {
+               std::string data;
+               reader.block (data);
+               LuaUserData ud (data.size());
+               memcpy (ud.getData(), data.data(), data.size());
+               return ud;
+            }
+
+            default:
+               throw SerializationError ("Invalid tag in serialized data.");
+         }
+      }
+
+
+
+      /// Tells which bytes must be escaped in Lua string literals.
+      class EscapeTable
+      {
+         public:
+            EscapeTable()
+            {
+               for (int c = 0; c < 256; ++c)
+               {
+                  needsEscape_[c] = c < 0x20 || c == '"' || c == '\\'
+                     || c == 0x7F;
+               }
+            }
+
+            /// Checks whether \c c must be escaped.
+            bool operator[] (unsigned char c) const { return needsEscape_[c]; }
+
+         private:
+            /// One flag for each possible byte.
+            bool needsEscape_[256];
+      };
+
+      /// The bytes that must be escaped in Lua string literals.
+      const EscapeTable NeedsEscape;
+
+      /// Writes \c str as a Lua string literal.
+      void WriteLuaString (Writer& writer, const char* str, std::size_t len)
+      {
+         const char* const end = str + len;
+         const char* run = str;
+
+         writer.byte ('"');
+         for (const char* p = str; p != end; ++p)
+         {
+            const unsigned char c = *p;
+            if (!NeedsEscape[c])
+               continue;
+
+            writer.raw (run, p - run);
+            run = p + 1;
+
+            switch (c)
+            {
+               case '"': writer.text ("\\\""); break;
+               case '\\': writer.text ("\\\\"); break;
+               case '\n': writer.text ("\\n"); break;
+               case '\r': writer.text ("\\r"); break;
+               case '\t': writer.text ("\\t"); break;
+
+               default:
+               {
+                  // Always three digits, in case a digit follows
+                  char escaped[8];
+                  sprintf (escaped, "\\%03d", c);
+                  writer.text (escaped);
+               }
+            }
+         }
+         writer.raw (run, end - run);
+         writer.byte ('"');
+      }
+
+      /** Writes \c number as a Lua expression, with the fewest digits that
+       *  read back to the same value (see \c Impl::FormatNumber()).
+       */
+      void WriteLuaNumber (Writer& writer, lua_Number number)
+      {
+         const double d = number;
+
+         if (d != d)
+         {
+            writer.text ("(0/0)");
+         }
+         else if (d - d != 0.0)
+         {
+            writer.text (d > 0.0 ? "(1/0)" : "(-1/0)");
+         }
+         else if (d == std::floor (d) && std::fabs (d) <= MaxExactInteger)
+         {
+            char digits[24];
+            char* const end = digits + sizeof(digits);
+            char* p = end;
+            boost::uint64_t n = static_cast<boost::uint64_t>(std::fabs (d));
+            do
+            {
+               *--p = static_cast<char>('0' + n % 10);
+               n /= 10;
+            }
+            while (n != 0);
+
+            if (d < 0.0 || (d == 0.0 && 1.0 / d < 0.0))
+               *--p = '-';
+            writer.raw (p, end - p);
+         }
+         else
+         {
+            writer.text (Impl::FormatNumber (d).c_str());
+         }
+      }
+
+      /** Checks whether \c str can be used as a field name in a table
+       *  constructor (that is, whether it is an identifier and not a reserved
+       *  word).
+       */
+      bool IsIdentifier (const std::string& str)
+      {
+         static const char* const reserved[] = {
+            "and", "break", "do", "else", "elseif", "end", "false", "for",
+            "function", "if", "in", "local", "nil", "not", "or", "repeat",
+            "return", "then", "true", "until", "while" };
+
+         if (str.empty() || (str[0] >= '0' && str[0] <= '9'))
+            return false;
+
+         for (std::size_t i = 0; i < str.size(); ++i)
+         {
+            const char c = str[i];
+            if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+                  || (c >= '0' && c <= '9') || c == '_'))
+            {
+               return false;
+            }
+         }
+
+         for (std::size_t i = 0; i < sizeof(reserved) / sizeof(*reserved); ++i)
+         {
+            if (str == reserved[i])
+               return false;
+         }
+
+         return true;
+      }
+
+
+
+      // - FitsInline ----------------------------------------------------------
+      /** Checks whether \c value can be written by \c WriteLuaSource() as a
+       *  single expression, without exceeding the Lua limits (see
+       *  \c MaxInlineSize and friends). \c depth is the nesting depth of
+       *  \c value in the expression. The number of keys and values in
+       *  \c value is added to \c size (this is an upper bound of the number
+       *  of constants it needs), and the number of registers needed to build
+       *  it is stored in \c registers.
+       *  <p>This gives up as soon as some limit is exceeded, so it never walks
+       *  much more than \c MaxInlineSize values.
+       */
+      bool FitsInline (const LuaValue& value, int depth, std::size_t& size,
+                       int& registers)
+      {
+         registers = 1;
+         if (++size > MaxInlineSize)
+            return false;
+
+         if (value.type() != LUA_TTABLE)
+            return true;
+
+         if (depth >= MaxInlineDepth)
+            return false;
+
+         // Mimic the way Lua builds table constructors: array items wait in
+         // registers until 'FieldsPerFlush' of them are stored at once, and
+         // the key of a field is held in a register while its value is built
+         typedef LuaValueMap::const_iterator iter_t;
+         const LuaValueMap& table = value.asConstTable();
+         int needed = 0;
+         int itemRegisters;
+
+         std::size_t arraySize = 0;
+         iter_t p = table.find (1);
+         while (p != table.end() && p->first == LuaValue (arraySize + 1))
+         {
+            if (!FitsInline (p->second, depth + 1, size, itemRegisters))
+               return false;
+
+            needed = std::max (
+               needed, static_cast<int>(arraySize % FieldsPerFlush)
+               + itemRegisters);
+            ++arraySize;
+            ++p;
+         }
+
+         const int pending = static_cast<int>(arraySize % FieldsPerFlush);
+         for (p = table.begin(); p != table.end(); ++p)
+         {
+            if (p->first == Nil || IsArrayKey (p->first, arraySize))
+               continue;
+
+            int keyRegisters;
+            if (!FitsInline (p->first, depth + 1, size, keyRegisters)
+                || !FitsInline (p->second, depth + 1, size, itemRegisters))
+            {
+               return false;
+            }
+
+            needed = std::max (needed,
+                               pending + keyRegisters + itemRegisters);
+         }
+
+         registers = 1 + needed;
+         return registers <= MaxInlineRegisters;
+      }
+
+
+
+      // - WriteLuaSource ------------------------------------------------------
+      void WriteLuaSource (Writer& writer, const LuaValue& value, int depth)
+      {
+         switch (value.type())
+         {
+            case LUA_TNIL:
+               writer.text ("nil");
+               break;
+
+            case LUA_TBOOLEAN:
+               writer.text (value.asBoolean() ? "true" : "false");
+               break;
+
+            case LUA_TNUMBER:
+               WriteLuaNumber (writer, value.asNumber());
+               break;
+
+            case LUA_TSTRING:
+            {
+               const std::string& str = value.asString();
+               WriteLuaString (writer, str.data(), str.size());
+               break;
+            }
+
+            case LUA_TTABLE:
+            {
+               CheckSerializationDepth (depth);
+
+               typedef LuaValueMap::const_iterator iter_t;
+               const LuaValueMap& table = value.asConstTable();
+
+               writer.byte ('{');
+
+               // The array part, as positional fields
+               std::size_t arraySize = 0;
+               iter_t p = table.find (1);
+               while (p != table.end() && p->first == LuaValue (arraySize + 1))
+               {
+                  if (arraySize > 0)
+                     writer.byte (',');
+                  WriteLuaSource (writer, p->second, depth + 1);
+                  ++arraySize;
+                  ++p;
+               }
+
+               bool first = arraySize == 0;
+               for (p = table.begin(); p != table.end(); ++p)
+               {
+                  // Ignore 'Nil'-indexed entries
+                  if (p->first == Nil || IsArrayKey (p->first, arraySize))
+                     continue;
+
+                  if (!first)
+                     writer.byte (',');
+                  first = false;
+
+                  if (p->first.type() == LUA_TSTRING
+                      && IsIdentifier (p->first.asString()))
+                  {
+                     writer.text (p->first.asString().c_str());
+                  }
+                  else
+                  {
+                     writer.byte ('[');
+                     WriteLuaSource (writer, p->first, depth + 1);
+                     writer.byte (']');
+                  }
+
+                  writer.byte ('=');
+                  WriteLuaSource (writer, p->second, depth + 1);
+               }
+
+               writer.byte ('}');
+               break;
+            }
+
+            default:
+               throw LuaTypeError (
+                  ("Values of type '" + value.typeName()
+                   + "' cannot be converted to Lua source.").c_str());
+         }
+      }
+
+
+
+      // - LuaSourceWriter -----------------------------------------------------
+      /** Writes values as Lua source, for \c ToLuaSource(). Values that fit
+       *  in a single expression (see \c FitsInline()) are written as such.
+       *  Larger ones are written as a call to a function building them piece
+       *  by piece, looking like this:
+       *  <pre>
+       *  (function()
+       *  local T,f={}
+       *  f=function()
+       *  local t
+       *  T[1]={}
+       *  t=T[1]
+       *  t.key=...
+       *  ...
+       *  end
+       *  f()
+       *  f=function()
+       *  ...
+       *  end
+       *  f()
+       *  return T[1] end)()
+       *  </pre>
+       *  Tables that don't fit in a single expression are stored in \c T and
+       *  filled by assignments, which are split among as many functions as
+       *  needed to keep the number of constants in each one well below the
+       *  Lua limit. Nothing is nested in such chunks but the (small) values
+       *  assigned, so they can be as deep as \c MaxDepth.
+       */
+      class LuaSourceWriter
+      {
+         public:
+            /// Constructs a \c LuaSourceWriter writing to \c writer.
+            LuaSourceWriter (Writer& writer)
+               : writer_(writer), numTables_(0), segmentConstants_(0),
+                 current_(0)
+            { }
+
+            /// Writes \c value as a Lua expression.
+            void write (const LuaValue& value)
+            {
+               std::size_t size = 0;
+               int registers;
+               if (FitsInline (value, 0, size, registers))
+               {
+                  WriteLuaSource (writer_, value, 0);
+                  return;
+               }
+
+               writer_.text ("(function()\nlocal T,f={}\n");
+               beginSegment();
+               writeTable (value, 0);
+               endSegment();
+               writer_.text ("return T[1] end)()");
+            }
+
+         private:
+            /** Writes the statements creating \c table in \c T, returning
+             *  its index there.
+             */
+            std::size_t writeTable (const LuaValue& table, int depth)
+            {
+               CheckSerializationDepth (depth);
+
+               const std::size_t index = ++numTables_;
+               reserve (1);
+               writer_.text ("T[");
+               WriteLuaNumber (writer_, static_cast<lua_Number>(index));
+               writer_.text ("]={}\n");
+
+               typedef LuaValueMap::const_iterator iter_t;
+               const LuaValueMap& entries = table.asConstTable();
+               for (iter_t p = entries.begin(); p != entries.end(); ++p)
+               {
+                  // Ignore 'Nil'-indexed entries
+                  if (p->first != Nil)
+                     writeEntry (index, p->first, p->second, depth);
+               }
+
+               return index;
+            }
+
+            /** Writes the statement assigning \c value to \c key in the
+             *  table at \c index in \c T (which is at \c depth).
+             */
+            void writeEntry (std::size_t index, const LuaValue& key,
+                             const LuaValue& value, int depth)
+            {
+               // Tables too large for the assignment go to 'T' first. (The
+               // key is held in registers while the value is built.)
+               std::size_t keySize = 0;
+               int keyRegisters;
+               std::size_t keyTable = 0;
+               if (!FitsInline (key, 0, keySize, keyRegisters))
+               {
+                  keyTable = writeTable (key, depth + 1);
+                  keySize = 0;
+                  keyRegisters = 2;
+               }
+
+               std::size_t valueSize = 0;
+               int valueRegisters;
+               std::size_t valueTable = 0;
+               if (!FitsInline (value, 0, valueSize, valueRegisters)
+                   || (value.type() == LUA_TTABLE
+                       && keyRegisters + valueRegisters > MaxInlineRegisters))
+               {
+                  valueTable = writeTable (value, depth + 1);
+                  valueSize = 0;
+               }
+
+               // The indices in 'T' are constants, too
+               reserve (keySize + valueSize + 3);
+               if (current_ != index)
+               {
+                  writer_.text ("t=T[");
+                  WriteLuaNumber (writer_, static_cast<lua_Number>(index));
+                  writer_.text ("]\n");
+                  current_ = index;
+               }
+
+               writer_.byte ('t');
+               if (keyTable == 0 && key.type() == LUA_TSTRING
+                   && IsIdentifier (key.asString()))
+               {
+                  writer_.byte ('.');
+                  writer_.text (key.asString().c_str());
+               }
+               else
+               {
+                  writer_.byte ('[');
+                  writeValue (key, keyTable, depth);
+                  writer_.byte (']');
+               }
+               writer_.byte ('=');
+               writeValue (value, valueTable, depth);
+               writer_.byte ('\n');
+            }
+
+            /** Writes \c value, an entry of a table at \c depth, which is
+             *  either written inline or (if \c tableIndex is not zero) stored
+             *  in \c T at \c tableIndex.
+             */
+            void writeValue (const LuaValue& value, std::size_t tableIndex,
+                             int depth)
+            {
+               if (tableIndex == 0)
+               {
+                  WriteLuaSource (writer_, value, depth + 1);
+               }
+               else
+               {
+                  writer_.text ("T[");
+                  WriteLuaNumber (writer_, static_cast<lua_Number>(tableIndex));
+                  writer_.byte (']');
+               }
+            }
+
+            /** Makes sure that the current function has room for \c constants
+             *  more constants, starting a new function if needed.
+             */
+            void reserve (std::size_t constants)
+            {
+               if (segmentConstants_ + constants > MaxSegmentConstants)
+               {
+                  endSegment();
+                  beginSegment();
+               }
+               segmentConstants_ += constants;
+            }
+
+            /// Starts a new function assigning values.
+            void beginSegment()
+            {
+               writer_.text ("f=function()\nlocal t\n");
+               segmentConstants_ = 0;
+               current_ = 0;
+            }
+
+            /// Ends the current function assigning values, and calls it.
+            void endSegment()
+            {
+               writer_.text ("end\nf()\n");
+            }
+
+            /// The destination of the source.
+            Writer& writer_;
+
+            /// The number of tables stored in \c T so far.
+            std::size_t numTables_;
+
+            /// The number of constants in the current function (a bound).
+            std::size_t segmentConstants_;
+
+            /// The index in \c T of the table in \c t (0 if none).
+            std::size_t current_;
+      };
+
+   } // (anonymous) namespace
+
+
+
+   // - Serialize --------------------------------------------------------------
+   void Serialize (const LuaValue& value, Sink& sink)
+   {
+      Writer writer (sink);
+      WriteHeader (writer);
+      EncodeLuaValue (writer, value, 0);
+      writer.flush();
+   }
+
+
+
+   // - SerializeFromStack -----------------------------------------------------
+   void SerializeFromStack (lua_State* ls, int index, Sink& sink)
+   {
+      const int top = lua_gettop (ls);
+      if (index < 0 && index > LUA_REGISTRYINDEX)
+         index = top + index + 1;
+
+      try
+      {
+         Writer writer (sink);
+         WriteHeader (writer);
+         EncodeFromStack (writer, ls, index, 0);
+         writer.flush();
+      }
+      catch (...)
+      {
+         lua_settop (ls, top);
+         throw;
+      }
+   }
+
+
+
+   // - Deserialize ------------------------------------------------------------
+   LuaValue Deserialize (Source& source)
+   {
+      Reader reader (source);
+      ReadHeader (reader);
+      return DecodeToLuaValue (reader, 0);
+   }
+
+
+
+   // - DeserializeToStack -----------------------------------------------------
+   void DeserializeToStack (lua_State* ls, Source& source)
+   {
+      const int top = lua_gettop (ls);
+
+      try
+      {
+         Reader reader (source);
+         ReadHeader (reader);
+
+         std::string buffer;
+         DecodeToStack (reader, ls, buffer, 0);
+      }
+      catch (...)
+      {
+         lua_settop (ls, top);
+         throw;
+      }
+   }
+
+
+
+
+   // - ToLuaSource ------------------------------------------------------------
+   void ToLuaSource (const LuaValue& value, Sink& sink)
+   {
+      Writer writer (sink);
+      LuaSourceWriter (writer).write (value);
+      writer.flush();
+   }
+
+} // namespace Diluculum
@@ -0,0 +1,851 @@
+/******************************************************************************\
+* LuaStore.cpp                                                                 *
+* Memory-mapped, read-only stores of Lua values.                               *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <new>
+#include <utility>
+#include <vector>
+#include <boost/cstdint.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaStore.hpp>
+#include <Diluculum/LuaWrappers.hpp>
+
+
+namespace Diluculum
+{
+   namespace
+   {
+      /** The format is as follows (all integers are little-endian):
+       *  - A header: the bytes \c "DLst", the format version and three zero
+       *    bytes, followed by the slot of the root value.
+       *  - A slot is a tag byte followed by eight bytes: a double for numbers,
+       *    or the offset of a string or table record.
+       *  - A string record is its 32-bit length, followed by its bytes.
+       *  - A table record is the 32-bit number of elements in its array part
+       *    and of entries in its hash part, followed by the slots of the array
+       *    part and then by the key and value slots of the hash part, sorted
+       *    by key (see \c CompareKeys()).
+       */
+      const unsigned char FormatVersion = 1;
+
+      /// The size of the header, excluding the root slot.
+      const boost::uint64_t HeaderSize = 8;
+
+      /// The size of a slot.
+      const boost::uint64_t SlotSize = 9;
+
+      /// The size of the fixed part of a table record.
+      const boost::uint64_t TableHeaderSize = 8;
+
+      /// The maximum nesting depth when decoding a store into a \c LuaValue.
+      const int MaxDepth = 1000;
+
+      /// The tags of the slots.
+      enum SlotTag
+      {
+         SLOT_NIL,
+         SLOT_FALSE,
+         SLOT_TRUE,
+         SLOT_NUMBER,
+         SLOT_STRING,
+         SLOT_TABLE
+      };
+
+      /// The name of the metatable used for proxies in the Lua registry.
+      const char* const ProxyMetatableName = "Diluculum.LuaStore";
+
+      /// A table key, wherever it comes from.
+      struct Key
+      {
+         /// The tag of the key (\c SLOT_NIL if it can't be a key).
+         unsigned char tag;
+
+         /// The value of numeric keys.
+         lua_Number number;
+
+         /// The bytes of string keys.
+         const char* str;
+
+         /// The length of string keys.
+         std::size_t len;
+      };
+
+      /** Compares two keys, returning a negative number, zero or a positive
+       *  number if \c lhs is less than, equal to or greater than \c rhs.
+       *  Keys are ordered by tag, then by value.
+       */
+      int CompareKeys (const Key& lhs, const Key& rhs)
+      {
+         if (lhs.tag != rhs.tag)
+            return lhs.tag < rhs.tag ? -1 : 1;
+
+         if (lhs.tag == SLOT_NUMBER)
+            return lhs.number < rhs.number ? -1 : rhs.number < lhs.number;
+
+         if (lhs.tag == SLOT_STRING)
+         {
+            const int cmp =
+               memcmp (lhs.str, rhs.str, std::min (lhs.len, rhs.len));
+            if (cmp != 0)
+               return cmp;
+            return lhs.len < rhs.len ? -1 : rhs.len < lhs.len;
+         }
+
+         return 0;
+      }
+
+      /** Returns the \c Key corresponding to \c value.
+       *  @throw LuaTypeError If \c value cannot be used as a key (NaN
+       *         included, since it isn't ordered).
+       */
+      Key KeyOf (const LuaValue& value)
+      {
+         Key key = { SLOT_NIL, 0, 0, 0 };
+         switch (value.type())
+         {
+            case LUA_TBOOLEAN:
+               key.tag = value.asBoolean() ? SLOT_TRUE : SLOT_FALSE;
+               break;
+
+            case LUA_TNUMBER:
+               key.tag = SLOT_NUMBER;
+               key.number = value.asNumber();
+               if (key.number != key.number)
+               {
+                  throw LuaTypeError (
+                     "Tables with NaN keys cannot be stored in a Lua store.");
+               }
+               break;
+
+            case LUA_TSTRING:
+               key.tag = SLOT_STRING;
+               key.str = value.asString().data();
+               key.len = value.asString().size();
+               break;
+
+            default:
+               throw LuaTypeError (
+                  ("Tables with keys of type '" + value.typeName()
+                   + "' cannot be stored in a Lua store.").c_str());
+         }
+
+         return key;
+      }
+
+      /// Orders key/value pairs by key, as in the hash part of a table record.
+      bool EntryLess (const std::pair<LuaValue, LuaValue>& lhs,
+                      const std::pair<LuaValue, LuaValue>& rhs)
+      {
+         return CompareKeys (KeyOf (lhs.first), KeyOf (rhs.first)) < 0;
+      }
+
+
+
+      // - StoreBuilder --------------------------------------------------------
+      /// Builds a store, in memory.
+      class StoreBuilder
+      {
+         public:
+            StoreBuilder()
+            {
+               const char header[HeaderSize] = { 'D', 'L', 's', 't',
+                                                 FormatVersion, 0, 0, 0 };
+               out_.append (header, HeaderSize);
+               out_.append (SlotSize, '\0');
+            }
+
+            /// Writes \c value into the slot at offset \c pos.
+            void slot (boost::uint64_t pos, const LuaValue& value)
+            {
+               switch (value.type())
+               {
+                  case LUA_TNIL:
+                     put (pos, SLOT_NIL, 0);
+                     break;
+
+                  case LUA_TBOOLEAN:
+                     put (pos, value.asBoolean() ? SLOT_TRUE : SLOT_FALSE, 0);
+                     break;
+
+                  case LUA_TNUMBER:
+                  {
+                     const double d = value.asNumber();
+                     boost::uint64_t bits;
+                     memcpy (&bits, &d, sizeof(bits));
+                     put (pos, SLOT_NUMBER, bits);
+                     break;
+                  }
+
+                  case LUA_TSTRING:
+                     put (pos, SLOT_STRING, string (value.asString()));
+                     break;
+
+                  case LUA_TTABLE:
+                     put (pos, SLOT_TABLE, table (value.asConstTable()));
+                     break;
+
+                  default:
+                     throw LuaTypeError (
+                        ("Values of type '" + value.typeName()
+                         + "' cannot be stored in a Lua store.").c_str());
+               }
+            }
+
+            /// Returns the store built so far.
+            const std::string& data() const { return out_; }
+
+         private:
+            /// Writes a slot at offset \c pos.
+            void put (boost::uint64_t pos, unsigned char tag,
+                      boost::uint64_t payload)
+            {
+               out_[pos] = static_cast<char>(tag);
+               for (int i = 0; i < 8; ++i)
+                  out_[pos + 1 + i] = static_cast<char>(payload >> (8 * i));
+            }
+
+            /// Appends a 32-bit integer.
+            void appendUInt32 (std::size_t n)
+            {
+               if (n > 0xFFFFFFFFul)
+                  throw LuaTypeError ("Value too large for a Lua store.");
+
+               for (int i = 0; i < 4; ++i)
+                  out_ += static_cast<char>(n >> (8 * i));
+            }
+
+            /** Returns the offset of the record of \c str, writing it if
+             *  needed.
+             */
+            boost::uint64_t string (const std::string& str)
+            {
+               typedef std::map<std::string, boost::uint64_t>::iterator iter_t;
+               const iter_t p = strings_.find (str);
+               if (p != strings_.end())
+                  return p->second;
+
+               const boost::uint64_t offset = out_.size();
+               appendUInt32 (str.size());
+               out_ += str;
+               strings_.insert (std::make_pair (str, offset));
+               return offset;
+            }
+
+            /// Writes the record of \c table, returning its offset.
+            boost::uint64_t table (const LuaValueMap& table)
+            {
+               typedef LuaValueMap::const_iterator iter_t;
+
+               // The array part holds keys 1, 2, 3... up to the first
+               // missing one. (Non-integer keys may appear between these in
+               // the 'LuaValueMap', so look each one up. A NaN key looks
+               // equivalent to any number to 'find()', so check what it
+               // found.)
+               std::vector<LuaValue> array;
+               for (iter_t p = table.find (1);
+                    p != table.end() && p->first == LuaValue (array.size() + 1);
+                    p = table.find (array.size() + 1))
+               {
+                  array.push_back (p->second);
+               }
+
+               std::vector<std::pair<LuaValue, LuaValue> > hash;
+               for (iter_t p = table.begin(); p != table.end(); ++p)
+               {
+                  const LuaValue& key = p->first;
+                  const bool isArrayKey = key.type() == LUA_TNUMBER
+                     && key.asNumber() >= 1 && key.asNumber() <= array.size()
+                     && key.asNumber() == std::floor (key.asNumber());
+
+                  // Ignore 'Nil'-indexed entries; check the others here,
+                  // since a single one is never compared when sorting
+                  if (key != Nil && !isArrayKey)
+                  {
+                     KeyOf (key);
+                     hash.push_back (*p);
+                  }
+               }
+               std::sort (hash.begin(), hash.end(), EntryLess);
+
+               const boost::uint64_t offset = out_.size();
+               appendUInt32 (array.size());
+               appendUInt32 (hash.size());
+               out_.append ((array.size() + 2 * hash.size()) * SlotSize, '\0');
+
+               boost::uint64_t pos = offset + TableHeaderSize;
+               for (std::size_t i = 0; i < array.size(); ++i, pos += SlotSize)
+                  slot (pos, array[i]);
+
+               for (std::size_t i = 0; i < hash.size(); ++i)
+               {
+                  slot (pos, hash[i].first);
+                  pos += SlotSize;
+                  slot (pos, hash[i].second);
+                  pos += SlotSize;
+               }
+
+               return offset;
+            }
+
+            /// The store being built.
+            std::string out_;
+
+            /// The offsets of the strings already written.
+            std::map<std::string, boost::uint64_t> strings_;
+      };
+
+   } // (anonymous) namespace
+
+
+
+   // - LuaStore::Data ---------------------------------------------------------
+   class LuaStore::Data
+   {
+      public:
+         /// Maps the file \c fileName.
+         explicit Data (const std::string& fileName)
+         {
+            using namespace boost::interprocess;
+
+            try
+            {
+               file_mapping file (fileName.c_str(), read_only);
+               mapped_region (file, read_only).swap (region_);
+            }
+            catch (interprocess_exception& e)
+            {
+               throw LuaFileError (("Cannot map the Lua store '" + fileName
+                                    + "': " + e.what()).c_str());
+            }
+
+            base_ = static_cast<const unsigned char*>(region_.get_address());
+            size_ = region_.get_size();
+
+            check (0, HeaderSize + SlotSize);
+            if (memcmp (base_, "DLst", 4) != 0)
+               throw SerializationError ("Not a Lua store.");
+            if (base_[4] != FormatVersion)
+               throw SerializationError ("Unsupported Lua store version.");
+         }
+
+         /// Returns the size of the store.
+         std::size_t size() const { return size_; }
+
+         /** Throws unless the \c size bytes at \c offset are inside the
+          *  store.
+          */
+         void check (boost::uint64_t offset, boost::uint64_t size) const
+         {
+            if (offset > size_ || size > size_ - offset)
+               throw SerializationError ("Corrupt Lua store.");
+         }
+
+         /// Reads a little-endian integer of \c size bytes at \c offset.
+         boost::uint64_t uint (boost::uint64_t offset, int size) const
+         {
+            check (offset, size);
+            boost::uint64_t n = 0;
+            for (int i = size - 1; i >= 0; --i)
+               n = (n << 8) | base_[offset + i];
+            return n;
+         }
+
+         /// Returns the tag of the slot at \c slot.
+         unsigned char tag (boost::uint64_t slot) const
+         {
+            check (slot, SlotSize);
+            return base_[slot];
+         }
+
+         /// Returns the payload of the slot at \c slot.
+         boost::uint64_t payload (boost::uint64_t slot) const
+         {
+            return uint (slot + 1, 8);
+         }
+
+         /// Returns the number stored in the slot at \c slot.
+         lua_Number number (boost::uint64_t slot) const
+         {
+            const boost::uint64_t bits = payload (slot);
+            double d;
+            memcpy (&d, &bits, sizeof(d));
+            return d;
+         }
+
+         /** Returns the string stored in the slot at \c slot (which is
+          *  not null-terminated), storing its length in \c len.
+          */
+         const char* string (boost::uint64_t slot, std::size_t& len) const
+         {
+            const boost::uint64_t record = payload (slot);
+            len = static_cast<std::size_t>(uint (record, 4));
+            check (record + 4, len);
+            return reinterpret_cast<const char*>(base_ + record + 4);
+         }
+
+         /** Returns the size of the array part of the table record at
+          *  \c table, checking that the whole record is inside the store.
+          */
+         boost::uint64_t arraySize (boost::uint64_t table) const
+         {
+            const boost::uint64_t n = uint (table, 4);
+            const boost::uint64_t h = uint (table + 4, 4);
+            check (table + TableHeaderSize, (n + 2 * h) * SlotSize);
+            return n;
+         }
+
+         /// Returns the size of the hash part of the table record at \c table.
+         boost::uint64_t hashSize (boost::uint64_t table) const
+         {
+            return uint (table + 4, 4);
+         }
+
+         /// Returns the \c Key in the slot at \c slot.
+         Key key (boost::uint64_t slot) const
+         {
+            Key key = { tag (slot), 0, 0, 0 };
+            if (key.tag == SLOT_NUMBER)
+               key.number = number (slot);
+            else if (key.tag == SLOT_STRING)
+               key.str = string (slot, key.len);
+            return key;
+         }
+
+         /** Looks for \c key in the table record at \c table. Returns the
+          *  offset of the slot with its value, or zero if it is not there.
+          */
+         boost::uint64_t find (boost::uint64_t table, const Key& key) const
+         {
+            const boost::uint64_t n = arraySize (table);
+            const boost::uint64_t h = hashSize (table);
+            const boost::uint64_t slots = table + TableHeaderSize;
+
+            if (key.tag == SLOT_NUMBER && key.number >= 1 && key.number <= n
+                && key.number == std::floor (key.number))
+            {
+               return slots + (static_cast<boost::uint64_t>(key.number) - 1)
+                  * SlotSize;
+            }
+
+            const boost::uint64_t entries = slots + n * SlotSize;
+            boost::uint64_t first = 0;
+            boost::uint64_t last = h;
+            while (first < last)
+            {
+               const boost::uint64_t middle = first + (last - first) / 2;
+               const boost::uint64_t entry = entries + middle * 2 * SlotSize;
+               const int cmp = CompareKeys (this->key (entry), key);
+               if (cmp == 0)
+                  return entry + SlotSize;
+               else if (cmp < 0)
+                  first = middle + 1;
+               else
+                  last = middle;
+            }
+
+            return 0;
+         }
+
+      private:
+         /// The mapping of the whole file.
+         boost::interprocess::mapped_region region_;
+
+         /// The start of the store.
+         const unsigned char* base_;
+
+         /// The size of the store.
+         std::size_t size_;
+   };
+
+
+
+   namespace
+   {
+      /// What is stored in the userdata of a proxy.
+      struct Proxy
+      {
+         /// The store containing the table.
+         boost::shared_ptr<LuaStore::Data> data;
+
+         /// The offset of the table record.
+         boost::uint64_t table;
+      };
+
+      void PushSlot (lua_State* ls,
+                     const boost::shared_ptr<LuaStore::Data>& data,
+                     boost::uint64_t slot);
+
+      /// Returns the proxy at index \c index, raising a Lua error if needed.
+      Proxy* CheckProxy (lua_State* ls, int index)
+      {
+         return static_cast<Proxy*>(
+            luaL_checkudata (ls, index, ProxyMetatableName));
+      }
+
+      /// Implements indexing of proxies.
+      int ProxyIndex (lua_State* ls)
+      {
+         const Proxy* proxy = CheckProxy (ls, 1);
+
+         Key key = { SLOT_NIL, 0, 0, 0 };
+         switch (lua_type (ls, 2))
+         {
+            case LUA_TBOOLEAN:
+               key.tag = lua_toboolean (ls, 2) ? SLOT_TRUE : SLOT_FALSE;
+               break;
+
+            case LUA_TNUMBER:
+               key.tag = SLOT_NUMBER;
+               key.number = lua_tonumber (ls, 2);
+               if (key.number != key.number) // NaN is never a key
+               {
+                  lua_pushnil (ls);
+                  return 1;
+               }
+               break;
+
+            case LUA_TSTRING:
+               key.tag = SLOT_STRING;
+               key.str = lua_tolstring (ls, 2, &key.len);
+               break;
+
+            default:
+               lua_pushnil (ls);
+               return 1;
+         }
+
+         try
+         {
+            const boost::uint64_t slot = proxy->data->find (proxy->table, key);
+            if (slot == 0)
+               lua_pushnil (ls);
+            else
+               PushSlot (ls, proxy->data, slot);
+            return 1;
+         }
+         catch (LuaError& e)
+         {
+            Impl::ReportErrorFromCFunction (ls, e.what());
+            return 0;
+         }
+         catch(...)
+         {
+            Impl::ReportErrorFromCFunction (
+               ls, "Unknown exception caught by wrapper.");
+            return 0;
+         }
+      }
+
+      /// Implements the length operator for proxies.
+      int ProxyLen (lua_State* ls)
+      {
+         const Proxy* proxy = CheckProxy (ls, 1);
+
+         try
+         {
+            lua_pushnumber (ls, static_cast<lua_Number>(
+               proxy->data->arraySize (proxy->table)));
+            return 1;
+         }
+         catch (LuaError& e)
+         {
+            Impl::ReportErrorFromCFunction (ls, e.what());
+            return 0;
+         }
+         catch(...)
+         {
+            Impl::ReportErrorFromCFunction (
+               ls, "Unknown exception caught by wrapper.");
+            return 0;
+         }
+      }
+
+      /// Implements \c == for proxies.
+      int ProxyEq (lua_State* ls)
+      {
+         const Proxy* lhs = CheckProxy (ls, 1);
+         const Proxy* rhs = CheckProxy (ls, 2);
+         lua_pushboolean (
+            ls, lhs->data == rhs->data && lhs->table == rhs->table);
+         return 1;
+      }
+
+      /// Raises an error: proxies are read-only.
+      int ProxyNewIndex (lua_State* ls)
+      {
+         return luaL_error (ls, "Tables in a Lua store are read-only.");
+      }
+
+      /** The iterator returned by \c ProxyPairs(). Its upvalues are the proxy
+       *  and the position of the last element returned.
+       */
+      int ProxyNext (lua_State* ls)
+      {
+         const Proxy* proxy =
+            static_cast<Proxy*>(lua_touserdata (ls, lua_upvalueindex (1)));
+         boost::uint64_t i = static_cast<boost::uint64_t>(
+            lua_tonumber (ls, lua_upvalueindex (2)));
+
+         try
+         {
+            const LuaStore::Data& data = *proxy->data;
+            const boost::uint64_t n = data.arraySize (proxy->table);
+            const boost::uint64_t h = data.hashSize (proxy->table);
+            const boost::uint64_t slots = proxy->table + TableHeaderSize;
+
+            // Elements of the array part may be nil; skip them
+            while (i < n && data.tag (slots + i * SlotSize) == SLOT_NIL)
+               ++i;
+
+            if (i >= n + h)
+               return 0;
+
+            lua_pushnumber (ls, static_cast<lua_Number>(i + 1));
+            lua_replace (ls, lua_upvalueindex (2));
+
+            if (i < n)
+            {
+               lua_pushnumber (ls, static_cast<lua_Number>(i + 1));
+               PushSlot (ls, proxy->data, slots + i * SlotSize);
+            }
+            else
+            {
+               const boost::uint64_t entry =
+                  slots + (n + 2 * (i - n)) * SlotSize;
+               PushSlot (ls, proxy->data, entry);
+               PushSlot (ls, proxy->data, entry + SlotSize);
+            }
+            return 2;
+         }
+         catch (LuaError& e)
+         {
+            Impl::ReportErrorFromCFunction (ls, e.what());
+            return 0;
+         }
+         catch(...)
+         {
+            Impl::ReportErrorFromCFunction (
+               ls, "Unknown exception caught by wrapper.");
+            return 0;
+         }
+      }
+
+      /** Implements iteration over proxies, both as \c __pairs (for Lua
+       *  versions supporting it) and \c __call.
+       */
+      int ProxyPairs (lua_State* ls)
+      {
+         CheckProxy (ls, 1);
+         lua_pushvalue (ls, 1);
+         lua_pushnumber (ls, 0);
+         lua_pushcclosure (ls, ProxyNext, 2);
+         return 1;
+      }
+
+      /// The \c __gc metamethod of proxies.
+      int ProxyGC (lua_State* ls)
+      {
+         static_cast<Proxy*>(lua_touserdata (ls, 1))->~Proxy();
+         return 0;
+      }
+
+      /// Pushes a proxy for the table record at \c table.
+      void PushProxy (lua_State* ls,
+                      const boost::shared_ptr<LuaStore::Data>& data,
+                      boost::uint64_t table)
+      {
+         data->arraySize (table); // checks the whole record
+
+         void* ud = lua_newuserdata (ls, sizeof(Proxy));
+         Proxy* proxy = new(ud) Proxy();
+         proxy->data = data;
+         proxy->table = table;
+
+         if (luaL_newmetatable (ls, ProxyMetatableName))
+         {
+            lua_pushcfunction (ls, ProxyIndex);
+            lua_setfield (ls, -2, "__index");
+            lua_pushcfunction (ls, ProxyNewIndex);
+            lua_setfield (ls, -2, "__newindex");
+            lua_pushcfunction (ls, ProxyLen);
+            lua_setfield (ls, -2, "__len");
+            lua_pushcfunction (ls, ProxyEq);
+            lua_setfield (ls, -2, "__eq");
+            lua_pushcfunction (ls, ProxyPairs);
+            lua_setfield (ls, -2, "__pairs");
+            lua_pushcfunction (ls, ProxyPairs);
+            lua_setfield (ls, -2, "__call");
+            lua_pushcfunction (ls, ProxyGC);
+            lua_setfield (ls, -2, "__gc");
+         }
+
+         lua_setmetatable (ls, -2);
+      }
+
+      /// Pushes the value in the slot at \c slot.
+      void PushSlot (lua_State* ls,
+                     const boost::shared_ptr<LuaStore::Data>& data,
+                     boost::uint64_t slot)
+      {
+         if (!lua_checkstack (ls, 3))
+            throw LuaMemoryError ("Cannot grow the Lua stack.");
+
+         switch (data->tag (slot))
+         {
+            case SLOT_NIL:
+               lua_pushnil (ls);
+               break;
+
+            case SLOT_FALSE:
+            case SLOT_TRUE:
+               lua_pushboolean (ls, data->tag (slot) == SLOT_TRUE);
+               break;
+
+            case SLOT_NUMBER:
+               lua_pushnumber (ls, data->number (slot));
+               break;
+
+            case SLOT_STRING:
+            {
+               std::size_t len;
+               const char* str = data->string (slot, len);
+               lua_pushlstring (ls, str, len);
+               break;
+            }
+
+            case SLOT_TABLE:
+               PushProxy (ls, data, data->payload (slot));
+               break;
+
+            default:
+               throw SerializationError ("Corrupt Lua store.");
+         }
+      }
+
+      /// Decodes the value in the slot at \c slot into a \c LuaValue.
+      LuaValue DecodeSlot (const LuaStore::Data& data, boost::uint64_t slot,
+                           int depth)
+      {
+         switch (data.tag (slot))
+         {
+            case SLOT_NIL:
+               return Nil;
+
+            case SLOT_FALSE:
+            case SLOT_TRUE:
+               return data.tag (slot) == SLOT_TRUE;
+
+            case SLOT_NUMBER:
+               return data.number (slot);
+
+            case SLOT_STRING:
+            {
+               std::size_t len;
+               const char* str = data.string (slot, len);
+               return std::string (str, len);
+            }
+
+            case SLOT_TABLE:
+            {
+               if (depth >= MaxDepth)
+                  throw SerializationError ("Corrupt Lua store.");
+
+               const boost::uint64_t table = data.payload (slot);
+               const boost::uint64_t n = data.arraySize (table);
+               const boost::uint64_t h = data.hashSize (table);
+               boost::uint64_t pos = table + TableHeaderSize;
+
+               LuaValueMap result;
+               for (boost::uint64_t i = 1; i <= n; ++i, pos += SlotSize)
+               {
+                  const LuaValue value = DecodeSlot (data, pos, depth + 1);
+                  if (value != Nil)
+                     result[static_cast<lua_Number>(i)] = value;
+               }
+
+               for (boost::uint64_t i = 0; i < h; ++i, pos += 2 * SlotSize)
+               {
+                  result[DecodeSlot (data, pos, depth + 1)] =
+                     DecodeSlot (data, pos + SlotSize, depth + 1);
+               }
+
+               return result;
+            }
+
+            default:
+               throw SerializationError ("Corrupt Lua store.");
+         }
+      }
+
+   } // (anonymous) namespace
+
+
+
+   // - LuaStore::LuaStore -----------------------------------------------------
+   LuaStore::LuaStore (const std::string& fileName)
+      : data_(new Data (fileName))
+   { }
+
+
+
+   // - LuaStore::value --------------------------------------------------------
+   LuaValue LuaStore::value() const
+   {
+      return DecodeSlot (*data_, HeaderSize, 0);
+   }
+
+
+
+   // - LuaStore::size ---------------------------------------------------------
+   std::size_t LuaStore::size() const
+   {
+      return data_->size();
+   }
+
+
+
+   // - WriteLuaStore ----------------------------------------------------------
+   void WriteLuaStore (const LuaValue& value, Sink& sink)
+   {
+      StoreBuilder builder;
+      builder.slot (HeaderSize, value);
+      sink.write (builder.data().data(), builder.data().size());
+   }
+
+
+
+   // - PushLuaStore -----------------------------------------------------------
+   void PushLuaStore (lua_State* state, const LuaStore& store)
+   {
+      PushSlot (state, store.data_, HeaderSize);
+   }
+
+} // namespace Diluculum
@@ -0,0 +1,433 @@
+/******************************************************************************\
+* LuaTypedArray.cpp                                                            *
+* Typed arrays of numbers, shared by C++ and Lua without conversions.          *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <new>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaTypedArray.hpp>
+#include <Diluculum/LuaWrappers.hpp>
+
+
+namespace Diluculum
+{
+   namespace
+   {
+      /// The name of the metatable used for typed arrays in the Lua registry.
+      const char* const TypedArrayMetatableName = "Diluculum.TypedArray";
+
+      /** What is stored at the start of the userdata of a typed array. For
+       *  arrays owned by Lua, the elements follow it, at \c HeaderSize.
+       */
+      struct ArrayHeader
+      {
+         /// The first element (null for empty or detached arrays).
+         void* data;
+
+         /// The number of elements.
+         std::size_t size;
+
+         /// The type of the elements.
+         TypedArrayType type;
+      };
+
+      /// The offset of the elements of arrays owned by Lua.
+      const std::size_t HeaderSize =
+         (sizeof(ArrayHeader) + sizeof(double) - 1)
+         / sizeof(double) * sizeof(double);
+
+      /** Returns the typed array at index \c index, raising a Lua error if
+       *  needed.
+       */
+      ArrayHeader* CheckArray (lua_State* ls, int index)
+      {
+         return static_cast<ArrayHeader*>(
+            luaL_checkudata (ls, index, TypedArrayMetatableName));
+      }
+
+      /** Returns the typed array at index \c index, or null if the value
+       *  there is not a typed array.
+       */
+      ArrayHeader* GetArray (lua_State* ls, int index)
+      {
+         void* ud = lua_touserdata (ls, index);
+         bool isArray = false;
+
+         if (ud != 0 && lua_getmetatable (ls, index))
+         {
+            luaL_getmetatable (ls, TypedArrayMetatableName);
+            isArray = lua_rawequal (ls, -1, -2) != 0;
+            lua_pop (ls, 2);
+         }
+
+         return isArray ? static_cast<ArrayHeader*>(ud) : 0;
+      }
+
+      /** Converts the Lua value at \c index into the position of an element
+       *  of \c array. Returns \c false if it is not the index of an element.
+       */
+      bool ToPosition (lua_State* ls, int index, const ArrayHeader* array,
+                       std::size_t& pos)
+      {
+         if (lua_type (ls, index) != LUA_TNUMBER)
+            return false;
+
+         const lua_Number key = lua_tonumber (ls, index);
+         if (!(key >= 1 && key <= static_cast<lua_Number>(array->size))
+             || key != std::floor (key))
+         {
+            return false;
+         }
+
+         pos = static_cast<std::size_t>(key) - 1;
+         return true;
+      }
+
+      /// The range of values that fit in the elements of integer arrays.
+      const lua_Number Int32Min = std::numeric_limits<boost::int32_t>::min();
+      const lua_Number Int32Max = std::numeric_limits<boost::int32_t>::max();
+      const lua_Number UInt8Max = std::numeric_limits<boost::uint8_t>::max();
+
+      /// Returns the element at \c pos in \c array.
+      lua_Number GetElement (const ArrayHeader* array, std::size_t pos)
+      {
+         switch (array->type)
+         {
+            case Float64Array:
+               return static_cast<const double*>(array->data)[pos];
+
+            case Float32Array:
+               return static_cast<const float*>(array->data)[pos];
+
+            case Int32Array:
+               return static_cast<const boost::int32_t*>(array->data)[pos];
+
+            default: // UInt8Array
+               return static_cast<const boost::uint8_t*>(array->data)[pos];
+         }
+      }
+
+      /** Stores \c value into the element at \c pos in \c array. Returns
+       *  \c false (and stores nothing) if \c value doesn't fit in the element
+       *  type.
+       */
+      bool SetElement (ArrayHeader* array, std::size_t pos, lua_Number value)
+      {
+         const lua_Number truncated =
+            value < 0 ? std::ceil (value) : std::floor (value);
+
+         switch (array->type)
+         {
+            case Float64Array:
+               static_cast<double*>(array->data)[pos] = value;
+               return true;
+
+            case Float32Array:
+               static_cast<float*>(array->data)[pos] =
+                  static_cast<float>(value);
+               return true;
+
+            case Int32Array:
+               if (!(truncated >= Int32Min && truncated <= Int32Max))
+               {
+                  return false;
+               }
+               static_cast<boost::int32_t*>(array->data)[pos] =
+                  static_cast<boost::int32_t>(truncated);
+               return true;
+
+            default: // UInt8Array
+               if (!(truncated >= 0 && truncated <= UInt8Max))
+               {
+                  return false;
+               }
+               static_cast<boost::uint8_t*>(array->data)[pos] =
+                  static_cast<boost::uint8_t>(truncated);
+               return true;
+         }
+      }
+
+      /// Implements indexing of typed arrays.
+      int TypedArrayIndex (lua_State* ls)
+      {
+         const ArrayHeader* array = CheckArray (ls, 1);
+
+         std::size_t pos;
+         if (ToPosition (ls, 2, array, pos))
+            lua_pushnumber (ls, GetElement (array, pos));
+         else
+            lua_pushnil (ls);
+
+         return 1;
+      }
+
+      /// Implements assignment to elements of typed arrays.
+      int TypedArrayNewIndex (lua_State* ls)
+      {
+         ArrayHeader* array = CheckArray (ls, 1);
+         const lua_Number value = luaL_checknumber (ls, 3);
+
+         std::size_t pos;
+         if (!ToPosition (ls, 2, array, pos))
+         {
+            return luaL_error (ls, "Invalid index for a %s array of size %d.",
+                               TypedArrayTypeName (array->type),
+                               static_cast<int>(array->size));
+         }
+
+         if (!SetElement (array, pos, value))
+         {
+            return luaL_error (ls, "Value %f does not fit in a %s array.",
+                               value, TypedArrayTypeName (array->type));
+         }
+
+         return 0;
+      }
+
+      /// Implements the length operator for typed arrays.
+      int TypedArrayLen (lua_State* ls)
+      {
+         const ArrayHeader* array = CheckArray (ls, 1);
+         lua_pushnumber (ls, static_cast<lua_Number>(array->size));
+         return 1;
+      }
+
+      /// Implements \c tostring() for typed arrays.
+      int TypedArrayToString (lua_State* ls)
+      {
+         const ArrayHeader* array = CheckArray (ls, 1);
+         lua_pushfstring (ls, "%s array of size %d: %p",
+                          TypedArrayTypeName (array->type),
+                          static_cast<int>(array->size), array->data);
+         return 1;
+      }
+
+      /// Pushes a typed array, without any elements attached to it.
+      ArrayHeader* PushArrayHeader (lua_State* ls, TypedArrayType type,
+                                    std::size_t userDataSize)
+      {
+         ArrayHeader* array =
+            static_cast<ArrayHeader*>(lua_newuserdata (ls, userDataSize));
+         array->data = 0;
+         array->size = 0;
+         array->type = type;
+
+         if (luaL_newmetatable (ls, TypedArrayMetatableName))
+         {
+            lua_pushcfunction (ls, TypedArrayIndex);
+            lua_setfield (ls, -2, "__index");
+            lua_pushcfunction (ls, TypedArrayNewIndex);
+            lua_setfield (ls, -2, "__newindex");
+            lua_pushcfunction (ls, TypedArrayLen);
+            lua_setfield (ls, -2, "__len");
+            lua_pushcfunction (ls, TypedArrayToString);
+            lua_setfield (ls, -2, "__tostring");
+         }
+
+         lua_setmetatable (ls, -2);
+
+         return array;
+      }
+
+      /** Implements the Lua constructors of typed arrays, like
+       *  <tt>float64 (n)</tt> and <tt>float64 (t)</tt>.
+       */
+      template <TypedArrayType Type>
+      int NewTypedArray (lua_State* ls)
+      {
+         const bool fromTable = lua_type (ls, 1) == LUA_TTABLE;
+         lua_Number size;
+
+         if (fromTable)
+         {
+            size = static_cast<lua_Number>(lua_objlen (ls, 1));
+         }
+         else
+         {
+            size = luaL_checknumber (ls, 1);
+            if (!(size >= 0) || size != std::floor (size))
+               return luaL_argerror (ls, 1, "invalid array size");
+
+            // Converting larger numbers to 'std::size_t' is undefined
+            if (size >= static_cast<lua_Number>(
+                   std::numeric_limits<std::size_t>::max()))
+            {
+               return luaL_argerror (ls, 1, "array size too large");
+            }
+         }
+
+         ArrayHeader* array;
+
+         try
+         {
+            PushTypedArray (ls, Type, static_cast<std::size_t>(size));
+            array = static_cast<ArrayHeader*>(lua_touserdata (ls, -1));
+         }
+         catch (LuaError& e)
+         {
+            Impl::ReportErrorFromCFunction (ls, e.what());
+            return 0;
+         }
+         catch(...)
+         {
+            Impl::ReportErrorFromCFunction (
+               ls, "Unknown exception caught by wrapper.");
+            return 0;
+         }
+
+         if (fromTable)
+         {
+            for (std::size_t i = 0; i < array->size; ++i)
+            {
+               lua_rawgeti (ls, 1, static_cast<int>(i + 1));
+               if (lua_type (ls, -1) != LUA_TNUMBER)
+               {
+                  return luaL_error (ls, "Element %d is not a number.",
+                                     static_cast<int>(i + 1));
+               }
+
+               if (!SetElement (array, i, lua_tonumber (ls, -1)))
+               {
+                  return luaL_error (ls, "Element %d does not fit in a %s "
+                                     "array.", static_cast<int>(i + 1),
+                                     TypedArrayTypeName (Type));
+               }
+               lua_pop (ls, 1);
+            }
+         }
+
+         return 1;
+      }
+
+   } // (anonymous) namespace
+
+
+
+   // - TypedArrayElementSize --------------------------------------------------
+   std::size_t TypedArrayElementSize (TypedArrayType type)
+   {
+      switch (type)
+      {
+         case Float64Array: return sizeof(double);
+         case Float32Array: return sizeof(float);
+         case Int32Array: return sizeof(boost::int32_t);
+         default: return sizeof(boost::uint8_t); // UInt8Array
+      }
+   }
+
+
+
+   // - TypedArrayTypeName -----------------------------------------------------
+   const char* TypedArrayTypeName (TypedArrayType type)
+   {
+      switch (type)
+      {
+         case Float64Array: return "float64";
+         case Float32Array: return "float32";
+         case Int32Array: return "int32";
+         default: return "uint8"; // UInt8Array
+      }
+   }
+
+
+
+   // - PushTypedArray ---------------------------------------------------------
+   void* PushTypedArray (lua_State* state, TypedArrayType type,
+                         std::size_t size)
+   {
+      const std::size_t elementSize = TypedArrayElementSize (type);
+      if (size > (std::numeric_limits<std::size_t>::max() - HeaderSize)
+          / elementSize)
+      {
+         throw LuaMemoryError ("Typed array too large.");
+      }
+
+      ArrayHeader* array =
+         PushArrayHeader (state, type, HeaderSize + size * elementSize);
+
+      if (size > 0)
+      {
+         array->data = reinterpret_cast<char*>(array) + HeaderSize;
+         array->size = size;
+         std::memset (array->data, 0, size * elementSize);
+      }
+
+      return array->data;
+   }
+
+
+
+   // - PushTypedArrayView -----------------------------------------------------
+   void PushTypedArrayView (lua_State* state, TypedArrayType type,
+                            void* data, std::size_t size)
+   {
+      ArrayHeader* array = PushArrayHeader (state, type, sizeof(ArrayHeader));
+      array->data = data;
+      array->size = data != 0 ? size : 0;
+   }
+
+
+
+   // - ToTypedArray -----------------------------------------------------------
+   TypedArraySpan ToTypedArray (lua_State* state, int index)
+   {
+      const ArrayHeader* array = GetArray (state, index);
+      if (array == 0)
+         throw TypeMismatchError ("typed array", luaL_typename (state, index));
+
+      TypedArraySpan span = { array->type, array->data, array->size };
+      return span;
+   }
+
+
+
+   // - DetachTypedArray -------------------------------------------------------
+   void DetachTypedArray (lua_State* state, int index)
+   {
+      ArrayHeader* array = GetArray (state, index);
+      if (array == 0)
+         throw TypeMismatchError ("typed array", luaL_typename (state, index));
+
+      array->data = 0;
+      array->size = 0;
+   }
+
+
+
+   // - RegisterTypedArrayFunctions --------------------------------------------
+   void RegisterTypedArrayFunctions (LuaVariable table)
+   {
+      if (table.value().type() != LUA_TTABLE)
+         table = EmptyLuaValueMap;
+
+      table["float64"] = NewTypedArray<Float64Array>;
+      table["float32"] = NewTypedArray<Float32Array>;
+      table["int32"] = NewTypedArray<Int32Array>;
+      table["uint8"] = NewTypedArray<UInt8Array>;
+   }
+
+} // namespace Diluculum
@@ -25,6 +25,8 @@
 \******************************************************************************/
 
 #include <cstring>
+#include <deque>
+#include <map>
 #include <Diluculum/LuaUtils.hpp>
 #include <Diluculum/LuaExceptions.hpp>
 #include <boost/lexical_cast.hpp>
@@ -33,162 +35,512 @@
 
 namespace Diluculum
 {
-   // - ToLuaValue -------------------------------------------------------------
-   LuaValue ToLuaValue (lua_State* state, int index)
+   namespace
    {
-      switch (lua_type (state, index))
+      // - ThrowTooDeep --------------------------------------------------------
+      void ThrowTooDeep (const char* function)
       {
-         case LUA_TNIL:
-            return Nil;
+         throw LuaTypeError(
+            ("Table nested too deeply found in call to '"
+             + std::string(function) + "()'.").c_str());
+      }
 
-         case LUA_TNUMBER:
-            return lua_tonumber (state, index);
 
-         case LUA_TBOOLEAN:
-            // this (instead of a cast) avoids a warning on Visual C++
-            return lua_toboolean (state, index) != 0;
 
-         case LUA_TSTRING:
-            return std::string(lua_tostring (state, index),
-                               lua_objlen(state, index));
+      // - ThrowTooManyElements ------------------------------------------------
+      void ThrowTooManyElements (const char* function)
+      {
+         throw LuaTypeError(
+            ("Too many table elements found in call to '"
+             + std::string(function) + "()'.").c_str());
+      }
+
 
-         case LUA_TUSERDATA:
-         {
-            void* addr = lua_touserdata (state, index);
-            size_t size = lua_objlen (state, index);
-            LuaUserData ud (size);
-            memcpy (ud.getData(), addr, size);
-            return ud;
-         }
 
-         case LUA_TTABLE:
+      // - ScalarToLuaValue ----------------------------------------------------
+      LuaValue ScalarToLuaValue (lua_State* state, int index)
+      {
+         switch (lua_type (state, index))
          {
-            // Make the index positive if necessary (using a negative index here
-            // will be *bad*, because the stack will be changed in the
-            // 'lua_next()' and a negative index will mess everything).
-            if (index < 0)
-               index = lua_gettop(state) + index + 1;
+            case LUA_TNIL:
+               return Nil;
 
-            // Traverse the table adding the key/value pairs to 'ret'
-            LuaValueMap ret;
+            case LUA_TNUMBER:
+               return lua_tonumber (state, index);
 
-            lua_pushnil (state);
-            while (lua_next (state, index) != 0)
-            {
-               ret[ToLuaValue (state, -2)] = ToLuaValue (state, -1);
-               lua_pop (state, 1);
-            }
+            case LUA_TBOOLEAN:
+               // this (instead of a cast) avoids a warning on Visual C++
+               return lua_toboolean (state, index) != 0;
 
-            // Alright, return the result
-            return ret;
-         }
+            case LUA_TSTRING:
+               return std::string(lua_tostring (state, index),
+                                  lua_objlen(state, index));
 
-         case LUA_TFUNCTION:
-         {
-            if (lua_iscfunction (state, index))
+            case LUA_TUSERDATA:
             {
-               return lua_tocfunction (state, index);
+               void* addr = lua_touserdata (state, index);
+               size_t size = lua_objlen (state, index);
+               LuaUserData ud (size);
+               memcpy (ud.getData(), addr, size);
+               return ud;
             }
-            else
+
+            case LUA_TFUNCTION:
             {
-               LuaFunction func("", 0);
-               lua_pushvalue (state, index);
-               lua_dump(state, Impl::LuaFunctionWriter, &func);
-               lua_pop(state, 1);
-               return func;
+               if (lua_iscfunction (state, index))
+               {
+                  return lua_tocfunction (state, index);
+               }
+               else
+               {
+                  LuaFunction func("", 0);
+                  lua_pushvalue (state, index);
+                  lua_dump(state, Impl::LuaFunctionWriter, &func);
+                  lua_pop(state, 1);
+                  return func;
+               }
             }
-         }
 
-         default:
-         {
-            throw LuaTypeError(
-               ("Unsupported type found in call to 'ToLuaValue()': "
-                + boost::lexical_cast<std::string>(lua_type (state, index))
-                + " (typename: \'" + luaL_typename (state, index)
-                + "')").c_str());
+            default:
+            {
+               throw LuaTypeError(
+                  ("Unsupported type found in call to 'ToLuaValue()': "
+                   + boost::lexical_cast<std::string>(lua_type (state, index))
+                   + " (typename: \'" + luaL_typename (state, index)
+                   + "')").c_str());
+            }
          }
       }
-   }
 
 
 
-   // - PushLuaValue -----------------------------------------------------------
-   void PushLuaValue (lua_State* state, const LuaValue& value)
-   {
-      switch (value.type())
+      /** Converts a Lua table, and everything nested in it, to a
+       *  \c LuaValue. Instead of recursing, this keeps an explicit stack of
+       *  the tables being converted, so the C++ stack use is constant.
+       */
+      class TableConverter
       {
-         case LUA_TNIL:
-            lua_pushnil (state);
-            break;
+         public:
+            TableConverter (lua_State* state, bool shareTables,
+                            const ConversionLimits& limits)
+               : state_(state), shareTables_(shareTables), limits_(limits),
+                 elements_(0), reserved_(0)
+            { }
 
-         case LUA_TNUMBER:
-            lua_pushnumber (state, value.asNumber());
-            break;
+            /** Converts the table at \c index (which must be a positive
+             *  index). On success, the Lua stack is left as it was.
+             */
+            LuaValue convert (int index)
+            {
+               LuaValue result;
+               if (!enter (index, result))
+                  return result;
 
-         case LUA_TSTRING:
-         {
-            const std::string& tmp = value.asString();
-            lua_pushlstring (state, tmp.c_str(), tmp.length());
-            break;
-         }
+               while (true)
+               {
+                  Frame& frame = frames_.back();
 
-         case LUA_TBOOLEAN:
-            lua_pushboolean (state, value.asBoolean());
-            break;
+                  if (frame.state == Frame::NEXT)
+                  {
+                     if (lua_next (state_, frame.index) == 0)
+                     {
+                        result = frame.table;
+                        if (shareTables_)
+                           memo_[frame.id] = result;
+                        frames_.pop_back();
 
-         case LUA_TUSERDATA:
-         {
-            size_t size = value.asUserData().getSize();
-            void* addr = lua_newuserdata (state, size);
-            memcpy (addr, value.asUserData().getData(), size);
-            break;
-         }
+                        if (frames_.empty())
+                           return result;
 
-         case LUA_TTABLE:
-         {
-            lua_newtable (state);
+                        deliver (result);
+                        continue;
+                     }
+
+                     if (++elements_ > limits_.maxElements)
+                        ThrowTooManyElements ("ToLuaValue");
+
+                     frame.state = Frame::KEY;
+                  }
+
+                  if (frame.state == Frame::KEY)
+                  {
+                     // The key is at -2, with its value above it
+                     frame.state = Frame::VALUE;
+                     const int keyIndex = lua_gettop (state_) - 1;
+                     if (lua_type (state_, keyIndex) != LUA_TTABLE)
+                        frame.key = ScalarToLuaValue (state_, keyIndex);
+                     else if (enter (keyIndex, frame.key))
+                        continue;
+                  }
+
+                  // frame.state == Frame::VALUE
+                  frame.state = Frame::NEXT;
+                  const int valueIndex = lua_gettop (state_);
+                  LuaValue value;
+                  if (lua_type (state_, valueIndex) != LUA_TTABLE)
+                     value = ScalarToLuaValue (state_, valueIndex);
+                  else if (enter (valueIndex, value))
+                     continue;
 
-            typedef LuaValueMap::const_iterator iter_t;
-            const LuaValueMap table = value.asTable();
-            for (iter_t p = table.begin(); p != table.end(); ++p)
+                  frame.table[frame.key] = value;
+                  lua_pop (state_, 1);
+               }
+            }
+
+         private:
+            /// A table being converted.
+            struct Frame
+            {
+                  /// What is to be done next with this table.
+                  enum State
+                  {
+                     NEXT,  ///< Call \c lua_next().
+                     KEY,   ///< Convert the key on the stack.
+                     VALUE  ///< Convert the value on the stack.
+                  };
+
+                  /// The (positive) index of the table on the Lua stack.
+                  int index;
+
+                  /// The table identity, as given by \c lua_topointer().
+                  const void* id;
+
+                  /// What is to be done next.
+                  State state;
+
+                  /// The entries converted so far.
+                  LuaValueMap table;
+
+                  /// The key of the entry being converted.
+                  LuaValue key;
+            };
+
+            /** Starts converting the table at \c index.
+             *  @return \c true if a new \c Frame was pushed; \c false if the
+             *          table was already converted and was stored in
+             *          \c result.
+             */
+            bool enter (int index, LuaValue& result)
             {
-               if (p->first != Nil) // Ignore 'Nil'-indexed entries
+               if (frames_.size() >= limits_.maxDepth)
+                  ThrowTooDeep ("ToLuaValue");
+
+               const void* id = lua_topointer (state_, index);
+
+               if (shareTables_)
                {
-                  PushLuaValue (state, p->first);
-                  PushLuaValue (state, p->second);
-                  lua_settable (state, -3);
+                  std::pair<TableMemo::iterator, bool> ins =
+                     memo_.insert (std::make_pair (id, Nil));
+
+                  if (!ins.second)
+                  {
+                     if (ins.first->second.type() == LUA_TNIL)
+                     {
+                        throw LuaTypeError(
+                           "Cyclic table found in call to 'ToLuaValue()': "
+                           "tables containing themselves cannot be "
+                           "converted to a LuaValue.");
+                     }
+
+                     result = ins.first->second;
+                     return false;
+                  }
                }
+
+               // The iteration key and value, plus one slot for dumping
+               // functions
+               Impl::ReserveLuaStack (state_, 3, reserved_);
+
+               frames_.push_back (Frame());
+               Frame& frame = frames_.back();
+               frame.index = index;
+               frame.id = id;
+               frame.state = Frame::NEXT;
+
+               lua_pushnil (state_);
+               return true;
             }
 
-            break;
-         }
+            /** Hands the just converted \c value to the table being converted
+             *  at the top of \c frames_.
+             */
+            void deliver (const LuaValue& value)
+            {
+               Frame& frame = frames_.back();
+               if (frame.state == Frame::VALUE)
+               {
+                  // It was a key; it must stay on the stack for 'lua_next()'
+                  frame.key = value;
+               }
+               else
+               {
+                  frame.table[frame.key] = value;
+                  lua_pop (state_, 1);
+               }
+            }
+
+            /** Maps the tables already converted (as given by
+             *  \c lua_topointer()) to their converted values. Tables still
+             *  being converted are mapped to \c Nil.
+             */
+            typedef std::map<const void*, LuaValue> TableMemo;
+
+            lua_State* state_;
+            const bool shareTables_;
+            const ConversionLimits limits_;
+            std::size_t elements_;
+            int reserved_;
+            std::deque<Frame> frames_;
+            TableMemo memo_;
+      };
+
 
-         case LUA_TFUNCTION:
+
+      // - PushScalarLuaValue --------------------------------------------------
+      void PushScalarLuaValue (lua_State* state, const LuaValue& value)
+      {
+         switch (value.type())
          {
-            const LuaFunction& f = value.asFunction();
-            if (f.isCFunction())
+            case LUA_TNIL:
+               lua_pushnil (state);
+               break;
+
+            case LUA_TNUMBER:
+               lua_pushnumber (state, value.asNumber());
+               break;
+
+            case LUA_TSTRING:
             {
-               lua_pushcfunction (state, f.getCFunction());
+               const std::string& tmp = value.asString();
+               lua_pushlstring (state, tmp.c_str(), tmp.length());
+               break;
             }
-            else
+
+            case LUA_TBOOLEAN:
+               lua_pushboolean (state, value.asBoolean());
+               break;
+
+            case LUA_TUSERDATA:
             {
-               LuaFunction* pf = const_cast<LuaFunction*>(&f); // yikes!
-               pf->setReaderFlag (false);
-               int status = lua_load (state, Impl::LuaFunctionReader, pf,
-                                      "Diluculum Lua chunk");
-               Impl::ThrowOnLuaError (state, status);
+               size_t size = value.asUserData().getSize();
+               void* addr = lua_newuserdata (state, size);
+               memcpy (addr, value.asUserData().getData(), size);
+               break;
             }
-            break;
-         }
 
-         default:
-         {
-            throw LuaTypeError(
-               ("Unsupported type found in call to 'PushLuaValue()': "
-                + boost::lexical_cast<std::string>(value.type())
-                + " (typename: \'" + value.typeName() + "')").c_str());
+            case LUA_TFUNCTION:
+            {
+               const LuaFunction& f = value.asFunction();
+               if (f.isCFunction())
+               {
+                  lua_pushcfunction (state, f.getCFunction());
+               }
+               else
+               {
+                  LuaFunction* pf = const_cast<LuaFunction*>(&f); // yikes!
+                  pf->setReaderFlag (false);
+                  int status = lua_load (state, Impl::LuaFunctionReader, pf,
+                                         "Diluculum Lua chunk");
+                  Impl::ThrowOnLuaError (state, status);
+               }
+               break;
+            }
+
+            default:
+            {
+               throw LuaTypeError(
+                  ("Unsupported type found in call to 'PushLuaValue()': "
+                   + boost::lexical_cast<std::string>(value.type())
+                   + " (typename: \'" + value.typeName() + "')").c_str());
+            }
          }
       }
+
+
+
+      /** Pushes a table, and everything nested in it, to the Lua stack.
+       *  Like \c TableConverter, this keeps an explicit stack of the tables
+       *  being pushed instead of recursing.
+       */
+      class TablePusher
+      {
+         public:
+            TablePusher (lua_State* state, const ConversionLimits& limits)
+               : state_(state), limits_(limits), elements_(0), reserved_(0)
+            { }
+
+            /// Pushes \c table. On error, the Lua stack may be left dirty.
+            void push (const LuaValueMap& table)
+            {
+               enter (table);
+
+               while (!frames_.empty())
+               {
+                  Frame& frame = frames_.back();
+
+                  if (frame.state == Frame::KEY)
+                  {
+                     // Lua does not support 'nil' as a table index
+                     while (frame.next != frame.end
+                            && frame.next->first.type() == LUA_TNIL)
+                     {
+                        ++frame.next;
+                     }
+
+                     if (frame.next == frame.end)
+                     {
+                        frames_.pop_back();
+
+                        // If the parent was waiting for a value, store it
+                        if (!frames_.empty()
+                            && frames_.back().state == Frame::KEY)
+                        {
+                           lua_settable (state_, -3);
+                        }
+                        continue;
+                     }
+
+                     if (++elements_ > limits_.maxElements)
+                        ThrowTooManyElements ("PushLuaValue");
+
+                     frame.state = Frame::VALUE;
+                     const LuaValue& key = frame.next->first;
+                     if (key.type() == LUA_TTABLE)
+                     {
+                        enter (key.asConstTable());
+                        continue;
+                     }
+                     PushScalarLuaValue (state_, key);
+                  }
+
+                  // frame.state == Frame::VALUE
+                  const LuaValue& value = frame.next->second;
+                  ++frame.next;
+                  frame.state = Frame::KEY;
+                  if (value.type() == LUA_TTABLE)
+                  {
+                     enter (value.asConstTable());
+                     continue;
+                  }
+                  PushScalarLuaValue (state_, value);
+                  lua_settable (state_, -3);
+               }
+            }
+
+         private:
+            /// A table being pushed.
+            struct Frame
+            {
+                  /// What is to be pushed next for this table.
+                  enum State
+                  {
+                     KEY,  ///< The key of the next entry.
+                     VALUE ///< The value of the entry whose key was pushed.
+                  };
+
+                  /// The next entry to push.
+                  LuaValueMap::const_iterator next;
+
+                  /// The end of the table being pushed.
+                  LuaValueMap::const_iterator end;
+
+                  /// What is to be pushed next.
+                  State state;
+            };
+
+            /// Pushes a new, empty, table and starts filling it.
+            void enter (const LuaValueMap& table)
+            {
+               if (frames_.size() >= limits_.maxDepth)
+                  ThrowTooDeep ("PushLuaValue");
+
+               // The table, a key and a value
+               Impl::ReserveLuaStack (state_, 3, reserved_);
+               lua_newtable (state_);
+
+               Frame frame;
+               frame.next = table.begin();
+               frame.end = table.end();
+               frame.state = Frame::KEY;
+               frames_.push_back (frame);
+            }
+
+            lua_State* state_;
+            const ConversionLimits limits_;
+            std::size_t elements_;
+            int reserved_;
+            std::deque<Frame> frames_;
+      };
+
+   } // (anonymous) namespace
+
+
+
+   // - ToLuaValue -------------------------------------------------------------
+   LuaValue ToLuaValue (lua_State* state, int index)
+   {
+      return ToLuaValue (state, index, CopyTables);
+   }
+
+
+
+   LuaValue ToLuaValue (lua_State* state, int index, TableConversion mode,
+                        const ConversionLimits& limits)
+   {
+      if (lua_type (state, index) != LUA_TTABLE)
+         return ScalarToLuaValue (state, index);
+
+      // Make the index positive if necessary (using a negative index here will
+      // be *bad*, because the stack will be changed in the 'lua_next()' and a
+      // negative index will mess everything).
+      if (index < 0 && index > LUA_REGISTRYINDEX)
+         index = lua_gettop(state) + index + 1;
+
+      const int top = lua_gettop (state);
+      try
+      {
+         TableConverter converter (state, mode == ShareTables, limits);
+         return converter.convert (index);
+      }
+      catch (...)
+      {
+         lua_settop (state, top);
+         throw;
+      }
+   }
+
+
+
+   // - PushLuaValue -----------------------------------------------------------
+   void PushLuaValue (lua_State* state, const LuaValue& value)
+   {
+      PushLuaValue (state, value, ConversionLimits());
+   }
+
+
+
+   void PushLuaValue (lua_State* state, const LuaValue& value,
+                      const ConversionLimits& limits)
+   {
+      if (value.type() != LUA_TTABLE)
+      {
+         if (!lua_checkstack (state, 1))
+            throw LuaTypeError ("Lua stack overflow in 'PushLuaValue()'.");
+         PushScalarLuaValue (state, value);
+         return;
+      }
+
+      const int top = lua_gettop (state);
+      try
+      {
+         TablePusher pusher (state, limits);
+         pusher.push (value.asConstTable());
+      }
+      catch (...)
+      {
+         lua_settop (state, top);
+         throw;
+      }
    }
 
 } // namespace Diluculum
@@ -133,7 +133,8 @@ namespace Diluculum
    LuaValue::LuaValue (const LuaValueMap& t)
       : dataType_(LUA_TTABLE)
    {
-      new(data_) LuaValueMap(t);
+      TableData* td = new(data_) TableData();
+      td->table.reset (new LuaValueMap(t));
    }
 
 
@@ -159,6 +160,7 @@ namespace Diluculum
 
 
    LuaValue::LuaValue (const LuaValueList& v)
+      : dataType_(LUA_TNIL)
    {
       if (v.size() >= 1)
          *this = v[0];
@@ -177,7 +179,7 @@ namespace Diluculum
             break;
 
          case LUA_TTABLE:
-            new(data_) LuaValueMap (other.asTable());
+            copyTableAtData (other);
             break;
 
          case LUA_TUSERDATA:
@@ -200,6 +202,26 @@ namespace Diluculum
    // - LuaValue::operator= ----------------------------------------------------
    LuaValue& LuaValue::operator= (const LuaValue& rhs)
    {
+      if (this == &rhs)
+         return *this;
+
+      // 'rhs' may live inside the table we are about to release, so keep that
+      // table alive until the assignment is complete.
+      boost::shared_ptr<LuaValueMap> oldTable;
+      if (dataType_ == LUA_TTABLE)
+         oldTable = reinterpret_cast<TableData*>(data_)->table;
+
+      // Conversely, a table in 'rhs' may contain this very value, so it must
+      // be copied before this value is destroyed. (Cheap, tables are shared.)
+      if (rhs.dataType_ == LUA_TTABLE)
+      {
+         const LuaValue tmp (rhs);
+         destroyObjectAtData();
+         dataType_ = LUA_TTABLE;
+         copyTableAtData (tmp);
+         return *this;
+      }
+
       destroyObjectAtData();
 
       dataType_ = rhs.dataType_;
@@ -211,7 +233,7 @@ namespace Diluculum
             break;
 
          case LUA_TTABLE:
-            new(data_) LuaValueMap (rhs.asTable());
+            copyTableAtData (rhs);
             break;
 
          case LUA_TUSERDATA:
@@ -334,7 +356,18 @@ namespace Diluculum
    LuaValueMap LuaValue::asTable() const
    {
       if (dataType_ == LUA_TTABLE)
-         return *reinterpret_cast<const LuaValueMap*>(&data_);
+         return tableRef();
+      else
+         throw TypeMismatchError ("table", typeName());
+   }
+
+
+
+   // - LuaValue::asConstTable -------------------------------------------------
+   const LuaValueMap& LuaValue::asConstTable() const
+   {
+      if (dataType_ == LUA_TTABLE)
+         return tableRef();
       else
          throw TypeMismatchError ("table", typeName());
    }
@@ -399,8 +432,8 @@ namespace Diluculum
             return asUserData() < rhs.asUserData();
          else if (lhsTypeName == "table")
          {
-            const LuaValueMap lhsMap = asTable();
-            const LuaValueMap rhsMap = rhs.asTable();
+            const LuaValueMap& lhsMap = tableRef();
+            const LuaValueMap& rhsMap = rhs.tableRef();
 
             if (lhsMap.size() < rhsMap.size())
                return true;
@@ -472,8 +505,8 @@ namespace Diluculum
             return asUserData() > rhs.asUserData();
          else if (lhsTypeName == "table")
          {
-            const LuaValueMap lhsMap = asTable();
-            const LuaValueMap rhsMap = rhs.asTable();
+            const LuaValueMap& lhsMap = tableRef();
+            const LuaValueMap& rhsMap = rhs.tableRef();
 
             if (lhsMap.size() > rhsMap.size())
                return true;
@@ -542,7 +575,8 @@ namespace Diluculum
             return asString() == rhs.asString();
 
          case LUA_TTABLE:
-            return asTable() == rhs.asTable();
+            return &tableRef() == &rhs.tableRef()
+               || tableRef() == rhs.tableRef();
 
          case LUA_TFUNCTION:
             return asFunction() == rhs.asFunction();
@@ -568,9 +602,14 @@ namespace Diluculum
       if (type() != LUA_TTABLE)
          throw TypeMismatchError ("table", typeName());
 
-      LuaValueMap& table = *reinterpret_cast<LuaValueMap*>(data_);
+      // Copy-on-write: detach from other values sharing this table, and stop
+      // sharing it from now on, since we are giving away a reference into it.
+      TableData& td = *reinterpret_cast<TableData*>(data_);
+      if (!td.table.unique())
+         td.table.reset (new LuaValueMap (*td.table));
+      td.unshareable = true;
 
-      return table[key];
+      return (*td.table)[key];
    }
 
 
@@ -580,7 +619,7 @@ namespace Diluculum
       if (type() != LUA_TTABLE)
          throw TypeMismatchError ("table", typeName());
 
-      const LuaValueMap& table = *reinterpret_cast<const LuaValueMap*>(data_);
+      const LuaValueMap& table = tableRef();
 
       LuaValueMap::const_iterator it = table.find(key);
 
@@ -592,6 +631,21 @@ namespace Diluculum
 
 
 
+   // - LuaValue::copyTableAtData ----------------------------------------------
+   void LuaValue::copyTableAtData (const LuaValue& other)
+   {
+      const TableData& otherTD =
+         *reinterpret_cast<const TableData*>(other.data_);
+      TableData* td = new(data_) TableData();
+
+      if (otherTD.unshareable)
+         td->table.reset (new LuaValueMap (*otherTD.table));
+      else
+         td->table = otherTD.table;
+   }
+
+
+
    // - LuaValue::destroyObjectAtData ------------------------------------------
    void LuaValue::destroyObjectAtData()
    {
@@ -602,7 +656,7 @@ namespace Diluculum
             break;
 
          case LUA_TTABLE:
-            reinterpret_cast<LuaValueMap*>(data_)->~LuaValueMap();
+            reinterpret_cast<TableData*>(data_)->~TableData();
             break;
 
          case LUA_TUSERDATA:
@@ -35,6 +35,178 @@
 
 namespace Diluculum
 {
+   namespace
+   {
+      /** The address of this variable is used as the key under which the
+       *  bindings version counter is stored in the Lua registry.
+       */
+      char BindingsVersionKey;
+
+      /** Returns a pointer to the bindings version counter of \c ls, creating
+       *  it if necessary. The counter is a userdata anchored in the registry,
+       *  so the returned pointer is valid as long as \c ls is open.
+       */
+      unsigned long* GetBindingsVersion (lua_State* ls)
+      {
+         lua_pushlightuserdata (ls, &BindingsVersionKey);
+         lua_rawget (ls, LUA_REGISTRYINDEX);
+         void* counter = lua_touserdata (ls, -1);
+         lua_pop (ls, 1);
+
+         if (counter == 0)
+         {
+            counter = lua_newuserdata (ls, sizeof(unsigned long));
+            *static_cast<unsigned long*>(counter) = 0;
+            lua_pushlightuserdata (ls, &BindingsVersionKey);
+            lua_insert (ls, -2);
+            lua_rawset (ls, LUA_REGISTRYINDEX);
+         }
+
+         return static_cast<unsigned long*>(counter);
+      }
+
+
+
+      /** Pushes a key onto the stack of \c ls and assigns \c value to it in
+       *  the table at \c absIndex (which must be an absolute index).
+       */
+      void SetTableEntry (lua_State* ls, int absIndex, const LuaValue& key,
+                          const LuaValue& value)
+      {
+         PushLuaValue (ls, key);
+         PushLuaValue (ls, value);
+         lua_settable (ls, absIndex);
+      }
+
+
+
+      /** Changes the table at \c absIndex (which must be an absolute index),
+       *  whose contents are assumed to be \c oldTable, so that its contents
+       *  become \c newTable. Only the entries that differ are written. Nested
+       *  tables present in both \c oldTable and \c newTable are patched
+       *  recursively, so that their identity is preserved, too.
+       *  <p>Both maps are sorted by key, so the difference is computed with a
+       *  single merge-like pass over them.
+       */
+      void ApplyTableDiff (lua_State* ls, int absIndex,
+                           const LuaValueMap& oldTable,
+                           const LuaValueMap& newTable)
+      {
+         if (!lua_checkstack (ls, 3))
+            throw LuaError ("Cannot grow Lua stack to apply table diff.");
+
+         typedef LuaValueMap::const_iterator iter_t;
+         iter_t pOld = oldTable.begin();
+         iter_t pNew = newTable.begin();
+
+         while (pOld != oldTable.end() || pNew != newTable.end())
+         {
+            if (pNew == newTable.end()
+                || (pOld != oldTable.end() && pOld->first < pNew->first))
+            {
+               // Removed entry
+               if (pOld->first != Nil)
+                  SetTableEntry (ls, absIndex, pOld->first, Nil);
+               ++pOld;
+            }
+            else if (pOld == oldTable.end() || pNew->first < pOld->first)
+            {
+               // Added entry
+               if (pNew->first != Nil)
+                  SetTableEntry (ls, absIndex, pNew->first, pNew->second);
+               ++pNew;
+            }
+            else
+            {
+               // Entry present in both; write it only if it changed. Nested
+               // tables are diffed right away (comparing them first would
+               // walk them twice), unless they are the very same table.
+               const bool bothTables = pOld->second.type() == LUA_TTABLE
+                  && pNew->second.type() == LUA_TTABLE;
+
+               if (pNew->first != Nil && bothTables)
+               {
+                  const LuaValueMap& oldSub = pOld->second.asConstTable();
+                  const LuaValueMap& newSub = pNew->second.asConstTable();
+                  if (&oldSub != &newSub)
+                  {
+                     PushLuaValue (ls, pNew->first);
+                     lua_gettable (ls, absIndex);
+                     if (lua_istable (ls, -1))
+                     {
+                        ApplyTableDiff (ls, lua_gettop (ls), oldSub, newSub);
+                        lua_pop (ls, 1);
+                     }
+                     else
+                     {
+                        lua_pop (ls, 1);
+                        SetTableEntry (ls, absIndex, pNew->first,
+                                       pNew->second);
+                     }
+                  }
+               }
+               else if (pNew->first != Nil && pOld->second != pNew->second)
+               {
+                  SetTableEntry (ls, absIndex, pNew->first, pNew->second);
+               }
+               ++pOld;
+               ++pNew;
+            }
+         }
+      }
+   }
+
+
+
+   // - LuaVariable::Binding ---------------------------------------------------
+   class LuaVariable::Binding
+   {
+      public:
+         /** Creates a binding to the table on the top of the stack of \c ls
+          *  (which is popped), for the variable stored there with key \c key.
+          */
+         Binding (lua_State* ls, const LuaValue& key)
+            : state(ls), currentVersion(GetBindingsVersion (ls)),
+              version(*currentVersion)
+         {
+            tableRef = luaL_ref (state, LUA_REGISTRYINDEX);
+            PushLuaValue (state, key);
+            keyRef = luaL_ref (state, LUA_REGISTRYINDEX);
+         }
+
+         /// Releases the references held in the registry.
+         ~Binding()
+         {
+            luaL_unref (state, LUA_REGISTRYINDEX, tableRef);
+            luaL_unref (state, LUA_REGISTRYINDEX, keyRef);
+         }
+
+         /// Was this binding invalidated by \c InvalidateBindings()?
+         bool isStale() const { return version != *currentVersion; }
+
+         /// The Lua state where the references are held.
+         lua_State* state;
+
+         /// The bindings version counter of \c state.
+         const unsigned long* currentVersion;
+
+         /// The value of \c *currentVersion when the table was last resolved.
+         unsigned long version;
+
+         /// Reference to the table storing the variable.
+         int tableRef;
+
+         /// Reference to the variable's key in that table.
+         int keyRef;
+
+      private:
+         // Non-copyable
+         Binding (const Binding&);
+         Binding& operator= (const Binding&);
+   };
+
+
+
    // - LuaVariable::LuaVariable -----------------------------------------------
    LuaVariable::LuaVariable (lua_State* state, const LuaValue& key,
                              const KeyList& predKeys)
@@ -49,7 +221,7 @@ namespace Diluculum
    const LuaValue& LuaVariable::operator= (const LuaValue& rhs)
    {
       pushLastTable();
-      PushLuaValue (state_, keys_.back());
+      pushKey();
       PushLuaValue (state_, rhs);
       lua_settable (state_, -3);
       lua_pop (state_, 1);
@@ -70,6 +242,17 @@ namespace Diluculum
 
 
 
+   // - LuaVariable::type ------------------------------------------------------
+   int LuaVariable::type() const
+   {
+      pushTheReferencedValue();
+      const int ret = lua_type (state_, -1);
+      lua_pop (state_, 1);
+      return ret;
+   }
+
+
+
    // - LuaVariable::operator[] ------------------------------------------------
    LuaVariable LuaVariable::operator[] (const LuaValue& key) const
    {
@@ -93,6 +276,7 @@ namespace Diluculum
    LuaValueList LuaVariable::operator() (const LuaValue& param)
    {
       LuaValueList params;
+      params.reserve (1);
       params.push_back (param);
       return (*this)(params);
    }
@@ -101,6 +285,7 @@ namespace Diluculum
                                          const LuaValue& param2)
    {
       LuaValueList params;
+      params.reserve (2);
       params.push_back (param1);
       params.push_back (param2);
       return (*this)(params);
@@ -111,6 +296,7 @@ namespace Diluculum
                                          const LuaValue& param3)
    {
       LuaValueList params;
+      params.reserve (3);
       params.push_back (param1);
       params.push_back (param2);
       params.push_back (param3);
@@ -123,6 +309,7 @@ namespace Diluculum
                                          const LuaValue& param4)
    {
       LuaValueList params;
+      params.reserve (4);
       params.push_back (param1);
       params.push_back (param2);
       params.push_back (param3);
@@ -137,6 +324,7 @@ namespace Diluculum
                                          const LuaValue& param5)
    {
       LuaValueList params;
+      params.reserve (5);
       params.push_back (param1);
       params.push_back (param2);
       params.push_back (param3);
@@ -147,12 +335,154 @@ namespace Diluculum
 
 
 
+   // - LuaVariable::getFields -------------------------------------------------
+   void LuaVariable::getFields (const char* const* names, size_t numNames,
+                                LuaValueList& values) const
+   {
+      pushTheReferencedTable();
+      Impl::StackTopRestorer restorer (state_, lua_gettop (state_) - 1);
+
+      values.resize (numNames);
+
+      for (size_t i = 0; i < numNames; ++i)
+      {
+         lua_getfield (state_, -1, names[i]);
+         values[i] = ToLuaValue (state_, -1);
+         lua_pop (state_, 1);
+      }
+   }
+
+
+   void LuaVariable::getFields (const std::vector<std::string>& names,
+                                LuaValueList& values) const
+   {
+      pushTheReferencedTable();
+      Impl::StackTopRestorer restorer (state_, lua_gettop (state_) - 1);
+
+      values.resize (names.size());
+
+      for (size_t i = 0; i < names.size(); ++i)
+      {
+         lua_pushlstring (state_, names[i].c_str(), names[i].length());
+         lua_gettable (state_, -2);
+         values[i] = ToLuaValue (state_, -1);
+         lua_pop (state_, 1);
+      }
+   }
+
+
+
+   // - LuaVariable::setFields -------------------------------------------------
+   void LuaVariable::setFields (const LuaValueMap& fields)
+   {
+      pushTheReferencedTable();
+      Impl::StackTopRestorer restorer (state_, lua_gettop (state_) - 1);
+
+      typedef LuaValueMap::const_iterator iter_t;
+      for (iter_t p = fields.begin(); p != fields.end(); ++p)
+      {
+         const LuaValue& key = p->first;
+
+         if (key.type() == LUA_TSTRING
+             && key.asString().find ('\0') == std::string::npos)
+         {
+            PushLuaValue (state_, p->second);
+            lua_setfield (state_, -2, key.asString().c_str());
+         }
+         else if (key != Nil) // Ignore 'Nil'-indexed entries
+         {
+            PushLuaValue (state_, key);
+            PushLuaValue (state_, p->second);
+            lua_settable (state_, -3);
+         }
+      }
+   }
+
+
+
+   // - LuaVariable::applyDiff -------------------------------------------------
+   void LuaVariable::applyDiff (const LuaValueMap& oldValue,
+                                const LuaValueMap& newValue)
+   {
+      pushTheReferencedTable();
+      Impl::StackTopRestorer restorer (state_, lua_gettop (state_) - 1);
+      ApplyTableDiff (state_, lua_gettop (state_), oldValue, newValue);
+   }
+
+
+
+   // - LuaVariable::pushTheReferencedTable ------------------------------------
+   void LuaVariable::pushTheReferencedTable() const
+   {
+      pushTheReferencedValue();
+
+      if (!lua_istable (state_, -1))
+      {
+         const std::string typeName = luaL_typename (state_, -1);
+         lua_pop (state_, 1);
+         throw TypeMismatchError ("table", typeName);
+      }
+   }
+
+
+
+   // - LuaVariable::pushFunctionForCall ---------------------------------------
+   void LuaVariable::pushFunctionForCall() const
+   {
+      pushTheReferencedValue();
+
+      if (lua_type (state_, -1) != LUA_TFUNCTION)
+      {
+         const std::string typeName = luaL_typename (state_, -1);
+         lua_pop (state_, 1);
+         throw TypeMismatchError ("function", typeName);
+      }
+   }
+
+
+
+   // - LuaVariable::doCall ----------------------------------------------------
+   void LuaVariable::doCall (int numParams, int numResults) const
+   {
+      Impl::ThrowOnLuaError (state_,
+                             lua_pcall (state_, numParams, numResults, 0));
+   }
+
+
+
    // - LuaVariable::pushLastTable ---------------------------------------------
    void LuaVariable::pushLastTable()
+   {
+      if (binding_)
+         pushBoundTable();
+      else
+         pushLastTableFromKeys();
+   }
+
+
+
+   // - LuaVariable::bind ------------------------------------------------------
+   void LuaVariable::bind()
+   {
+      pushLastTableFromKeys();
+      binding_.reset (new Binding (state_, keys_.back()));
+   }
+
+
+
+   // - InvalidateBindings -----------------------------------------------------
+   void InvalidateBindings (lua_State* state)
+   {
+      ++*GetBindingsVersion (state);
+   }
+
+
+
+   // - LuaVariable::pushLastTableFromKeys -------------------------------------
+   void LuaVariable::pushLastTableFromKeys() const
    {
       // Push the globals table onto the stack
-      lua_pushstring (state_, "_G");
-      lua_gettable (state_, LUA_GLOBALSINDEX);
+      lua_pushvalue (state_, LUA_GLOBALSINDEX);
 
       // Reach the "final" table (and leave it at the stack top)
       typedef KeyList::const_iterator iter_t;
@@ -167,18 +497,63 @@ namespace Diluculum
          PushLuaValue (state_, *p);
          lua_gettable (state_, -2);
          if (!lua_istable (state_, -1))
-            throw TypeMismatchError ("table", luaL_typename (state_, -1));
+         {
+            // Type names are static strings, still valid after popping
+            const char* foundType = luaL_typename (state_, -1);
+            lua_pop (state_, 2);
+            throw TypeMismatchError ("table", foundType);
+         }
          lua_remove (state_, -2);
       }
    }
 
 
 
+   // - LuaVariable::pushBoundTable --------------------------------------------
+   void LuaVariable::pushBoundTable() const
+   {
+      assert (binding_ && "The variable should be bound here.");
+
+      if (binding_->isStale())
+      {
+         pushLastTableFromKeys();
+         lua_pushvalue (state_, -1);
+         lua_rawseti (state_, LUA_REGISTRYINDEX, binding_->tableRef);
+         binding_->version = *binding_->currentVersion;
+      }
+      else
+      {
+         lua_rawgeti (state_, LUA_REGISTRYINDEX, binding_->tableRef);
+      }
+   }
+
+
+
+   // - LuaVariable::pushKey ---------------------------------------------------
+   void LuaVariable::pushKey() const
+   {
+      if (binding_)
+         lua_rawgeti (state_, LUA_REGISTRYINDEX, binding_->keyRef);
+      else
+         PushLuaValue (state_, keys_.back());
+   }
+
+
+
    // - LuaVariable::pushTheReferencedValue ------------------------------------
    void LuaVariable::pushTheReferencedValue() const
    {
       assert (keys_.size() > 0 && "There should be at least one key here.");
 
+      if (binding_)
+      {
+         pushBoundTable();
+         pushKey();
+         lua_gettable (state_, -2);
+         lua_remove (state_, -2);
+         return;
+      }
+
       int index = LUA_GLOBALSINDEX;
 
       typedef std::vector<LuaValue>::const_iterator iter_t;
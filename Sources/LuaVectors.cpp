@@ -0,0 +1,701 @@
+/******************************************************************************\
+* LuaVectors.cpp                                                               *
+* Small vectors and matrices, efficiently usable from Lua.                     *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#include <cmath>
+#include <sstream>
+#include <Diluculum/LuaVectors.hpp>
+#include <Diluculum/LuaWrappers.hpp>
+
+
+namespace Diluculum
+{
+   namespace
+   {
+      // The kernels below work on four lanes at a time. They are plain loops
+      // of fixed length over contiguous data, so that the compiler can turn
+      // each of them into a couple of SIMD instructions (SSE2, AVX or
+      // whatever is enabled when compiling), without sacrificing
+      // portability.
+
+      inline void AddLanes (const double* a, const double* b, double* r)
+      {
+         for (int i = 0; i < 4; ++i)
+            r[i] = a[i] + b[i];
+      }
+
+      inline void SubtractLanes (const double* a, const double* b, double* r)
+      {
+         for (int i = 0; i < 4; ++i)
+            r[i] = a[i] - b[i];
+      }
+
+      inline void MultiplyLanes (const double* a, const double* b, double* r)
+      {
+         for (int i = 0; i < 4; ++i)
+            r[i] = a[i] * b[i];
+      }
+
+      inline void ScaleLanes (const double* a, double s, double* r)
+      {
+         for (int i = 0; i < 4; ++i)
+            r[i] = a[i] * s;
+      }
+
+      inline void DivideLanes (const double* a, double s, double* r)
+      {
+         for (int i = 0; i < 4; ++i)
+            r[i] = a[i] / s;
+      }
+
+      inline double DotLanes (const double* a, const double* b)
+      {
+         double p[4];
+         MultiplyLanes (a, b, p);
+         return (p[0] + p[1]) + (p[2] + p[3]);
+      }
+
+      inline bool EqualLanes (const double* a, const double* b)
+      {
+         bool equal = true;
+         for (int i = 0; i < 4; ++i)
+            equal &= (a[i] == b[i]);
+         return equal;
+      }
+
+      /** Computes <tt>r = m * v</tt>, where \c m is a 4x4 matrix in
+       *  column-major order. \c r must not overlap \c v.
+       */
+      inline void TransformLanes (const double* m, const double* v, double* r)
+      {
+         ScaleLanes (m, v[0], r);
+         for (int c = 1; c < 4; ++c)
+         {
+            double col[4];
+            ScaleLanes (m + 4*c, v[c], col);
+            AddLanes (r, col, r);
+         }
+      }
+
+      /** Reads the components of a vector from the parameters passed to its
+       *  constructor in Lua.
+       *  @param params The parameters: either none (for a zero vector) or
+       *         exactly \c n numbers.
+       *  @param v The components read are stored here. Must have room for
+       *         four of them; lanes after the <tt>n</tt>th are zeroed.
+       *  @param n The number of components.
+       *  @param className Used in error messages.
+       *  @throw LuaError If \c params is not as expected.
+       */
+      void ReadComponents (const LuaValueList& params, double* v,
+                           LuaValueList::size_type n, const char* className)
+      {
+         for (int i = 0; i < 4; ++i)
+            v[i] = 0.0;
+
+         if (params.empty())
+            return;
+
+         bool ok = params.size() == n;
+         for (LuaValueList::size_type i = 0; ok && i < n; ++i)
+         {
+            if (params[i].type() == LUA_TNUMBER)
+               v[i] = params[i].asNumber();
+            else
+               ok = false;
+         }
+
+         if (!ok)
+         {
+            std::ostringstream msg;
+            msg << "Bad parameters to '" << className
+                << ".new': expected no parameters or " << n << " numbers.";
+            throw LuaError (msg.str().c_str());
+         }
+      }
+
+      /// Writes \c n numbers to a string, as done by \c tostring() in Lua.
+      std::string FormatComponents (const char* className, const double* v,
+                                    int n)
+      {
+         std::ostringstream out;
+         out.precision (14);
+         out << className << '(';
+         for (int i = 0; i < n; ++i)
+            out << (i > 0 ? ", " : "") << v[i];
+         out << ')';
+         return out.str();
+      }
+   }
+
+
+
+   // - Vec3::Vec3 -------------------------------------------------------------
+   Vec3::Vec3()
+   {
+      for (int i = 0; i < 4; ++i)
+         v_[i] = 0.0;
+   }
+
+   Vec3::Vec3 (double x, double y, double z)
+   {
+      v_[0] = x;
+      v_[1] = y;
+      v_[2] = z;
+      v_[3] = 0.0;
+   }
+
+   Vec3::Vec3 (const LuaValueList& params)
+   {
+      ReadComponents (params, v_, 3, "Vec3");
+   }
+
+
+
+   // - Vec3::dot --------------------------------------------------------------
+   double Vec3::dot (const Vec3& other) const
+   {
+      return DotLanes (v_, other.v_);
+   }
+
+
+
+   // - Vec3::cross ------------------------------------------------------------
+   Vec3 Vec3::cross (const Vec3& other) const
+   {
+      return Vec3 (v_[1] * other.v_[2] - v_[2] * other.v_[1],
+                   v_[2] * other.v_[0] - v_[0] * other.v_[2],
+                   v_[0] * other.v_[1] - v_[1] * other.v_[0]);
+   }
+
+
+
+   // - Vec3::length -----------------------------------------------------------
+   double Vec3::length() const
+   {
+      return std::sqrt (dot (*this));
+   }
+
+
+
+   // - Vec3::normalized -------------------------------------------------------
+   Vec3 Vec3::normalized() const
+   {
+      const double len = length();
+      if (len == 0.0)
+         throw LuaError ("Cannot normalize a zero vector.");
+      return *this / len;
+   }
+
+
+
+   // - Vec3 operators ---------------------------------------------------------
+   // The padding lane must stay zero, so it is reset after the operations
+   // that could disturb it (like multiplying by infinity).
+   Vec3 Vec3::operator+ (const Vec3& rhs) const
+   {
+      Vec3 r;
+      AddLanes (v_, rhs.v_, r.v_);
+      return r;
+   }
+
+   Vec3 Vec3::operator- (const Vec3& rhs) const
+   {
+      Vec3 r;
+      SubtractLanes (v_, rhs.v_, r.v_);
+      return r;
+   }
+
+   Vec3 Vec3::operator-() const
+   {
+      Vec3 r;
+      SubtractLanes (r.v_, v_, r.v_);
+      return r;
+   }
+
+   Vec3 Vec3::operator* (const Vec3& rhs) const
+   {
+      Vec3 r;
+      MultiplyLanes (v_, rhs.v_, r.v_);
+      return r;
+   }
+
+   Vec3 Vec3::operator* (double rhs) const
+   {
+      Vec3 r;
+      ScaleLanes (v_, rhs, r.v_);
+      r.v_[3] = 0.0;
+      return r;
+   }
+
+   Vec3 Vec3::operator/ (double rhs) const
+   {
+      Vec3 r;
+      DivideLanes (v_, rhs, r.v_);
+      r.v_[3] = 0.0;
+      return r;
+   }
+
+   bool Vec3::operator== (const Vec3& rhs) const
+   {
+      return EqualLanes (v_, rhs.v_);
+   }
+
+
+
+   // - Vec3::toString ---------------------------------------------------------
+   std::string Vec3::toString() const
+   {
+      return FormatComponents ("Vec3", v_, 3);
+   }
+
+
+
+   // - Vec4::Vec4 -------------------------------------------------------------
+   Vec4::Vec4()
+   {
+      for (int i = 0; i < 4; ++i)
+         v_[i] = 0.0;
+   }
+
+   Vec4::Vec4 (double x, double y, double z, double w)
+   {
+      v_[0] = x;
+      v_[1] = y;
+      v_[2] = z;
+      v_[3] = w;
+   }
+
+   Vec4::Vec4 (const LuaValueList& params)
+   {
+      ReadComponents (params, v_, 4, "Vec4");
+   }
+
+
+
+   // - Vec4::dot --------------------------------------------------------------
+   double Vec4::dot (const Vec4& other) const
+   {
+      return DotLanes (v_, other.v_);
+   }
+
+
+
+   // - Vec4::length -----------------------------------------------------------
+   double Vec4::length() const
+   {
+      return std::sqrt (dot (*this));
+   }
+
+
+
+   // - Vec4::normalized -------------------------------------------------------
+   Vec4 Vec4::normalized() const
+   {
+      const double len = length();
+      if (len == 0.0)
+         throw LuaError ("Cannot normalize a zero vector.");
+      return *this / len;
+   }
+
+
+
+   // - Vec4 operators ---------------------------------------------------------
+   Vec4 Vec4::operator+ (const Vec4& rhs) const
+   {
+      Vec4 r;
+      AddLanes (v_, rhs.v_, r.v_);
+      return r;
+   }
+
+   Vec4 Vec4::operator- (const Vec4& rhs) const
+   {
+      Vec4 r;
+      SubtractLanes (v_, rhs.v_, r.v_);
+      return r;
+   }
+
+   Vec4 Vec4::operator-() const
+   {
+      Vec4 r;
+      SubtractLanes (r.v_, v_, r.v_);
+      return r;
+   }
+
+   Vec4 Vec4::operator* (const Vec4& rhs) const
+   {
+      Vec4 r;
+      MultiplyLanes (v_, rhs.v_, r.v_);
+      return r;
+   }
+
+   Vec4 Vec4::operator* (double rhs) const
+   {
+      Vec4 r;
+      ScaleLanes (v_, rhs, r.v_);
+      return r;
+   }
+
+   Vec4 Vec4::operator/ (double rhs) const
+   {
+      Vec4 r;
+      DivideLanes (v_, rhs, r.v_);
+      return r;
+   }
+
+   bool Vec4::operator== (const Vec4& rhs) const
+   {
+      return EqualLanes (v_, rhs.v_);
+   }
+
+
+
+   // - Vec4::toString ---------------------------------------------------------
+   std::string Vec4::toString() const
+   {
+      return FormatComponents ("Vec4", v_, 4);
+   }
+
+
+
+   // - Mat4::Mat4 -------------------------------------------------------------
+   Mat4::Mat4()
+   {
+      for (int i = 0; i < 16; ++i)
+         m_[i] = (i % 5 == 0) ? 1.0 : 0.0;
+   }
+
+   Mat4::Mat4 (const LuaValueList& params)
+   {
+      if (params.empty())
+      {
+         *this = Mat4();
+         return;
+      }
+
+      if (params.size() != 16)
+      {
+         throw LuaError ("Bad parameters to 'Mat4.new': expected no "
+                         "parameters or 16 numbers.");
+      }
+
+      for (int row = 0; row < 4; ++row)
+      {
+         for (int col = 0; col < 4; ++col)
+         {
+            const LuaValue& value = params[row * 4 + col];
+            if (value.type() != LUA_TNUMBER)
+            {
+               throw LuaError ("Bad parameters to 'Mat4.new': expected no "
+                               "parameters or 16 numbers.");
+            }
+            m_[col * 4 + row] = value.asNumber();
+         }
+      }
+   }
+
+
+
+   // - Mat4::offset -----------------------------------------------------------
+   int Mat4::offset (int row, int col)
+   {
+      if (row < 1 || row > 4 || col < 1 || col > 4)
+         throw LuaError ("Matrix indices must be between 1 and 4.");
+
+      return (col - 1) * 4 + (row - 1);
+   }
+
+
+
+   // - Mat4::get --------------------------------------------------------------
+   double Mat4::get (int row, int col) const
+   {
+      return m_[offset (row, col)];
+   }
+
+
+
+   // - Mat4::set --------------------------------------------------------------
+   void Mat4::set (int row, int col, double value)
+   {
+      m_[offset (row, col)] = value;
+   }
+
+
+
+   // - Mat4::transposed -------------------------------------------------------
+   Mat4 Mat4::transposed() const
+   {
+      Mat4 r;
+      for (int row = 0; row < 4; ++row)
+         for (int col = 0; col < 4; ++col)
+            r.m_[col * 4 + row] = m_[row * 4 + col];
+      return r;
+   }
+
+
+
+   // - Mat4 operators ---------------------------------------------------------
+   Mat4 Mat4::operator* (const Mat4& rhs) const
+   {
+      Mat4 r;
+      for (int col = 0; col < 4; ++col)
+         TransformLanes (m_, rhs.m_ + 4*col, r.m_ + 4*col);
+      return r;
+   }
+
+   Vec4 Mat4::operator* (const Vec4& rhs) const
+   {
+      Vec4 r;
+      TransformLanes (m_, rhs.v_, r.v_);
+      return r;
+   }
+
+   Vec3 Mat4::operator* (const Vec3& rhs) const
+   {
+      double point[4] = { rhs.v_[0], rhs.v_[1], rhs.v_[2], 1.0 };
+      Vec3 r;
+      TransformLanes (m_, point, r.v_);
+      r.v_[3] = 0.0;
+      return r;
+   }
+
+   Mat4 Mat4::operator* (double rhs) const
+   {
+      Mat4 r;
+      for (int col = 0; col < 4; ++col)
+         ScaleLanes (m_ + 4*col, rhs, r.m_ + 4*col);
+      return r;
+   }
+
+   Mat4 Mat4::operator+ (const Mat4& rhs) const
+   {
+      Mat4 r;
+      for (int col = 0; col < 4; ++col)
+         AddLanes (m_ + 4*col, rhs.m_ + 4*col, r.m_ + 4*col);
+      return r;
+   }
+
+   bool Mat4::operator== (const Mat4& rhs) const
+   {
+      bool equal = true;
+      for (int col = 0; col < 4; ++col)
+         equal &= EqualLanes (m_ + 4*col, rhs.m_ + 4*col);
+      return equal;
+   }
+
+
+
+   // - Mat4::toString ---------------------------------------------------------
+   std::string Mat4::toString() const
+   {
+      const Mat4 rows = transposed();
+      std::ostringstream out;
+      out << "Mat4(";
+      for (int row = 0; row < 4; ++row)
+      {
+         out << (row > 0 ? ", " : "")
+             << FormatComponents ("", rows.m_ + 4*row, 4);
+      }
+      out << ')';
+      return out.str();
+   }
+
+
+
+   // - The metamethods --------------------------------------------------------
+   namespace
+   {
+      template <class T>
+      T Add (const T& a, const T& b)
+      {
+         return a + b;
+      }
+
+      template <class T>
+      T Subtract (const T& a, const T& b)
+      {
+         return a - b;
+      }
+
+      template <class T>
+      T Negate (const T& a, const T&)
+      {
+         return -a;
+      }
+
+      template <class T>
+      T Divide (const T& a, double b)
+      {
+         return a / b;
+      }
+
+      template <class T>
+      bool AreEqual (const T& a, const T& b)
+      {
+         return a == b;
+      }
+
+      template <class T>
+      std::string ToString (const T& a)
+      {
+         return a.toString();
+      }
+
+      /** Implements \c __mul for vectors, which accepts a vector and a
+       *  number in any order, or two vectors (multiplied component-wise).
+       */
+      template <class T>
+      int MultiplyVectors (lua_State* ls)
+      {
+         if (lua_type (ls, 1) == LUA_TNUMBER)
+         {
+            LuaTypeTraits<T>::push(
+               ls, LuaTypeTraits<T>::get (ls, 2) * lua_tonumber (ls, 1));
+         }
+         else if (lua_type (ls, 2) == LUA_TNUMBER)
+         {
+            LuaTypeTraits<T>::push(
+               ls, LuaTypeTraits<T>::get (ls, 1) * lua_tonumber (ls, 2));
+         }
+         else
+         {
+            LuaTypeTraits<T>::push(
+               ls, LuaTypeTraits<T>::get (ls, 1)
+                      * LuaTypeTraits<T>::get (ls, 2));
+         }
+
+         return 1;
+      }
+
+      int MultiplyVec3 (lua_State* ls)
+      {
+         return MultiplyVectors<Vec3> (ls);
+      }
+
+      int MultiplyVec4 (lua_State* ls)
+      {
+         return MultiplyVectors<Vec4> (ls);
+      }
+
+      /** Implements \c __mul for matrices. The left operand can be a matrix
+       *  or a number, and the right one a matrix, a vector or a number.
+       */
+      int MultiplyMat4 (lua_State* ls)
+      {
+         if (lua_type (ls, 1) == LUA_TNUMBER)
+         {
+            LuaTypeTraits<Mat4>::push(
+               ls, LuaTypeTraits<Mat4>::get (ls, 2) * lua_tonumber (ls, 1));
+            return 1;
+         }
+
+         const Mat4& m = LuaTypeTraits<Mat4>::get (ls, 1);
+
+         if (lua_type (ls, 2) == LUA_TNUMBER)
+         {
+            LuaTypeTraits<Mat4>::push (ls, m * lua_tonumber (ls, 2));
+         }
+         else if (LuaTypeTraits<Vec4>::is (ls, 2))
+         {
+            LuaTypeTraits<Vec4>::push(
+               ls, m * LuaTypeTraits<Vec4>::get (ls, 2));
+         }
+         else if (LuaTypeTraits<Vec3>::is (ls, 2))
+         {
+            LuaTypeTraits<Vec3>::push(
+               ls, m * LuaTypeTraits<Vec3>::get (ls, 2));
+         }
+         else
+         {
+            LuaTypeTraits<Mat4>::push(
+               ls, m * LuaTypeTraits<Mat4>::get (ls, 2));
+         }
+
+         return 1;
+      }
+   }
+
+
+
+   // - The exported classes ---------------------------------------------------
+   DILUCULUM_BEGIN_CLASS_INLINE (Vec3);
+      DILUCULUM_CLASS_PROPERTY (Vec3, x, x, setX);
+      DILUCULUM_CLASS_PROPERTY (Vec3, y, y, setY);
+      DILUCULUM_CLASS_PROPERTY (Vec3, z, z, setZ);
+      DILUCULUM_CLASS_BIND_METHOD (Vec3, dot);
+      DILUCULUM_CLASS_BIND_METHOD (Vec3, cross);
+      DILUCULUM_CLASS_BIND_METHOD (Vec3, length);
+      DILUCULUM_CLASS_BIND_METHOD (Vec3, normalized);
+      DILUCULUM_CLASS_METAMETHOD (Vec3, __add, Add<Vec3>);
+      DILUCULUM_CLASS_METAMETHOD (Vec3, __sub, Subtract<Vec3>);
+      DILUCULUM_CLASS_METAMETHOD (Vec3, __unm, Negate<Vec3>);
+      DILUCULUM_CLASS_METAMETHOD (Vec3, __mul, MultiplyVec3);
+      DILUCULUM_CLASS_METAMETHOD (Vec3, __div, Divide<Vec3>);
+      DILUCULUM_CLASS_METAMETHOD (Vec3, __eq, AreEqual<Vec3>);
+      DILUCULUM_CLASS_METAMETHOD (Vec3, __tostring, ToString<Vec3>);
+   DILUCULUM_END_CLASS (Vec3);
+
+   DILUCULUM_BEGIN_CLASS_INLINE (Vec4);
+      DILUCULUM_CLASS_PROPERTY (Vec4, x, x, setX);
+      DILUCULUM_CLASS_PROPERTY (Vec4, y, y, setY);
+      DILUCULUM_CLASS_PROPERTY (Vec4, z, z, setZ);
+      DILUCULUM_CLASS_PROPERTY (Vec4, w, w, setW);
+      DILUCULUM_CLASS_BIND_METHOD (Vec4, dot);
+      DILUCULUM_CLASS_BIND_METHOD (Vec4, length);
+      DILUCULUM_CLASS_BIND_METHOD (Vec4, normalized);
+      DILUCULUM_CLASS_METAMETHOD (Vec4, __add, Add<Vec4>);
+      DILUCULUM_CLASS_METAMETHOD (Vec4, __sub, Subtract<Vec4>);
+      DILUCULUM_CLASS_METAMETHOD (Vec4, __unm, Negate<Vec4>);
+      DILUCULUM_CLASS_METAMETHOD (Vec4, __mul, MultiplyVec4);
+      DILUCULUM_CLASS_METAMETHOD (Vec4, __div, Divide<Vec4>);
+      DILUCULUM_CLASS_METAMETHOD (Vec4, __eq, AreEqual<Vec4>);
+      DILUCULUM_CLASS_METAMETHOD (Vec4, __tostring, ToString<Vec4>);
+   DILUCULUM_END_CLASS (Vec4);
+
+   DILUCULUM_BEGIN_CLASS_INLINE (Mat4);
+      DILUCULUM_CLASS_BIND_METHOD (Mat4, get);
+      DILUCULUM_CLASS_BIND_METHOD (Mat4, set);
+      DILUCULUM_CLASS_BIND_METHOD (Mat4, transposed);
+      DILUCULUM_CLASS_METAMETHOD (Mat4, __add, Add<Mat4>);
+      DILUCULUM_CLASS_METAMETHOD (Mat4, __mul, MultiplyMat4);
+      DILUCULUM_CLASS_METAMETHOD (Mat4, __eq, AreEqual<Mat4>);
+      DILUCULUM_CLASS_METAMETHOD (Mat4, __tostring, ToString<Mat4>);
+   DILUCULUM_END_CLASS (Mat4);
+
+
+
+   // - RegisterVectorClasses --------------------------------------------------
+   void RegisterVectorClasses (LuaVariable table)
+   {
+      if (table.type() != LUA_TTABLE)
+         table = EmptyLuaValueMap;
+
+      DILUCULUM_REGISTER_CLASS (table["Vec3"], Vec3);
+      DILUCULUM_REGISTER_CLASS (table["Vec4"], Vec4);
+      DILUCULUM_REGISTER_CLASS (table["Mat4"], Mat4);
+   }
+
+} // namespace Diluculum
@@ -0,0 +1,166 @@
+/******************************************************************************\
+* LuaView.cpp                                                                  *
+* A lightweight view of a value on the Lua stack.                              *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#include <cstring>
+#include <Diluculum/LuaUtils.hpp>
+#include <Diluculum/LuaView.hpp>
+
+
+namespace Diluculum
+{
+   // - LuaView::LuaView -------------------------------------------------------
+   LuaView::LuaView (lua_State* state, int index)
+      : state_(state), index_(index)
+   {
+      // Pseudo-indices (like 'LUA_REGISTRYINDEX') are left alone
+      if (index_ < 0 && index_ > LUA_REGISTRYINDEX)
+         index_ = lua_gettop (state_) + index_ + 1;
+   }
+
+
+
+   // - LuaView::asNumber ------------------------------------------------------
+   lua_Number LuaView::asNumber() const
+   {
+      if (type() != LUA_TNUMBER)
+         throw TypeMismatchError ("number", typeName());
+
+      return lua_tonumber (state_, index_);
+   }
+
+
+
+   // - LuaView::asInteger -----------------------------------------------------
+   lua_Integer LuaView::asInteger() const
+   {
+      if (type() != LUA_TNUMBER)
+         throw TypeMismatchError ("number", typeName());
+
+      return lua_tointeger (state_, index_);
+   }
+
+
+
+   // - LuaView::asString ------------------------------------------------------
+   std::string LuaView::asString() const
+   {
+      if (type() != LUA_TSTRING)
+         throw TypeMismatchError ("string", typeName());
+
+      size_t len;
+      const char* str = lua_tolstring (state_, index_, &len);
+      return std::string (str, len);
+   }
+
+
+
+   // - LuaView::asBoolean -----------------------------------------------------
+   bool LuaView::asBoolean() const
+   {
+      if (type() != LUA_TBOOLEAN)
+         throw TypeMismatchError ("boolean", typeName());
+
+      return lua_toboolean (state_, index_) != 0;
+   }
+
+
+
+   // - LuaView::asStringData --------------------------------------------------
+   const char* LuaView::asStringData() const
+   {
+      if (type() != LUA_TSTRING)
+         throw TypeMismatchError ("string", typeName());
+
+      return lua_tostring (state_, index_);
+   }
+
+
+
+   // - LuaView::asUserDataPointer ---------------------------------------------
+   void* LuaView::asUserDataPointer() const
+   {
+      if (type() != LUA_TUSERDATA)
+         throw TypeMismatchError ("userdata", typeName());
+
+      return lua_touserdata (state_, index_);
+   }
+
+
+
+   // - LuaView::size ----------------------------------------------------------
+   std::size_t LuaView::size() const
+   {
+      const int t = type();
+      if (t != LUA_TSTRING && t != LUA_TUSERDATA)
+         throw TypeMismatchError ("string or userdata", typeName());
+
+      return lua_objlen (state_, index_);
+   }
+
+
+
+   // - LuaView::value ---------------------------------------------------------
+   LuaValue LuaView::value() const
+   {
+      return ToLuaValue (state_, index_);
+   }
+
+
+
+   // - LuaView::operator== ----------------------------------------------------
+   bool LuaView::operator== (const LuaValue& rhs) const
+   {
+      const int t = type();
+
+      if (t != rhs.type())
+         return false;
+
+      switch (t)
+      {
+         case LUA_TNIL:
+            return true;
+
+         case LUA_TBOOLEAN:
+            return (lua_toboolean (state_, index_) != 0) == rhs.asBoolean();
+
+         case LUA_TNUMBER:
+            return lua_tonumber (state_, index_) == rhs.asNumber();
+
+         case LUA_TSTRING:
+         {
+            size_t len;
+            const char* str = lua_tolstring (state_, index_, &len);
+            const std::string& rhsStr = rhs.asString();
+            return len == rhsStr.length()
+               && memcmp (str, rhsStr.data(), len) == 0;
+         }
+
+         default:
+            return value() == rhs;
+      }
+   }
+
+} // namespace Diluculum
@@ -0,0 +1,396 @@
+/******************************************************************************\
+* LuaVisitor.cpp                                                               *
+* Event-driven (SAX-style) walking over Lua values.                            *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#include <deque>
+#include <Diluculum/LuaVisitor.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <boost/lexical_cast.hpp>
+#include "InternalUtils.hpp"
+
+
+namespace Diluculum
+{
+   namespace
+   {
+      // - ThrowTooDeep --------------------------------------------------------
+      void ThrowTooDeep()
+      {
+         throw LuaTypeError(
+            "Table nested too deeply found in call to 'VisitLuaValue()'.");
+      }
+
+
+
+      // - ThrowTooManyElements ------------------------------------------------
+      void ThrowTooManyElements()
+      {
+         throw LuaTypeError(
+            "Too many table elements found in call to 'VisitLuaValue()'.");
+      }
+
+
+
+      /** Walks over a value on the Lua stack, generating the events for a
+       *  \c LuaValueVisitor. Nested tables are handled with an explicit
+       *  stack, not by recursion.
+       */
+      class StackWalker
+      {
+         public:
+            StackWalker (lua_State* ls, LuaValueVisitor& visitor,
+                         const ConversionLimits& limits)
+               : ls_(ls), visitor_(visitor), limits_(limits), elements_(0),
+                 reserved_(0)
+            { }
+
+            /// Walks over the value at \c index (a positive index).
+            void walk (int index)
+            {
+               if (!visit (index))
+                  return;
+
+               while (!frames_.empty())
+               {
+                  Frame& frame = frames_.back();
+
+                  if (frame.state == Frame::NEXT)
+                  {
+                     if (lua_next (ls_, frame.index) == 0)
+                     {
+                        frames_.pop_back();
+                        visitor_.endTable();
+
+                        // A finished value must be popped; a finished key
+                        // must stay for 'lua_next()'
+                        if (!frames_.empty()
+                            && frames_.back().state == Frame::NEXT)
+                        {
+                           lua_pop (ls_, 1);
+                        }
+                        continue;
+                     }
+
+                     if (++elements_ > limits_.maxElements)
+                        ThrowTooManyElements();
+
+                     frame.state = Frame::KEY;
+                  }
+
+                  if (frame.state == Frame::KEY)
+                  {
+                     frame.state = Frame::VALUE;
+                     visitor_.key();
+                     if (visit (lua_gettop (ls_) - 1))
+                        continue;
+                  }
+
+                  // frame.state == Frame::VALUE
+                  frame.state = Frame::NEXT;
+                  visitor_.value();
+                  if (visit (lua_gettop (ls_)))
+                     continue;
+                  lua_pop (ls_, 1);
+               }
+            }
+
+         private:
+            /// A table being walked over.
+            struct Frame
+            {
+                  /// What is to be done next with this table.
+                  enum State
+                  {
+                     NEXT,  ///< Call \c lua_next().
+                     KEY,   ///< Visit the key on the stack.
+                     VALUE  ///< Visit the value on the stack.
+                  };
+
+                  /// The (positive) index of the table on the Lua stack.
+                  int index;
+
+                  /// What is to be done next.
+                  State state;
+            };
+
+            /** Generates the event for the value at \c index or, if it is a
+             *  table, starts walking over it.
+             *  @return \c true if a table was started.
+             */
+            bool visit (int index)
+            {
+               switch (lua_type (ls_, index))
+               {
+                  case LUA_TNIL:
+                     visitor_.nilValue();
+                     return false;
+
+                  case LUA_TBOOLEAN:
+                     visitor_.booleanValue (lua_toboolean (ls_, index) != 0);
+                     return false;
+
+                  case LUA_TNUMBER:
+                     visitor_.numberValue (lua_tonumber (ls_, index));
+                     return false;
+
+                  case LUA_TSTRING:
+                  {
+                     size_t size;
+                     const char* str = lua_tolstring (ls_, index, &size);
+                     visitor_.stringValue (str, size);
+                     return false;
+                  }
+
+                  case LUA_TUSERDATA:
+                     visitor_.userDataValue (lua_touserdata (ls_, index),
+                                             lua_objlen (ls_, index));
+                     return false;
+
+                  case LUA_TFUNCTION:
+                  {
+                     if (lua_iscfunction (ls_, index))
+                     {
+                        visitor_.functionValue (
+                           LuaFunction (lua_tocfunction (ls_, index)));
+                     }
+                     else
+                     {
+                        Impl::ReserveLuaStack (ls_, 1, reserved_);
+                        LuaFunction func ("", 0);
+                        lua_pushvalue (ls_, index);
+                        lua_dump (ls_, Impl::LuaFunctionWriter, &func);
+                        lua_pop (ls_, 1);
+                        visitor_.functionValue (func);
+                     }
+                     return false;
+                  }
+
+                  case LUA_TTABLE:
+                  {
+                     if (frames_.size() >= limits_.maxDepth)
+                        ThrowTooDeep();
+
+                     // The iteration key and value
+                     Impl::ReserveLuaStack (ls_, 2, reserved_);
+
+                     visitor_.beginTable();
+
+                     Frame frame;
+                     frame.index = index;
+                     frame.state = Frame::NEXT;
+                     frames_.push_back (frame);
+
+                     lua_pushnil (ls_);
+                     return true;
+                  }
+
+                  default:
+                  {
+                     throw LuaTypeError(
+                        ("Unsupported type found in call to 'VisitLuaValue()': "
+                         + boost::lexical_cast<std::string>(
+                            lua_type (ls_, index))
+                         + " (typename: \'" + luaL_typename (ls_, index)
+                         + "')").c_str());
+                  }
+               }
+            }
+
+            lua_State* ls_;
+            LuaValueVisitor& visitor_;
+            const ConversionLimits limits_;
+            std::size_t elements_;
+            int reserved_;
+            std::deque<Frame> frames_;
+      };
+
+
+
+      /** Walks over a \c LuaValue, generating the events for a
+       *  \c LuaValueVisitor. Just like \c StackWalker, this doesn't recurse.
+       */
+      class ValueWalker
+      {
+         public:
+            ValueWalker (LuaValueVisitor& visitor,
+                         const ConversionLimits& limits)
+               : visitor_(visitor), limits_(limits), elements_(0)
+            { }
+
+            /// Walks over \c value.
+            void walk (const LuaValue& value)
+            {
+               if (!visit (value))
+                  return;
+
+               while (!frames_.empty())
+               {
+                  Frame& frame = frames_.back();
+
+                  if (frame.state == Frame::KEY)
+                  {
+                     if (frame.next == frame.end)
+                     {
+                        frames_.pop_back();
+                        visitor_.endTable();
+                        continue;
+                     }
+
+                     if (++elements_ > limits_.maxElements)
+                        ThrowTooManyElements();
+
+                     frame.state = Frame::VALUE;
+                     visitor_.key();
+                     if (visit (frame.next->first))
+                        continue;
+                  }
+
+                  // frame.state == Frame::VALUE
+                  const LuaValue& value = frame.next->second;
+                  ++frame.next;
+                  frame.state = Frame::KEY;
+                  visitor_.value();
+                  visit (value);
+               }
+            }
+
+         private:
+            /// A table being walked over.
+            struct Frame
+            {
+                  /// What is to be visited next in this table.
+                  enum State
+                  {
+                     KEY,  ///< The key of the next entry.
+                     VALUE ///< The value of the entry whose key was visited.
+                  };
+
+                  /// The next entry to visit.
+                  LuaValueMap::const_iterator next;
+
+                  /// The end of the table being walked over.
+                  LuaValueMap::const_iterator end;
+
+                  /// What is to be visited next.
+                  State state;
+            };
+
+            /** Generates the event for \c value or, if it is a table, starts
+             *  walking over it.
+             *  @return \c true if a table was started.
+             */
+            bool visit (const LuaValue& value)
+            {
+               switch (value.type())
+               {
+                  case LUA_TNIL:
+                     visitor_.nilValue();
+                     return false;
+
+                  case LUA_TBOOLEAN:
+                     visitor_.booleanValue (value.asBoolean());
+                     return false;
+
+                  case LUA_TNUMBER:
+                     visitor_.numberValue (value.asNumber());
+                     return false;
+
+                  case LUA_TSTRING:
+                  {
+                     const std::string& str = value.asString();
+                     visitor_.stringValue (str.data(), str.size());
+                     return false;
+                  }
+
+                  case LUA_TUSERDATA:
+                  {
+                     const LuaUserData& ud = value.asUserData();
+                     visitor_.userDataValue (ud.getData(), ud.getSize());
+                     return false;
+                  }
+
+                  case LUA_TFUNCTION:
+                     visitor_.functionValue (value.asFunction());
+                     return false;
+
+                  default: // LUA_TTABLE
+                  {
+                     if (frames_.size() >= limits_.maxDepth)
+                        ThrowTooDeep();
+
+                     visitor_.beginTable();
+
+                     const LuaValueMap& table = value.asConstTable();
+                     Frame frame;
+                     frame.next = table.begin();
+                     frame.end = table.end();
+                     frame.state = Frame::KEY;
+                     frames_.push_back (frame);
+                     return true;
+                  }
+               }
+            }
+
+            LuaValueVisitor& visitor_;
+            const ConversionLimits limits_;
+            std::size_t elements_;
+            std::deque<Frame> frames_;
+      };
+
+   } // (anonymous) namespace
+
+
+
+   // - VisitLuaValue ----------------------------------------------------------
+   void VisitLuaValue (lua_State* ls, int index, LuaValueVisitor& visitor,
+                       const ConversionLimits& limits)
+   {
+      // See 'ToLuaValue()' for why a positive index is needed here
+      if (index < 0 && index > LUA_REGISTRYINDEX)
+         index = lua_gettop (ls) + index + 1;
+
+      const int top = lua_gettop (ls);
+      try
+      {
+         StackWalker walker (ls, visitor, limits);
+         walker.walk (index);
+      }
+      catch (...)
+      {
+         lua_settop (ls, top);
+         throw;
+      }
+   }
+
+
+
+   void VisitLuaValue (const LuaValue& value, LuaValueVisitor& visitor,
+                       const ConversionLimits& limits)
+   {
+      ValueWalker walker (visitor, limits);
+      walker.walk (value);
+   }
+
+} // namespace Diluculum
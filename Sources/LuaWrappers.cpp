@@ -26,6 +26,8 @@
 
 #include <Diluculum/LuaWrappers.hpp>
 #include <cassert>
+#include <new>
+#include <boost/type_traits/alignment_of.hpp>
 
 
 namespace Diluculum
@@ -47,11 +49,414 @@ namespace Diluculum
          assert (ret != 0 && "'lua_getinfo()' wasn't supposed to return '1' "
                  "here. *Nothing* could go wrong at this point! Oh, well...");
 
+         // 'ar.name' is null if Lua cannot find a name for the function (for
+         // instance, when it is called through 'pcall()')
          const std::string msg = std::string("Error found when calling '")
-            + ar.name + "': " + what;
+            + (ar.name != 0 ? ar.name : "?") + "': " + what;
 
          lua_pushstring (ls, msg.c_str());
          lua_error (ls);
       }
+
+
+
+      // - PushClassMetatable --------------------------------------------------
+      void PushClassMetatable (lua_State* ls, const void* classKey)
+      {
+         lua_pushlightuserdata (ls, const_cast<void*>(classKey));
+         lua_rawget (ls, LUA_REGISTRYINDEX);
+      }
+
+
+
+      // - IsCppObject ---------------------------------------------------------
+      bool IsCppObject (lua_State* ls, int index, const void* classKey)
+      {
+         if (lua_type (ls, index) != LUA_TUSERDATA
+             || !lua_getmetatable (ls, index))
+         {
+            return false;
+         }
+
+         PushClassMetatable (ls, classKey);
+         const bool isInstance = lua_rawequal (ls, -1, -2) != 0;
+         lua_pop (ls, 2);
+
+         return isInstance;
+      }
+
+
+
+      // - GetCppObject --------------------------------------------------------
+      CppObject* GetCppObject (lua_State* ls, int index, const void* classKey,
+                               const char* className)
+      {
+         if (!IsCppObject (ls, index, classKey))
+            throw TypeMismatchError (className, luaL_typename (ls, index));
+
+         CppObject* cppObj =
+            static_cast<CppObject*>(lua_touserdata (ls, index));
+
+         if (cppObj->ptr == 0)
+            throw TypeMismatchError (className, "object was deleted");
+
+         return cppObj;
+      }
+
+
+
+      // - ThrowCannotPushObject -----------------------------------------------
+      void ThrowCannotPushObject (const char* className)
+      {
+         if (className == 0)
+         {
+            throw LuaTypeError(
+               "Using objects of a class not exported to Lua.");
+         }
+
+         throw LuaTypeError (("Objects of class '" + std::string(className)
+                              + "' cannot be copied to Lua.").c_str());
+      }
+
+
+
+      // - ThrowClassNotRegistered ---------------------------------------------
+      void ThrowClassNotRegistered (const char* className)
+      {
+         throw LuaError (("Class '" + std::string(className)
+                          + "' is not registered in this Lua state.").c_str());
+      }
+
+
+
+      // - NewSharedCppObject --------------------------------------------------
+      CppObject* NewSharedCppObject (lua_State* ls,
+                                     const boost::shared_ptr<void>& obj)
+      {
+         typedef boost::shared_ptr<void> Owner;
+         const std::size_t alignment = boost::alignment_of<Owner>::value;
+
+         void* ud = lua_newuserdata(
+            ls, sizeof(CppObject) + alignment - 1 + sizeof(Owner));
+
+         std::size_t addr =
+            reinterpret_cast<std::size_t>(ud) + sizeof(CppObject);
+         addr = (addr + alignment - 1) / alignment * alignment;
+
+         CppObject* cppObj = static_cast<CppObject*>(ud);
+         cppObj->ptr = obj.get();
+         cppObj->deleteMe = false;
+         cppObj->owner = new (reinterpret_cast<void*>(addr)) Owner (obj);
+
+         return cppObj;
+      }
+
+
+
+      // - ReleaseSharedObject -------------------------------------------------
+      void ReleaseSharedObject (CppObject* cppObj)
+      {
+         typedef boost::shared_ptr<void> Owner;
+
+         if (cppObj->owner != 0)
+         {
+            Owner* owner = cppObj->owner;
+            cppObj->owner = 0; // don't release again when gc'ed!
+            owner->~Owner();
+         }
+      }
+
+
+
+      // - PushSharedObject ----------------------------------------------------
+      void PushSharedObject (lua_State* ls, const boost::shared_ptr<void>& obj,
+                             const void* classKey, const char* className)
+      {
+         if (!obj)
+         {
+            lua_pushnil (ls);
+            return;
+         }
+
+         if (classKey == 0)
+            ThrowCannotPushObject (0);
+
+         PushClassMetatable (ls, classKey);
+         if (lua_isnil (ls, -1))
+         {
+            lua_pop (ls, 1);
+            ThrowClassNotRegistered (className);
+         }
+
+         NewSharedCppObject (ls, obj);
+         lua_insert (ls, -2);
+         lua_setmetatable (ls, -2);
+      }
+
+
+
+      // - PushObjectReference -------------------------------------------------
+      void PushObjectReference (lua_State* ls, void* obj, const void* classKey,
+                                const char* className)
+      {
+         if (obj == 0)
+         {
+            lua_pushnil (ls);
+            return;
+         }
+
+         if (classKey == 0)
+            ThrowCannotPushObject (0);
+
+         PushClassMetatable (ls, classKey);
+         if (lua_isnil (ls, -1))
+         {
+            lua_pop (ls, 1);
+            ThrowClassNotRegistered (className);
+         }
+
+         CppObject* cppObj = static_cast<CppObject*>(
+            lua_newuserdata (ls, sizeof(CppObject)));
+         cppObj->ptr = obj;
+         cppObj->deleteMe = false;
+         cppObj->owner = 0;
+
+         lua_insert (ls, -2);
+         lua_setmetatable (ls, -2);
+      }
+
+
+
+      // - GetSharedObject -----------------------------------------------------
+      const boost::shared_ptr<void>& GetSharedObject (lua_State* ls, int index,
+                                                      const void* classKey,
+                                                      const char* className)
+      {
+         CppObject* cppObj = GetCppObject (ls, index, classKey, className);
+
+         if (cppObj->owner == 0)
+         {
+            throw TypeMismatchError ("shared " + std::string(className),
+                                     "object not shared with C++");
+         }
+
+         return *cppObj->owner;
+      }
+
+
+
+      // - RegisterClassProperties ---------------------------------------------
+      void RegisterClassProperties (lua_State* ls,
+                                    const PropertyMap& properties)
+      {
+         lua_pushlightuserdata (ls, const_cast<PropertyMap*>(&properties));
+         lua_createtable (ls, 0, properties.size());
+
+         typedef PropertyMap::const_iterator iter_t;
+         for (iter_t p = properties.begin(); p != properties.end(); ++p)
+         {
+            lua_pushlstring (ls, p->first.c_str(), p->first.length());
+            lua_pushlightuserdata (ls, const_cast<PropertyAccessors*>(
+                                      &p->second));
+            lua_rawset (ls, -3);
+         }
+
+         lua_rawset (ls, LUA_REGISTRYINDEX);
+      }
+
+
+
+      // - RegisterClass -------------------------------------------------------
+      void RegisterClass (LuaVariable target, const void* classKey,
+                          const char* className, const LuaValueMap& methods,
+                          lua_CFunction constructor, lua_CFunction destructor,
+                          lua_CFunction index, lua_CFunction newIndex,
+                          const PropertyMap& properties)
+      {
+         lua_State* ls = target.getState();
+
+         target.pushLastTable();
+         PushLuaValue (ls, target.getKeys().back());
+
+         PushClassMetatable (ls, classKey);
+         if (lua_isnil (ls, -1))
+         {
+            lua_pop (ls, 1);
+            lua_createtable (ls, 0, static_cast<int>(methods.size()) + 6);
+
+            typedef LuaValueMap::const_iterator iter_t;
+            for (iter_t p = methods.begin(); p != methods.end(); ++p)
+            {
+               PushLuaValue (ls, p->first);
+               PushLuaValue (ls, p->second);
+               lua_rawset (ls, -3);
+            }
+
+            lua_pushstring (ls, className);
+            lua_setfield (ls, -2, "classname");
+
+            // The constructor gets the metatable as an upvalue, so that
+            // creating objects requires no lookups at all
+            lua_pushvalue (ls, -1);
+            lua_pushcclosure (ls, constructor, 1);
+            lua_setfield (ls, -2, "new");
+
+            lua_pushcfunction (ls, destructor);
+            lua_pushvalue (ls, -1);
+            lua_setfield (ls, -3, "delete");
+            lua_setfield (ls, -2, "__gc");
+
+            if (properties.empty())
+            {
+               lua_pushvalue (ls, -1);
+               lua_setfield (ls, -2, "__index");
+            }
+            else
+            {
+               lua_pushcfunction (ls, index);
+               lua_setfield (ls, -2, "__index");
+               lua_pushcfunction (ls, newIndex);
+               lua_setfield (ls, -2, "__newindex");
+               RegisterClassProperties (ls, properties);
+            }
+
+            lua_pushlightuserdata (ls, const_cast<void*>(classKey));
+            lua_pushvalue (ls, -2);
+            lua_rawset (ls, LUA_REGISTRYINDEX);
+         }
+
+         lua_settable (ls, -3);
+         lua_pop (ls, 1); // the table storing 'target'
+      }
+
+
+
+      // - RegisterObject ------------------------------------------------------
+      void RegisterObject (LuaVariable target, const void* classKey,
+                           const char* className, void* object)
+      {
+         lua_State* ls = target.getState();
+         StackTopRestorer restorer (ls, lua_gettop (ls));
+
+         target.pushLastTable();
+         PushLuaValue (ls, target.getKeys().back());
+         PushObjectReference (ls, object, classKey, className);
+         lua_settable (ls, -3);
+      }
+
+
+
+      // - RegisterSharedObject ------------------------------------------------
+      void RegisterSharedObject (LuaVariable target, const void* classKey,
+                                 const char* className,
+                                 const boost::shared_ptr<void>& object)
+      {
+         lua_State* ls = target.getState();
+         StackTopRestorer restorer (ls, lua_gettop (ls));
+
+         target.pushLastTable();
+         PushLuaValue (ls, target.getKeys().back());
+         PushSharedObject (ls, object, classKey, className);
+         lua_settable (ls, -3);
+      }
+
+
+
+      /** Returns the accessors of the property whose name is at
+       *  \c keyIndex, among those registered for \c properties, or null if
+       *  there is no such property.
+       */
+      const PropertyAccessors* FindProperty (lua_State* ls,
+                                             const PropertyMap& properties,
+                                             int keyIndex)
+      {
+         lua_pushlightuserdata (ls, const_cast<PropertyMap*>(&properties));
+         lua_rawget (ls, LUA_REGISTRYINDEX);
+         if (!lua_istable (ls, -1))
+         {
+            lua_pop (ls, 1);
+            return 0;
+         }
+
+         lua_pushvalue (ls, keyIndex);
+         lua_rawget (ls, -2);
+         const PropertyAccessors* accessors =
+            static_cast<const PropertyAccessors*>(lua_touserdata (ls, -1));
+         lua_pop (ls, 2);
+
+         return accessors;
+      }
+
+
+
+      /// Returns a string describing the key at \c index, for error messages.
+      std::string DescribeKey (lua_State* ls, int index)
+      {
+         if (lua_type (ls, index) == LUA_TSTRING)
+            return lua_tostring (ls, index);
+         else
+            return std::string("<") + luaL_typename (ls, index) + ">";
+      }
+
+
+
+      // - IndexObject ---------------------------------------------------------
+      int IndexObject (lua_State* ls, const void* classKey,
+                       const PropertyMap& properties, const char* className)
+      {
+         if (!IsCppObject (ls, 1, classKey))
+            throw TypeMismatchError (className, luaL_typename (ls, 1));
+
+         // Methods and everything else in the class table (these are found
+         // even in deleted objects; 'delete' must be, at least)
+         lua_getmetatable (ls, 1);
+         lua_pushvalue (ls, 2);
+         lua_rawget (ls, -2);
+         if (!lua_isnil (ls, -1))
+            return 1;
+         lua_pop (ls, 2);
+
+         // Properties
+         const PropertyAccessors* accessors =
+            FindProperty (ls, properties, 2);
+
+         if (accessors == 0)
+            lua_pushnil (ls);
+         else
+            accessors->get (ls, GetCppObject (ls, 1, classKey, className)->ptr);
+
+         return 1;
+      }
+
+
+
+      // - NewIndexObject ------------------------------------------------------
+      int NewIndexObject (lua_State* ls, const void* classKey,
+                          const PropertyMap& properties,
+                          const char* className)
+      {
+         CppObject* cppObj = GetCppObject (ls, 1, classKey, className);
+
+         const PropertyAccessors* accessors =
+            FindProperty (ls, properties, 2);
+
+         if (accessors == 0)
+         {
+            throw LuaError (("Class '" + std::string(className)
+                             + "' has no property '" + DescribeKey (ls, 2)
+                             + "'.").c_str());
+         }
+
+         if (accessors->set == 0)
+         {
+            throw LuaError (("Property '" + DescribeKey (ls, 2)
+                             + "' of class '" + className
+                             + "' is read-only.").c_str());
+         }
+
+         accessors->set (ls, cppObj->ptr, 3);
+
+         return 0;
+      }
    }
 }
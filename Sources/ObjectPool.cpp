@@ -0,0 +1,167 @@
+/******************************************************************************\
+* ObjectPool.cpp                                                               *
+* A pool of memory blocks, used to recycle objects created in Lua.             *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#include <new>
+#include <vector>
+#include <boost/thread/mutex.hpp>
+#include <Diluculum/ObjectPool.hpp>
+
+
+namespace Diluculum
+{
+   // - ObjectPool::State ------------------------------------------------------
+   class ObjectPool::State
+   {
+      public:
+         explicit State (std::size_t capacity)
+            : capacity(capacity)
+         {
+            free.reserve (capacity);
+         }
+
+         /// Protects everything else here.
+         boost::mutex mutex;
+
+         /// The maximum size of \c free.
+         const std::size_t capacity;
+
+         /// The free blocks.
+         std::vector<void*> free;
+
+         /** The statistics (but \c capacity and \c available are not kept
+          *  up to date here).
+          */
+         ObjectPoolStats stats;
+   };
+
+
+
+   // - ObjectPool::ObjectPool -------------------------------------------------
+   ObjectPool::ObjectPool (std::size_t blockSize, std::size_t capacity)
+      : blockSize_(blockSize), state_(new State (capacity))
+   { }
+
+
+
+   // - ObjectPool::~ObjectPool ------------------------------------------------
+   ObjectPool::~ObjectPool()
+   {
+      clear();
+   }
+
+
+
+   // - ObjectPool::acquire ----------------------------------------------------
+   void* ObjectPool::acquire()
+   {
+      {
+         boost::mutex::scoped_lock lock (state_->mutex);
+         if (!state_->free.empty())
+         {
+            void* block = state_->free.back();
+            state_->free.pop_back();
+            ++state_->stats.hits;
+            return block;
+         }
+         ++state_->stats.misses;
+      }
+
+      return ::operator new (blockSize_);
+   }
+
+
+
+   // - ObjectPool::release ----------------------------------------------------
+   void ObjectPool::release (void* block)
+   {
+      {
+         boost::mutex::scoped_lock lock (state_->mutex);
+         if (state_->free.size() < state_->capacity)
+         {
+            state_->free.push_back (block);
+            return;
+         }
+         ++state_->stats.discards;
+      }
+
+      ::operator delete (block);
+   }
+
+
+
+   // - ObjectPool::reserve ----------------------------------------------------
+   void ObjectPool::reserve (std::size_t count)
+   {
+      if (count > state_->capacity)
+         count = state_->capacity;
+
+      boost::mutex::scoped_lock lock (state_->mutex);
+      while (state_->free.size() < count)
+         state_->free.push_back (::operator new (blockSize_));
+   }
+
+
+
+   // - ObjectPool::clear ------------------------------------------------------
+   void ObjectPool::clear()
+   {
+      std::vector<void*> blocks;
+      {
+         boost::mutex::scoped_lock lock (state_->mutex);
+         blocks.swap (state_->free);
+         state_->free.reserve (state_->capacity);
+      }
+
+      for (std::vector<void*>::iterator p = blocks.begin();
+           p != blocks.end();
+           ++p)
+      {
+         ::operator delete (*p);
+      }
+   }
+
+
+
+   // - ObjectPool::stats ------------------------------------------------------
+   ObjectPoolStats ObjectPool::stats() const
+   {
+      boost::mutex::scoped_lock lock (state_->mutex);
+      ObjectPoolStats ret = state_->stats;
+      ret.capacity = state_->capacity;
+      ret.available = state_->free.size();
+      return ret;
+   }
+
+
+
+   // - ObjectPool::resetStats -------------------------------------------------
+   void ObjectPool::resetStats()
+   {
+      boost::mutex::scoped_lock lock (state_->mutex);
+      state_->stats = ObjectPoolStats();
+   }
+
+} // namespace Diluculum
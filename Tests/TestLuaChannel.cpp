@@ -0,0 +1,215 @@
+/******************************************************************************\
+* TestLuaChannel.cpp                                                           *
+* Unit tests for things declared in 'LuaChannel.hpp'.                          *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#define BOOST_TEST_MODULE LuaChannel
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+#include <Diluculum/LuaChannel.hpp>
+#include <Diluculum/LuaState.hpp>
+
+
+// - TestLuaChannelCpp ---------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaChannelCpp)
+{
+   using namespace Diluculum;
+
+   LuaChannel chan;
+   LuaChannel otherChan;
+   LuaChannel sameChan = chan;
+
+   BOOST_CHECK (chan == sameChan);
+   BOOST_CHECK (chan != otherChan);
+   BOOST_CHECK (chan.size() == 0);
+
+   // Values come out in the same order they went in
+   LuaValueMap table;
+   table[1] = "one";
+   table["two"] = 2;
+   table["nested"] = EmptyLuaValueMap;
+   table["nested"]["deep"] = true;
+
+   chan.send (1.5);
+   chan.send ("foo");
+   chan.send (table);
+   chan.send (Nil);
+   BOOST_CHECK (chan.size() == 4);
+
+   LuaValue v;
+   BOOST_REQUIRE (sameChan.receive (v, 0.0));
+   BOOST_CHECK (v == 1.5);
+   BOOST_REQUIRE (sameChan.receive (v, 0.0));
+   BOOST_CHECK (v == "foo");
+   BOOST_REQUIRE (sameChan.receive (v, 0.0));
+   BOOST_CHECK (v == table);
+   BOOST_REQUIRE (sameChan.receive (v, 0.0));
+   BOOST_CHECK (v == Nil);
+
+   // Empty channel: timeouts are reported and the value is left untouched
+   v = "untouched";
+   BOOST_CHECK (!chan.receive (v, 0.0));
+   BOOST_CHECK (!chan.receive (v, 0.01));
+   BOOST_CHECK (v == "untouched");
+
+   // Strings with embedded zeros must survive
+   chan.send (std::string ("a\0b", 3));
+   BOOST_REQUIRE (chan.receive (v));
+   BOOST_CHECK (v.asString().size() == 3);
+   BOOST_CHECK (v == std::string ("a\0b", 3));
+
+   // Huge timeouts just mean "wait forever"
+   chan.send (1.5);
+   BOOST_REQUIRE (chan.receive (v, 1e300));
+   BOOST_CHECK (v == 1.5);
+}
+
+
+
+// - TestLuaChannelBetweenStates -----------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaChannelBetweenStates)
+{
+   using namespace Diluculum;
+
+   LuaState ls1;
+   LuaState ls2;
+   LuaChannel chan;
+
+   PushLuaChannel (ls1.getState(), chan);
+   lua_setglobal (ls1.getState(), "chan");
+   PushLuaChannel (ls2.getState(), chan);
+   lua_setglobal (ls2.getState(), "chan");
+
+   BOOST_CHECK (ls1["chan"].value().type() == LUA_TUSERDATA);
+
+   // From Lua to Lua
+   ls1.doString ("chan:send ({ 10, 20, 30, name = 'x', sub = { k = false } })");
+   ls1.doString ("chan:send (function (a) return a * 3 end)");
+
+   LuaValueList ret = ls2.doString ("local t = chan:receive(); "
+                                    "return t[1], t[2], t[3], t.name, t.sub.k");
+   BOOST_REQUIRE (ret.size() == 5);
+   BOOST_CHECK (ret[0] == 10);
+   BOOST_CHECK (ret[1] == 20);
+   BOOST_CHECK (ret[2] == 30);
+   BOOST_CHECK (ret[3] == "x");
+   BOOST_CHECK (ret[4] == false);
+
+   ret = ls2.doString ("local f = chan:receive(); return f(7)");
+   BOOST_REQUIRE (ret.size() == 1);
+   BOOST_CHECK (ret[0] == 21);
+
+   // From C++ to Lua and back
+   chan.send ("hello");
+   ret = ls2.doString ("return chan:receive(0)");
+   BOOST_REQUIRE (ret.size() == 1);
+   BOOST_CHECK (ret[0] == "hello");
+
+   ls1.doString ("chan:send (123)");
+   LuaValue v;
+   BOOST_REQUIRE (chan.receive (v, 0.0));
+   BOOST_CHECK (v == 123);
+
+   // Timeouts in Lua
+   ret = ls2.doString ("return chan:receive(0)");
+   BOOST_REQUIRE (ret.size() == 2);
+   BOOST_CHECK (ret[0] == Nil);
+   BOOST_CHECK (ret[1] == "timeout");
+
+   // Getting the channel back from Lua
+   lua_getglobal (ls1.getState(), "chan");
+   LuaChannel fromLua = ToLuaChannel (ls1.getState(), -1);
+   lua_pop (ls1.getState(), 1);
+   BOOST_CHECK (fromLua == chan);
+
+   lua_pushnumber (ls1.getState(), 1.0);
+   BOOST_CHECK_THROW (ToLuaChannel (ls1.getState(), -1), TypeMismatchError);
+   lua_pop (ls1.getState(), 1);
+
+   // Trying to send a coroutine or a C function is an error
+   BOOST_CHECK_THROW (
+      ls1.doString ("chan:send (coroutine.create (function() end))"),
+      LuaRunTimeError);
+   BOOST_CHECK_THROW (ls1.doString ("chan:send ({ f = print })"),
+                      LuaRunTimeError);
+}
+
+
+
+// - Pipeline stages, each running its own 'LuaState' -------------------------
+namespace
+{
+   /// A pipeline stage: receives numbers from 'input', sends 'x * factor'.
+   void RunStage (Diluculum::LuaChannel input, Diluculum::LuaChannel output,
+                  int factor, int count)
+   {
+      using namespace Diluculum;
+
+      LuaState ls;
+      PushLuaChannel (ls.getState(), input);
+      lua_setglobal (ls.getState(), "input");
+      PushLuaChannel (ls.getState(), output);
+      lua_setglobal (ls.getState(), "output");
+      ls["factor"] = factor;
+      ls["count"] = count;
+
+      ls.doString ("for i = 1, count do "
+                   "   output:send (input:receive() * factor) "
+                   "end");
+   }
+}
+
+
+// - TestLuaChannelThreads -----------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaChannelThreads)
+{
+   using namespace Diluculum;
+
+   const int count = 1000;
+
+   LuaChannel first;
+   LuaChannel middle;
+   LuaChannel last;
+
+   boost::thread stage1 (RunStage, first, middle, 2, count);
+   boost::thread stage2 (RunStage, middle, last, 3, count);
+
+   for (int i = 1; i <= count; ++i)
+      first.send (i);
+
+   for (int i = 1; i <= count; ++i)
+   {
+      LuaValue v;
+      BOOST_REQUIRE (last.receive (v, 10.0));
+      BOOST_CHECK (v == i * 6);
+   }
+
+   stage1.join();
+   stage2.join();
+
+   BOOST_CHECK (first.size() == 0);
+   BOOST_CHECK (middle.size() == 0);
+   BOOST_CHECK (last.size() == 0);
+}
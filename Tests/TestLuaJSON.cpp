@@ -0,0 +1,189 @@
+/******************************************************************************\
+* TestLuaJSON.cpp                                                              *
+* Tests for the conversion between JSON and Lua values.                        *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#define BOOST_TEST_MODULE LuaJSON
+
+#include <clocale>
+#include <limits>
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaJSON.hpp>
+#include <Diluculum/LuaState.hpp>
+
+
+// - TestFromJSON --------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestFromJSON)
+{
+   using namespace Diluculum;
+
+   BOOST_CHECK (FromJSON ("true") == true);
+   BOOST_CHECK (FromJSON (" false ") == false);
+   BOOST_CHECK (FromJSON ("null") == Nil);
+   BOOST_CHECK (FromJSON ("0") == 0);
+   BOOST_CHECK (FromJSON ("-17") == -17);
+   BOOST_CHECK (FromJSON ("1.5e3") == 1500);
+   BOOST_CHECK (FromJSON ("-0.25") == -0.25);
+   BOOST_CHECK (FromJSON ("12345678901234567890") == 12345678901234567890.0);
+   BOOST_CHECK (FromJSON ("\"plain\"") == "plain");
+   BOOST_CHECK (FromJSON ("\"a\\\"b\\\\c\\/d\\n\\t\"") == "a\"b\\c/d\n\t");
+   BOOST_CHECK (FromJSON ("\"\\u00e9\\u20ac\"") == "\xc3\xa9\xe2\x82\xac");
+   BOOST_CHECK (FromJSON ("\"\\ud83d\\ude00\"") == "\xf0\x9f\x98\x80");
+   BOOST_CHECK (FromJSON ("\"a long string, with no escapes at all\"")
+                == "a long string, with no escapes at all");
+
+   const LuaValue v = FromJSON (
+      "{ \"name\": \"x\", \"list\": [1, 2, [3]], \"empty\": {}, "
+      "  \"nothing\": null, \"dup\": 1, \"dup\": 2 }");
+   BOOST_CHECK (v["name"] == "x");
+   BOOST_CHECK (v["list"][1] == 1);
+   BOOST_CHECK (v["list"][2] == 2);
+   BOOST_CHECK (v["list"][3][1] == 3);
+   BOOST_CHECK (v["empty"] == EmptyLuaValueMap);
+   BOOST_CHECK (v["dup"] == 2);
+   BOOST_CHECK (v.asTable().size() == 4);
+
+   // A sentinel for 'null'
+   const LuaValue withNull = FromJSON ("[1, null, 3]", "NULL");
+   BOOST_CHECK (withNull[2] == "NULL");
+   BOOST_CHECK (FromJSON ("[1, null, 3]").asTable().size() == 2);
+
+   // Invalid JSON
+   const char* invalid[] = {
+      "", "tru", "nul", "[1, 2", "[1 2]", "{\"a\" 1}", "{1: 2}", "{\"a\": 1,}",
+      "\"unterminated", "\"bad \\x escape\"", "\"ctrl \x01 char\"", "01",
+      "1.", "1e", "-", "[1] x", "'single'", "\"\\ud83d\"",
+      "\"\\ud83d\\u0041\"", "\"\\ud83d\\ud83d\"", "\"\\ude00\"" };
+
+   for (std::size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); ++i)
+      BOOST_CHECK_THROW (FromJSON (invalid[i]), SerializationError);
+
+   // Too deeply nested
+   BOOST_CHECK_THROW (FromJSON (std::string (5000, '[')), SerializationError);
+}
+
+
+
+// - TestToJSON ----------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestToJSON)
+{
+   using namespace Diluculum;
+
+   BOOST_CHECK (ToJSON (Nil) == "null");
+   BOOST_CHECK (ToJSON (true) == "true");
+   BOOST_CHECK (ToJSON (42) == "42");
+   BOOST_CHECK (ToJSON (-3) == "-3");
+   BOOST_CHECK (ToJSON (0.1) == "0.1");
+   BOOST_CHECK (FromJSON (ToJSON (1.0 / 3.0)) == 1.0 / 3.0);
+   BOOST_CHECK (ToJSON (std::numeric_limits<double>::denorm_min())
+                == "5e-324");
+
+   // Numbers don't depend on the locale
+   if (std::setlocale (LC_NUMERIC, "de_DE.UTF-8") != 0)
+   {
+      const std::string json = ToJSON (2.5);
+      const LuaValue value = FromJSON ("1.5");
+      std::setlocale (LC_NUMERIC, "C");
+      BOOST_CHECK (json == "2.5");
+      BOOST_CHECK (value == 1.5);
+   }
+   BOOST_CHECK (ToJSON ("q\"b\\n\n\x01") == "\"q\\\"b\\\\n\\n\\u0001\"");
+
+   LuaValueMap array;
+   array[1] = "a";
+   array[2] = 2;
+   BOOST_CHECK (ToJSON (array) == "[\"a\",2]");
+
+   LuaValueMap object;
+   object["k"] = array;
+   object[7] = "NULL";
+   BOOST_CHECK (ToJSON (object) == "{\"7\":\"NULL\",\"k\":[\"a\",2]}");
+   BOOST_CHECK (ToJSON (object, "NULL") == "{\"7\":null,\"k\":[\"a\",2]}");
+   BOOST_CHECK (ToJSON (EmptyLuaValueMap) == "{}");
+
+   BOOST_CHECK_THROW (ToJSON (1.0 / 0.0), LuaTypeError);
+   LuaValueMap badKey;
+   badKey[true] = 1;
+   BOOST_CHECK_THROW (ToJSON (badKey), LuaTypeError);
+}
+
+
+
+// - TestJSONOnTheStack --------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestJSONOnTheStack)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   lua_State* state = ls.getState();
+
+   // A big array, larger than what is kept pending on the stack
+   std::string json = "[";
+   for (int i = 1; i <= 100; ++i)
+      json += (i > 1 ? "," : "") + boost::lexical_cast<std::string>(i);
+   json += "]";
+
+   PushJSON (state, json.data(), json.size());
+   lua_setglobal (state, "big");
+   LuaValueList ret = ls.doString ("local s = 0 "
+                                   "for _, v in ipairs (big) do s = s + v end "
+                                   "return #big, s");
+   BOOST_REQUIRE (ret.size() == 2);
+   BOOST_CHECK (ret[0] == 100);
+   BOOST_CHECK (ret[1] == 5050);
+   BOOST_CHECK (lua_gettop (state) == 0);
+
+   // Errors leave the stack alone
+   BOOST_CHECK_THROW (PushJSON (state, "[1, 2, {", 8), SerializationError);
+   BOOST_CHECK (lua_gettop (state) == 0);
+
+   // From Lua
+   RegisterJSONFunctions (ls["json"]);
+   ret = ls.doString (
+      "local NULL = {} "
+      "local t = json.decode ('{\"a\": [1, null, 3], \"b\": {\"c\": null}}', "
+      "                       NULL) "
+      "return t.a[2] == NULL, t.b.c == NULL, "
+      "       json.encode (t.a, NULL), json.encode ({}), "
+      "       json.encode ({ x = { 'y' } })");
+   BOOST_REQUIRE (ret.size() == 5);
+   BOOST_CHECK (ret[0] == true);
+   BOOST_CHECK (ret[1] == true);
+   BOOST_CHECK (ret[2] == "[1,null,3]");
+   BOOST_CHECK (ret[3] == "{}");
+   BOOST_CHECK (ret[4] == "{\"x\":[\"y\"]}");
+
+   ret = ls.doString ("local t = json.decode ('{\"a\": 1, \"b\": null}') "
+                      "return t.a, t.b");
+   BOOST_REQUIRE (ret.size() == 2);
+   BOOST_CHECK (ret[0] == 1);
+   BOOST_CHECK (ret[1] == Nil);
+
+   BOOST_CHECK_THROW (ls.doString ("json.decode ('{')"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("local t = {}; t.t = t; json.encode (t)"),
+                      LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("json.encode (print)"), LuaRunTimeError);
+}
@@ -0,0 +1,162 @@
+/******************************************************************************\
+* TestLuaMsgPack.cpp                                                           *
+* Tests for the conversion between MessagePack and Lua values.                 *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#define BOOST_TEST_MODULE LuaMsgPack
+
+#include <boost/test/unit_test.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaMsgPack.hpp>
+#include <Diluculum/LuaState.hpp>
+
+
+namespace
+{
+   /// Encodes the value of the Lua expression \c expr as MessagePack.
+   std::string Encode (Diluculum::LuaState& ls, const std::string& expr)
+   {
+      ls.doString ("msgpackValue = " + expr);
+      lua_getglobal (ls.getState(), "msgpackValue");
+
+      std::string bytes;
+      Diluculum::StringSink sink (bytes);
+      Diluculum::ToMsgPack (ls.getState(), -1, sink);
+      lua_pop (ls.getState(), 1);
+
+      return bytes;
+   }
+
+   /// Decodes MessagePack data, returning the value as a \c LuaValue.
+   Diluculum::LuaValue Decode (Diluculum::LuaState& ls,
+                               const std::string& bytes)
+   {
+      Diluculum::PushMsgPack (ls.getState(), bytes.data(), bytes.size());
+      lua_setglobal (ls.getState(), "msgpackValue");
+      return ls["msgpackValue"].value();
+   }
+}
+
+
+
+// - TestToMsgPack -------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestToMsgPack)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+
+   BOOST_CHECK (Encode (ls, "nil") == "\xc0");
+   BOOST_CHECK (Encode (ls, "false") == "\xc2");
+   BOOST_CHECK (Encode (ls, "true") == "\xc3");
+   BOOST_CHECK (Encode (ls, "5") == "\x05");
+   BOOST_CHECK (Encode (ls, "-1") == "\xff");
+   BOOST_CHECK (Encode (ls, "-32") == "\xe0");
+   BOOST_CHECK (Encode (ls, "200") == "\xcc\xc8");
+   BOOST_CHECK (Encode (ls, "-33") == "\xd0\xdf");
+   BOOST_CHECK (Encode (ls, "65536")
+                == std::string ("\xce\x00\x01\x00\x00", 5));
+   BOOST_CHECK (Encode (ls, "-129") == "\xd1\xff\x7f");
+   BOOST_CHECK (Encode (ls, "1.5")
+                == std::string ("\xcb\x3f\xf8\x00\x00\x00\x00\x00\x00", 9));
+   BOOST_CHECK (Encode (ls, "'abc'") == "\xa3" "abc");
+   BOOST_CHECK (Encode (ls, "'a\\0b'") == std::string ("\xa3" "a\0b", 4));
+   BOOST_CHECK (Encode (ls, "string.rep ('x', 40)").substr (0, 2)
+                == "\xd9\x28");
+   BOOST_CHECK (Encode (ls, "{ 1, 2, 3 }") == "\x93\x01\x02\x03");
+   BOOST_CHECK (Encode (ls, "{ a = 1 }") == "\x81\xa1" "a\x01");
+   BOOST_CHECK (Encode (ls, "{}") == "\x80");
+   BOOST_CHECK (Encode (ls, "{ [1] = 1, [3] = 3 }").substr (0, 1) == "\x82");
+
+   BOOST_CHECK_THROW (Encode (ls, "print"), LuaTypeError);
+   BOOST_CHECK_THROW (Encode (ls, "coroutine.create (function() end)"),
+                      LuaTypeError);
+
+   // On errors, 'ToMsgPack()' leaves the stack alone (here, only the value
+   // pushed by 'Encode()' is left)
+   lua_settop (ls.getState(), 0);
+   ls.doString ("cyclic = {}; cyclic[1] = cyclic");
+   BOOST_CHECK_THROW (Encode (ls, "cyclic"), LuaTypeError);
+   BOOST_CHECK (lua_gettop (ls.getState()) == 1);
+}
+
+
+
+// - TestPushMsgPack -----------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestPushMsgPack)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+
+   BOOST_CHECK (Decode (ls, "\xc0") == Nil);
+   BOOST_CHECK (Decode (ls, "\xc3") == true);
+   BOOST_CHECK (Decode (ls, "\x7f") == 127);
+   BOOST_CHECK (Decode (ls, "\xe0") == -32);
+   BOOST_CHECK (Decode (ls, "\xd0\x80") == -128);
+   BOOST_CHECK (Decode (ls, "\xd3\xff\xff\xff\xff\xff\xff\xff\xfe") == -2);
+   BOOST_CHECK (Decode (ls, std::string (
+                   "\xcf\x00\x00\x00\x01\x00\x00\x00\x00", 9))
+                == 4294967296.0);
+   BOOST_CHECK (Decode (ls, std::string ("\xca\x3f\xc0\x00\x00", 5)) == 1.5);
+   BOOST_CHECK (Decode (ls, std::string ("\xc4\x03" "a\0b", 5))
+                == std::string ("a\0b", 3));
+   BOOST_CHECK (Decode (ls, std::string ("\xda\x00\x02" "hi", 5)) == "hi");
+
+   const LuaValue v = Decode (
+      ls, std::string ("\x82\xa4" "list\x92\x01\xa1x\x05\xc3", 12));
+   BOOST_CHECK (v["list"][1] == 1);
+   BOOST_CHECK (v["list"][2] == "x");
+   BOOST_CHECK (v[5] == true);
+
+   // Round trip, with a table bigger than the "fix" forms
+   ls.doString ("big = {} for i = 1, 1000 do big[i] = { i, tostring (i) } end");
+   const std::string bytes = Encode (ls, "big");
+   BOOST_CHECK (bytes.substr (0, 3) == "\xdc\x03\xe8");
+   Decode (ls, bytes);
+   LuaValueList ret = ls.doString ("return #msgpackValue, "
+                                   "msgpackValue[1000][1], "
+                                   "msgpackValue[1000][2]");
+   BOOST_REQUIRE (ret.size() == 3);
+   BOOST_CHECK (ret[0] == 1000);
+   BOOST_CHECK (ret[1] == 1000);
+   BOOST_CHECK (ret[2] == "1000");
+
+   // Invalid data
+   for (std::size_t i = 0; i < bytes.size(); i += 97)
+   {
+      BOOST_CHECK_THROW (Decode (ls, bytes.substr (0, i)), SerializationError);
+      BOOST_CHECK (lua_gettop (ls.getState()) == 0);
+   }
+
+   BOOST_CHECK_THROW (Decode (ls, "\xc1"), SerializationError);
+   BOOST_CHECK_THROW (Decode (ls, std::string ("\xd4\x01\x00", 3)),
+                      SerializationError);
+   BOOST_CHECK_THROW (Decode (ls, "\xdb\xff\xff\xff\xff"), SerializationError);
+   BOOST_CHECK_THROW (Decode (ls, "\x81\xc0\x01"), SerializationError);
+   BOOST_CHECK_THROW (Decode (ls, "\x01\x02"), SerializationError);
+   BOOST_CHECK_THROW (Decode (ls, std::string (5000, '\x91')),
+                      SerializationError);
+   BOOST_CHECK (lua_gettop (ls.getState()) == 0);
+}
@@ -0,0 +1,351 @@
+/******************************************************************************\
+* TestLuaSerialization.cpp                                                     *
+* Tests for the binary serialization of Lua values.                            *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#define BOOST_TEST_MODULE LuaSerialization
+
+#include <clocale>
+#include <cstdio>
+#include <limits>
+#include <boost/test/unit_test.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaSerialization.hpp>
+#include <Diluculum/LuaState.hpp>
+
+
+namespace
+{
+   /// Serializes \c value into a string.
+   std::string ToBytes (const Diluculum::LuaValue& value)
+   {
+      std::string bytes;
+      Diluculum::StringSink sink (bytes);
+      Diluculum::Serialize (value, sink);
+      return bytes;
+   }
+
+   /// Deserializes a value from a string.
+   Diluculum::LuaValue FromBytes (const std::string& bytes)
+   {
+      Diluculum::MemorySource source (bytes);
+      return Diluculum::Deserialize (source);
+   }
+
+   /// A C function, just to have something to serialize.
+   int DoNothing (lua_State*)
+   {
+      return 0;
+   }
+}
+
+
+
+// - TestSerializeRoundTrip ----------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestSerializeRoundTrip)
+{
+   using namespace Diluculum;
+
+   const double inf = std::numeric_limits<double>::infinity();
+
+   LuaValueList values;
+   values.push_back (Nil);
+   values.push_back (true);
+   values.push_back (false);
+   values.push_back (0);
+   values.push_back (-1);
+   values.push_back (123456789);
+   values.push_back (-9007199254740992.0);
+   values.push_back (0.1);
+   values.push_back (-2.5e300);
+   values.push_back (inf);
+   values.push_back (-inf);
+   values.push_back ("");
+   values.push_back (std::string ("a\0b", 3));
+   values.push_back (std::string (100000, 'x'));
+
+   for (LuaValueList::const_iterator p = values.begin(); p != values.end(); ++p)
+      BOOST_CHECK (FromBytes (ToBytes (*p)) == *p);
+
+   // Negative zero keeps its sign
+   const LuaValue negZero = FromBytes (ToBytes (-0.0));
+   BOOST_CHECK (negZero == 0);
+   BOOST_CHECK (1.0 / negZero.asNumber() < 0.0);
+
+   // NaN stays NaN
+   const double nan = std::numeric_limits<double>::quiet_NaN();
+   const LuaValue notANumber = FromBytes (ToBytes (nan));
+   BOOST_CHECK (notANumber.asNumber() != notANumber.asNumber());
+
+   // Small integers are really small
+   BOOST_CHECK (ToBytes (1).size() == 5);
+   BOOST_CHECK (ToBytes (0.5).size() == 12);
+
+   // Tables, with array and hash sections
+   LuaValueMap table;
+   table[1] = "one";
+   table[2] = "two";
+   table[3] = 3;
+   table[5] = "after a hole";
+   table[2.5] = "not an array key";
+   table["nested"] = EmptyLuaValueMap;
+   table["nested"][1] = true;
+   table["nested"]["k"] = "v";
+   table[true] = false;
+
+   BOOST_CHECK (FromBytes (ToBytes (table)) == table);
+   BOOST_CHECK (FromBytes (ToBytes (EmptyLuaValueMap)) == EmptyLuaValueMap);
+
+   // User data
+   LuaUserData ud (4);
+   memcpy (ud.getData(), "abcd", 4);
+   BOOST_CHECK (FromBytes (ToBytes (ud)) == ud);
+
+   // C functions are just addresses, meaningless elsewhere
+   std::string bytes;
+   StringSink sink (bytes);
+   BOOST_CHECK_THROW (Serialize (LuaValue (DoNothing), sink), LuaTypeError);
+   table["f"] = DoNothing;
+   BOOST_CHECK_THROW (Serialize (table, sink), LuaTypeError);
+}
+
+
+
+// - TestSerializeFromStack ----------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestSerializeFromStack)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   lua_State* state = ls.getState();
+
+   ls.doString ("t = { 10, 20, 30, nil, 50, name = 'x', sub = { k = false }, "
+                "      f = function (a) return a * 3 end }");
+
+   // Stack and 'LuaValue' serialization produce compatible data
+   lua_getglobal (state, "t");
+   std::string bytes;
+   StringSink sink (bytes);
+   SerializeFromStack (state, -1, sink);
+   lua_pop (state, 1);
+   BOOST_CHECK (lua_gettop (state) == 0);
+
+   const LuaValue t = FromBytes (bytes);
+   BOOST_CHECK (t[1] == 10);
+   BOOST_CHECK (t[3] == 30);
+   BOOST_CHECK (t[5] == 50);
+   BOOST_CHECK (t["name"] == "x");
+   BOOST_CHECK (t["sub"]["k"] == false);
+   BOOST_CHECK (t["f"].type() == LUA_TFUNCTION);
+
+   const std::string tBytes = ToBytes (t);
+   MemorySource source (tBytes);
+   DeserializeToStack (state, source);
+   lua_setglobal (state, "copy");
+   LuaValueList ret = ls.doString ("return copy[2], copy[5], copy.sub.k, "
+                                   "copy.f(7), copy[4]");
+   BOOST_REQUIRE (ret.size() == 5);
+   BOOST_CHECK (ret[0] == 20);
+   BOOST_CHECK (ret[1] == 50);
+   BOOST_CHECK (ret[2] == false);
+   BOOST_CHECK (ret[3] == 21);
+   BOOST_CHECK (ret[4] == Nil);
+   BOOST_CHECK (lua_gettop (state) == 0);
+
+   // Cyclic tables and coroutines cannot be serialized
+   ls.doString ("cyclic = {}; cyclic.self = cyclic");
+   lua_getglobal (state, "cyclic");
+   BOOST_CHECK_THROW (SerializeFromStack (state, -1, sink), LuaTypeError);
+   BOOST_CHECK (lua_gettop (state) == 1);
+   lua_pop (state, 1);
+
+   ls.doString ("co = coroutine.create (function() end)");
+   lua_getglobal (state, "co");
+   BOOST_CHECK_THROW (SerializeFromStack (state, -1, sink), LuaTypeError);
+   lua_pop (state, 1);
+
+   // Neither can C functions
+   lua_getglobal (state, "print");
+   BOOST_CHECK_THROW (SerializeFromStack (state, -1, sink), LuaTypeError);
+   lua_pop (state, 1);
+}
+
+
+
+// - TestDeserializeInvalidData ------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestDeserializeInvalidData)
+{
+   using namespace Diluculum;
+
+   LuaValueMap table;
+   table[1] = "some string";
+   table["key"] = 1.5;
+   const std::string bytes = ToBytes (table);
+
+   // Every truncation is detected
+   for (std::size_t i = 0; i < bytes.size(); ++i)
+   {
+      BOOST_CHECK_THROW (FromBytes (bytes.substr (0, i)), SerializationError);
+      MemorySource source (bytes.data(), i);
+      LuaState ls;
+      BOOST_CHECK_THROW (DeserializeToStack (ls.getState(), source),
+                         SerializationError);
+      BOOST_CHECK (lua_gettop (ls.getState()) == 0);
+   }
+
+   // Bad header and unsupported version
+   BOOST_CHECK_THROW (FromBytes ("Xl\x01\x00"), SerializationError);
+   std::string newer = ToBytes (Nil);
+   newer[2] = 2;
+   BOOST_CHECK_THROW (FromBytes (newer), SerializationError);
+
+   // Unknown tag
+   std::string bad = ToBytes (Nil);
+   bad[3] = 100;
+   BOOST_CHECK_THROW (FromBytes (bad), SerializationError);
+
+   // C functions are never serialized, so their tag is invalid
+   bad[3] = 7;
+   bad += std::string (sizeof(lua_CFunction), '\0');
+   BOOST_CHECK_THROW (FromBytes (bad), SerializationError);
+
+   // Absurd lengths do not cause absurd allocations
+   const char hugeString[] = "Dl\x01\x05\xff\xff\xff\xff\xff\xff\xff\x7f";
+   BOOST_CHECK_THROW (
+      FromBytes (std::string (hugeString, sizeof(hugeString) - 1)),
+      SerializationError);
+
+   // Nil keys are rejected
+   const char nilKey[] = "Dl\x01\x06\x00\x01\x00\x01";
+   BOOST_CHECK_THROW (FromBytes (std::string (nilKey, sizeof(nilKey) - 1)),
+                      SerializationError);
+}
+
+
+
+// - TestToLuaSource -----------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestToLuaSource)
+{
+   using namespace Diluculum;
+
+   LuaValueMap table;
+   table[1] = "one";
+   table[2] = 2;
+   table[3] = EmptyLuaValueMap;
+   table[5] = 0.1;
+   table["name"] = "x";
+   table["end"] = true;
+   table["with space"] = -7;
+   table[-1.5] = 1e300;
+   table[false] = std::string ("quote\" backslash\\ zero\0" "1 nl\n", 28);
+
+   std::string source;
+   StringSink sink (source);
+   ToLuaSource (table, sink);
+   BOOST_CHECK (source.substr (0, 13) == "{\"one\",2,{},[");
+   BOOST_CHECK (source.find ("name=\"x\"") != std::string::npos);
+   BOOST_CHECK (source.find ("[\"end\"]=true") != std::string::npos);
+   BOOST_CHECK (source.find ("[5]=0.1") != std::string::npos);
+   BOOST_CHECK (source.find ("\\0001 nl\\n") != std::string::npos);
+
+   LuaState ls;
+   BOOST_CHECK (ls.doString ("return " + source)[0] == table);
+
+   // Numbers are written exactly, and special numbers survive
+   const double inf = std::numeric_limits<double>::infinity();
+   const double numbers[] = { 1.0 / 3.0, -2.5e-300, 123456789012345678.0,
+                              -0.0, inf, -inf };
+   for (std::size_t i = 0; i < sizeof(numbers) / sizeof(numbers[0]); ++i)
+   {
+      source.clear();
+      ToLuaSource (numbers[i], sink);
+      BOOST_CHECK (ls.doString ("return " + source)[0] == numbers[i]);
+   }
+
+   // ...with as few digits as possible, whatever the locale
+   source.clear();
+   ToLuaSource (0.1, sink);
+   BOOST_CHECK (source == "0.1");
+   source.clear();
+   ToLuaSource (std::numeric_limits<double>::denorm_min(), sink);
+   BOOST_CHECK (source == "5e-324");
+
+   if (std::setlocale (LC_NUMERIC, "de_DE.UTF-8") != 0)
+   {
+      source.clear();
+      ToLuaSource (2.5, sink);
+      std::setlocale (LC_NUMERIC, "C");
+      BOOST_CHECK (source == "2.5");
+   }
+
+   source.clear();
+   ToLuaSource (std::numeric_limits<double>::quiet_NaN(), sink);
+   ls.doString ("nan = " + source);
+   BOOST_CHECK (ls.doString ("return nan ~= nan")[0] == true);
+
+   // Streaming to a file
+   const char* fileName = "TestToLuaSource.lua";
+   std::FILE* file = std::fopen (fileName, "w");
+   BOOST_REQUIRE (file != 0);
+   FileSink fileSink (file);
+   fileSink.write ("return ", 7);
+   ToLuaSource (table, fileSink);
+   std::fclose (file);
+   BOOST_CHECK (ls.doFile (fileName)[0] == table);
+   std::remove (fileName);
+
+   // Values with more constants than a Lua function can hold
+   LuaValueMap big;
+   for (int i = 0; i < 300000; ++i)
+   {
+      char key[16];
+      std::sprintf (key, "k%d", i);
+      big[key] = i + 0.5;
+   }
+   big[1] = table;
+   big[table] = "table key";
+   source.clear();
+   ToLuaSource (big, sink);
+   BOOST_CHECK (ls.doString ("return " + source)[0] == big);
+
+   // Values nested deeper than Lua can parse, but not too deeply
+   LuaValue nested = "bottom";
+   for (int i = 0; i < 1100; ++i)
+   {
+      LuaValueMap outer;
+      outer[1] = nested;
+      nested = outer;
+      if (i == 500)
+      {
+         source.clear();
+         ToLuaSource (nested, sink);
+         BOOST_CHECK (ls.doString ("return " + source)[0] == nested);
+      }
+   }
+   BOOST_CHECK_THROW (ToLuaSource (nested, sink), LuaTypeError);
+
+   // Functions have no source representation
+   BOOST_CHECK_THROW (ToLuaSource (LuaValue (DoNothing), sink),
+                      LuaTypeError);
+}
@@ -0,0 +1,214 @@
+/******************************************************************************\
+* TestLuaStore.cpp                                                             *
+* Tests for the memory-mapped, read-only stores of Lua values.                 *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#define BOOST_TEST_MODULE LuaStore
+
+#include <cstdio>
+#include <limits>
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaState.hpp>
+#include <Diluculum/LuaStore.hpp>
+
+
+namespace
+{
+   /// Writes \c value as a store into the file \c fileName.
+   void WriteStoreFile (const char* fileName, const Diluculum::LuaValue& value)
+   {
+      std::FILE* file = std::fopen (fileName, "wb");
+      BOOST_REQUIRE (file != 0);
+      Diluculum::FileSink sink (file);
+      Diluculum::WriteLuaStore (value, sink);
+      std::fclose (file);
+   }
+
+   /// Writes raw bytes into the file \c fileName.
+   void WriteRawFile (const char* fileName, const std::string& data)
+   {
+      std::FILE* file = std::fopen (fileName, "wb");
+      BOOST_REQUIRE (file != 0);
+      std::fwrite (data.data(), 1, data.size(), file);
+      std::fclose (file);
+   }
+
+   /// A C function, just to have something that cannot be stored.
+   int DoNothing (lua_State*)
+   {
+      return 0;
+   }
+
+   /// The test data.
+   Diluculum::LuaValueMap MakeCatalogue()
+   {
+      using namespace Diluculum;
+
+      LuaValueMap catalogue;
+      catalogue[1] = "first";
+      catalogue[2] = 2;
+      catalogue[3] = EmptyLuaValueMap;
+      catalogue["name"] = "catalogue";
+      catalogue["binary"] = std::string ("a\0b", 3);
+      catalogue[true] = "yes";
+      catalogue[2.5] = "two and a half";
+      catalogue[-1] = false;
+
+      LuaValueMap products;
+      for (int i = 1; i <= 100; ++i)
+      {
+         LuaValueMap product;
+         product["id"] = i;
+         product["kind"] = i % 2 == 0 ? "even" : "odd";
+         products["p" + boost::lexical_cast<std::string>(i)] = product;
+         products[i * 1000] = product;
+      }
+      catalogue["products"] = products;
+
+      return catalogue;
+   }
+}
+
+
+
+// - TestLuaStoreValue ---------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaStoreValue)
+{
+   using namespace Diluculum;
+
+   const char* fileName = "TestLuaStoreValue.store";
+   const LuaValueMap catalogue = MakeCatalogue();
+   WriteStoreFile (fileName, catalogue);
+
+   LuaStore store (fileName);
+   BOOST_CHECK (store.value() == catalogue);
+
+   // Repeated strings are stored only once
+   std::string bytes;
+   StringSink sink (bytes);
+   WriteLuaStore (catalogue, sink);
+   BOOST_CHECK (store.size() == bytes.size());
+   BOOST_CHECK (bytes.find ("even") == bytes.rfind ("even"));
+
+   // Scalars can be stored, too
+   WriteStoreFile (fileName, "just a string");
+   BOOST_CHECK (LuaStore (fileName).value() == "just a string");
+
+   // Functions cannot
+   LuaValueMap withFunction;
+   withFunction["f"] = DoNothing;
+   BOOST_CHECK_THROW (WriteLuaStore (withFunction, sink), LuaTypeError);
+
+   // Neither can keys other than booleans, numbers and strings, even alone
+   LuaValueMap tableKey;
+   tableKey[EmptyLuaValueMap] = 1;
+   BOOST_CHECK_THROW (WriteLuaStore (tableKey, sink), LuaTypeError);
+   LuaValueMap functionKey;
+   functionKey[DoNothing] = 1;
+   BOOST_CHECK_THROW (WriteLuaStore (functionKey, sink), LuaTypeError);
+   LuaValueMap nanKey;
+   nanKey[std::numeric_limits<double>::quiet_NaN()] = 1;
+   BOOST_CHECK_THROW (WriteLuaStore (nanKey, sink), LuaTypeError);
+
+   // Invalid files
+   BOOST_CHECK_THROW (LuaStore ("NoSuchFile.store"), LuaFileError);
+   WriteRawFile (fileName, "This is not a store, but it is long enough.");
+   BOOST_CHECK_THROW (LuaStore invalid (fileName), SerializationError);
+
+   // A corrupt offset is detected
+   // (the root slot starts at byte 8: make it a table far, far away)
+   bytes[8] = 5;
+   bytes.replace (9, 8, "\xff\xff\xff\xff\x00\x00\x00\x00", 8);
+   WriteRawFile (fileName, bytes);
+   BOOST_CHECK_THROW (LuaStore (fileName).value(), SerializationError);
+
+   std::remove (fileName);
+}
+
+
+
+// - TestLuaStoreFromLua -------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaStoreFromLua)
+{
+   using namespace Diluculum;
+
+   const char* fileName = "TestLuaStoreFromLua.store";
+   WriteStoreFile (fileName, MakeCatalogue());
+
+   LuaState ls;
+   {
+      LuaStore store (fileName);
+      PushLuaStore (ls.getState(), store);
+      lua_setglobal (ls.getState(), "store");
+   }
+
+   // The proxies keep the store alive
+   std::remove (fileName);
+   ls.doString ("collectgarbage ('collect')");
+
+   LuaValueList ret = ls.doString (
+      "return store[1], store[2], #store, store.name, store.binary, "
+      "       store[true], store[2.5], store[-1], store.missing, "
+      "       store.products.p7.kind, store.products[7000].id, #store[3]");
+   BOOST_REQUIRE (ret.size() == 12);
+   BOOST_CHECK (ret[0] == "first");
+   BOOST_CHECK (ret[1] == 2);
+   BOOST_CHECK (ret[2] == 3);
+   BOOST_CHECK (ret[3] == "catalogue");
+   BOOST_CHECK (ret[4] == std::string ("a\0b", 3));
+   BOOST_CHECK (ret[5] == "yes");
+   BOOST_CHECK (ret[6] == "two and a half");
+   BOOST_CHECK (ret[7] == false);
+   BOOST_CHECK (ret[8] == Nil);
+   BOOST_CHECK (ret[9] == "odd");
+   BOOST_CHECK (ret[10] == 7);
+   BOOST_CHECK (ret[11] == 0);
+
+   // Keys that cannot be in a table are not found
+   ret = ls.doString ("return store[0/0], store[{ }], store[print]");
+   BOOST_REQUIRE (ret.size() == 3);
+   BOOST_CHECK (ret[0] == Nil);
+   BOOST_CHECK (ret[1] == Nil);
+   BOOST_CHECK (ret[2] == Nil);
+
+   // Iteration and equality
+   ret = ls.doString (
+      "local count, sum = 0, 0 "
+      "for k, v in store.products() do "
+      "   count = count + 1 "
+      "   if type (k) == 'number' then sum = sum + v.id end "
+      "end "
+      "return count, sum, store.products == store.products, "
+      "       store.products ~= store[3]");
+   BOOST_REQUIRE (ret.size() == 4);
+   BOOST_CHECK (ret[0] == 200);
+   BOOST_CHECK (ret[1] == 5050);
+   BOOST_CHECK (ret[2] == true);
+   BOOST_CHECK (ret[3] == true);
+
+   // Read-only
+   BOOST_CHECK_THROW (ls.doString ("store.name = 'other'"), LuaRunTimeError);
+}
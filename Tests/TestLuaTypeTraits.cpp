@@ -0,0 +1,108 @@
+/******************************************************************************\
+* TestLuaTypeTraits.cpp                                                        *
+* Unit tests for things declared in 'LuaTypeTraits.hpp'.                       *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#define BOOST_TEST_MODULE LuaTypeTraits
+
+#include <boost/test/unit_test.hpp>
+#include <Diluculum/LuaState.hpp>
+#include <Diluculum/LuaTypeTraits.hpp>
+
+
+// - TestLuaTypeTraitsPush -----------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaTypeTraitsPush)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   lua_State* rawState = ls.getState();
+
+   LuaTypeTraits<int>::push (rawState, 123);
+   LuaTypeTraits<bool>::push (rawState, true);
+   LuaTypeTraits<std::string>::push (rawState, std::string ("a\0b", 3));
+   LuaTypeTraits<const char*>::push (rawState, "foo");
+   LuaTypeTraits<LuaValue>::push (rawState, Nil);
+   LuaTypeTraits<LuaValueMap>::push (rawState, EmptyLuaValueMap);
+
+   BOOST_REQUIRE (lua_gettop (rawState) == 6);
+   BOOST_CHECK (ToLuaValue (rawState, 1) == 123);
+   BOOST_CHECK (ToLuaValue (rawState, 2) == true);
+   BOOST_CHECK (ToLuaValue (rawState, 3) == std::string ("a\0b", 3));
+   BOOST_CHECK (ToLuaValue (rawState, 4) == "foo");
+   BOOST_CHECK (ToLuaValue (rawState, 5) == Nil);
+   BOOST_CHECK (ToLuaValue (rawState, 6) == EmptyTable);
+
+   // C functions are functions, not pointers
+   LuaTypeTraits<lua_CFunction>::push (rawState, luaopen_base);
+   BOOST_CHECK (lua_iscfunction (rawState, -1));
+   BOOST_CHECK (LuaTypeTraits<lua_CFunction>::get (rawState, -1)
+                == luaopen_base);
+}
+
+
+
+// - TestLuaTypeTraitsGet ------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaTypeTraitsGet)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   lua_State* rawState = ls.getState();
+
+   lua_pushnumber (rawState, 3.5);
+   lua_pushstring (rawState, "17");
+   lua_pushstring (rawState, "xyz");
+   lua_pushnil (rawState);
+   lua_newtable (rawState);
+
+   // Numbers, including strings convertible to numbers
+   BOOST_CHECK (LuaTypeTraits<double>::is (rawState, 1));
+   BOOST_CHECK (LuaTypeTraits<double>::get (rawState, 1) == 3.5);
+   BOOST_CHECK (LuaTypeTraits<int>::get (rawState, 1) == 3);
+   BOOST_CHECK (LuaTypeTraits<unsigned>::get (rawState, 2) == 17);
+   BOOST_CHECK (!LuaTypeTraits<double>::is (rawState, 3));
+   BOOST_CHECK_THROW (LuaTypeTraits<double>::get (rawState, 3),
+                      TypeMismatchError);
+
+   // Strings, including numbers
+   BOOST_CHECK (LuaTypeTraits<std::string>::get (rawState, 3) == "xyz");
+   BOOST_CHECK (LuaTypeTraits<std::string>::is (rawState, 2));
+   BOOST_CHECK (!LuaTypeTraits<std::string>::is (rawState, 4));
+   BOOST_CHECK_THROW (LuaTypeTraits<std::string>::get (rawState, 5),
+                      TypeMismatchError);
+
+   // Booleans follow the Lua rules
+   BOOST_CHECK (LuaTypeTraits<bool>::get (rawState, 1) == true);
+   BOOST_CHECK (LuaTypeTraits<bool>::get (rawState, 4) == false);
+
+   // Tables and generic values
+   BOOST_CHECK (LuaTypeTraits<LuaValueMap>::get (rawState, 5).empty());
+   BOOST_CHECK_THROW (LuaTypeTraits<LuaValueMap>::get (rawState, 1),
+                      TypeMismatchError);
+   BOOST_CHECK (LuaTypeTraits<LuaValue>::get (rawState, -1) == EmptyTable);
+
+   // The stack is untouched
+   BOOST_CHECK (lua_gettop (rawState) == 5);
+}
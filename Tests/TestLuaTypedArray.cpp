@@ -0,0 +1,209 @@
+/******************************************************************************\
+* TestLuaTypedArray.cpp                                                        *
+* Unit tests for things declared in 'LuaTypedArray.hpp'.                       *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#define BOOST_TEST_MODULE LuaTypedArray
+
+#include <vector>
+#include <boost/test/unit_test.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaState.hpp>
+#include <Diluculum/LuaTypedArray.hpp>
+
+
+// - TestTypedArrayView --------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestTypedArrayView)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   lua_State* state = ls.getState();
+
+   // A frame of samples, owned by C++, processed in place by Lua
+   std::vector<double> samples (48000);
+   for (std::size_t i = 0; i < samples.size(); ++i)
+      samples[i] = static_cast<double>(i);
+
+   PushTypedArrayView (state, &samples[0], samples.size());
+   lua_setglobal (state, "samples");
+
+   LuaValueList ret = ls.doString (
+      "local sum = 0 "
+      "for i = 1, #samples do "
+      "   sum = sum + samples[i] "
+      "   samples[i] = samples[i] * 0.5 "
+      "end "
+      "return sum, #samples, samples[0], samples[48001], samples.x, "
+      "   tostring (samples):sub (1, 24)");
+
+   BOOST_REQUIRE_EQUAL (ret.size(), 6U);
+   BOOST_CHECK_EQUAL (ret[0].asNumber(), 47999.0 * 48000.0 / 2.0);
+   BOOST_CHECK_EQUAL (ret[1].asNumber(), 48000);
+   BOOST_CHECK (ret[2] == Nil);
+   BOOST_CHECK (ret[3] == Nil);
+   BOOST_CHECK (ret[4] == Nil);
+   BOOST_CHECK_EQUAL (ret[5].asString(), "float64 array of size 48");
+
+   BOOST_CHECK_EQUAL (samples[0], 0.0);
+   BOOST_CHECK_EQUAL (samples[1], 0.5);
+   BOOST_CHECK_EQUAL (samples[47999], 47999.0 / 2.0);
+
+   // The same memory can be seen back from C++
+   lua_getglobal (state, "samples");
+   std::size_t size = 0;
+   double* data = ToTypedArray<double> (state, -1, size);
+   BOOST_CHECK_EQUAL (data, &samples[0]);
+   BOOST_CHECK_EQUAL (size, samples.size());
+   BOOST_CHECK_THROW (ToTypedArray<float> (state, -1, size),
+                      TypeMismatchError);
+
+   // After detaching, Lua can no longer touch the samples
+   DetachTypedArray (state, -1);
+   lua_pop (state, 1);
+   ret = ls.doString ("return #samples, samples[1]");
+   BOOST_REQUIRE_EQUAL (ret.size(), 2U);
+   BOOST_CHECK_EQUAL (ret[0].asNumber(), 0);
+   BOOST_CHECK (ret[1] == Nil);
+   BOOST_CHECK_THROW (ls.doString ("samples[1] = 1"), LuaRunTimeError);
+   BOOST_CHECK_EQUAL (samples[1], 0.5);
+
+   // Not typed arrays
+   lua_pushnumber (state, 1);
+   BOOST_CHECK_THROW (ToTypedArray (state, -1), TypeMismatchError);
+   BOOST_CHECK_THROW (DetachTypedArray (state, -1), TypeMismatchError);
+   lua_newuserdata (state, 32);
+   BOOST_CHECK_THROW (ToTypedArray (state, -1), TypeMismatchError);
+   lua_pop (state, 2);
+}
+
+
+
+// - TestTypedArrayOwnedByLua --------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestTypedArrayOwnedByLua)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   lua_State* state = ls.getState();
+
+   float* floats = PushTypedArray<float> (state, 3);
+   BOOST_REQUIRE (floats != 0);
+   BOOST_CHECK_EQUAL (floats[0], 0.0f);
+   BOOST_CHECK_EQUAL (floats[2], 0.0f);
+   floats[1] = 1.5f;
+   lua_setglobal (state, "floats");
+
+   LuaValueList ret = ls.doString ("floats[3] = 0.25 "
+                                   "return #floats, floats[2], floats[3]");
+   BOOST_REQUIRE_EQUAL (ret.size(), 3U);
+   BOOST_CHECK_EQUAL (ret[0].asNumber(), 3);
+   BOOST_CHECK_EQUAL (ret[1].asNumber(), 1.5);
+   BOOST_CHECK_EQUAL (ret[2].asNumber(), 0.25);
+   BOOST_CHECK_EQUAL (floats[2], 0.25f);
+
+   // Integer elements are truncated, and must fit
+   boost::int32_t* ints = PushTypedArray<boost::int32_t> (state, 2);
+   lua_setglobal (state, "ints");
+   ls.doString ("ints[1] = -2.75; ints[2] = 2147483647");
+   BOOST_CHECK_EQUAL (ints[0], -2);
+   BOOST_CHECK_EQUAL (ints[1], 2147483647);
+   BOOST_CHECK_THROW (ls.doString ("ints[1] = 2147483648"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("ints[1] = 0/0"), LuaRunTimeError);
+   BOOST_CHECK_EQUAL (ints[0], -2);
+
+   boost::uint8_t* bytes = PushTypedArray<boost::uint8_t> (state, 1);
+   lua_setglobal (state, "bytes");
+   ls.doString ("bytes[1] = 255.9");
+   BOOST_CHECK_EQUAL (bytes[0], 255);
+   BOOST_CHECK_THROW (ls.doString ("bytes[1] = 256"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("bytes[1] = -1"), LuaRunTimeError);
+
+   // Invalid indices and values
+   BOOST_CHECK_THROW (ls.doString ("floats[0] = 1"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("floats[4] = 1"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("floats[1.5] = 1"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("floats.x = 1"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("floats[1] = 'x'"), LuaRunTimeError);
+
+   // Empty arrays
+   BOOST_CHECK (PushTypedArray<double> (state, 0) == 0);
+   const TypedArraySpan span = ToTypedArray (state, -1);
+   BOOST_CHECK_EQUAL (span.type, Float64Array);
+   BOOST_CHECK_EQUAL (span.size, 0U);
+   lua_pop (state, 1);
+
+   // Arrays survive garbage collection while referenced
+   ls.doString ("collectgarbage ('collect')");
+   BOOST_CHECK_EQUAL (floats[1], 1.5f);
+}
+
+
+
+// - TestTypedArrayFunctions ---------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestTypedArrayFunctions)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   RegisterTypedArrayFunctions (ls["arrays"]);
+
+   LuaValueList ret = ls.doString (
+      "local a = arrays.float64 (4) "
+      "local b = arrays.int32 {1, 2.5, -3} "
+      "local c = arrays.uint8 {} "
+      "local d = arrays.float32 {0.5} "
+      "a[4] = 10 "
+      "return #a, a[1], a[4], #b, b[2], b[3], #c, d[1]");
+
+   BOOST_REQUIRE_EQUAL (ret.size(), 8U);
+   BOOST_CHECK_EQUAL (ret[0].asNumber(), 4);
+   BOOST_CHECK_EQUAL (ret[1].asNumber(), 0);
+   BOOST_CHECK_EQUAL (ret[2].asNumber(), 10);
+   BOOST_CHECK_EQUAL (ret[3].asNumber(), 3);
+   BOOST_CHECK_EQUAL (ret[4].asNumber(), 2);
+   BOOST_CHECK_EQUAL (ret[5].asNumber(), -3);
+   BOOST_CHECK_EQUAL (ret[6].asNumber(), 0);
+   BOOST_CHECK_EQUAL (ret[7].asNumber(), 0.5);
+
+   // Arrays created in Lua can be used from C++
+   lua_State* state = ls.getState();
+   ls.doString ("bytes = arrays.uint8 {7, 8, 9}");
+   lua_getglobal (state, "bytes");
+   std::size_t size = 0;
+   const boost::uint8_t* bytes = ToTypedArray<boost::uint8_t> (state, -1, size);
+   BOOST_REQUIRE_EQUAL (size, 3U);
+   BOOST_CHECK_EQUAL (bytes[0], 7);
+   BOOST_CHECK_EQUAL (bytes[2], 9);
+   lua_pop (state, 1);
+
+   BOOST_CHECK_THROW (ls.doString ("arrays.float64 (-1)"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("arrays.float64 (1.5)"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("arrays.float64 (1e300)"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("arrays.float64 (1/0)"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("arrays.float64 ('x')"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("arrays.float64 {1, 'x'}"),
+                      LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("arrays.uint8 {1, 300}"), LuaRunTimeError);
+}
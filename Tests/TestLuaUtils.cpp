@@ -199,3 +199,126 @@ BOOST_AUTO_TEST_CASE(TestToLuaValueLuaFunction)
    BOOST_REQUIRE_EQUAL (ret.size(), 1u);
    BOOST_CHECK_EQUAL (ret[0].asInteger(), 25);
 }
+
+
+
+// - TestToLuaValueShareTables -------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestToLuaValueShareTables)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+
+   // The same results as 'CopyTables' for a tree with shared subtables
+   ls.doString ("shared = { 1, 2, x = 'x' }\n"
+                "t = { a = shared, b = shared, c = { shared, 'c' } }");
+   lua_getglobal (ls.getState(), "t");
+   const LuaValue copied = ToLuaValue (ls.getState(), -1);
+   const LuaValue sharedTables = ToLuaValue (ls.getState(), -1, ShareTables);
+   BOOST_CHECK (copied == sharedTables);
+   BOOST_CHECK_EQUAL (sharedTables["c"][1]["x"].asString(), "x");
+   BOOST_CHECK_EQUAL (lua_gettop (ls.getState()), 1);
+   lua_settop (ls.getState(), 0);
+
+   // Each level references the previous one twice: copying this would need
+   // 2^100 tables
+   ls.doString ("t = { }\n"
+                "for i = 1, 100 do t = { left = t, right = t, level = i } end");
+   lua_getglobal (ls.getState(), "t");
+   LuaValue dag = ToLuaValue (ls.getState(), -1, ShareTables);
+   BOOST_CHECK_EQUAL (dag["level"].asInteger(), 100);
+   BOOST_CHECK_EQUAL (dag["left"]["right"]["level"].asInteger(), 98);
+   BOOST_CHECK (dag["left"] == dag["right"]);
+   lua_settop (ls.getState(), 0);
+
+   // Cycles are reported, and the stack is left as it was
+   ls.doString ("t = { a = { } }; t.a.b = { parent = t }");
+   lua_getglobal (ls.getState(), "t");
+   BOOST_CHECK_THROW (ToLuaValue (ls.getState(), -1, ShareTables),
+                      LuaTypeError);
+   BOOST_CHECK_EQUAL (lua_gettop (ls.getState()), 1);
+   lua_settop (ls.getState(), 0);
+
+   // Non-table values are converted as usual
+   lua_pushstring (ls.getState(), "Hello!");
+   BOOST_CHECK_EQUAL (
+      ToLuaValue (ls.getState(), -1, ShareTables).asString(), "Hello!");
+}
+
+
+
+// - TestConversionLimits ------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestConversionLimits)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   lua_State* state = ls.getState();
+
+   // Deeper than the default limit (but fine with a larger limit); this used
+   // to overflow the Lua stack
+   ls.doString ("deep = { }\n"
+                "for i = 1, 3000 do deep = { child = deep, level = i } end");
+   lua_getglobal (state, "deep");
+   BOOST_CHECK_THROW (ToLuaValue (state, -1), LuaTypeError);
+   BOOST_CHECK_EQUAL (lua_gettop (state), 1);
+
+   const LuaValue deep =
+      ToLuaValue (state, -1, CopyTables, ConversionLimits (3001));
+   BOOST_CHECK_EQUAL (lua_gettop (state), 1);
+
+   int depth = 0;
+   for (LuaValue v = deep; v.type() == LUA_TTABLE; v = v["child"])
+      ++depth;
+   BOOST_CHECK_EQUAL (depth, 3001);
+   lua_settop (state, 0);
+
+   // And back to Lua
+   BOOST_CHECK_THROW (PushLuaValue (state, deep), LuaTypeError);
+   BOOST_CHECK_EQUAL (lua_gettop (state), 0);
+
+   PushLuaValue (state, deep, ConversionLimits (3001));
+   lua_setglobal (state, "deepAgain");
+   BOOST_CHECK_EQUAL (
+      ls.doString ("local n = 0\n"
+                   "while deepAgain do n = n + 1; deepAgain = deepAgain.child "
+                   "end\n"
+                   "return n")[0].asInteger(), 3001);
+
+   // Tables used as keys count as nesting, too
+   ls.doString ("k = { { } }; t = { [k] = true }");
+   lua_getglobal (state, "t");
+   BOOST_CHECK_THROW (ToLuaValue (state, -1, CopyTables, ConversionLimits (2)),
+                      LuaTypeError);
+   const LuaValue withTableKey =
+      ToLuaValue (state, -1, CopyTables, ConversionLimits (3));
+   BOOST_CHECK_THROW (PushLuaValue (state, withTableKey, ConversionLimits (2)),
+                      LuaTypeError);
+   PushLuaValue (state, withTableKey, ConversionLimits (3));
+   BOOST_CHECK (ToLuaValue (state, -1) == withTableKey);
+   lua_settop (state, 0);
+
+   // Number of elements, summed over all tables
+   ls.doString ("t = { 1, 2, 3, { 4, 5 } }");
+   lua_getglobal (state, "t");
+   BOOST_CHECK_THROW (
+      ToLuaValue (state, -1, CopyTables, ConversionLimits (10, 5)),
+      LuaTypeError);
+   BOOST_CHECK_EQUAL (lua_gettop (state), 1);
+   const LuaValue t =
+      ToLuaValue (state, -1, CopyTables, ConversionLimits (10, 6));
+   lua_settop (state, 0);
+
+   BOOST_CHECK_THROW (PushLuaValue (state, t, ConversionLimits (10, 5)),
+                      LuaTypeError);
+   BOOST_CHECK_EQUAL (lua_gettop (state), 0);
+   PushLuaValue (state, t, ConversionLimits (10, 6));
+   BOOST_CHECK (ToLuaValue (state, -1) == t);
+   lua_settop (state, 0);
+
+   // Cyclic tables hit the depth limit instead of crashing
+   ls.doString ("cyclic = { }; cyclic.self = cyclic");
+   lua_getglobal (state, "cyclic");
+   BOOST_CHECK_THROW (ToLuaValue (state, -1), LuaTypeError);
+   BOOST_CHECK_EQUAL (lua_gettop (state), 1);
+}
@@ -293,6 +293,9 @@ BOOST_AUTO_TEST_CASE(TestLuaValueAsSomethingFunctions)
    BOOST_CHECK (tableValue.asTable()[5.4].asNumber() == 4);
    BOOST_CHECK (tableValue.asTable()[171].asString() == "Hey!");
    BOOST_CHECK (tableValue.asTable()[true].asString() == "Ahhhh!");
+   BOOST_CHECK (tableValue.asConstTable().find ("Foo")->second.asBoolean()
+                == false);
+   BOOST_CHECK (tableValue.asConstTable().size() == 6);
    BOOST_CHECK (memcmp (anUserDataValue.asUserData().getData(), ints,
                         sizeof(ints)) == 0);
    BOOST_CHECK (memcmp (aLuaFunctionValue.asFunction().getData(), fbc,
@@ -303,6 +306,7 @@ BOOST_AUTO_TEST_CASE(TestLuaValueAsSomethingFunctions)
    BOOST_CHECK_THROW (aNilValue.asNumber(), TypeMismatchError);
    BOOST_CHECK_THROW (aNilValue.asString(), TypeMismatchError);
    BOOST_CHECK_THROW (aNilValue.asTable(), TypeMismatchError);
+   BOOST_CHECK_THROW (aNilValue.asConstTable(), TypeMismatchError);
    BOOST_CHECK_THROW (aNilValue.asFunction(), TypeMismatchError);
    BOOST_CHECK_THROW (aNilValue.asUserData(), TypeMismatchError);
 
@@ -822,3 +826,52 @@ BOOST_AUTO_TEST_CASE(TestLuaValueWithStringWithEmbeddedNull)
       BOOST_CHECK_EQUAL (stringBack[4], 'd');
    }
 }
+
+
+
+// - TestLuaValueCopyOnWrite ---------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaValueCopyOnWrite)
+{
+   using namespace Diluculum;
+
+   // Modifying a copy must not affect the original (and vice versa)
+   LuaValue original (EmptyTable);
+   original["a"] = 1;
+   LuaValue copy (original);
+   copy["a"] = 2;
+   copy["b"] = 3;
+   original["c"] = 4;
+
+   BOOST_CHECK_EQUAL (original["a"].asInteger(), 1);
+   BOOST_CHECK (original["b"] == Nil);
+   BOOST_CHECK_EQUAL (original["c"].asInteger(), 4);
+   BOOST_CHECK_EQUAL (copy["a"].asInteger(), 2);
+   BOOST_CHECK_EQUAL (copy["b"].asInteger(), 3);
+   BOOST_CHECK (copy["c"] == Nil);
+
+   // Storing a table into itself stores a snapshot, not a reference
+   LuaValue self (EmptyTable);
+   self["x"] = 1;
+   self["self"] = self;
+   BOOST_CHECK_EQUAL (self["self"]["x"].asInteger(), 1);
+   BOOST_CHECK (self["self"]["self"] == Nil);
+
+   // References obtained before a copy must not modify the copy
+   LuaValue outer (EmptyTable);
+   LuaValue& inner = outer["inner"];
+   inner = EmptyTable;
+   const LuaValue snapshot (outer);
+   inner["x"] = 1;
+   BOOST_CHECK_EQUAL (outer["inner"]["x"].asInteger(), 1);
+   BOOST_CHECK (snapshot["inner"]["x"] == Nil);
+
+   // Assigning a value that lives inside the table being replaced
+   LuaValue nested (EmptyTable);
+   nested["child"] = EmptyTable;
+   nested["child"]["leaf"] = "leaf";
+   const LuaValue constNested (nested);
+   LuaValue target (constNested);
+   target = constNested["child"];
+   target = target["leaf"];
+   BOOST_CHECK_EQUAL (target.asString(), "leaf");
+}
@@ -424,6 +424,11 @@ BOOST_AUTO_TEST_CASE(TestLuaVariableExceptions)
    // Accessing an (obviously) invalid key of an invalid table shall throw
    BOOST_CHECK_THROW (ls["x"]["x"].value(), TypeMismatchError);
 
+   // The same is true when checking types
+   BOOST_CHECK (lv1.type() == LUA_TTABLE);
+   BOOST_CHECK (lv4.type() == LUA_TNIL);
+   BOOST_CHECK_THROW (ls["x"]["x"].type(), TypeMismatchError);
+
    // Subscripting a non-table shall throw, too
    BOOST_CHECK_THROW (ls["a"]["x"].value(), TypeMismatchError);
 }
@@ -612,3 +617,385 @@ BOOST_AUTO_TEST_CASE(TestLuaVariablePushLastTable)
    BOOST_REQUIRE (lua_isnumber (rawState, -1));
    BOOST_CHECK (lua_tonumber (rawState, -1) == 171);
 }
+
+
+
+// - TestLuaVariableBind -------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaVariableBind)
+{
+   using namespace Diluculum;
+   LuaState ls;
+   lua_State* rawState = ls.getState();
+
+   ls.doString ("config = { limits = { rate = 10 } }");
+   ls.doString ("function config.limits.twice(x) return 2 * x end");
+
+   LuaVariable rate = ls["config"]["limits"]["rate"];
+   BOOST_CHECK (!rate.isBound());
+   rate.bind();
+   BOOST_CHECK (rate.isBound());
+
+   // Reads and writes go to the right place, and leave the stack clean
+   BOOST_CHECK (rate == 10);
+   rate = 20;
+   BOOST_CHECK (ls.doString ("return config.limits.rate")[0] == 20);
+   ls.doString ("config.limits.rate = 30");
+   BOOST_CHECK (rate == 30);
+   BOOST_CHECK (lua_gettop (rawState) == 0);
+
+   // Calls work, too
+   LuaVariable twice = ls["config"]["limits"]["twice"];
+   twice.bind();
+   BOOST_CHECK (twice (21)[0] == 42);
+
+   // Copies share the binding
+   LuaVariable rateCopy = rate;
+   BOOST_CHECK (rateCopy.isBound());
+   BOOST_CHECK (rateCopy == rate);
+
+   // Replacing an intermediate table: the binding still refers to the old one
+   ls.doString ("oldLimits = config.limits; config.limits = { rate = 99 }");
+   BOOST_CHECK (rate == 30);
+   BOOST_CHECK (ls["config"]["limits"]["rate"] == 99);
+
+   // ...until the bindings are invalidated
+   InvalidateBindings (rawState);
+   BOOST_CHECK (rate == 99);
+   BOOST_CHECK (rateCopy == 99);
+   rate = 100;
+   BOOST_CHECK (ls.doString ("return config.limits.rate")[0] == 100);
+   BOOST_CHECK (ls.doString ("return oldLimits.rate")[0] == 30);
+
+   // Explicit rebinding works, too
+   ls.doString ("config.limits = { rate = 7 }");
+   rate.bind();
+   BOOST_CHECK (rate == 7);
+
+   // After unbinding, the key sequence is traversed every time
+   rate.unbind();
+   BOOST_CHECK (!rate.isBound());
+   ls.doString ("config.limits = { rate = 8 }");
+   BOOST_CHECK (rate == 8);
+
+   // Global variables can be bound as well
+   ls["g"] = "global";
+   LuaVariable g = ls["g"];
+   g.bind();
+   BOOST_CHECK (g == "global");
+   g = "changed";
+   BOOST_CHECK (ls["g"] == "changed");
+
+   // Binding a path that goes through a non-table is an error
+   ls["notATable"] = 1;
+   LuaVariable bad = ls["notATable"]["x"];
+   BOOST_CHECK_THROW (bad.bind(), TypeMismatchError);
+   BOOST_CHECK (!bad.isBound());
+   lua_settop (rawState, 0);
+
+   // If the path becomes invalid, invalidated variables report it when used
+   ls.doString ("config.limits = 1");
+   InvalidateBindings (rawState);
+   BOOST_CHECK_THROW (rateCopy.value(), TypeMismatchError);
+}
+
+
+
+// - ThrowsWhenPushed ----------------------------------------------------------
+/// A type whose 'LuaTypeTraits' always throw when pushing.
+struct ThrowsWhenPushed { };
+
+namespace Diluculum
+{
+   template <>
+   struct LuaTypeTraits<ThrowsWhenPushed>
+   {
+      static void push (lua_State*, const ThrowsWhenPushed&)
+      {
+         throw LuaTypeError ("Cannot push this.");
+      }
+   };
+}
+
+
+
+// - TestLuaVariableTypedCall --------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaVariableTypedCall)
+{
+   using namespace Diluculum;
+   LuaState ls;
+   lua_State* rawState = ls.getState();
+
+   ls.doString ("function Answer() return 42 end");
+   ls.doString ("function Add (a, b) return a + b end");
+   ls.doString ("function Describe (n, s, b) "
+                "   return n * 2, s .. '!', not b "
+                "end");
+   ls.doString ("function Sum5 (a, b, c, d, e) return a + b + c + d + e end");
+   ls.doString ("called = false; function SetCalled() called = true end");
+   ls.doString ("t = { f = function (x) return x .. x end }");
+
+   // No parameters, single result
+   BOOST_CHECK (ls["Answer"].call<double>() == 42.0);
+   BOOST_CHECK (ls["Answer"].call<int>() == 42);
+   BOOST_CHECK (ls["Answer"].call<LuaValue>() == 42);
+
+   // No results
+   ls["SetCalled"].call<void>();
+   BOOST_CHECK (ls["called"] == true);
+
+   // Native parameters, including string literals and std::strings
+   BOOST_CHECK (ls["Add"].call<double> (1.5, 2) == 3.5);
+   BOOST_CHECK (ls["t"]["f"].call<std::string> ("ab") == "abab");
+   BOOST_CHECK (ls["t"]["f"].call<std::string> (std::string ("c\0d", 3))
+                == std::string ("c\0dc\0d", 6));
+   BOOST_CHECK (ls["Sum5"].call<int> (1, 2u, 3L, 4.0f, 5.0) == 15);
+
+   // Multiple results
+   boost::tuple<double, std::string, bool> res =
+      ls["Describe"].call<boost::tuple<double, std::string, bool> > (
+         10, "hey", true);
+   BOOST_CHECK (boost::get<0>(res) == 20.0);
+   BOOST_CHECK (boost::get<1>(res) == "hey!");
+   BOOST_CHECK (boost::get<2>(res) == false);
+
+   // Missing results are 'nil'
+   boost::tuple<double, LuaValue> res2 =
+      ls["Answer"].call<boost::tuple<double, LuaValue> >();
+   BOOST_CHECK (boost::get<0>(res2) == 42.0);
+   BOOST_CHECK (boost::get<1>(res2) == Nil);
+
+   // Like in 'luaL_checkstring()', numbers are read as strings
+   BOOST_CHECK (ls["Answer"].call<std::string>() == "42");
+
+   // The stack is left untouched
+   BOOST_CHECK (lua_gettop (rawState) == 0);
+
+   // Errors
+   BOOST_CHECK_THROW (ls["Answer"].call<LuaValueMap>(), TypeMismatchError);
+   BOOST_CHECK_THROW (ls["Add"].call<double> (1, "x"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls["nonExistent"].call<void>(), TypeMismatchError);
+   BOOST_CHECK (lua_gettop (rawState) == 0);
+
+   // If pushing a parameter throws, the function is not left on the stack
+   BOOST_CHECK_THROW (ls["Add"].call<double> (1, ThrowsWhenPushed()),
+                      LuaTypeError);
+   BOOST_CHECK (lua_gettop (rawState) == 0);
+
+   // Bound variables work, too
+   LuaVariable add = ls["Add"];
+   add.bind();
+   BOOST_CHECK (add.call<double> (20, 22) == 42.0);
+}
+
+
+
+// - Helpers for TestLuaVariableForEach ----------------------------------------
+namespace
+{
+   /// Counts the entries of a table, and sums the ones keyed by "price".
+   struct PriceCollector
+   {
+      PriceCollector() : numEntries(0), totalPrice(0.0) { }
+
+      void operator() (const Diluculum::LuaView&,
+                       const Diluculum::LuaView& value)
+      {
+         ++numEntries;
+         value.forEach (PriceAdder (totalPrice));
+      }
+
+      struct PriceAdder
+      {
+         PriceAdder (double& total) : total_(total) { }
+
+         void operator() (const Diluculum::LuaView& key,
+                          const Diluculum::LuaView& value)
+         {
+            if (key == "price")
+               total_ += value.asNumber();
+         }
+
+         double& total_;
+      };
+
+      int numEntries;
+      double totalPrice;
+   };
+
+   /// Throws when it finds a given key.
+   struct ThrowOnKey
+   {
+      void operator() (const Diluculum::LuaView& key,
+                       const Diluculum::LuaView&)
+      {
+         if (key == "bad")
+            throw Diluculum::LuaError ("Found a bad key!");
+      }
+   };
+}
+
+
+
+// - TestLuaVariableForEach ----------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaVariableForEach)
+{
+   using namespace Diluculum;
+   LuaState ls;
+   lua_State* rawState = ls.getState();
+
+   ls.doString ("items = { } "
+                "for i = 1, 100 do "
+                "   items[i] = { name = 'item' .. i, price = i, "
+                "                tags = { 'a', 'b' } } "
+                "end");
+
+   PriceCollector collector = ls["items"].forEach (PriceCollector());
+   BOOST_CHECK (collector.numEntries == 100);
+   BOOST_CHECK (collector.totalPrice == 5050.0);
+   BOOST_CHECK (lua_gettop (rawState) == 0);
+
+   // Nested variables work, too
+   ls.doString ("outer = { inner = { price = { price = 3 } } }");
+   collector = ls["outer"]["inner"].forEach (PriceCollector());
+   BOOST_CHECK (collector.numEntries == 1);
+   BOOST_CHECK (collector.totalPrice == 3.0);
+
+   // Empty tables
+   ls.doString ("empty = { }");
+   collector = ls["empty"].forEach (PriceCollector());
+   BOOST_CHECK (collector.numEntries == 0);
+
+   // The stack is cleaned up if the callback throws
+   ls.doString ("t = { good = 1, bad = 2 }");
+   BOOST_CHECK_THROW (ls["t"].forEach (ThrowOnKey()), LuaError);
+   BOOST_CHECK (lua_gettop (rawState) == 0);
+
+   // Not a table
+   ls["n"] = 1;
+   BOOST_CHECK_THROW (ls["n"].forEach (ThrowOnKey()), TypeMismatchError);
+   BOOST_CHECK (lua_gettop (rawState) == 0);
+}
+
+
+
+// - TestLuaVariableGetSetFields -----------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaVariableGetSetFields)
+{
+   using namespace Diluculum;
+   LuaState ls;
+   lua_State* rawState = ls.getState();
+
+   ls.doString ("ctx = { req = { a = 1, b = 'two', c = true } }");
+   ls.doString ("alias = ctx.req");
+
+   // Reading, with a C array of names
+   const char* names[] = { "a", "b", "c", "missing" };
+   LuaValueList values;
+   ls["ctx"]["req"].getFields (names, 4, values);
+   BOOST_REQUIRE (values.size() == 4);
+   BOOST_CHECK (values[0] == 1);
+   BOOST_CHECK (values[1] == "two");
+   BOOST_CHECK (values[2] == true);
+   BOOST_CHECK (values[3] == Nil);
+
+   // Reading again into the same list, with a vector of names
+   std::vector<std::string> nameVec;
+   nameVec.push_back ("c");
+   nameVec.push_back ("a");
+   ls["ctx"]["req"].getFields (nameVec, values);
+   BOOST_REQUIRE (values.size() == 2);
+   BOOST_CHECK (values[0] == true);
+   BOOST_CHECK (values[1] == 1);
+   BOOST_CHECK (lua_gettop (rawState) == 0);
+
+   // Writing: the table is changed in place
+   LuaValueMap fields;
+   fields["a"] = 10;
+   fields["d"] = "new";
+   fields[std::string ("e\0f", 3)] = "zero";
+   fields[1] = "first";
+   fields["c"] = Nil;
+   ls["ctx"]["req"].setFields (fields);
+   BOOST_CHECK (lua_gettop (rawState) == 0);
+
+   BOOST_CHECK (ls["alias"]["a"] == 10);
+   BOOST_CHECK (ls["alias"]["b"] == "two");
+   BOOST_CHECK (ls["alias"]["c"] == Nil);
+   BOOST_CHECK (ls["alias"]["d"] == "new");
+   BOOST_CHECK (ls["alias"][std::string ("e\0f", 3)] == "zero");
+   BOOST_CHECK (ls["alias"][1] == "first");
+   BOOST_CHECK (ls.doString ("return ctx.req == alias")[0] == true);
+
+   // Errors
+   ls["n"] = 1;
+   BOOST_CHECK_THROW (ls["n"].getFields (names, 4, values), TypeMismatchError);
+   BOOST_CHECK_THROW (ls["n"].setFields (fields), TypeMismatchError);
+   BOOST_CHECK (lua_gettop (rawState) == 0);
+}
+
+
+
+// - TestLuaVariableApplyDiff --------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaVariableApplyDiff)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   lua_State* rawState = ls.getState();
+
+   LuaValueMap pos;
+   pos["x"] = 1;
+   pos["y"] = 2;
+
+   LuaValueMap oldValue;
+   oldValue["name"] = "foo";
+   oldValue["hp"] = 100;
+   oldValue["gone"] = true;
+   oldValue["pos"] = pos;
+   oldValue[1] = "a";
+   oldValue[2] = "b";
+
+   ls["world"] = oldValue;
+   ls.doString ("alias = world; posAlias = world.pos");
+
+   LuaValueMap newPos (pos);
+   newPos["y"] = 3;
+   newPos["z"] = 4;
+
+   LuaValueMap newValue (oldValue);
+   newValue.erase ("gone");
+   newValue["hp"] = 90;
+   newValue["pos"] = newPos;
+   newValue["new"] = "bar";
+   newValue[2] = "c";
+
+   ls["world"].applyDiff (oldValue, newValue);
+   BOOST_CHECK (lua_gettop (rawState) == 0);
+
+   // The table (and its subtable) are changed in place
+   BOOST_CHECK (ls.doString ("return world == alias")[0] == true);
+   BOOST_CHECK (ls.doString ("return world.pos == posAlias")[0] == true);
+   BOOST_CHECK (ls["world"].value() == newValue);
+   BOOST_CHECK (ls["alias"]["gone"] == Nil);
+   BOOST_CHECK (ls["posAlias"]["y"] == 3);
+   BOOST_CHECK (ls["posAlias"]["z"] == 4);
+
+   // Only changed entries are written
+   ls.doString ("world.name = 'changed by Lua'");
+   ls["world"].applyDiff (newValue, newValue);
+   BOOST_CHECK (ls["world"]["name"] == "changed by Lua");
+
+   // A subtable replaced by Lua with a non-table is assigned as a whole
+   ls.doString ("world.pos = 'nowhere'");
+   ls["world"].applyDiff (newValue, oldValue);
+   BOOST_CHECK (ls["world"]["pos"].value() == pos);
+   BOOST_CHECK (ls["world"]["gone"] == true);
+   BOOST_CHECK (ls["world"]["new"] == Nil);
+   BOOST_CHECK (lua_gettop (rawState) == 0);
+
+   // Errors
+   ls["n"] = 1;
+   BOOST_CHECK_THROW (ls["n"].applyDiff (oldValue, newValue),
+                      TypeMismatchError);
+   BOOST_CHECK (lua_gettop (rawState) == 0);
+}
@@ -0,0 +1,196 @@
+/******************************************************************************\
+* TestLuaVectors.cpp                                                           *
+* Unit tests for the vector and matrix classes exported to Lua.                *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#define BOOST_TEST_MODULE LuaVectors
+
+#include <boost/test/unit_test.hpp>
+#include <Diluculum/LuaState.hpp>
+#include <Diluculum/LuaVectors.hpp>
+
+
+// - TestVec3 ------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestVec3)
+{
+   using namespace Diluculum;
+   LuaState ls;
+   RegisterVectorClasses (ls["geom"]);
+
+   ls.doString ("Vec3 = geom.Vec3");
+   ls.doString ("a = Vec3.new (1, 2, 3); b = Vec3.new (4, 5, 6)");
+
+   // Properties
+   LuaValueList ret = ls.doString ("return a.x, a.y, a.z, Vec3.new().z");
+   BOOST_REQUIRE (ret.size() == 4);
+   BOOST_CHECK (ret[0] == 1);
+   BOOST_CHECK (ret[1] == 2);
+   BOOST_CHECK (ret[2] == 3);
+   BOOST_CHECK (ret[3] == 0);
+
+   ls.doString ("c = Vec3.new (1, 2, 3); c.y = 10");
+   BOOST_CHECK (ls.doString ("return c.y")[0] == 10);
+   BOOST_CHECK (ls.doString ("return a.y")[0] == 2);
+
+   // Methods
+   ret = ls.doString ("return a:dot (b), Vec3.new (3, 0, 4):length(), "
+                      "tostring (a:cross (b)), tostring (b:normalized() * 0)");
+   BOOST_REQUIRE (ret.size() == 4);
+   BOOST_CHECK (ret[0] == 32);
+   BOOST_CHECK (ret[1] == 5);
+   BOOST_CHECK (ret[2] == "Vec3(-3, 6, -3)");
+   BOOST_CHECK (ret[3] == "Vec3(0, 0, 0)");
+
+   // Metamethods
+   ret = ls.doString ("return tostring (a + b), tostring (b - a), "
+                      "tostring (-a), tostring (2 * a), tostring (a * 2), "
+                      "tostring (a * b), tostring (b / 2)");
+   BOOST_REQUIRE (ret.size() == 7);
+   BOOST_CHECK (ret[0] == "Vec3(5, 7, 9)");
+   BOOST_CHECK (ret[1] == "Vec3(3, 3, 3)");
+   BOOST_CHECK (ret[2] == "Vec3(-1, -2, -3)");
+   BOOST_CHECK (ret[3] == "Vec3(2, 4, 6)");
+   BOOST_CHECK (ret[4] == "Vec3(2, 4, 6)");
+   BOOST_CHECK (ret[5] == "Vec3(4, 10, 18)");
+   BOOST_CHECK (ret[6] == "Vec3(2, 2.5, 3)");
+
+   ret = ls.doString ("return a == Vec3.new (1, 2, 3), a == b, a ~= b");
+   BOOST_REQUIRE (ret.size() == 3);
+   BOOST_CHECK (ret[0] == true);
+   BOOST_CHECK (ret[1] == false);
+   BOOST_CHECK (ret[2] == true);
+
+   // Scaling by infinity must not leak into other operations
+   ret = ls.doString ("local inf = Vec3.new (1, 0, 0) * (1/0) "
+                      "return inf.x, (inf * 0):dot (a)");
+   BOOST_REQUIRE (ret.size() == 2);
+   BOOST_CHECK (ret[0].asNumber() > 1e300);
+   BOOST_CHECK (ret[1].asNumber() != ret[1].asNumber()); // NaN
+
+   // Values can be read back in C++
+   lua_getglobal (ls.getState(), "a");
+   BOOST_CHECK (LuaTypeTraits<Vec3>::is (ls.getState(), -1));
+   BOOST_CHECK (LuaTypeTraits<Vec4>::is (ls.getState(), -1) == false);
+   BOOST_CHECK (LuaTypeTraits<Vec3>::get (ls.getState(), -1) + Vec3 (4, 5, 6)
+                == Vec3 (5, 7, 9));
+   lua_pop (ls.getState(), 1);
+
+   // Errors
+   BOOST_CHECK_THROW (ls.doString ("Vec3.new (1, 2)"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("Vec3.new (1, 2, 'x')"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("Vec3.new():normalized()"),
+                      LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("return a + 1"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("return a * 'x'"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("return a * geom.Vec4.new()"),
+                      LuaRunTimeError);
+}
+
+
+
+// - TestVec4 ------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestVec4)
+{
+   using namespace Diluculum;
+   LuaState ls;
+   RegisterVectorClasses (ls["geom"]);
+
+   ls.doString ("Vec4 = geom.Vec4");
+   ls.doString ("a = Vec4.new (1, 2, 3, 4); b = Vec4.new (4, 3, 2, 1)");
+
+   LuaValueList ret = ls.doString ("return a.w, a:dot (b), "
+                                   "Vec4.new (1, 1, 1, 1):length()");
+   BOOST_REQUIRE (ret.size() == 3);
+   BOOST_CHECK (ret[0] == 4);
+   BOOST_CHECK (ret[1] == 20);
+   BOOST_CHECK (ret[2] == 2);
+
+   ls.doString ("a.w = 8");
+   ret = ls.doString ("return tostring (a + b), tostring (a * 0.5), "
+                      "tostring (-b), a == Vec4.new (1, 2, 3, 8)");
+   BOOST_REQUIRE (ret.size() == 4);
+   BOOST_CHECK (ret[0] == "Vec4(5, 5, 5, 9)");
+   BOOST_CHECK (ret[1] == "Vec4(0.5, 1, 1.5, 4)");
+   BOOST_CHECK (ret[2] == "Vec4(-4, -3, -2, -1)");
+   BOOST_CHECK (ret[3] == true);
+
+   BOOST_CHECK_THROW (ls.doString ("Vec4.new (1, 2, 3)"), LuaRunTimeError);
+}
+
+
+
+// - TestMat4 ------------------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestMat4)
+{
+   using namespace Diluculum;
+   LuaState ls;
+   RegisterVectorClasses (ls["geom"]);
+
+   ls.doString ("Vec3, Vec4, Mat4 = geom.Vec3, geom.Vec4, geom.Mat4");
+
+   // A translation by (10, 20, 30)
+   ls.doString ("t = Mat4.new (1, 0, 0, 10,"
+                "              0, 1, 0, 20,"
+                "              0, 0, 1, 30,"
+                "              0, 0, 0, 1)");
+
+   LuaValueList ret = ls.doString(
+      "return t:get (1, 4), t:get (4, 1), Mat4.new():get (3, 3), "
+      "tostring (t * Vec3.new (1, 2, 3)), "
+      "tostring (t * Vec4.new (1, 2, 3, 0)), "
+      "tostring (t * t * Vec3.new())");
+   BOOST_REQUIRE (ret.size() == 6);
+   BOOST_CHECK (ret[0] == 10);
+   BOOST_CHECK (ret[1] == 0);
+   BOOST_CHECK (ret[2] == 1);
+   BOOST_CHECK (ret[3] == "Vec3(11, 22, 33)");
+   BOOST_CHECK (ret[4] == "Vec4(1, 2, 3, 0)");
+   BOOST_CHECK (ret[5] == "Vec3(20, 40, 60)");
+
+   ret = ls.doString(
+      "local m = Mat4.new (1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, "
+      "                    15, 16) "
+      "local id = Mat4.new() "
+      "return m * id == m, id * m == m, m:transposed():get (1, 2), "
+      "tostring (m), m:transposed():transposed() == m, "
+      "(m + m) == 2 * m, (m * 2):get (4, 4)");
+   BOOST_REQUIRE (ret.size() == 7);
+   BOOST_CHECK (ret[0] == true);
+   BOOST_CHECK (ret[1] == true);
+   BOOST_CHECK (ret[2] == 5);
+   BOOST_CHECK (ret[3] == "Mat4((1, 2, 3, 4), (5, 6, 7, 8), (9, 10, 11, 12), "
+                "(13, 14, 15, 16))");
+   BOOST_CHECK (ret[4] == true);
+   BOOST_CHECK (ret[5] == true);
+   BOOST_CHECK (ret[6] == 32);
+
+   ls.doString ("t:set (2, 4, -20)");
+   BOOST_CHECK (ls.doString ("return tostring (t * Vec3.new())")[0]
+                == "Vec3(10, -20, 30)");
+
+   BOOST_CHECK_THROW (ls.doString ("t:get (0, 1)"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("t:set (1, 5, 0)"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("Mat4.new (1, 2, 3)"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("return t * 'x'"), LuaRunTimeError);
+}
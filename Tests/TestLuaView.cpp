@@ -0,0 +1,178 @@
+/******************************************************************************\
+* TestLuaView.cpp                                                              *
+* Unit tests for things declared in 'LuaView.hpp'.                             *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#define BOOST_TEST_MODULE LuaView
+
+#include <cstring>
+#include <boost/test/unit_test.hpp>
+#include <Diluculum/LuaState.hpp>
+#include <Diluculum/LuaView.hpp>
+
+
+namespace
+{
+   /// Sums the values of a table, recursing into nested tables.
+   struct DeepSummer
+   {
+      DeepSummer() : sum(0.0), numTables(0) { }
+
+      void operator() (const Diluculum::LuaView&,
+                       const Diluculum::LuaView& value)
+      {
+         if (value.type() == LUA_TTABLE)
+         {
+            ++numTables;
+            DeepSummer inner = value.forEach (DeepSummer());
+            sum += inner.sum;
+            numTables += inner.numTables;
+         }
+         else
+         {
+            sum += value.asNumber();
+         }
+      }
+
+      double sum;
+      int numTables;
+   };
+}
+
+
+
+// - TestLuaViewAccess ---------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaViewAccess)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   lua_State* rawState = ls.getState();
+
+   lua_pushnumber (rawState, 12.5);
+   lua_pushlstring (rawState, "a\0b", 3);
+   lua_pushboolean (rawState, 1);
+   lua_pushnil (rawState);
+
+   LuaView number (rawState, 1);
+   LuaView string (rawState, -3);
+   LuaView boolean (rawState, -2);
+   LuaView nil (rawState, -1);
+
+   // Negative indices are made absolute
+   BOOST_CHECK (string.getIndex() == 2);
+   lua_pushnumber (rawState, 1.0);
+   BOOST_CHECK (string.getIndex() == 2);
+   BOOST_CHECK (string.type() == LUA_TSTRING);
+   lua_pop (rawState, 1);
+
+   BOOST_CHECK (number.type() == LUA_TNUMBER);
+   BOOST_CHECK (number.typeName() == "number");
+   BOOST_CHECK (number.asNumber() == 12.5);
+   BOOST_CHECK (number.asInteger() == 12);
+   BOOST_CHECK (string.asString() == std::string ("a\0b", 3));
+   BOOST_CHECK (boolean.asBoolean() == true);
+   BOOST_CHECK (nil.type() == LUA_TNIL);
+
+   // Strict type checks
+   BOOST_CHECK_THROW (number.asString(), TypeMismatchError);
+   BOOST_CHECK_THROW (string.asNumber(), TypeMismatchError);
+   BOOST_CHECK_THROW (nil.asBoolean(), TypeMismatchError);
+   BOOST_CHECK_THROW (nil.forEach (DeepSummer()), TypeMismatchError);
+
+   // Comparisons
+   BOOST_CHECK (number == 12.5);
+   BOOST_CHECK (number != "12.5");
+   BOOST_CHECK (string == std::string ("a\0b", 3));
+   BOOST_CHECK (string != "a");
+   BOOST_CHECK (boolean == true);
+   BOOST_CHECK (nil == Nil);
+   BOOST_CHECK (nil != false);
+
+   // Conversion to 'LuaValue'
+   BOOST_CHECK (number.value() == 12.5);
+   BOOST_CHECK (string.value() == std::string ("a\0b", 3));
+
+   BOOST_CHECK (lua_gettop (rawState) == 4);
+}
+
+
+
+// - TestLuaViewZeroCopy -------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaViewZeroCopy)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   lua_State* rawState = ls.getState();
+
+   lua_pushlstring (rawState, "a\0b", 3);
+   void* ud = lua_newuserdata (rawState, 1000);
+   memset (ud, 7, 1000);
+   lua_pushnumber (rawState, 1.0);
+
+   LuaView string (rawState, 1);
+   LuaView userData (rawState, 2);
+   LuaView number (rawState, 3);
+
+   // The pointers point right into the memory owned by Lua
+   BOOST_CHECK (string.asStringData() == lua_tostring (rawState, 1));
+   BOOST_CHECK (memcmp (string.asStringData(), "a\0b", 4) == 0);
+   BOOST_CHECK_EQUAL (string.size(), 3u);
+
+   BOOST_CHECK (userData.asUserDataPointer() == ud);
+   BOOST_CHECK_EQUAL (userData.size(), 1000u);
+   static_cast<char*>(userData.asUserDataPointer())[999] = 8;
+   BOOST_CHECK_EQUAL (static_cast<char*>(ud)[999], 8);
+
+   // Strict type checks
+   BOOST_CHECK_THROW (userData.asStringData(), TypeMismatchError);
+   BOOST_CHECK_THROW (string.asUserDataPointer(), TypeMismatchError);
+   BOOST_CHECK_THROW (number.asStringData(), TypeMismatchError);
+   BOOST_CHECK_THROW (number.size(), TypeMismatchError);
+
+   BOOST_CHECK (lua_gettop (rawState) == 3);
+}
+
+
+
+// - TestLuaViewForEach --------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestLuaViewForEach)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   lua_State* rawState = ls.getState();
+
+   ls.doString ("t = { 1, 2, { 3, 4, { 5 } }, x = 6, y = { z = 7 } }");
+   lua_getglobal (rawState, "t");
+
+   LuaView t (rawState, -1);
+   BOOST_CHECK (t == ls["t"].value());
+
+   DeepSummer summer = t.forEach (DeepSummer());
+   BOOST_CHECK (summer.sum == 28.0);
+   BOOST_CHECK (summer.numTables == 3);
+   BOOST_CHECK (lua_gettop (rawState) == 1);
+}
@@ -0,0 +1,279 @@
+/******************************************************************************\
+* TestLuaVisitor.cpp                                                           *
+* Unit tests for things declared in 'LuaVisitor.hpp'.                          *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#define BOOST_TEST_MODULE LuaVisitor
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <boost/lexical_cast.hpp>
+#include <boost/test/unit_test.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaState.hpp>
+#include <Diluculum/LuaVisitor.hpp>
+
+
+namespace
+{
+   /// A visitor that records the events it gets as a string.
+   class RecordingVisitor: public Diluculum::LuaValueVisitor
+   {
+      public:
+         void beginTable() { events += "{"; }
+         void key() { events += " k:"; }
+         void value() { events += " v:"; }
+         void endTable() { events += " }"; }
+         void nilValue() { events += "nil"; }
+         void booleanValue (bool b) { events += b ? "true" : "false"; }
+
+         void numberValue (lua_Number n)
+         {
+            events += boost::lexical_cast<std::string>(n);
+         }
+
+         void stringValue (const char* str, std::size_t size)
+         {
+            events += "'" + std::string (str, size) + "'";
+         }
+
+         void functionValue (const Diluculum::LuaFunction& func)
+         {
+            events += func.isCFunction() ? "cfunc" : "func";
+         }
+
+         void userDataValue (const void* /*data*/, std::size_t size)
+         {
+            events += "ud" + boost::lexical_cast<std::string>(size);
+         }
+
+         std::string events;
+   };
+
+
+
+   /** A visitor that rebuilds the visited value, to check that the events
+    *  carry everything needed to do so.
+    */
+   class BuildingVisitor: public Diluculum::LuaValueVisitor
+   {
+      public:
+         void beginTable() { stack_.push_back (Level()); }
+
+         void key() { stack_.back().readingKey = true; }
+
+         void value() { stack_.back().readingKey = false; }
+
+         void endTable()
+         {
+            Diluculum::LuaValue table (stack_.back().table);
+            stack_.pop_back();
+            add (table);
+         }
+
+         void nilValue() { add (Diluculum::Nil); }
+         void booleanValue (bool b) { add (b); }
+         void numberValue (lua_Number n) { add (n); }
+
+         void stringValue (const char* str, std::size_t size)
+         {
+            add (std::string (str, size));
+         }
+
+         void functionValue (const Diluculum::LuaFunction& func)
+         {
+            add (func);
+         }
+
+         void userDataValue (const void* data, std::size_t size)
+         {
+            Diluculum::LuaUserData ud (size);
+            memcpy (ud.getData(), data, size);
+            add (ud);
+         }
+
+         Diluculum::LuaValue result;
+
+      private:
+         struct Level
+         {
+               Diluculum::LuaValueMap table;
+               Diluculum::LuaValue key;
+               bool readingKey;
+         };
+
+         void add (const Diluculum::LuaValue& v)
+         {
+            if (stack_.empty())
+               result = v;
+            else if (stack_.back().readingKey)
+               stack_.back().key = v;
+            else
+               stack_.back().table[stack_.back().key] = v;
+         }
+
+         std::vector<Level> stack_;
+   };
+
+
+
+   /// A visitor that gives up on the first string.
+   class ThrowingVisitor: public Diluculum::LuaValueVisitor
+   {
+      public:
+         void stringValue (const char* /*str*/, std::size_t /*size*/)
+         {
+            throw Diluculum::LuaError ("Strings are not welcome here.");
+         }
+   };
+
+   /// Does nothing; used just to have a C function around.
+   int DoNothing (lua_State*)
+   {
+      return 0;
+   }
+}
+
+
+
+// - TestVisitScalars ----------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestVisitScalars)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   lua_State* state = ls.getState();
+
+   lua_pushnil (state);
+   lua_pushboolean (state, 1);
+   lua_pushnumber (state, 1.5);
+   lua_pushlstring (state, "a\0b", 3);
+   lua_pushcfunction (state, DoNothing);
+   lua_newuserdata (state, 7);
+
+   RecordingVisitor visitor;
+   for (int i = 1; i <= 6; ++i)
+      VisitLuaValue (state, i, visitor);
+
+   BOOST_CHECK_EQUAL (visitor.events,
+                      std::string ("niltrue1.5'a\0b'cfuncud7", 23));
+   BOOST_CHECK_EQUAL (lua_gettop (state), 6);
+
+   RecordingVisitor fromValues;
+   for (int i = 1; i <= 6; ++i)
+      VisitLuaValue (ToLuaValue (state, i), fromValues);
+   BOOST_CHECK_EQUAL (fromValues.events, visitor.events);
+}
+
+
+
+// - TestVisitTables -----------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestVisitTables)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   lua_State* state = ls.getState();
+
+   // Table with a single entry, so that the order is known
+   ls.doString ("t = { a = { [{ 1 }] = false } }");
+   lua_getglobal (state, "t");
+   RecordingVisitor visitor;
+   VisitLuaValue (state, -1, visitor);
+   BOOST_CHECK_EQUAL (visitor.events,
+                      "{ k:'a' v:{ k:{ k:1 v:1 } v:false } }");
+   BOOST_CHECK_EQUAL (lua_gettop (state), 1);
+
+   RecordingVisitor fromValue;
+   VisitLuaValue (ToLuaValue (state, -1), fromValue);
+   BOOST_CHECK_EQUAL (fromValue.events, visitor.events);
+   lua_settop (state, 0);
+
+   // Something bigger, rebuilt by a visitor
+   ls.doString ("t = { 1, 2, 3, x = { y = { z = 'z' }, f = function() end },\n"
+                "      [{ 'key' }] = { }, [true] = 1.5 }");
+   lua_getglobal (state, "t");
+   BuildingVisitor builder;
+   VisitLuaValue (state, -1, builder);
+   BOOST_CHECK (builder.result == ToLuaValue (state, -1));
+
+   BuildingVisitor fromValueBuilder;
+   VisitLuaValue (builder.result, fromValueBuilder);
+   BOOST_CHECK (fromValueBuilder.result == builder.result);
+   BOOST_CHECK_EQUAL (lua_gettop (state), 1);
+}
+
+
+
+// - TestVisitErrors -----------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestVisitErrors)
+{
+   using namespace Diluculum;
+
+   LuaState ls;
+   lua_State* state = ls.getState();
+   RecordingVisitor visitor;
+
+   // Unsupported types
+   ls.doString ("t = { co = coroutine.create (function() end) }");
+   lua_getglobal (state, "t");
+   BOOST_CHECK_THROW (VisitLuaValue (state, -1, visitor), LuaTypeError);
+   BOOST_CHECK_EQUAL (lua_gettop (state), 1);
+   lua_settop (state, 0);
+
+   // Limits
+   ls.doString ("t = { { { } }, 2, 3 }");
+   lua_getglobal (state, "t");
+   BOOST_CHECK_THROW (VisitLuaValue (state, -1, visitor, ConversionLimits (2)),
+                      LuaTypeError);
+   BOOST_CHECK_EQUAL (lua_gettop (state), 1);
+   BOOST_CHECK_THROW (
+      VisitLuaValue (state, -1, visitor, ConversionLimits (3, 3)),
+      LuaTypeError);
+   BOOST_CHECK_NO_THROW (
+      VisitLuaValue (state, -1, visitor, ConversionLimits (3, 4)));
+
+   const LuaValue t = ToLuaValue (state, -1);
+   BOOST_CHECK_THROW (VisitLuaValue (t, visitor, ConversionLimits (2)),
+                      LuaTypeError);
+   BOOST_CHECK_THROW (VisitLuaValue (t, visitor, ConversionLimits (3, 3)),
+                      LuaTypeError);
+   BOOST_CHECK_NO_THROW (VisitLuaValue (t, visitor, ConversionLimits (3, 4)));
+   lua_settop (state, 0);
+
+   // Cyclic tables are too deep
+   ls.doString ("t = { }; t.t = t");
+   lua_getglobal (state, "t");
+   BOOST_CHECK_THROW (VisitLuaValue (state, -1, visitor), LuaTypeError);
+   BOOST_CHECK_EQUAL (lua_gettop (state), 1);
+   lua_settop (state, 0);
+
+   // Exceptions thrown by the visitor are propagated
+   ls.doString ("t = { { { 'deep' } } }");
+   lua_getglobal (state, "t");
+   ThrowingVisitor thrower;
+   BOOST_CHECK_THROW (VisitLuaValue (state, -1, thrower), LuaError);
+   BOOST_CHECK_EQUAL (lua_gettop (state), 1);
+}
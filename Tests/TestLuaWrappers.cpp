@@ -26,6 +26,7 @@
 
 #define BOOST_TEST_MODULE LuaWrappers
 
+#include <cstring>
 #include <boost/test/unit_test.hpp>
 #include <Diluculum/LuaState.hpp>
 #include <Diluculum/LuaWrappers.hpp>
@@ -48,6 +49,7 @@ BOOST_AUTO_TEST_CASE(TestFunctionWrapping)
    ls["ConcatenateThree"] = DILUCULUM_WRAPPER_FUNCTION (ConcatenateThree);
    ls["FibonacciSequence"] = DILUCULUM_WRAPPER_FUNCTION (FibonacciSequence);
    ls["ToOrFromString"] = DILUCULUM_WRAPPER_FUNCTION (ToOrFromString);
+   ls["SizesAndSums"] = DILUCULUM_WRAPPER_FUNCTION (SizesAndSums);
 
    // Here we go...
    Diluculum::LuaValueList res;
@@ -119,6 +121,99 @@ BOOST_AUTO_TEST_CASE(TestFunctionWrapping)
    res = ls.doString ("return ToOrFromString ('two')");
    BOOST_REQUIRE (res.size() == 1);
    BOOST_CHECK (res[0] == 2);
+
+   // Functions taking 'LuaView's
+   LuaUserData blob (1000000);
+   memset (blob.getData(), 2, blob.getSize());
+   ls["blob"] = blob;
+   res = ls.doString ("return SizesAndSums ('ab\\0', blob)");
+   BOOST_REQUIRE (res.size() == 4);
+   BOOST_CHECK (res[0] == 3);
+   BOOST_CHECK (res[1] == 'a' + 'b');
+   BOOST_CHECK (res[2] == 1000000);
+   BOOST_CHECK (res[3] == 2000000);
+
+   res = ls.doString ("return SizesAndSums()");
+   BOOST_CHECK (res.size() == 0);
+
+   BOOST_CHECK_THROW (ls.doString ("SizesAndSums ('ok', 1)"), LuaRunTimeError);
+   BOOST_CHECK (lua_gettop (ls.getState()) == 0);
+}
+
+
+
+// - TestFunctionBinding -------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestFunctionBinding)
+{
+   using namespace Diluculum;
+   LuaState ls;
+
+   // The functions used below are defined in 'WrappedFunctions.hpp'
+   ls["Hypotenuse"] = DILUCULUM_BIND_FUNCTION (Hypotenuse);
+   ls["Repeat"] = DILUCULUM_BIND_FUNCTION (Repeat);
+   ls["SetTheGlobalOrZero"] = DILUCULUM_BIND_FUNCTION (SetTheGlobalOrZero);
+   ls["TypeOf"] = DILUCULUM_BIND_FUNCTION (TypeOf);
+   ls["GetTheGlobal"] = DILUCULUM_BIND_FUNCTION (GetTheGlobal);
+   ls["NonNegative"] = DILUCULUM_BIND_FUNCTION (NonNegative);
+   ls["Sum5"] = DILUCULUM_BIND_FUNCTION (Sum5);
+   ls["StringOr"] = DILUCULUM_BIND_FUNCTION (StringOr);
+
+   LuaValueList res = ls.doString ("return Hypotenuse (3, 4)");
+   BOOST_REQUIRE (res.size() == 1);
+   BOOST_CHECK (res[0] == 5);
+
+   res = ls.doString ("return Repeat ('ab', 3)");
+   BOOST_REQUIRE (res.size() == 1);
+   BOOST_CHECK (res[0] == "ababab");
+
+   // Functions returning 'void' return nothing
+   res = ls.doString ("return SetTheGlobalOrZero (123, false)");
+   BOOST_CHECK (res.size() == 0);
+   BOOST_CHECK (TheGlobal == 123);
+
+   ls.doString ("SetTheGlobalOrZero (456, true)");
+   BOOST_CHECK (TheGlobal == 0);
+
+   TheGlobal = 789;
+   res = ls.doString ("return GetTheGlobal()");
+   BOOST_REQUIRE (res.size() == 1);
+   BOOST_CHECK (res[0] == 789);
+
+   // 'LuaValue' parameters take anything (including missing parameters)
+   res = ls.doString ("return TypeOf ({ }), TypeOf ('x'), TypeOf()");
+   BOOST_REQUIRE (res.size() == 3);
+   BOOST_CHECK (res[0] == LUA_TTABLE);
+   BOOST_CHECK (res[1] == LUA_TSTRING);
+   BOOST_CHECK (res[2] == LUA_TNIL);
+
+   // 'LuaView' parameters too, and they can be returned
+   res = ls.doString ("return StringOr ('a', 1), StringOr ({ }, 2), "
+                      "StringOr (true)");
+   BOOST_REQUIRE (res.size() == 3);
+   BOOST_CHECK (res[0] == "a");
+   BOOST_CHECK (res[1] == 2);
+   BOOST_CHECK (res[2] == Nil);
+
+   // Numbers of several types; extra parameters are ignored
+   res = ls.doString ("return Sum5 (1, 2, 3, 4, 5, 6)");
+   BOOST_REQUIRE (res.size() == 1);
+   BOOST_CHECK (res[0] == 15);
+
+   // Errors: wrong or missing parameters, and exceptions thrown by the
+   // function
+   BOOST_CHECK_THROW (ls.doString ("Hypotenuse (3, 'four')"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("Repeat ('ab')"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("NonNegative (-1)"), LuaRunTimeError);
+   res = ls.doString ("return NonNegative (1)");
+   BOOST_REQUIRE (res.size() == 1);
+   BOOST_CHECK (res[0] == 1);
+
+   res = ls.doString ("return select (2, pcall (Hypotenuse, 3, {}))");
+   BOOST_REQUIRE (res.size() == 1);
+   BOOST_CHECK (res[0].asString().find ("Bad parameter #2")
+                != std::string::npos);
+
+   BOOST_CHECK (lua_gettop (ls.getState()) == 0);
 }
 
 
@@ -186,6 +281,411 @@ BOOST_AUTO_TEST_CASE(TestClassWrapping)
 
 
 
+// - TestClassMethodBinding ----------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestClassMethodBinding)
+{
+   using namespace Diluculum;
+   LuaState ls;
+
+   DILUCULUM_REGISTER_CLASS (ls["Counter"], Counter);
+
+   ls.doString ("c = Counter.new (10)");
+   ls.doString ("c:add (5)");
+
+   LuaValueList ret = ls.doString ("return c:get()");
+   BOOST_REQUIRE (ret.size() == 1);
+   BOOST_CHECK (ret[0] == 15);
+
+   ret = ls.doString ("return c:isBetween (0, 20), c:isBetween (0, 10)");
+   BOOST_REQUIRE (ret.size() == 2);
+   BOOST_CHECK (ret[0] == true);
+   BOOST_CHECK (ret[1] == false);
+
+   ret = ls.doString ("return c:describe ('count = ')");
+   BOOST_REQUIRE (ret.size() == 1);
+   BOOST_CHECK (ret[0] == "count = 15");
+
+   // Objects instantiated in C++ work, too
+   LuaValueList params;
+   Counter aCppCounter (params);
+   DILUCULUM_REGISTER_OBJECT (ls["c2"], Counter, aCppCounter);
+   ls.doString ("c2:add (3)");
+   BOOST_CHECK (aCppCounter.get() == 3);
+
+   // Registering the class again doesn't invalidate existing objects
+   DILUCULUM_REGISTER_CLASS (ls["Counter"], Counter);
+   ret = ls.doString ("return c:get()");
+   BOOST_REQUIRE (ret.size() == 1);
+   BOOST_CHECK (ret[0] == 15);
+
+   // Bad parameters
+   BOOST_CHECK_THROW (ls.doString ("c:add ('x')"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("c:isBetween (1)"), LuaRunTimeError);
+
+   // Bad 'self'es, both for bound and for wrapped methods
+   DILUCULUM_REGISTER_CLASS (ls["Account"], Account);
+   ls.doString ("a = Account.new (1)");
+   BOOST_CHECK_THROW (ls.doString ("c.get (a)"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("c.get (123)"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("c.get()"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("a.balance (c)"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("a.balance ({ })"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("a.balance (io.stdout)"), LuaRunTimeError);
+
+   ret = ls.doString ("return c:get(), a:balance()");
+   BOOST_REQUIRE (ret.size() == 2);
+   BOOST_CHECK (ret[0] == 15);
+   BOOST_CHECK (ret[1] == 1);
+}
+
+
+
+// - TestClassInlineStorage ----------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestClassInlineStorage)
+{
+   using namespace Diluculum;
+   LuaState ls;
+
+   DILUCULUM_REGISTER_CLASS (ls["Timestamp"], Timestamp);
+   Timestamp::liveInstances = 0;
+
+   ls.doString ("t1 = Timestamp.new (1.5)");
+   ls.doString ("t2 = Timestamp.new (2.5)");
+   BOOST_CHECK (Timestamp::liveInstances == 2);
+
+   LuaValueList ret = ls.doString ("return t1:seconds(), t2:seconds()");
+   BOOST_REQUIRE (ret.size() == 2);
+   BOOST_CHECK (ret[0] == 1.5);
+   BOOST_CHECK (ret[1] == 2.5);
+
+   ret = ls.doString ("return t1:isAligned(), t2:isAligned()");
+   BOOST_REQUIRE (ret.size() == 2);
+   BOOST_CHECK (ret[0] == true);
+   BOOST_CHECK (ret[1] == true);
+
+   // Objects are destroyed when garbage-collected...
+   ls.doString ("t1 = nil; collectgarbage ('collect')");
+   BOOST_CHECK (Timestamp::liveInstances == 1);
+
+   // ...or when explicitly deleted, but only once
+   ls.doString ("t2:delete()");
+   BOOST_CHECK (Timestamp::liveInstances == 0);
+   ls.doString ("t2 = nil; collectgarbage ('collect')");
+   BOOST_CHECK (Timestamp::liveInstances == 0);
+
+   // Objects whose constructor throw are not destroyed
+   BOOST_CHECK_THROW (ls.doString ("t3 = Timestamp.new ('x')"),
+                      LuaRunTimeError);
+   ls.doString ("collectgarbage ('collect')");
+   BOOST_CHECK (Timestamp::liveInstances == 0);
+}
+
+
+
+// - TestClassPooledStorage ----------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestClassPooledStorage)
+{
+   using namespace Diluculum;
+   LuaState ls;
+
+   DILUCULUM_REGISTER_CLASS (ls["Token"], Token);
+   Token::liveInstances = 0;
+   ObjectPool& pool = DILUCULUM_CLASS_POOL(Token);
+   pool.clear();
+   pool.resetStats();
+
+   // The first objects are newly allocated...
+   ls.doString ("t = { } for i = 1, 3 do t[i] = Token.new (i) end");
+   BOOST_CHECK (Token::liveInstances == 3);
+   BOOST_CHECK (ls.doString ("return t[2]:id()")[0] == 2);
+
+   ObjectPoolStats stats = pool.stats();
+   BOOST_CHECK (stats.capacity == 4);
+   BOOST_CHECK (stats.misses == 3);
+   BOOST_CHECK (stats.hits == 0);
+   BOOST_CHECK (stats.available == 0);
+
+   // ...and their memory goes to the pool when they are destroyed...
+   ls.doString ("t = nil; collectgarbage ('collect')");
+   BOOST_CHECK (Token::liveInstances == 0);
+   BOOST_CHECK (pool.stats().available == 3);
+
+   // ...to be used by the next ones
+   ls.doString ("t = { } for i = 1, 3 do t[i] = Token.new (i) end");
+   stats = pool.stats();
+   BOOST_CHECK (stats.hits == 3);
+   BOOST_CHECK (stats.misses == 3);
+   BOOST_CHECK (stats.available == 0);
+   BOOST_CHECK (stats.hitRate() == 0.5);
+   BOOST_CHECK (ls.doString ("return t[3]:id()")[0] == 3);
+
+   // Explicitly deleted objects are recycled, too, and just once
+   ls.doString ("t[1]:delete()");
+   BOOST_CHECK (pool.stats().available == 1);
+   ls.doString ("t[1] = nil; collectgarbage ('collect')");
+   BOOST_CHECK (pool.stats().available == 1);
+
+   // The pool doesn't grow beyond its capacity
+   ls.doString ("t = nil; collectgarbage ('collect')");
+   BOOST_CHECK (pool.stats().available == 3);
+   ls.doString ("t = { } for i = 1, 6 do t[i] = Token.new (i) end");
+   ls.doString ("t = nil; collectgarbage ('collect')");
+   BOOST_CHECK (Token::liveInstances == 0);
+   stats = pool.stats();
+   BOOST_CHECK (stats.available == 4);
+   BOOST_CHECK (stats.discards == 2);
+
+   // Memory of objects whose constructor throws goes back to the pool
+   BOOST_CHECK_THROW (ls.doString ("t = Token.new ('x')"), LuaRunTimeError);
+   BOOST_CHECK (pool.stats().available == 4);
+   BOOST_CHECK (Token::liveInstances == 0);
+
+   // The pool is shared among states
+   LuaState ls2;
+   DILUCULUM_REGISTER_CLASS (ls2["Token"], Token);
+   ls2.doString ("t = Token.new (10)");
+   BOOST_CHECK (pool.stats().available == 3);
+
+   // Warming up, clearing
+   pool.clear();
+   BOOST_CHECK (pool.stats().available == 0);
+   pool.reserve (10);
+   BOOST_CHECK (pool.stats().available == 4);
+   pool.resetStats();
+   BOOST_CHECK (pool.stats().hitRate() == 0.0);
+}
+
+
+
+// - TestClassSharedOwnership --------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestClassSharedOwnership)
+{
+   using namespace Diluculum;
+   typedef boost::shared_ptr<Document> DocPtr;
+
+   LuaState ls;
+   DILUCULUM_REGISTER_CLASS (ls["Document"], Document);
+   ls["MakeDocument"] = DILUCULUM_BIND_FUNCTION (MakeDocument);
+   ls["TitleOf"] = DILUCULUM_BIND_FUNCTION (TitleOf);
+   Document::liveInstances = 0;
+
+   // Objects created in Lua can be kept alive by C++...
+   ls.doString ("d = Document.new ('Lua doc')");
+   DocPtr doc = ls["d"].as<DocPtr>();
+   BOOST_REQUIRE (doc);
+   BOOST_CHECK (doc->getTitle() == "Lua doc");
+   BOOST_CHECK (doc.use_count() == 2);
+
+   ls.doString ("d = nil; collectgarbage ('collect')");
+   BOOST_CHECK (Document::liveInstances == 1);
+   BOOST_CHECK (doc.use_count() == 1);
+   doc.reset();
+   BOOST_CHECK (Document::liveInstances == 0);
+
+   // ...and are destroyed by Lua when C++ doesn't refer to them
+   ls.doString ("d = Document.new(); d = nil; collectgarbage ('collect')");
+   BOOST_CHECK (Document::liveInstances == 0);
+
+   // Objects created in C++ can be shared with Lua
+   doc = MakeDocument ("C++ doc");
+   DILUCULUM_REGISTER_SHARED_OBJECT (ls["d2"], Document, doc);
+   BOOST_CHECK (lua_gettop (ls.getState()) == 0);
+   BOOST_CHECK (doc.use_count() == 2);
+   ls.doString ("d2.title = d2.title .. '!'");
+   BOOST_CHECK (doc->getTitle() == "C++ doc!");
+   BOOST_CHECK (ls["d2"].as<DocPtr>() == doc);
+
+   // Deleting them in Lua just releases the reference held by Lua
+   ls.doString ("d2:delete()");
+   BOOST_CHECK (doc.use_count() == 1);
+   ls.doString ("d2 = nil; collectgarbage ('collect')");
+   BOOST_CHECK (doc.use_count() == 1);
+   BOOST_CHECK (Document::liveInstances == 1);
+
+   // Shared pointers as parameters and return values
+   ls.doString ("d3 = MakeDocument ('made')");
+   BOOST_CHECK (ls["d3"].as<DocPtr>()->getTitle() == "made");
+   LuaValueList ret = ls.doString ("return TitleOf (d3), TitleOf (nil)");
+   BOOST_REQUIRE (ret.size() == 2);
+   BOOST_CHECK (ret[0] == "made");
+   BOOST_CHECK (ret[1] == "<none>");
+   BOOST_CHECK (ls["nothing"].as<DocPtr>() == DocPtr());
+
+   // Objects of any class can be shared, but only those shared can be read
+   // as shared pointers
+   DILUCULUM_REGISTER_CLASS (ls["Counter"], Counter);
+   LuaValueList params;
+   params.push_back (7);
+   boost::shared_ptr<Counter> counter (new Counter (params));
+   LuaTypeTraits<boost::shared_ptr<Counter> >::push (ls.getState(), counter);
+   lua_setglobal (ls.getState(), "c");
+   BOOST_CHECK (ls.doString ("return c:get()")[0] == 7);
+   BOOST_CHECK (counter.use_count() == 2);
+
+   ls.doString ("c2 = Counter.new (1)");
+   BOOST_CHECK_THROW (ls["c2"].as<boost::shared_ptr<Counter> >(),
+                      TypeMismatchError);
+   BOOST_CHECK_THROW (ls["c"].as<DocPtr>(), TypeMismatchError);
+   BOOST_CHECK_THROW (ls.doString ("TitleOf (c)"), LuaRunTimeError);
+   BOOST_CHECK (lua_gettop (ls.getState()) == 0);
+
+   // Objects outlive the Lua state
+   ls.doString ("d4 = Document.new ('survivor')");
+   DocPtr survivor = ls["d4"].as<DocPtr>();
+   {
+      LuaState ls2;
+      DILUCULUM_REGISTER_CLASS (ls2["Document"], Document);
+      DILUCULUM_REGISTER_SHARED_OBJECT (ls2["s"], Document, survivor);
+   }
+   BOOST_CHECK (survivor.use_count() == 2);
+   BOOST_CHECK (survivor->getTitle() == "survivor");
+}
+
+
+
+// - TestClassMetamethods ------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestClassMetamethods)
+{
+   using namespace Diluculum;
+   LuaState ls;
+
+   DILUCULUM_REGISTER_CLASS (ls["Timestamp"], Timestamp);
+   Timestamp::liveInstances = 0;
+
+   ls.doString ("t1 = Timestamp.new (10)");
+   ls.doString ("t2 = t1 + 5");
+   BOOST_CHECK (Timestamp::liveInstances == 2);
+
+   LuaValueList ret = ls.doString ("return t2:seconds(), t2:isAligned()");
+   BOOST_REQUIRE (ret.size() == 2);
+   BOOST_CHECK (ret[0] == 15);
+   BOOST_CHECK (ret[1] == true);
+
+   ret = ls.doString ("return t1 == t2, t1 == t2 + (-5), t1 < t2, t2 <= t1");
+   BOOST_REQUIRE (ret.size() == 4);
+   BOOST_CHECK (ret[0] == false);
+   BOOST_CHECK (ret[1] == true);
+   BOOST_CHECK (ret[2] == true);
+   BOOST_CHECK (ret[3] == false);
+
+   ret = ls.doString ("return tostring (t2), -t1");
+   BOOST_REQUIRE (ret.size() == 2);
+   BOOST_CHECK (ret[0] == "Timestamp(15)");
+   BOOST_CHECK (ret[1] == "negated");
+
+   // Objects returned by metamethods are garbage-collected as usual
+   ls.doString ("t1 = nil; t2 = nil; collectgarbage ('collect')");
+   BOOST_CHECK (Timestamp::liveInstances == 0);
+
+   // Operands of the wrong type
+   ls.doString ("t = Timestamp.new (1)");
+   BOOST_CHECK_THROW (ls.doString ("return 5 + t"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("return t + t"), LuaRunTimeError);
+
+   // Objects of heap-allocated classes can be passed by reference, but not
+   // copied to Lua
+   DILUCULUM_REGISTER_CLASS (ls["Counter"], Counter);
+   ls.doString ("c = Counter.new (3)");
+   lua_getglobal (ls.getState(), "c");
+   BOOST_CHECK (LuaTypeTraits<Counter>::is (ls.getState(), -1));
+   BOOST_CHECK (LuaTypeTraits<Counter>::get (ls.getState(), -1).get() == 3);
+   BOOST_CHECK (LuaTypeTraits<Timestamp>::is (ls.getState(), -1) == false);
+   BOOST_CHECK_THROW (LuaTypeTraits<Counter>::push (ls.getState(),
+                         LuaTypeTraits<Counter>::get (ls.getState(), -1)),
+                      LuaTypeError);
+   lua_pop (ls.getState(), 1);
+
+   // Objects are passed to bound functions by reference, without copies
+   ls["Transfer"] = DILUCULUM_BIND_FUNCTION (Transfer);
+   ls["IsSameCounter"] = DILUCULUM_BIND_FUNCTION (IsSameCounter);
+   ls.doString ("c2 = Counter.new (10); Transfer (c2, c, 4)");
+   ret = ls.doString ("return c:get(), c2:get(), IsSameCounter (c, c), "
+                      "IsSameCounter (c, c2)");
+   BOOST_REQUIRE (ret.size() == 4);
+   BOOST_CHECK (ret[0] == 7);
+   BOOST_CHECK (ret[1] == 6);
+   BOOST_CHECK (ret[2] == true);
+   BOOST_CHECK (ret[3] == false);
+
+   // Pointers to objects are passed and returned as references to them, and
+   // null pointers as 'nil'
+   ls["LargerOf"] = DILUCULUM_BIND_FUNCTION (LargerOf);
+   ret = ls.doString ("local l = LargerOf (c, c2); l:add (1); "
+                      "return l:get(), c:get(), LargerOf (nil, c)");
+   BOOST_REQUIRE (ret.size() == 3);
+   BOOST_CHECK (ret[0] == 8);
+   BOOST_CHECK (ret[1] == 8);
+   BOOST_CHECK (ret[2] == Nil);
+   BOOST_CHECK_THROW (ls.doString ("LargerOf (c, 5)"), LuaRunTimeError);
+
+   // Classes must be registered in the state before their objects are pushed
+   LuaState ls2;
+   BOOST_CHECK_THROW (LuaTypeTraits<Timestamp>::push (ls2.getState(),
+                                                      Timestamp (1.0)),
+                      LuaError);
+   BOOST_CHECK (lua_gettop (ls2.getState()) == 0);
+}
+
+
+
+// - TestClassProperties -------------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestClassProperties)
+{
+   using namespace Diluculum;
+   LuaState ls;
+
+   DILUCULUM_REGISTER_CLASS (ls["Particle"], Particle);
+   ls.doString ("p = Particle.new()");
+
+   // Reading and writing properties
+   ls.doString ("p.x = 1.5; p.y = -2; p.mass = 4; p.name = 'electron'");
+   LuaValueList ret = ls.doString ("return p.x, p.y, p.mass, p.name");
+   BOOST_REQUIRE (ret.size() == 4);
+   BOOST_CHECK (ret[0] == 1.5);
+   BOOST_CHECK (ret[1] == -2);
+   BOOST_CHECK (ret[2] == 4);
+   BOOST_CHECK (ret[3] == "electron");
+
+   ret = ls.doString ("return p.momentum");
+   BOOST_REQUIRE (ret.size() == 1);
+   BOOST_CHECK (ret[0] == 6);
+
+   // Methods are still there, and see the same object
+   ls.doString ("p:move (1, 1)");
+   ret = ls.doString ("return p.x, p.y, p.classname");
+   BOOST_REQUIRE (ret.size() == 3);
+   BOOST_CHECK (ret[0] == 2.5);
+   BOOST_CHECK (ret[1] == -1);
+   BOOST_CHECK (ret[2] == "Particle");
+
+   // Objects instantiated in C++ work, too
+   LuaValueList params;
+   Particle aCppParticle (params);
+   DILUCULUM_REGISTER_OBJECT (ls["p2"], Particle, aCppParticle);
+   ls.doString ("p2.x = p.x * 2");
+   BOOST_CHECK (aCppParticle.x == 5.0);
+
+   // Unknown fields are 'nil'
+   ret = ls.doString ("return p.foo, p[1]");
+   BOOST_REQUIRE (ret.size() == 2);
+   BOOST_CHECK (ret[0] == Nil);
+   BOOST_CHECK (ret[1] == Nil);
+
+   // Errors
+   BOOST_CHECK_THROW (ls.doString ("p.momentum = 1"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("p.foo = 1"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("p.x = 'abc'"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("p.mass = -1"), LuaRunTimeError);
+   ret = ls.doString ("return p.mass");
+   BOOST_REQUIRE (ret.size() == 1);
+   BOOST_CHECK (ret[0] == 4);
+
+   // Nothing is left on the stack
+   BOOST_CHECK (lua_gettop (ls.getState()) == 0);
+}
+
+
+
 // - TestTwoClasses ------------------------------------------------------------
 BOOST_AUTO_TEST_CASE(TestTwoClasses)
 {
@@ -420,6 +920,56 @@ BOOST_AUTO_TEST_CASE(TestClassDestructorObjectInstantiatedInCppAndDestructorCall
 
 
 
+// - TestClassUseAfterDelete --------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestClassUseAfterDelete)
+{
+   using namespace Diluculum;
+   LuaState ls;
+
+   DILUCULUM_REGISTER_CLASS (ls["Counter"], Counter);
+   DILUCULUM_REGISTER_CLASS (ls["Particle"], Particle);
+   DILUCULUM_REGISTER_CLASS (ls["Timestamp"], Timestamp);
+   DILUCULUM_REGISTER_CLASS (ls["Token"], Token);
+   DILUCULUM_REGISTER_CLASS (ls["Document"], Document);
+
+   // Deleted objects cannot be used anymore, whatever their storage...
+   ls.doString ("c = Counter.new (1); c:delete()");
+   BOOST_CHECK_THROW (ls.doString ("c:get()"), LuaRunTimeError);
+
+   ls.doString ("p = Particle.new(); p:delete()");
+   BOOST_CHECK_THROW (ls.doString ("return p.x"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("p.x = 1"), LuaRunTimeError);
+
+   ls.doString ("t = Timestamp.new (1.5); t:delete()");
+   BOOST_CHECK_THROW (ls.doString ("t:seconds()"), LuaRunTimeError);
+
+   ls.doString ("k = Token.new (1); k:delete()");
+   BOOST_CHECK_THROW (ls.doString ("k:id()"), LuaRunTimeError);
+
+   ls.doString ("d = Document.new ('doc'); d:delete()");
+   BOOST_CHECK_THROW (ls.doString ("return d.title"), LuaRunTimeError);
+
+   // ...not even as parameters...
+   ls["Transfer"] = DILUCULUM_BIND_FUNCTION (Transfer);
+   ls.doString ("c2 = Counter.new (5)");
+   BOOST_CHECK_THROW (ls.doString ("Transfer (c2, c, 1)"), LuaRunTimeError);
+   BOOST_CHECK (ls.doString ("return c2:get()")[0] == 5);
+
+   // ...but they can be deleted (and garbage-collected) again
+   ls.doString ("c:delete(); t:delete(); k:delete(); d:delete()");
+   ls.doString ("c, p, t, k, d = nil; collectgarbage ('collect')");
+
+   // Only objects of the class can be deleted
+   BOOST_CHECK_THROW (ls.doString ("Counter.delete (5)"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("Counter.delete ({ })"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("Counter.delete()"), LuaRunTimeError);
+   BOOST_CHECK_THROW (ls.doString ("Counter.delete (Token.new (1))"),
+                      LuaRunTimeError);
+   BOOST_CHECK (ls.doString ("return c2:get()")[0] == 5);
+}
+
+
+
 // - TestDynamicModule ---------------------------------------------------------
 BOOST_AUTO_TEST_CASE(TestDynamicModule)
 {
@@ -471,6 +1021,93 @@ BOOST_AUTO_TEST_CASE(TestMultipleStates)
 }
 
 
+
+// - TestClassRegistration -----------------------------------------------------
+BOOST_AUTO_TEST_CASE(TestClassRegistration)
+{
+   using namespace Diluculum;
+   LuaState ls;
+
+   DILUCULUM_REGISTER_CLASS (ls["Account"], Account);
+   DILUCULUM_REGISTER_CLASS (ls["Particle"], Particle);
+   BOOST_CHECK (lua_gettop (ls.getState()) == 0);
+
+   // The class table is also the objects metatable, and its own '__index'
+   LuaValueList ret = ls.doString(
+      "local a = Account.new (1) "
+      "return getmetatable (a) == Account, Account.__index == Account, "
+      "       Account.classname");
+   BOOST_REQUIRE (ret.size() == 3);
+   BOOST_CHECK (ret[0] == true);
+   BOOST_CHECK (ret[1] == true);
+   BOOST_CHECK (ret[2] == "Account");
+
+   // Classes with properties have '__index' implemented in C++
+   ret = ls.doString(
+      "local p = Particle.new() "
+      "return getmetatable (p) == Particle, type (Particle.__index), "
+      "       type (Particle.__newindex)");
+   BOOST_REQUIRE (ret.size() == 3);
+   BOOST_CHECK (ret[0] == true);
+   BOOST_CHECK (ret[1] == "function");
+   BOOST_CHECK (ret[2] == "function");
+
+   // Registering again reuses the same table, so that existing objects and
+   // the new ones share their metatable
+   ls.doString ("a = Account.new (2)");
+   ls.doString ("Bank = { }");
+   DILUCULUM_REGISTER_CLASS (ls["Bank"]["Account"], Account);
+   BOOST_CHECK (lua_gettop (ls.getState()) == 0);
+   ret = ls.doString ("return Bank.Account == Account, "
+                      "getmetatable (Bank.Account.new()) == getmetatable (a), "
+                      "a:balance()");
+   BOOST_REQUIRE (ret.size() == 3);
+   BOOST_CHECK (ret[0] == true);
+   BOOST_CHECK (ret[1] == true);
+   BOOST_CHECK (ret[2] == 2);
+
+   // Each state gets its own table
+   LuaState ls2;
+   DILUCULUM_REGISTER_CLASS (ls2["Account"], Account);
+   BOOST_CHECK (ls2.doString ("return Account.new (5):balance()")[0] == 5);
+   ls2.doString ("Account.extra = 1");
+   BOOST_CHECK (ls.doString ("return Account.extra")[0] == Nil);
+
+   // Registering into something that is not a table fails cleanly
+   ls.doString ("x = 1");
+   BOOST_CHECK_THROW (DILUCULUM_REGISTER_CLASS (ls["x"]["Account"], Account),
+                      TypeMismatchError);
+   BOOST_CHECK (lua_gettop (ls.getState()) == 0);
+
+   // Nothing is stored in global variables, and creating objects doesn't
+   // depend on them
+   ret = ls.doString ("local new = Account.new "
+                      "Account = nil; Bank = nil; collectgarbage ('collect') "
+                      "return __Diluculum__Class_Metatables, "
+                      "       new (3):balance(), a:balance()");
+   BOOST_REQUIRE (ret.size() == 3);
+   BOOST_CHECK (ret[0] == Nil);
+   BOOST_CHECK (ret[1] == 3);
+   BOOST_CHECK (ret[2] == 2);
+
+   // Objects created in C++ use the same metatable
+   LuaValueList params;
+   Account aCppAccount (params);
+   DILUCULUM_REGISTER_OBJECT (ls["cppAccount"], Account, aCppAccount);
+   BOOST_CHECK (lua_gettop (ls.getState()) == 0);
+   ret = ls.doString ("return getmetatable (cppAccount) == getmetatable (a)");
+   BOOST_REQUIRE (ret.size() == 1);
+   BOOST_CHECK (ret[0] == true);
+
+   // ...which must exist
+   BOOST_CHECK_THROW (DILUCULUM_REGISTER_OBJECT (ls2["cppCounter"], Counter,
+                                                 aCppAccount),
+                      LuaError);
+   BOOST_CHECK (lua_gettop (ls2.getState()) == 0);
+   BOOST_CHECK (ls2["cppCounter"].value() == Nil);
+}
+
+
 #if 0
 
 //
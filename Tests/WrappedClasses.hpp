@@ -27,6 +27,10 @@
 #ifndef _DILUCULUM_TESTS_WRAPPED_CLASSES_HPP_
 #define _DILUCULUM_TESTS_WRAPPED_CLASSES_HPP_
 
+#include <cstddef>
+#include <string>
+#include <boost/lexical_cast.hpp>
+#include <boost/type_traits/alignment_of.hpp>
 #include <Diluculum/LuaWrappers.hpp>
 
 namespace
@@ -150,6 +154,273 @@ namespace
    DILUCULUM_BEGIN_CLASS (DestructorTester);
    DILUCULUM_END_CLASS (DestructorTester);
 
+
+
+   /// A class whose methods have ordinary signatures.
+   class Counter
+   {
+      public:
+         Counter (const LuaValueList& params)
+            : count_(params.size() > 0
+                     ? static_cast<int>(params[0].asNumber())
+                     : 0)
+         { }
+
+         void add (int n) { count_ += n; }
+
+         int get() const { return count_; }
+
+         bool isBetween (double lo, double hi) const
+         {
+            return count_ >= lo && count_ <= hi;
+         }
+
+         std::string describe (const std::string& prefix) const
+         {
+            return prefix + boost::lexical_cast<std::string>(count_);
+         }
+
+      private:
+         // Counters are never copied: bound functions get them by reference
+         Counter (const Counter&);
+         Counter& operator= (const Counter&);
+
+         int count_;
+   };
+
+   /// Moves \c n from \c from to \c to, which are modified in place.
+   void Transfer (Counter& from, Counter& to, int n)
+   {
+      from.add (-n);
+      to.add (n);
+   }
+
+   /// Checks whether \c a and \c b are the very same object.
+   bool IsSameCounter (const Counter& a, const Counter& b)
+   {
+      return &a == &b;
+   }
+
+   /** Returns the counter with the larger count, or null if any of them is
+    *  null. Takes and returns pointers.
+    */
+   Counter* LargerOf (Counter* a, const Counter* b)
+   {
+      if (a == 0 || b == 0)
+         return 0;
+      return a->get() >= b->get() ? a : const_cast<Counter*>(b);
+   }
+
+   DILUCULUM_BEGIN_CLASS (Counter);
+      DILUCULUM_CLASS_BIND_METHOD (Counter, add);
+      DILUCULUM_CLASS_BIND_METHOD (Counter, get);
+      DILUCULUM_CLASS_BIND_METHOD (Counter, isBetween);
+      DILUCULUM_CLASS_BIND_METHOD (Counter, describe);
+   DILUCULUM_END_CLASS (Counter);
+
+
+
+   /** A small value type, stored inline in the Lua userdata. Has a member
+    *  with a stricter alignment requirement than most types, and keeps
+    *  track of the number of live instances.
+    */
+   class Timestamp
+   {
+      public:
+         /// The number of live instances.
+         static int liveInstances;
+
+         Timestamp (const LuaValueList& params)
+         {
+            if (params.size() != 1 || params[0].type() != LUA_TNUMBER)
+               throw Diluculum::LuaError ("Bad parameters!");
+            time_ = params[0].asNumber();
+            ++liveInstances;
+         }
+
+         explicit Timestamp (double time)
+            : time_(time)
+         {
+            ++liveInstances;
+         }
+
+         Timestamp (const Timestamp& other)
+            : time_(other.time_)
+         {
+            ++liveInstances;
+         }
+
+         ~Timestamp() { --liveInstances; }
+
+         double seconds() const { return static_cast<double>(time_); }
+
+         bool isAligned() const
+         {
+            return reinterpret_cast<std::size_t>(this)
+               % boost::alignment_of<Timestamp>::value == 0;
+         }
+
+      private:
+         long double time_;
+   };
+
+   int Timestamp::liveInstances = 0;
+
+   Timestamp AddSeconds (const Timestamp& t, double seconds)
+   {
+      return Timestamp (t.seconds() + seconds);
+   }
+
+   bool AreEqual (const Timestamp& a, const Timestamp& b)
+   {
+      return a.seconds() == b.seconds();
+   }
+
+   bool IsEarlier (const Timestamp& a, const Timestamp& b)
+   {
+      return a.seconds() < b.seconds();
+   }
+
+   std::string ToString (const Timestamp& t)
+   {
+      return "Timestamp(" + boost::lexical_cast<std::string>(t.seconds())
+         + ")";
+   }
+
+   int Negate (lua_State* ls)
+   {
+      lua_pushstring (ls, "negated");
+      return 1;
+   }
+
+   DILUCULUM_BEGIN_CLASS_INLINE (Timestamp);
+      DILUCULUM_CLASS_BIND_METHOD (Timestamp, seconds);
+      DILUCULUM_CLASS_BIND_METHOD (Timestamp, isAligned);
+      DILUCULUM_CLASS_METAMETHOD (Timestamp, __add, AddSeconds);
+      DILUCULUM_CLASS_METAMETHOD (Timestamp, __eq, AreEqual);
+      DILUCULUM_CLASS_METAMETHOD (Timestamp, __lt, IsEarlier);
+      DILUCULUM_CLASS_METAMETHOD (Timestamp, __tostring, ToString);
+      DILUCULUM_CLASS_METAMETHOD (Timestamp, __unm, Negate);
+   DILUCULUM_END_CLASS (Timestamp);
+
+
+
+   /// A class with properties.
+   class Particle
+   {
+      public:
+         Particle (const LuaValueList& params)
+            : x(0.0), y(0.0), mass_(1.0), name_("unnamed")
+         { }
+
+         double x;
+         double y;
+
+         double getMass() const { return mass_; }
+
+         void setMass (double mass)
+         {
+            if (mass <= 0.0)
+               throw Diluculum::LuaError ("Mass must be positive.");
+            mass_ = mass;
+         }
+
+         const std::string& getName() const { return name_; }
+         void setName (const std::string& name) { name_ = name; }
+
+         double getMomentum() const { return mass_ * x; }
+
+         void move (double dx, double dy) { x += dx; y += dy; }
+
+      private:
+         double mass_;
+         std::string name_;
+   };
+
+   DILUCULUM_BEGIN_CLASS (Particle);
+      DILUCULUM_CLASS_BIND_METHOD (Particle, move);
+      DILUCULUM_CLASS_MEMBER_PROPERTY (Particle, x);
+      DILUCULUM_CLASS_MEMBER_PROPERTY (Particle, y);
+      DILUCULUM_CLASS_PROPERTY (Particle, mass, getMass, setMass);
+      DILUCULUM_CLASS_PROPERTY (Particle, name, getName, setName);
+      DILUCULUM_CLASS_READONLY_PROPERTY (Particle, momentum, getMomentum);
+   DILUCULUM_END_CLASS (Particle);
+
+
+
+   /** A short-lived object, whose memory is recycled through a pool. Keeps
+    *  track of the number of live instances.
+    */
+   class Token
+   {
+      public:
+         /// The number of live instances.
+         static int liveInstances;
+
+         Token (const LuaValueList& params)
+         {
+            if (params.size() != 1 || params[0].type() != LUA_TNUMBER)
+               throw Diluculum::LuaError ("Bad parameters!");
+            id_ = static_cast<int>(params[0].asNumber());
+            ++liveInstances;
+         }
+
+         ~Token() { --liveInstances; }
+
+         int id() const { return id_; }
+
+      private:
+         int id_;
+   };
+
+   int Token::liveInstances = 0;
+
+   DILUCULUM_BEGIN_CLASS_POOLED (Token, 4);
+      DILUCULUM_CLASS_BIND_METHOD (Token, id);
+   DILUCULUM_END_CLASS (Token);
+
+
+
+   /// A class whose objects are shared between Lua and C++.
+   class Document
+   {
+      public:
+         /// The number of live instances.
+         static int liveInstances;
+
+         Document (const LuaValueList& params)
+            : title_(params.size() > 0 ? params[0].asString() : "untitled")
+         {
+            ++liveInstances;
+         }
+
+         ~Document() { --liveInstances; }
+
+         const std::string& getTitle() const { return title_; }
+         void setTitle (const std::string& title) { title_ = title; }
+
+      private:
+         std::string title_;
+   };
+
+   int Document::liveInstances = 0;
+
+   DILUCULUM_BEGIN_CLASS_SHARED (Document);
+      DILUCULUM_CLASS_PROPERTY (Document, title, getTitle, setTitle);
+   DILUCULUM_END_CLASS (Document);
+
+   boost::shared_ptr<Document> MakeDocument (const std::string& title)
+   {
+      LuaValueList params;
+      params.push_back (title);
+      return boost::shared_ptr<Document> (new Document (params));
+   }
+
+   std::string TitleOf (boost::shared_ptr<Document> doc)
+   {
+      return doc ? doc->getTitle() : "<none>";
+   }
+
 } // (anonymous) namespace
 
 #endif // _DILUCULUM_TESTS_WRAPPED_CLASSES_HPP_
@@ -27,6 +27,8 @@
 #ifndef _DILUCULUM_TESTS_WRAPPED_FUNCTIONS_HPP_
 #define _DILUCULUM_TESTS_WRAPPED_FUNCTIONS_HPP_
 
+#include <cmath>
+#include <string>
 #include <Diluculum/LuaWrappers.hpp>
 
 namespace
@@ -226,6 +228,104 @@ namespace
    DILUCULUM_WRAP_FUNCTION (ToOrFromString);
 
 
+
+   /** Returns the size and the sum of the bytes of each string or userdata
+    *  passed as parameter (so, it returns twice as many values as it
+    *  takes). Takes <tt>LuaView</tt>s, so that nothing is copied.
+    */
+   LuaValueList SizesAndSums (const Diluculum::LuaViewList& params)
+   {
+      LuaValueList ret;
+
+      for (Diluculum::LuaViewList::size_type i = 0; i < params.size(); ++i)
+      {
+         const unsigned char* data;
+         if (params[i].type() == LUA_TSTRING)
+         {
+            data = reinterpret_cast<const unsigned char*>(
+               params[i].asStringData());
+         }
+         else
+         {
+            data = static_cast<const unsigned char*>(
+               params[i].asUserDataPointer());
+         }
+
+         unsigned sum = 0;
+         for (std::size_t j = 0; j < params[i].size(); ++j)
+            sum += data[j];
+
+         ret.push_back (params[i].size());
+         ret.push_back (sum);
+      }
+
+      return ret;
+   }
+
+   DILUCULUM_WRAP_FUNCTION (SizesAndSums);
+
+
+
+   // The functions below have ordinary signatures and are bound to Lua with
+   // 'DILUCULUM_BIND_FUNCTION()'.
+
+   /// Returns the distance from the origin to (\c x, \c y).
+   double Hypotenuse (double x, double y)
+   {
+      return std::sqrt (x*x + y*y);
+   }
+
+   /// Repeats \c str \c times times.
+   std::string Repeat (const std::string& str, int times)
+   {
+      std::string res;
+      for (int i = 0; i < times; ++i)
+         res += str;
+      return res;
+   }
+
+   /// Sets \c TheGlobal to a given value, or to zero if \c zero is \c true.
+   void SetTheGlobalOrZero (int value, bool zero)
+   {
+      TheGlobal = zero ? 0 : value;
+   }
+
+   /// Returns the number of the type of \c value.
+   int TypeOf (const Diluculum::LuaValue& value)
+   {
+      return value.type();
+   }
+
+   /// Returns the current value of \c TheGlobal.
+   int GetTheGlobal()
+   {
+      return TheGlobal;
+   }
+
+   /// Throws a \c LuaError if \c value is negative; returns it otherwise.
+   int NonNegative (int value)
+   {
+      if (value < 0)
+         throw Diluculum::LuaError ("Negative!");
+      return value;
+   }
+
+   /// Returns the sum of five numbers.
+   double Sum5 (double a, float b, long c, unsigned d, short e)
+   {
+      return a + b + c + d + e;
+   }
+
+   /** Returns \c value if it is a string, and \c otherwise if not. Both
+    *  parameters are just viewed, not converted.
+    */
+   Diluculum::LuaView StringOr (const Diluculum::LuaView& value,
+                                const Diluculum::LuaView& otherwise)
+   {
+      return value.type() == LUA_TSTRING ? value : otherwise;
+   }
+
+
 } // (anonymous) namespace
 
 #endif // _DILUCULUM_TESTS_WRAPPED_FUNCTIONS_HPP_
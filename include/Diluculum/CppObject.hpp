@@ -28,6 +28,9 @@
 #ifndef _DILUCULUM_CPP_OBJECT_HPP_
 #define _DILUCULUM_CPP_OBJECT_HPP_
 
+#include <boost/shared_ptr.hpp>
+#include <lua.hpp>
+
 namespace Diluculum
 {
    namespace Impl
@@ -47,6 +50,155 @@ namespace Diluculum
              *  it doesn't.
              */
             bool deleteMe;
+
+            /** If the object is shared between Lua and C++, points to the
+             *  <tt>boost::shared_ptr</tt> by which Lua owns it (which lives
+             *  in the same userdata). Null otherwise.
+             */
+            boost::shared_ptr<void>* owner;
+      };
+
+
+
+      /** Pushes the metatable of the class identified by \c classKey (as
+       *  stored by \c RegisterClass()) onto the stack of \c ls. If the
+       *  class was not registered in \c ls, pushes \c nil.
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      void PushClassMetatable (lua_State* ls, const void* classKey);
+
+      /** Checks whether the value at \c index is an object of the class
+       *  identified by \c classKey (that is, a userdata whose metatable is
+       *  the class metatable).
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      bool IsCppObject (lua_State* ls, int index, const void* classKey);
+
+      /** Returns the \c CppObject stored in the userdata at \c index,
+       *  checking that it is an object of the class identified by
+       *  \c classKey. This reads the userdata in place (nothing is copied)
+       *  and validates it just by comparing its metatable with the class
+       *  metatable.
+       *  @throw TypeMismatchError If the value at \c index is not an object
+       *         of the expected class, or if the object was already deleted
+       *         (by calling its \c delete method).
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      CppObject* GetCppObject (lua_State* ls, int index, const void* classKey,
+                               const char* className);
+
+      /** Pushes onto the stack of \c ls a userdata (without a metatable)
+       *  holding a copy of \c obj, thus sharing the ownership of the object
+       *  pointed by it. Returns the \c CppObject stored in the userdata, whose
+       *  \c owner points to the copy.
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      CppObject* NewSharedCppObject (lua_State* ls,
+                                     const boost::shared_ptr<void>& obj);
+
+      /** Releases the reference to the object held by \c cppObj, created by
+       *  \c NewSharedCppObject(). The object is destroyed if this was the
+       *  last reference to it.
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      void ReleaseSharedObject (CppObject* cppObj);
+
+      /** Pushes onto the stack of \c ls a userdata sharing the ownership of
+       *  \c obj, an object of the class identified by \c classKey. Pushes
+       *  \c nil if \c obj is null.
+       *  @throw LuaTypeError If \c classKey is null (the class was not
+       *         exported).
+       *  @throw LuaError If the class is not registered in \c ls.
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      void PushSharedObject (lua_State* ls, const boost::shared_ptr<void>& obj,
+                             const void* classKey, const char* className);
+
+      /** Pushes onto the stack of \c ls a userdata referring to \c obj, an
+       *  object of the class identified by \c classKey, without taking its
+       *  ownership (the object is not destroyed by Lua). Pushes \c nil if
+       *  \c obj is null.
+       *  @throw LuaTypeError If \c classKey is null (the class was not
+       *         exported).
+       *  @throw LuaError If the class is not registered in \c ls.
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      void PushObjectReference (lua_State* ls, void* obj, const void* classKey,
+                                const char* className);
+
+      /** Returns the <tt>boost::shared_ptr</tt> owning the object at
+       *  \c index, which must be an object of the class identified by
+       *  \c classKey, shared with C++.
+       *  @throw TypeMismatchError If the value at \c index is not an object
+       *         of the expected class, or if it is not shared with C++ (that
+       *         is, if its lifetime is managed by other means).
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      const boost::shared_ptr<void>& GetSharedObject (lua_State* ls, int index,
+                                                      const void* classKey,
+                                                      const char* className);
+
+      /** Throws a \c LuaTypeError telling that objects of the class
+       *  \c className cannot be pushed by value (or, if \c className is
+       *  null, that the class was not exported to Lua).
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      void ThrowCannotPushObject (const char* className);
+
+      /** Throws a \c LuaError telling that the class \c className is not
+       *  registered in the Lua state being used.
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      void ThrowClassNotRegistered (const char* className);
+
+
+
+      /** Information about a C++ class exported to Lua, needed to read and
+       *  push its objects given just its type (as done by the generic
+       *  \c LuaTypeTraits). These are set by \c DILUCULUM_BEGIN_CLASS() (and
+       *  its variants); for classes that were not exported, they are null.
+       */
+      template <class T>
+      struct ClassInfo
+      {
+         /// The address identifying the class (see \c GetCppObject()).
+         static const void* key;
+
+         /// The class name.
+         static const char* name;
+
+         /** Pushes onto the stack of \c ls a userdata (without a metatable)
+          *  holding a copy of an object. Null if objects of the class cannot
+          *  be copied to Lua.
+          */
+         static CppObject* (*copy) (lua_State* ls, const T& obj);
+      };
+
+      template <class T>
+      const void* ClassInfo<T>::key = 0;
+
+      template <class T>
+      const char* ClassInfo<T>::name = 0;
+
+      template <class T>
+      CppObject* (*ClassInfo<T>::copy) (lua_State* ls, const T& obj) = 0;
+
+
+
+      /** Helper class, used by \c DILUCULUM_BEGIN_CLASS() to set the
+       *  \c ClassInfo of the class being exported, much like
+       *  \c ClassTableFiller.
+       */
+      template <class T>
+      struct ClassInfoFiller
+      {
+         ClassInfoFiller (const void* key, const char* name,
+                          CppObject* (*copy) (lua_State*, const T&))
+         {
+            ClassInfo<T>::key = key;
+            ClassInfo<T>::name = name;
+            ClassInfo<T>::copy = copy;
+         }
       };
 
    } // namespace Impl
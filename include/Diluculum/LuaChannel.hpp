@@ -0,0 +1,127 @@
+/******************************************************************************\
+* LuaChannel.hpp                                                               *
+* Message-passing channels between Lua states.                                 *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#ifndef _DILUCULUM_LUA_CHANNEL_HPP_
+#define _DILUCULUM_LUA_CHANNEL_HPP_
+
+#include <boost/shared_ptr.hpp>
+#include <lua.hpp>
+#include <Diluculum/LuaValue.hpp>
+
+
+namespace Diluculum
+{
+   /** A channel through which values can be sent from one Lua state to
+    *  another, possibly running in a different thread. Any number of senders
+    *  and receivers may share the same channel.
+    *  <p>A \c LuaChannel is a handle: copies of it refer to the same underlying
+    *  queue, which lives as long as some copy (or some Lua state holding it,
+    *  see \c PushLuaChannel()) is alive.
+    *  <p>Values travel through the channel in the format written by
+    *  \c Serialize(). When sending or receiving from Lua, the value is
+    *  serialized directly from (or deserialized directly onto) the Lua stack,
+    *  so no \c LuaValue is built in between.
+    *  <p>In Lua, a channel is a userdata with two methods:
+    *  - <tt>channel:send(v)</tt> sends the value \c v.
+    *  - <tt>channel:receive(timeout)</tt> removes and returns the next value
+    *    from the channel. \c timeout is the maximum time to wait for a value,
+    *    in seconds. If it is \c nil (or absent), waits forever. If the
+    *    timeout expires, returns <tt>nil, "timeout"</tt>.
+    *  @note Lua threads (coroutines) and functions implemented in C cannot be
+    *        sent through a channel. Userdata is sent as a block of raw memory,
+    *        just like when converting it to a \c LuaValue.
+    */
+   class LuaChannel
+   {
+      public:
+         /// Constructs a \c LuaChannel with a new, empty queue.
+         LuaChannel();
+
+         /** Sends a value through the channel. This never blocks (besides a
+          *  very short critical section).
+          *  @throw LuaTypeError If \c value cannot be sent through a channel.
+          */
+         void send (const LuaValue& value);
+
+         /** Removes the next value from the channel and stores it in \c value.
+          *  @param value Where the received value is stored.
+          *  @param timeout The maximum time to wait for a value to arrive, in
+          *         seconds. A negative number (the default) means "wait
+          *         forever"; zero means "don't wait at all". Timeouts
+          *         longer than 10^9 seconds also mean "wait forever".
+          *  @return \c true if a value was received; \c false if the timeout
+          *          expired (in this case, \c value is not changed).
+          */
+         bool receive (LuaValue& value, double timeout = -1.0);
+
+         /// Returns the number of values currently waiting in the channel.
+         size_t size() const;
+
+         /** Checks whether this \c LuaChannel refers to the same channel as
+          *  \c rhs.
+          */
+         bool operator== (const LuaChannel& rhs) const
+         { return queue_ == rhs.queue_; }
+
+         /** Checks whether this \c LuaChannel refers to a different channel
+          *  than \c rhs.
+          */
+         bool operator!= (const LuaChannel& rhs) const
+         { return queue_ != rhs.queue_; }
+
+         /** The queue shared by all copies of a channel.
+          *  @note This is used internally. Users can ignore this class.
+          */
+         class Queue;
+
+      private:
+         friend void PushLuaChannel (lua_State*, const LuaChannel&);
+         friend LuaChannel ToLuaChannel (lua_State*, int);
+
+         /// Constructs a \c LuaChannel sharing an existing queue.
+         explicit LuaChannel (const boost::shared_ptr<Queue>& queue);
+
+         /// The queue where the serialized values are stored.
+         boost::shared_ptr<Queue> queue_;
+   };
+
+
+
+   /** Pushes onto the Lua stack of \c state a userdata through which Lua code
+    *  can use \c channel. The userdata keeps the channel alive until it is
+    *  garbage-collected.
+    */
+   void PushLuaChannel (lua_State* state, const LuaChannel& channel);
+
+   /** Returns the channel stored in the userdata at index \c index on the Lua
+    *  stack of \c state. The stack is not changed.
+    *  @throw TypeMismatchError If the value at \c index is not a channel.
+    */
+   LuaChannel ToLuaChannel (lua_State* state, int index);
+
+} // namespace Diluculum
+
+#endif // _DILUCULUM_LUA_CHANNEL_HPP_
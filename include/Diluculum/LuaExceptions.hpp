@@ -134,6 +134,22 @@ namespace Diluculum
 
 
 
+   /** An error found while deserializing a value, like truncated data, an
+    *  unknown tag or an unsupported format version.
+    */
+   class SerializationError: public LuaError
+   {
+      public:
+         /** Constructs a \c SerializationError object.
+          *  @param what The message associated with the error.
+          */
+         SerializationError (const char* what)
+            : LuaError (what)
+         { }
+   };
+
+
+
    /** An error that happens when a certain type is expected but another one is
     *  found.
     */
@@ -0,0 +1,99 @@
+/******************************************************************************\
+* LuaJSON.hpp                                                                  *
+* Conversion between JSON and Lua values.                                      *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#ifndef _DILUCULUM_LUA_JSON_HPP_
+#define _DILUCULUM_LUA_JSON_HPP_
+
+#include <cstddef>
+#include <string>
+#include <lua.hpp>
+#include <Diluculum/LuaValue.hpp>
+#include <Diluculum/LuaVariable.hpp>
+
+
+namespace Diluculum
+{
+   /** Parses a JSON document and pushes the corresponding value onto the Lua
+    *  stack of \c ls. The value is built directly on the stack (no \c LuaValue
+    *  is created in between), and tables are created with the right size
+    *  whenever they have up to a few dozen elements.
+    *  <p>JSON objects and arrays become tables (arrays are indexed from 1).
+    *  JSON \c null becomes the value at \c nullIndex, or \c nil if
+    *  \c nullIndex is zero. Notice that a \c nil leaves a hole in an array and
+    *  makes a field disappear from an object, so pass a sentinel value if this
+    *  distinction matters.
+    *  @param ls The Lua state where the value will be pushed.
+    *  @param json The JSON text. It doesn't have to be null-terminated.
+    *  @param size The size of \c json, in bytes.
+    *  @param nullIndex The index of the value used to represent \c null.
+    *  @throw SerializationError If \c json is not valid JSON (unpaired
+    *         UTF-16 surrogates in \c \\u escapes included). In this case,
+    *         the stack is left unchanged.
+    *  @note Strings are copied as they are, without validating their UTF-8.
+    */
+   void PushJSON (lua_State* ls, const char* json, std::size_t size,
+                  int nullIndex = 0);
+
+   /** Converts the value at index \c index of the Lua stack of \c ls to JSON.
+    *  The stack is left unchanged.
+    *  <p>A table whose keys are exactly the integers from 1 to some \c n
+    *  becomes a JSON array; any other table becomes a JSON object (so, an
+    *  empty table becomes <tt>{}</tt>). Object keys must be strings or
+    *  numbers; numbers are converted to strings. Both \c nil and values raw
+    *  equal to the value at \c nullIndex (if it is not zero) become \c null.
+    *  @throw LuaTypeError If the value contains something that cannot be
+    *         represented in JSON: functions, userdata, threads, NaNs, infinite
+    *         numbers, tables with invalid keys, or tables nested too deeply
+    *         (which is also what happens with cyclic tables).
+    */
+   std::string ToJSON (lua_State* ls, int index, int nullIndex = 0);
+
+   /** Parses a JSON document into a \c LuaValue. This follows the same rules
+    *  as \c PushJSON(), but JSON \c null becomes the value passed as
+    *  \c null.
+    *  @throw SerializationError If \c json is not valid JSON.
+    */
+   LuaValue FromJSON (const std::string& json, const LuaValue& null = Nil);
+
+   /** Converts a \c LuaValue to JSON. This follows the same rules as the
+    *  other \c ToJSON(), but values equal to \c null become JSON \c null.
+    *  @throw LuaTypeError If \c value contains something that cannot be
+    *         represented in JSON.
+    */
+   std::string ToJSON (const LuaValue& value, const LuaValue& null = Nil);
+
+   /** Registers the JSON functions into a Lua table, as fields named
+    *  \c "decode" and \c "encode". In Lua, <tt>table.decode (s, null)</tt>
+    *  works like \c PushJSON(), and <tt>table.encode (v, null)</tt> works like
+    *  \c ToJSON(). In both cases, \c null is optional.
+    *  @param table The table into which the functions will be stored. It will
+    *         be created if it doesn't exist.
+    */
+   void RegisterJSONFunctions (LuaVariable table);
+
+} // namespace Diluculum
+
+#endif // _DILUCULUM_LUA_JSON_HPP_
@@ -0,0 +1,66 @@
+/******************************************************************************\
+* LuaMsgPack.hpp                                                               *
+* Conversion between MessagePack and Lua values.                               *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#ifndef _DILUCULUM_LUA_MSGPACK_HPP_
+#define _DILUCULUM_LUA_MSGPACK_HPP_
+
+#include <cstddef>
+#include <lua.hpp>
+#include <Diluculum/LuaSerialization.hpp>
+
+
+namespace Diluculum
+{
+   /** Decodes a MessagePack object and pushes the corresponding value onto
+    *  the Lua stack of \c ls, without building a \c LuaValue in between.
+    *  <p>Arrays become tables indexed from 1, and maps become tables with
+    *  the same keys. Both strings and binary data become Lua strings; they
+    *  are pushed straight from \c data, with no intermediate copies. All
+    *  numbers become \c lua_Numbers (so, integers beyond 2^53 lose
+    *  precision).
+    *  @throw SerializationError If \c data is truncated, malformed, contains
+    *         extension types, or uses \c nil or NaN as a map key. In this
+    *         case, the stack is left unchanged.
+    */
+   void PushMsgPack (lua_State* ls, const char* data, std::size_t size);
+
+   /** Encodes the value at index \c index of the Lua stack of \c ls as
+    *  MessagePack, writing it to \c sink. The stack is left unchanged.
+    *  <p>A table whose keys are exactly the integers from 1 to some \c n
+    *  becomes an array; any other table becomes a map (so, an empty table
+    *  becomes an empty map). Numbers with an exact integer representation are
+    *  encoded as the smallest integer type that fits them, other numbers as
+    *  64-bit floats. Strings are encoded as the \c str type, with their full
+    *  length (embedded zeros included).
+    *  @throw LuaTypeError If the value contains functions, userdata or
+    *         threads, or tables nested too deeply (which is also what happens
+    *         with cyclic tables).
+    */
+   void ToMsgPack (lua_State* ls, int index, Sink& sink);
+
+} // namespace Diluculum
+
+#endif // _DILUCULUM_LUA_MSGPACK_HPP_
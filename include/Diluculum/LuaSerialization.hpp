@@ -0,0 +1,212 @@
+/******************************************************************************\
+* LuaSerialization.hpp                                                         *
+* Serialization of Lua values, in binary form and as Lua source code.          *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#ifndef _DILUCULUM_LUA_SERIALIZATION_HPP_
+#define _DILUCULUM_LUA_SERIALIZATION_HPP_
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <lua.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaValue.hpp>
+
+
+namespace Diluculum
+{
+   /** Something where serialized data is written to. Implement this to
+    *  serialize directly into a file, a socket or some other custom buffer.
+    */
+   class Sink
+   {
+      public:
+         /// Destroys a \c Sink.
+         virtual ~Sink() { }
+
+         /// Writes \c size bytes starting at \c data.
+         virtual void write (const void* data, std::size_t size) = 0;
+   };
+
+
+
+   /// A \c Sink that appends everything to a \c std::string.
+   class StringSink: public Sink
+   {
+      public:
+         /** Constructs a \c StringSink.
+          *  @param out The string to which data will be appended. It must
+          *         outlive the \c StringSink.
+          */
+         explicit StringSink (std::string& out)
+            : out_(out)
+         { }
+
+         virtual void write (const void* data, std::size_t size)
+         { out_.append (static_cast<const char*>(data), size); }
+
+      private:
+         /// The string to which data is appended.
+         std::string& out_;
+   };
+
+
+
+   /// A \c Sink that writes everything to a C \c FILE.
+   class FileSink: public Sink
+   {
+      public:
+         /** Constructs a \c FileSink.
+          *  @param file The file to which data will be written. It is not
+          *         closed by the \c FileSink.
+          */
+         explicit FileSink (std::FILE* file)
+            : file_(file)
+         { }
+
+         /// @throw LuaFileError If the data cannot be written.
+         virtual void write (const void* data, std::size_t size)
+         {
+            if (std::fwrite (data, 1, size, file_) != size)
+               throw LuaFileError ("Error writing serialized data to a file.");
+         }
+
+      private:
+         /// The file to which data is written.
+         std::FILE* file_;
+   };
+
+
+
+   /// Something where serialized data is read from.
+   class Source
+   {
+      public:
+         /// Destroys a \c Source.
+         virtual ~Source() { }
+
+         /** Reads exactly \c size bytes, storing them at \c data.
+          *  @throw SerializationError If there are less than \c size bytes
+          *         available.
+          */
+         virtual void read (void* data, std::size_t size) = 0;
+   };
+
+
+
+   /** A \c Source reading from a block of memory. The memory is not copied,
+    *  so it must outlive the \c MemorySource.
+    */
+   class MemorySource: public Source
+   {
+      public:
+         /// Constructs a \c MemorySource reading \c size bytes from \c data.
+         MemorySource (const void* data, std::size_t size)
+            : pos_(static_cast<const char*>(data)), end_(pos_ + size)
+         { }
+
+         /// Constructs a \c MemorySource reading the contents of \c data.
+         explicit MemorySource (const std::string& data)
+            : pos_(data.data()), end_(pos_ + data.size())
+         { }
+
+         virtual void read (void* data, std::size_t size);
+
+         /// Returns the number of bytes not read yet.
+         std::size_t remaining() const { return end_ - pos_; }
+
+      private:
+         /// The next byte to read.
+         const char* pos_;
+
+         /// One past the last byte available.
+         const char* end_;
+   };
+
+
+
+   /** Writes \c value to \c sink in Diluculum's binary serialization format.
+    *  <p>The data starts with a header (the bytes \c 'D' and \c 'l', followed
+    *  by the format version), followed by the value itself. Every value starts
+    *  with a one-byte tag; lengths and counts are stored as variable-length
+    *  integers (LEB128). Numbers with an exact integer representation are
+    *  stored as (zigzag-encoded) variable-length integers, so that small
+    *  numbers take just one or two bytes; other numbers are stored as
+    *  little-endian IEEE doubles. Tables are split in an array section (the
+    *  values at keys <tt>1..n</tt>, stored without their keys) and a hash
+    *  section (the remaining key/value pairs). Lua functions are stored as
+    *  bytecode and userdata as raw bytes. C functions cannot be serialized,
+    *  since they are just addresses in the current process.
+    *  @throw LuaTypeError If \c value contains something that cannot be
+    *         serialized (like a C function).
+    */
+   void Serialize (const LuaValue& value, Sink& sink);
+
+   /** Serializes the value at index \c index of the Lua stack of \c ls directly
+    *  to \c sink, without building a \c LuaValue. The format is the same used
+    *  by \c Serialize(), and the stack is left unchanged.
+    *  @throw LuaTypeError If the value contains something that cannot be
+    *         serialized (like a coroutine or a C function) or tables nested
+    *         too deeply (which is also what happens with cyclic tables).
+    */
+   void SerializeFromStack (lua_State* ls, int index, Sink& sink);
+
+   /** Reads a value serialized by \c Serialize() or \c SerializeFromStack().
+    *  @throw SerializationError If the data is truncated, malformed or of an
+    *         unsupported format version.
+    *  @note Serialized Lua functions are loaded as bytecode, which Lua does not
+    *        verify. Do not deserialize data from untrusted sources.
+    */
+   LuaValue Deserialize (Source& source);
+
+   /** Reads a value serialized by \c Serialize() or \c SerializeFromStack()
+    *  and pushes it onto the Lua stack of \c ls, without building a
+    *  \c LuaValue. If an exception is thrown, the stack is left unchanged.
+    *  @throw SerializationError See \c Deserialize().
+    *  @throw LuaError If the Lua bytecode of some function cannot be loaded.
+    */
+   void DeserializeToStack (lua_State* ls, Source& source);
+
+   /** Writes \c value to \c sink as a Lua expression that evaluates to an
+    *  equivalent value. Prepending \c "return " to it makes a chunk that can
+    *  be loaded with \c LuaState::doFile() or \c LuaState::doString().
+    *  <p>Tables are written as table constructors, with the array part
+    *  (keys <tt>1..n</tt>) as positional fields and the other keys sorted as
+    *  in a \c LuaValueMap, so the output is deterministic. Numbers are written
+    *  with the fewest digits that read back to the same value, and strings
+    *  are escaped so that they survive any bytes they contain.
+    *  <p>Values too large or too deeply nested for a single expression (Lua
+    *  limits the constants of each function and the nesting of expressions)
+    *  are written instead as a call to a function that builds them piece by
+    *  piece, so the output is always a loadable expression.
+    *  @throw LuaTypeError If \c value contains functions or userdata, which
+    *         have no source representation, or tables nested too deeply
+    *         (which is also what happens with cyclic tables).
+    */
+   void ToLuaSource (const LuaValue& value, Sink& sink);
+
+} // namespace Diluculum
+
+#endif // _DILUCULUM_LUA_SERIALIZATION_HPP_
@@ -0,0 +1,104 @@
+/******************************************************************************\
+* LuaStore.hpp                                                                 *
+* Memory-mapped, read-only stores of Lua values.                               *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#ifndef _DILUCULUM_LUA_STORE_HPP_
+#define _DILUCULUM_LUA_STORE_HPP_
+
+#include <cstddef>
+#include <string>
+#include <boost/shared_ptr.hpp>
+#include <lua.hpp>
+#include <Diluculum/LuaSerialization.hpp>
+#include <Diluculum/LuaValue.hpp>
+
+
+namespace Diluculum
+{
+   /** A large, read-only Lua value stored in a file with a flat, offset-based
+    *  format (see \c WriteLuaStore()), which is memory-mapped instead of
+    *  loaded. Since the mapping is read-only, the operating system shares the
+    *  same physical memory among all processes using the same file.
+    *  <p>Lua code sees the tables in the store through proxies (see
+    *  \c PushLuaStore()) that decode values only when they are accessed.
+    *  <p>A \c LuaStore is a handle: copies of it refer to the same mapping,
+    *  which stays alive as long as some copy (or some proxy in some Lua
+    *  state) is alive.
+    */
+   class LuaStore
+   {
+      public:
+         /** Memory-maps the store in the file \c fileName.
+          *  @throw LuaFileError If the file cannot be mapped.
+          *  @throw SerializationError If the file is not a valid store.
+          */
+         explicit LuaStore (const std::string& fileName);
+
+         /** Decodes the whole store into a \c LuaValue. This is mostly useful
+          *  for small stores and for debugging.
+          *  @throw SerializationError If the store is corrupt.
+          */
+         LuaValue value() const;
+
+         /// Returns the size of the store, in bytes.
+         std::size_t size() const;
+
+         /** The mapped data shared by all copies of a store.
+          *  @note This is used internally. Users can ignore this class.
+          */
+         class Data;
+
+      private:
+         friend void PushLuaStore (lua_State*, const LuaStore&);
+
+         /// The mapped data.
+         boost::shared_ptr<Data> data_;
+   };
+
+
+
+   /** Writes \c value to \c sink in the format used by \c LuaStore.
+    *  <p>In this format, every value takes a fixed-size slot, so that array
+    *  elements can be found by their position, and other table keys by a
+    *  binary search. Identical strings are stored only once.
+    *  @throw LuaTypeError If \c value contains functions or userdata, or
+    *         tables with keys that are not booleans, numbers or strings (or
+    *         that are NaN).
+    */
+   void WriteLuaStore (const LuaValue& value, Sink& sink);
+
+   /** Pushes onto the Lua stack of \c state the value stored in \c store.
+    *  Tables are pushed as read-only proxies supporting indexing, the length
+    *  operator, \c == and iteration. In Lua 5.1 (which has no \c __pairs),
+    *  iterate with <tt>for k, v in proxy() do ... end</tt>.
+    *  @note Each access to a table in the store creates a new proxy. Proxies
+    *        for the same table compare as equal, but are different keys in
+    *        other tables.
+    */
+   void PushLuaStore (lua_State* state, const LuaStore& store);
+
+} // namespace Diluculum
+
+#endif // _DILUCULUM_LUA_STORE_HPP_
@@ -0,0 +1,513 @@
+/******************************************************************************\
+* LuaTypeTraits.hpp                                                            *
+* Moving native C++ values to and from the Lua stack.                          *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#ifndef _DILUCULUM_LUA_TYPE_TRAITS_HPP_
+#define _DILUCULUM_LUA_TYPE_TRAITS_HPP_
+
+#include <cstddef>
+#include <string>
+#include <boost/tuple/tuple.hpp>
+#include <boost/type_traits/is_convertible.hpp>
+#include <boost/type_traits/remove_cv.hpp>
+#include <lua.hpp>
+#include <Diluculum/CppObject.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaUtils.hpp>
+#include <Diluculum/LuaValue.hpp>
+
+
+namespace Diluculum
+{
+   namespace Impl
+   {
+      /** The generic \c LuaTypeTraits for types that can be converted to a
+       *  \c LuaValue: they can be pushed, but not read.
+       */
+      template <class T, bool IsConvertibleToLuaValue>
+      struct DefaultTypeTraits
+      {
+         static void push (lua_State* ls, const T& value)
+         {
+            PushLuaValue (ls, LuaValue (value));
+         }
+      };
+
+      /** The generic \c LuaTypeTraits for objects of classes exported to
+       *  Lua.
+       */
+      template <class T>
+      struct DefaultTypeTraits<T, false>
+      {
+         /// Objects are passed to bound functions by reference.
+         typedef T& parameter_type;
+
+         static void push (lua_State* ls, const T& value)
+         {
+            if (ClassInfo<T>::copy == 0)
+               ThrowCannotPushObject (ClassInfo<T>::name);
+
+            PushClassMetatable (ls, ClassInfo<T>::key);
+            if (lua_isnil (ls, -1))
+            {
+               lua_pop (ls, 1);
+               ThrowClassNotRegistered (ClassInfo<T>::name);
+            }
+
+            ClassInfo<T>::copy (ls, value);
+            lua_insert (ls, -2);
+            lua_setmetatable (ls, -2);
+         }
+
+         static bool is (lua_State* ls, int index)
+         {
+            return ClassInfo<T>::key != 0
+               && IsCppObject (ls, index, ClassInfo<T>::key);
+         }
+
+         static T& get (lua_State* ls, int index)
+         {
+            if (ClassInfo<T>::key == 0)
+               ThrowCannotPushObject (0);
+
+            return *static_cast<T*>(
+               GetCppObject (ls, index, ClassInfo<T>::key,
+                             ClassInfo<T>::name)->ptr);
+         }
+      };
+   }
+
+
+
+   /** Describes how values of the C++ type \c T are pushed onto and read from
+    *  the Lua stack, without going through a \c LuaValue whenever possible.
+    *  Specializations provide (some of) the following static members:
+    *  - <tt>void push (lua_State* ls, const T& value)</tt>: pushes \c value
+    *    onto the stack of \c ls.
+    *  - <tt>bool is (lua_State* ls, int index)</tt>: checks whether the value
+    *    at \c index can be read as a \c T.
+    *  - <tt>T get (lua_State* ls, int index)</tt>: reads the value at
+    *    \c index as a \c T, leaving the stack untouched. Throws a
+    *    \c TypeMismatchError if this is not possible.
+    *  - <tt>typedef T& parameter_type</tt>: tells that \c get() returns a
+    *    reference, which bound functions taking a \c T parameter (by value
+    *    or by reference) get directly. Without it, \c get() is taken to
+    *    return a value.
+    *  <p>This generic version pushes anything that can be converted to a
+    *  \c LuaValue, but cannot read it. Numbers, booleans, strings,
+    *  <tt>LuaValue</tt>s and <tt>LuaValueMap</tt>s are fully supported by the
+    *  specializations below. Users may add their own specializations.
+    *  <p>Types that cannot be converted to a \c LuaValue are assumed to be
+    *  classes exported to Lua with \c DILUCULUM_BEGIN_CLASS() (or one of its
+    *  variants). Their objects are read by reference (\c get() returns a
+    *  <tt>T&</tt> referring to the object stored in the userdata) and pushed
+    *  by copy. Only classes exported with \c DILUCULUM_BEGIN_CLASS_INLINE()
+    *  can be pushed, and the class must have been registered in the Lua state.
+    */
+   template <class T>
+   struct LuaTypeTraits
+      : public Impl::DefaultTypeTraits<
+           T, boost::is_convertible<T, LuaValue>::value>
+   { };
+
+
+
+   /** Defines the \c LuaTypeTraits specialization for a numeric type. Numbers
+    *  are read like \c luaL_checknumber() does: strings convertible to
+    *  numbers are accepted.
+    *  @note This is used internally. Users can ignore this macro.
+    */
+#define DILUCULUM_NUMERIC_TYPE_TRAITS(TYPE)                                   \
+   template <>                                                                \
+   struct LuaTypeTraits<TYPE>                                                 \
+   {                                                                          \
+      static void push (lua_State* ls, TYPE value)                            \
+      {                                                                       \
+         lua_pushnumber (ls, static_cast<lua_Number>(value));                 \
+      }                                                                       \
+                                                                              \
+      static bool is (lua_State* ls, int index)                               \
+      {                                                                       \
+         return lua_isnumber (ls, index) != 0;                                \
+      }                                                                       \
+                                                                              \
+      static TYPE get (lua_State* ls, int index)                              \
+      {                                                                       \
+         if (!lua_isnumber (ls, index))                                       \
+            throw TypeMismatchError ("number", luaL_typename (ls, index));    \
+         return static_cast<TYPE>(lua_tonumber (ls, index));                  \
+      }                                                                       \
+   };
+
+   DILUCULUM_NUMERIC_TYPE_TRAITS (float)
+   DILUCULUM_NUMERIC_TYPE_TRAITS (double)
+   DILUCULUM_NUMERIC_TYPE_TRAITS (long double)
+   DILUCULUM_NUMERIC_TYPE_TRAITS (short)
+   DILUCULUM_NUMERIC_TYPE_TRAITS (unsigned short)
+   DILUCULUM_NUMERIC_TYPE_TRAITS (int)
+   DILUCULUM_NUMERIC_TYPE_TRAITS (unsigned)
+   DILUCULUM_NUMERIC_TYPE_TRAITS (long)
+   DILUCULUM_NUMERIC_TYPE_TRAITS (unsigned long)
+
+#undef DILUCULUM_NUMERIC_TYPE_TRAITS
+
+
+
+   /// \c LuaTypeTraits for booleans. Any Lua value can be read as a boolean.
+   template <>
+   struct LuaTypeTraits<bool>
+   {
+      static void push (lua_State* ls, bool value)
+      {
+         lua_pushboolean (ls, value);
+      }
+
+      static bool is (lua_State*, int)
+      {
+         return true;
+      }
+
+      static bool get (lua_State* ls, int index)
+      {
+         return lua_toboolean (ls, index) != 0;
+      }
+   };
+
+
+
+   /** \c LuaTypeTraits for strings. Strings may have embedded zeros. Like in
+    *  \c luaL_checkstring(), numbers are accepted as strings.
+    */
+   template <>
+   struct LuaTypeTraits<std::string>
+   {
+      static void push (lua_State* ls, const std::string& value)
+      {
+         lua_pushlstring (ls, value.c_str(), value.length());
+      }
+
+      static bool is (lua_State* ls, int index)
+      {
+         return lua_isstring (ls, index) != 0;
+      }
+
+      static std::string get (lua_State* ls, int index)
+      {
+         if (!lua_isstring (ls, index))
+            throw TypeMismatchError ("string", luaL_typename (ls, index));
+         size_t len;
+         const char* str = lua_tolstring (ls, index, &len);
+         return std::string (str, len);
+      }
+   };
+
+
+
+   /** \c LuaTypeTraits for C strings. Only pushing is supported, since the
+    *  memory of a string read from Lua is owned by Lua.
+    */
+   template <>
+   struct LuaTypeTraits<const char*>
+   {
+      static void push (lua_State* ls, const char* value)
+      {
+         lua_pushstring (ls, value);
+      }
+   };
+
+   /// \c LuaTypeTraits for non-\c const C strings. Only pushing is supported.
+   template <>
+   struct LuaTypeTraits<char*>: public LuaTypeTraits<const char*>
+   { };
+
+   /// \c LuaTypeTraits for string literals. Only pushing is supported.
+   template <std::size_t N>
+   struct LuaTypeTraits<char[N]>: public LuaTypeTraits<const char*>
+   { };
+
+
+
+   /** \c LuaTypeTraits for <tt>LuaValue</tt>s, which can hold anything.
+    *  Non-valid stack indices (like the index of a missing function
+    *  parameter) are read as \c Nil.
+    */
+   template <>
+   struct LuaTypeTraits<LuaValue>
+   {
+      static void push (lua_State* ls, const LuaValue& value)
+      {
+         PushLuaValue (ls, value);
+      }
+
+      static bool is (lua_State*, int)
+      {
+         return true;
+      }
+
+      static LuaValue get (lua_State* ls, int index)
+      {
+         if (lua_isnone (ls, index))
+            return Nil;
+         return ToLuaValue (ls, index);
+      }
+   };
+
+
+
+   /// \c LuaTypeTraits for tables.
+   template <>
+   struct LuaTypeTraits<LuaValueMap>
+   {
+      static void push (lua_State* ls, const LuaValueMap& value)
+      {
+         PushLuaValue (ls, value);
+      }
+
+      static bool is (lua_State* ls, int index)
+      {
+         return lua_istable (ls, index);
+      }
+
+      static LuaValueMap get (lua_State* ls, int index)
+      {
+         if (!lua_istable (ls, index))
+            throw TypeMismatchError ("table", luaL_typename (ls, index));
+         return ToLuaValue (ls, index).asTable();
+      }
+   };
+
+
+
+   /** \c LuaTypeTraits for objects of classes exported to Lua, whose
+    *  ownership is shared between Lua and C++. Pushing a non-null pointer
+    *  creates a userdata holding a copy of it (a null pointer is pushed as
+    *  \c nil). Reading gives back a pointer sharing the ownership with the
+    *  userdata, so that the object stays alive for as long as any of them
+    *  (or their copies) exists. Only objects pushed this way (or created in
+    *  Lua, for classes exported with \c DILUCULUM_BEGIN_CLASS_SHARED()) can
+    *  be read; \c nil is read as a null pointer.
+    */
+   template <class T>
+   struct LuaTypeTraits<boost::shared_ptr<T> >
+   {
+      static void push (lua_State* ls, const boost::shared_ptr<T>& value)
+      {
+         Impl::PushSharedObject (ls, value, Impl::ClassInfo<T>::key,
+                                 Impl::ClassInfo<T>::name);
+      }
+
+      static bool is (lua_State* ls, int index)
+      {
+         return lua_isnil (ls, index)
+            || (Impl::ClassInfo<T>::key != 0
+                && Impl::IsCppObject (ls, index, Impl::ClassInfo<T>::key)
+                && static_cast<Impl::CppObject*>(
+                      lua_touserdata (ls, index))->owner != 0);
+      }
+
+      static boost::shared_ptr<T> get (lua_State* ls, int index)
+      {
+         if (lua_isnil (ls, index))
+            return boost::shared_ptr<T>();
+
+         if (Impl::ClassInfo<T>::key == 0)
+            Impl::ThrowCannotPushObject (0);
+
+         return boost::static_pointer_cast<T>(
+            Impl::GetSharedObject (ls, index, Impl::ClassInfo<T>::key,
+                                   Impl::ClassInfo<T>::name));
+      }
+   };
+
+
+
+   /** \c LuaTypeTraits for pointers to objects of classes exported to Lua.
+    *  Pushing a non-null pointer creates a userdata referring to the object,
+    *  just like \c DILUCULUM_REGISTER_OBJECT() does: C++ keeps the ownership
+    *  of the object, which must outlive its uses in Lua. A null pointer is
+    *  pushed as \c nil. Reading gives a pointer to the object stored in the
+    *  userdata; \c nil is read as a null pointer.
+    *  <p>(Without this specialization, pointers would be pushed as booleans,
+    *  because they are convertible to \c bool.)
+    */
+   template <class T>
+   struct LuaTypeTraits<T*>
+   {
+      /// The class, as exported to Lua.
+      typedef typename boost::remove_cv<T>::type Class;
+
+      static void push (lua_State* ls, T* value)
+      {
+         Impl::PushObjectReference (ls, const_cast<Class*>(value),
+                                    Impl::ClassInfo<Class>::key,
+                                    Impl::ClassInfo<Class>::name);
+      }
+
+      static bool is (lua_State* ls, int index)
+      {
+         return lua_isnil (ls, index)
+            || (Impl::ClassInfo<Class>::key != 0
+                && Impl::IsCppObject (ls, index, Impl::ClassInfo<Class>::key));
+      }
+
+      static T* get (lua_State* ls, int index)
+      {
+         if (lua_isnil (ls, index))
+            return 0;
+
+         if (Impl::ClassInfo<Class>::key == 0)
+            Impl::ThrowCannotPushObject (0);
+
+         return static_cast<T*>(
+            Impl::GetCppObject (ls, index, Impl::ClassInfo<Class>::key,
+                                Impl::ClassInfo<Class>::name)->ptr);
+      }
+   };
+
+
+
+   /** \c LuaTypeTraits for functions implemented in C. This takes
+    *  precedence over the one for pointers.
+    */
+   template <>
+   struct LuaTypeTraits<lua_CFunction>
+   {
+      static void push (lua_State* ls, lua_CFunction value)
+      {
+         lua_pushcfunction (ls, value);
+      }
+
+      static bool is (lua_State* ls, int index)
+      {
+         return lua_iscfunction (ls, index) != 0;
+      }
+
+      static lua_CFunction get (lua_State* ls, int index)
+      {
+         if (!lua_iscfunction (ls, index))
+            throw TypeMismatchError ("C function", luaL_typename (ls, index));
+         return lua_tocfunction (ls, index);
+      }
+   };
+
+
+
+   namespace Impl
+   {
+      /** Restores the Lua stack top to a given value when destroyed. Used to
+       *  clean up the stack even when reading values from it throws.
+       */
+      class StackTopRestorer
+      {
+         public:
+            /// Will restore the stack of \c ls to \c top elements.
+            StackTopRestorer (lua_State* ls, int top)
+               : ls_(ls), top_(top)
+            { }
+
+            /// Restores the stack top.
+            ~StackTopRestorer() { lua_settop (ls_, top_); }
+
+         private:
+            /// The Lua state whose stack will be restored.
+            lua_State* ls_;
+
+            /// The stack top to restore.
+            int top_;
+      };
+
+
+
+      /// Ends the recursion of \c ReadTupleFromStack().
+      template <class Head>
+      void ReadTupleFromStack (
+         lua_State* ls, int index,
+         boost::tuples::cons<Head, boost::tuples::null_type>& dest)
+      {
+         dest.head = LuaTypeTraits<Head>::get (ls, index);
+      }
+
+      /** Reads the values stored at a sequence of stack positions into a
+       *  Boost.Tuple (or, more precisely, to the \c cons list a tuple is made
+       *  of).
+       */
+      template <class Head, class Tail>
+      void ReadTupleFromStack (lua_State* ls, int index,
+                               boost::tuples::cons<Head, Tail>& dest)
+      {
+         dest.head = LuaTypeTraits<Head>::get (ls, index);
+         ReadTupleFromStack (ls, index + 1, dest.tail);
+      }
+
+
+
+      /** Describes how the results of a Lua function call are returned to C++
+       *  as a value of type \c Ret. \c count is the number of results
+       *  expected, and \c read() reads them, starting at stack index
+       *  \c index. In this generic version, a single value is expected.
+       */
+      template <class Ret>
+      struct CallResults
+      {
+         static const int count = 1;
+
+         static Ret read (lua_State* ls, int index)
+         {
+            return LuaTypeTraits<Ret>::get (ls, index);
+         }
+      };
+
+      /// \c CallResults for calls whose results are ignored.
+      template <>
+      struct CallResults<void>
+      {
+         static const int count = 0;
+
+         static void read (lua_State*, int)
+         { }
+      };
+
+      /// \c CallResults for calls returning a statically known set of values.
+      template <class T0, class T1, class T2, class T3, class T4,
+                class T5, class T6, class T7, class T8, class T9>
+      struct CallResults<boost::tuple<T0, T1, T2, T3, T4, T5, T6, T7, T8, T9> >
+      {
+         typedef boost::tuple<T0, T1, T2, T3, T4, T5, T6, T7, T8, T9> tuple_t;
+
+         static const int count = boost::tuples::length<tuple_t>::value;
+
+         static tuple_t read (lua_State* ls, int index)
+         {
+            tuple_t ret;
+            ReadTupleFromStack (ls, index, ret);
+            return ret;
+         }
+      };
+
+   } // namespace Impl
+
+} // namespace Diluculum
+
+#endif // _DILUCULUM_LUA_TYPE_TRAITS_HPP_
@@ -0,0 +1,176 @@
+/******************************************************************************\
+* LuaTypedArray.hpp                                                            *
+* Typed arrays of numbers, shared by C++ and Lua without conversions.          *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#ifndef _DILUCULUM_LUA_TYPED_ARRAY_HPP_
+#define _DILUCULUM_LUA_TYPED_ARRAY_HPP_
+
+#include <cstddef>
+#include <boost/cstdint.hpp>
+#include <lua.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaVariable.hpp>
+
+
+namespace Diluculum
+{
+   /// The types of the elements of typed arrays.
+   enum TypedArrayType
+   {
+      Float64Array, ///< \c double elements (\c "float64" in Lua).
+      Float32Array, ///< \c float elements (\c "float32" in Lua).
+      Int32Array,   ///< \c boost::int32_t elements (\c "int32" in Lua).
+      UInt8Array    ///< \c boost::uint8_t elements (\c "uint8" in Lua).
+   };
+
+   /// Maps the C++ type of the elements of a typed array to its \c enum.
+   template <class T> struct TypedArrayTraits;
+
+   template<> struct TypedArrayTraits<double>
+   { static const TypedArrayType type = Float64Array; };
+
+   template<> struct TypedArrayTraits<float>
+   { static const TypedArrayType type = Float32Array; };
+
+   template<> struct TypedArrayTraits<boost::int32_t>
+   { static const TypedArrayType type = Int32Array; };
+
+   template<> struct TypedArrayTraits<boost::uint8_t>
+   { static const TypedArrayType type = UInt8Array; };
+
+   /** The elements of a typed array, as seen from C++. They are contiguous,
+    *  and are valid while the typed array is alive (for arrays owned by Lua)
+    *  or while the memory given to \c PushTypedArrayView() is (for views).
+    */
+   struct TypedArraySpan
+   {
+      /// The type of the elements.
+      TypedArrayType type;
+
+      /// The first element.
+      void* data;
+
+      /// The number of elements.
+      std::size_t size;
+   };
+
+   /// Returns the size, in bytes, of each element of a \c type array.
+   std::size_t TypedArrayElementSize (TypedArrayType type);
+
+   /// Returns the name of \c type as seen in Lua (like \c "float64").
+   const char* TypedArrayTypeName (TypedArrayType type);
+
+   /** Pushes onto the Lua stack of \c state a typed array with \c size
+    *  elements of type \c type, all zero. Its memory is owned by Lua, and is
+    *  freed when the array is garbage-collected.
+    *  <p>In Lua, typed arrays are userdata indexed from 1 to their size, and
+    *  support the length operator. Reading outside this range yields \c nil;
+    *  writing outside it, or writing something that is not a number, raises
+    *  an error. Numbers written to integer arrays are truncated toward zero,
+    *  and must fit in the element type.
+    *  @return A pointer to the first element of the new array.
+    */
+   void* PushTypedArray (lua_State* state, TypedArrayType type,
+                         std::size_t size);
+
+   /** Pushes onto the Lua stack of \c state a typed array that is a view of
+    *  \c size elements of type \c type starting at \c data. Nothing is
+    *  copied: Lua code reads and writes directly in \c data.
+    *  @note The memory remains owned by the caller, and must outlive every
+    *        use of the view by Lua code. Use \c DetachTypedArray() before
+    *        releasing it if Lua code may have kept a reference to the view.
+    */
+   void PushTypedArrayView (lua_State* state, TypedArrayType type,
+                            void* data, std::size_t size);
+
+   /** Returns the elements of the typed array at index \c index on the Lua
+    *  stack of \c state. The stack is not changed.
+    *  @throw TypeMismatchError If the value at \c index is not a typed array.
+    */
+   TypedArraySpan ToTypedArray (lua_State* state, int index);
+
+   /** Makes the typed array at index \c index on the Lua stack of \c state
+    *  empty, so that Lua code can no longer access its former elements. This
+    *  is mostly useful for views, whose memory is about to be released or
+    *  reused.
+    *  @throw TypeMismatchError If the value at \c index is not a typed array.
+    */
+   void DetachTypedArray (lua_State* state, int index);
+
+   /** Registers typed array constructors into a Lua table, as fields named
+    *  \c "float64", \c "float32", \c "int32" and \c "uint8". In Lua,
+    *  <tt>table.float64 (n)</tt> creates a \c float64 array with \c n zeros,
+    *  and <tt>table.float64 (t)</tt> creates one with the elements of the
+    *  sequence \c t. The other constructors work likewise.
+    *  @param table The table into which the functions will be stored. It will
+    *         be created if it doesn't exist.
+    */
+   void RegisterTypedArrayFunctions (LuaVariable table);
+
+
+
+   /** Pushes a typed array of \c size elements of type \c T, owned by Lua.
+    *  This works like the non-template \c PushTypedArray().
+    */
+   template <class T>
+   T* PushTypedArray (lua_State* state, std::size_t size)
+   {
+      return static_cast<T*>(
+         PushTypedArray (state, TypedArrayTraits<T>::type, size));
+   }
+
+   /** Pushes a view of \c size elements of type \c T starting at \c data.
+    *  This works like the non-template \c PushTypedArrayView().
+    */
+   template <class T>
+   void PushTypedArrayView (lua_State* state, T* data, std::size_t size)
+   {
+      PushTypedArrayView (state, TypedArrayTraits<T>::type, data, size);
+   }
+
+   /** Returns the elements of the typed array at index \c index on the Lua
+    *  stack of \c state, storing their number in \c size.
+    *  @throw TypeMismatchError If the value at \c index is not a typed array
+    *         with elements of type \c T.
+    */
+   template <class T>
+   T* ToTypedArray (lua_State* state, int index, std::size_t& size)
+   {
+      const TypedArraySpan span = ToTypedArray (state, index);
+      const TypedArrayType type = TypedArrayTraits<T>::type;
+
+      if (span.type != type)
+      {
+         throw TypeMismatchError (TypedArrayTypeName (type),
+                                  TypedArrayTypeName (span.type));
+      }
+
+      size = span.size;
+      return static_cast<T*>(span.data);
+   }
+
+} // namespace Diluculum
+
+#endif // _DILUCULUM_LUA_TYPED_ARRAY_HPP_
@@ -27,10 +27,42 @@
 #ifndef _DILUCULUM_LUA_UTILS_HPP_
 #define _DILUCULUM_LUA_UTILS_HPP_
 
+#include <cstddef>
+#include <limits>
 #include <Diluculum/LuaValue.hpp>
 
 namespace Diluculum
 {
+   /** Limits on the work done by \c ToLuaValue() and \c PushLuaValue(). Both
+    *  functions convert nested tables iteratively (not recursively), so these
+    *  limits are what bounds the memory and time they use, even for
+    *  adversarial inputs.
+    */
+   struct ConversionLimits
+   {
+      /// The default maximum nesting depth.
+      static const unsigned DefaultMaxDepth = 1000;
+
+      /** Constructs the limits. By default, tables can be nested up to
+       *  \c DefaultMaxDepth levels, and there is no limit on the number of
+       *  elements.
+       */
+      ConversionLimits (
+         unsigned depth = DefaultMaxDepth,
+         std::size_t elements = std::numeric_limits<std::size_t>::max())
+         : maxDepth(depth), maxElements(elements)
+      { }
+
+      /** The maximum number of nested tables. A table not nested in any other
+       *  is at depth 1.
+       */
+      unsigned maxDepth;
+
+      /** The maximum number of table entries (key/value pairs), summed over
+       *  all tables converted in one call.
+       */
+      std::size_t maxElements;
+   };
 
    /** Converts and returns the element at index \c index on the stack to a
     *  \c LuaValue. This keeps the Lua stack untouched. Oh, yes, and it accepts
@@ -38,10 +70,38 @@ namespace Diluculum
     *  the Lua C API.
     *  @throw LuaTypeError If the element at \c index cannot be converted to a
     *         \c LuaValue. This can happen if the value at that position is, for
-    *         example, a "Lua Thread" that is not supported by \c LuaValue.
+    *         example, a "Lua Thread" that is not supported by \c LuaValue, or
+    *         if it exceeds the default \c ConversionLimits.
     */
    LuaValue ToLuaValue (lua_State* state, int index);
 
+   /// The ways in which \c ToLuaValue() can convert tables.
+   enum TableConversion
+   {
+      /** Converts a table every time it is reached. A table referenced from
+       *  many places is copied many times, and a cyclic table cannot be
+       *  converted at all. This is what the two-parameter \c ToLuaValue()
+       *  does.
+       */
+      CopyTables,
+
+      /** Converts every distinct table only once, and makes all the places
+       *  referencing it share the same storage in the resulting \c LuaValue.
+       *  Cycles are detected and reported as errors.
+       */
+      ShareTables
+   };
+
+   /** Just like the two-parameter \c ToLuaValue(), but allows to select how
+    *  tables are converted and the limits on the conversion.
+    *  @throw LuaTypeError If the element at \c index cannot be converted to a
+    *         \c LuaValue. This includes values exceeding \c limits and, with
+    *         \c ShareTables, tables that (directly or indirectly) contain
+    *         themselves. In any case, the Lua stack is left untouched.
+    */
+   LuaValue ToLuaValue (lua_State* state, int index, TableConversion mode,
+                        const ConversionLimits& limits = ConversionLimits());
+
    /** Pushes the value stored at \c value into the Lua stack of \c state. For
     *  most types, this is equivalent to simply calling the appropriate
     *  <tt>lua_push*()</tt> function. For other types, like tables and Lua
@@ -49,9 +109,20 @@ namespace Diluculum
     *  @note If \c value holds a table, then any entry that happens to have
     *        \c Nil as key will be ignored. (Since Lua does not support \c nil
     *        as a table index.)
+    *  @throw LuaTypeError If \c value cannot be pushed, for instance because
+    *         it exceeds the default \c ConversionLimits. In this case, nothing
+    *         is pushed.
     */
    void PushLuaValue (lua_State* state, const LuaValue& value);
 
+   /** Just like the two-parameter \c PushLuaValue(), but with the given
+    *  \c limits.
+    *  @throw LuaTypeError If \c value cannot be pushed, for instance because
+    *         it exceeds \c limits. In this case, nothing is pushed.
+    */
+   void PushLuaValue (lua_State* state, const LuaValue& value,
+                      const ConversionLimits& limits);
+
 } // namespace Diluculum
 
 #endif // _DILUCULUM_LUA_UTILS_HPP_
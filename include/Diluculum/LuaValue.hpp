@@ -31,6 +31,7 @@
 #include <map>
 #include <stdexcept>
 #include <string>
+#include <boost/shared_ptr.hpp>
 #include <Diluculum/CppObject.hpp>
 #include <Diluculum/LuaUserData.hpp>
 #include <Diluculum/LuaFunction.hpp>
@@ -47,6 +48,14 @@ namespace Diluculum
     *  represents the value (hence the name!). So, if a \c LuaValue holds a
     *  table, then it contains a collection of keys and values. Similarly, if it
     *  holds a userdata, it actually contains a block of memory with some data.
+    *  <p>Tables are stored with copy-on-write semantics: copying a table-typed
+    *  \c LuaValue just shares its \c LuaValueMap, which is duplicated only
+    *  when one of the copies is modified through the non-\c const
+    *  \c operator[]. This is invisible to users, but makes copies cheap and
+    *  lets a table that appears in many places of a value be stored only once.
+    *  (Once a non-\c const reference into a table has been handed out, that
+    *  table is copied eagerly again, so that the reference can never end up
+    *  aliasing another value.)
     */
    class LuaValue
    {
@@ -173,6 +182,15 @@ namespace Diluculum
           */
          LuaValueMap asTable() const;
 
+         /** Returns the value as a \c const reference to a table, without
+          *  copying it.
+          *  @note The reference is valid only while this \c LuaValue is not
+          *        modified or destroyed.
+          *  @throw TypeMismatchError If the value is not a table (this is a
+          *         strict check; no type conversion is performed).
+          */
+         const LuaValueMap& asConstTable() const;
+
          /** Return the value as a \c const Lua function.
           *  @throw TypeMismatchError If the value is not a Lua function.
           *         (this is a strict check; no type conversion is performed).
@@ -265,6 +283,8 @@ namespace Diluculum
           *  a table). If there is no value associated with the key passed as
           *  parameter, inserts a new value (\c nil) and returns a reference to
           *  it.
+          *  @note If the table is shared with other <tt>LuaValue</tt>s, it is
+          *        copied first, so that they are not affected.
           *  @throw TypeMismatchError If this \c LuaValue does not hold a table.
           */
          LuaValue& operator[] (const LuaValue& key);
@@ -278,6 +298,26 @@ namespace Diluculum
 
       private:
 
+         /// The way tables are stored at \c data_ (shared, copy-on-write).
+         struct TableData
+         {
+               /// The table itself, possibly shared with other values.
+               boost::shared_ptr<LuaValueMap> table;
+
+               /** Is \c true if a non-\c const reference into \c table was
+                *  given away. In this case, \c table is not shared with
+                *  anyone, and copies of this \c LuaValue will copy it.
+                */
+               bool unshareable;
+         };
+
+         /// Returns the table stored in this \c LuaValue, which must hold one.
+         const LuaValueMap& tableRef() const
+         { return *reinterpret_cast<const TableData*>(data_)->table; }
+
+         /// Constructs at \c data_ a copy of the table stored in \c other.
+         void copyTableAtData (const LuaValue& other);
+
          /** Destroys the object allocated at the \c data_ member, freeing its
           *  resources.
           */
@@ -289,7 +329,7 @@ namespace Diluculum
                lua_Number typeNumber;
                char typeString[sizeof(std::string)];
                bool typeBool;
-               char typeLuaValueMap[sizeof(LuaValueMap)];
+               char typeTableData[sizeof(TableData)];
                char typeFunction[sizeof(LuaFunction)];
                char typeUserData[sizeof(LuaUserData)];
          };
@@ -27,8 +27,12 @@
 #ifndef _DILUCULUM_LUA_VARIABLE_HPP_
 #define _DILUCULUM_LUA_VARIABLE_HPP_
 
+#include <string>
 #include <vector>
+#include <boost/shared_ptr.hpp>
+#include <Diluculum/LuaTypeTraits.hpp>
 #include <Diluculum/LuaValue.hpp>
+#include <Diluculum/LuaView.hpp>
 
 
 namespace Diluculum
@@ -75,6 +79,31 @@ namespace Diluculum
           */
          LuaValue value() const;
 
+         /** Returns the type of the value associated with this variable (one
+          *  of the \c LUA_T* constants, like \c LuaValue::type()), without
+          *  converting the value to a \c LuaValue.
+          *  @throw TypeMismatchError If this \c LuaVariable tries to subscript
+          *         something that is not a table.
+          */
+         int type() const;
+
+         /** Returns the value associated with this variable read as a \c T,
+          *  as described by \c LuaTypeTraits. No \c LuaValue is built, so,
+          *  for instance, <tt>var.as<boost::shared_ptr<Foo> >()</tt> gives
+          *  a pointer sharing the ownership of a \c Foo object living in
+          *  Lua (which a \c LuaValue could only hold as a copy of its bytes).
+          *  @throw TypeMismatchError If this \c LuaVariable tries to subscript
+          *         something that is not a table, or if the value cannot be
+          *         read as a \c T.
+          */
+         template <class T>
+         T as() const
+         {
+            Impl::StackTopRestorer restorer (state_, lua_gettop (state_));
+            pushTheReferencedValue();
+            return LuaTypeTraits<T>::get (state_, -1);
+         }
+
          /** Assuming that this \c LuaVariable holds a table, returns the value
           *  whose index is \c key.
           *  @param key The key whose value is desired.
@@ -214,6 +243,186 @@ namespace Diluculum
                                   const LuaValue& param4,
                                   const LuaValue& param5);
 
+         /** Assuming that this \c LuaVariable holds a function, calls this
+          *  function with native C++ values as parameters, and returns its
+          *  results as native C++ values. Unlike \c operator(), no
+          *  \c LuaValueList is built, neither for the parameters nor for the
+          *  results: parameters are pushed directly onto the Lua stack and
+          *  results are read directly from it, as described by
+          *  \c LuaTypeTraits. Thus, calls with scalar parameters and results
+          *  do not allocate memory.
+          *  <p>The template parameter \c Ret tells what is expected back:
+          *  - \c void: the results are discarded.
+          *  - A type supported by \c LuaTypeTraits (like \c double or
+          *    \c std::string): the first result is returned.
+          *  - A \c boost::tuple of such types: the first results are returned,
+          *    one per tuple element. For example,
+          *    <tt>var.call<boost::tuple<double, std::string> >(1, "a")</tt>.
+          *  <p>If the function returns fewer values than expected, the missing
+          *  ones are taken as \c nil. There are overloads of this method
+          *  taking from zero to five parameters.
+          *  @throw TypeMismatchError If this \c LuaVariable tries to subscript
+          *         something that is not a table, if it does not hold a
+          *         function, or if some result cannot be read as the requested
+          *         type.
+          *  @throw LuaRunTimeError If something bad happens while executing the
+          *         function.
+          */
+         template <class Ret>
+         Ret call()
+         {
+            Impl::StackTopRestorer restorer (state_, lua_gettop (state_));
+            pushFunctionForCall();
+            return callPushedFunction<Ret>(0);
+         }
+
+         /// Like the parameterless \c call(), but passing one parameter.
+         template <class Ret, class P1>
+         Ret call (const P1& param1)
+         {
+            Impl::StackTopRestorer restorer (state_, lua_gettop (state_));
+            pushFunctionForCall();
+            LuaTypeTraits<P1>::push (state_, param1);
+            return callPushedFunction<Ret>(1);
+         }
+
+         /// Like the parameterless \c call(), but passing two parameters.
+         template <class Ret, class P1, class P2>
+         Ret call (const P1& param1, const P2& param2)
+         {
+            Impl::StackTopRestorer restorer (state_, lua_gettop (state_));
+            pushFunctionForCall();
+            LuaTypeTraits<P1>::push (state_, param1);
+            LuaTypeTraits<P2>::push (state_, param2);
+            return callPushedFunction<Ret>(2);
+         }
+
+         /// Like the parameterless \c call(), but passing three parameters.
+         template <class Ret, class P1, class P2, class P3>
+         Ret call (const P1& param1, const P2& param2, const P3& param3)
+         {
+            Impl::StackTopRestorer restorer (state_, lua_gettop (state_));
+            pushFunctionForCall();
+            LuaTypeTraits<P1>::push (state_, param1);
+            LuaTypeTraits<P2>::push (state_, param2);
+            LuaTypeTraits<P3>::push (state_, param3);
+            return callPushedFunction<Ret>(3);
+         }
+
+         /// Like the parameterless \c call(), but passing four parameters.
+         template <class Ret, class P1, class P2, class P3, class P4>
+         Ret call (const P1& param1, const P2& param2, const P3& param3,
+                   const P4& param4)
+         {
+            Impl::StackTopRestorer restorer (state_, lua_gettop (state_));
+            pushFunctionForCall();
+            LuaTypeTraits<P1>::push (state_, param1);
+            LuaTypeTraits<P2>::push (state_, param2);
+            LuaTypeTraits<P3>::push (state_, param3);
+            LuaTypeTraits<P4>::push (state_, param4);
+            return callPushedFunction<Ret>(4);
+         }
+
+         /// Like the parameterless \c call(), but passing five parameters.
+         template <class Ret, class P1, class P2, class P3, class P4, class P5>
+         Ret call (const P1& param1, const P2& param2, const P3& param3,
+                   const P4& param4, const P5& param5)
+         {
+            Impl::StackTopRestorer restorer (state_, lua_gettop (state_));
+            pushFunctionForCall();
+            LuaTypeTraits<P1>::push (state_, param1);
+            LuaTypeTraits<P2>::push (state_, param2);
+            LuaTypeTraits<P3>::push (state_, param3);
+            LuaTypeTraits<P4>::push (state_, param4);
+            LuaTypeTraits<P5>::push (state_, param5);
+            return callPushedFunction<Ret>(5);
+         }
+
+         /** Assuming that this \c LuaVariable holds a table, calls
+          *  <tt>func (key, value)</tt> for each of its entries. The table is
+          *  traversed directly in the Lua state (with \c lua_next()), and
+          *  both \c key and \c value are passed as <tt>LuaView</tt>s, so
+          *  nothing is converted to a \c LuaValue unless \c func asks for it.
+          *  Nested tables can be traversed with \c LuaView::forEach().
+          *  @return \c func, like \c std::for_each() does.
+          *  @throw TypeMismatchError If this \c LuaVariable tries to subscript
+          *         something that is not a table, or if it does not hold a
+          *         table.
+          *  @note \c func must not change the Lua stack below the values it
+          *        receives, and must not assign to new keys of the table being
+          *        traversed (the usual \c lua_next() rules).
+          */
+         template <class F>
+         F forEach (F func) const
+         {
+            pushTheReferencedTable();
+            Impl::StackTopRestorer restorer (state_, lua_gettop (state_) - 1);
+            Impl::ForEachInTable (state_, lua_gettop (state_), func);
+            return func;
+         }
+
+         /** Assuming that this \c LuaVariable holds a table, reads several of
+          *  its fields at once. The table is reached only once (instead of once
+          *  per field, as in <tt>var["a"].value()</tt>), and each field is read
+          *  with a single \c lua_getfield().
+          *  @param names The names of the fields to read.
+          *  @param numNames The number of elements in \c names.
+          *  @param values Where the values are stored: the value of
+          *         \c names[i] is stored in \c values[i]. Missing fields are
+          *         \c Nil. \c values is resized to \c numNames elements; when
+          *         reusing the same \c values for repeated reads, its memory
+          *         is reused, too.
+          *  @throw TypeMismatchError If this \c LuaVariable tries to subscript
+          *         something that is not a table, or if it does not hold a
+          *         table.
+          */
+         void getFields (const char* const* names, size_t numNames,
+                         LuaValueList& values) const;
+
+         /** Assuming that this \c LuaVariable holds a table, reads several of
+          *  its fields at once. This is just like the other \c getFields(),
+          *  but takes the field names as a \c std::vector.
+          */
+         void getFields (const std::vector<std::string>& names,
+                         LuaValueList& values) const;
+
+         /** Assuming that this \c LuaVariable holds a table, assigns several
+          *  of its fields at once. The table is reached only once, and fields
+          *  with string keys are written with a single \c lua_setfield(). The
+          *  table itself is changed in place, so Lua code holding references
+          *  to it sees the new values. Fields not in \c fields are left
+          *  untouched.
+          *  @param fields The keys and values to assign. Entries with \c Nil
+          *         keys are ignored; entries with \c Nil values remove the
+          *         corresponding fields from the table.
+          *  @throw TypeMismatchError If this \c LuaVariable tries to subscript
+          *         something that is not a table, or if it does not hold a
+          *         table.
+          */
+         void setFields (const LuaValueMap& fields);
+
+         /** Assuming that this \c LuaVariable holds a table whose contents
+          *  are \c oldValue, changes it in place so that its contents become
+          *  \c newValue. Only the entries that differ between \c oldValue and
+          *  \c newValue are written: removed keys are set to \c nil, added
+          *  or changed keys are assigned. Nested tables present in both are
+          *  patched recursively instead of being replaced, so Lua code
+          *  holding references to the table (or to its subtables) sees the
+          *  changes, and no new tables are created for them.
+          *  <p>This is meant for keeping a large Lua table in sync with a C++
+          *  mirror of it, where assigning the whole new \c LuaValueMap
+          *  would rebuild the table on every update.
+          *  @param oldValue The contents the table is assumed to have. Changes
+          *         made to the table by Lua code and not reflected here are
+          *         not detected.
+          *  @param newValue The contents the table shall have.
+          *  @throw TypeMismatchError If this \c LuaVariable tries to subscript
+          *         something that is not a table, or if it does not hold a
+          *         table.
+          */
+         void applyDiff (const LuaValueMap& oldValue,
+                         const LuaValueMap& newValue);
+
          /** Checks whether the value stored in this variable is equal to the
           *  value at \c rhs.
           *  @param rhs The value against which the comparison will be done.
@@ -264,6 +473,40 @@ namespace Diluculum
           */
          void pushLastTable();
 
+         /** Binds this \c LuaVariable to the table currently storing it. The
+          *  sequence of keys is traversed once, and the table where the
+          *  variable lives (see \c pushLastTable()) is kept in the Lua
+          *  registry, along with the variable's own key. From now on, reading,
+          *  assigning or calling this variable costs a single table lookup,
+          *  regardless of how deeply nested it is.
+          *  <p>The binding refers to a table, not to a path. If Lua code
+          *  replaces one of the intermediate tables (say, by doing
+          *  <tt>config.limits = {}</tt> for a variable bound to
+          *  <tt>config.limits.rate</tt>), this variable will keep referring to
+          *  the old table until it is rebound. This can be done explicitly,
+          *  by calling \c bind() again, or for all bound variables of a Lua
+          *  state at once, by calling \c InvalidateBindings(). In the latter
+          *  case, each variable traverses its sequence of keys again the next
+          *  time it is used.
+          *  <p>Copies of a bound \c LuaVariable share the same binding.
+          *  @throw TypeMismatchError If this \c LuaVariable tries to subscript
+          *         something that is not a table.
+          *  @note A bound \c LuaVariable holds references in the Lua registry,
+          *        which are released when the last copy sharing the binding is
+          *        destroyed. So, bound variables must not outlive the Lua
+          *        state they live in.
+          */
+         void bind();
+
+         /** Unbinds this \c LuaVariable, so that it goes back to traversing
+          *  its sequence of keys every time it is used. Does nothing if the
+          *  variable is not bound.
+          */
+         void unbind() { binding_.reset(); }
+
+         /// Checks whether this \c LuaVariable is bound. See \c bind().
+         bool isBound() const { return binding_.get() != 0; }
+
          /** Returns the LuaState in which this \c LuaVariable lives.
           *  @note This method exists mostly to allow a nicer implementation of
           *        other Diluculum features. Users aren't expected to call this.
@@ -299,6 +542,65 @@ namespace Diluculum
           */
          void pushTheReferencedValue() const;
 
+         /** Pushes onto the Lua stack the table storing this variable, by
+          *  traversing the sequence of keys. This is what \c pushLastTable()
+          *  does for unbound variables.
+          *  @throw TypeMismatchError If this \c LuaVariable tries to subscript
+          *         something that is not a table.
+          */
+         void pushLastTableFromKeys() const;
+
+         /** Pushes onto the Lua stack the table to which this variable is
+          *  bound, rebinding it first if it was invalidated by
+          *  \c InvalidateBindings().
+          *  @note Must be called only if the variable is bound.
+          */
+         void pushBoundTable() const;
+
+         /** Pushes onto the Lua stack the last key in \c keys_ (that is, the
+          *  key of this variable in the table storing it).
+          */
+         void pushKey() const;
+
+         /** Pushes onto the Lua stack the value referenced by this
+          *  \c LuaVariable, which is expected to be a table.
+          *  @throw TypeMismatchError If this \c LuaVariable tries to subscript
+          *         something that is not a table, or if it does not hold a
+          *         table. In this case, nothing is left on the stack.
+          */
+         void pushTheReferencedTable() const;
+
+         /** Pushes onto the Lua stack the value referenced by this
+          *  \c LuaVariable, which is expected to be a function.
+          *  @throw TypeMismatchError If this \c LuaVariable tries to subscript
+          *         something that is not a table, or if it does not hold a
+          *         function. In this case, nothing is left on the stack.
+          */
+         void pushFunctionForCall() const;
+
+         /** Calls the function pushed by \c pushFunctionForCall(), whose
+          *  \c numParams parameters are on the stack above it, leaving
+          *  \c numResults results in its place.
+          *  @throw LuaRunTimeError If something bad happens while executing the
+          *         function. In this case, nothing is left on the stack.
+          */
+         void doCall (int numParams, int numResults) const;
+
+         /** Calls the function pushed by \c pushFunctionForCall(), whose
+          *  \c numParams parameters are on the stack above it, and returns its
+          *  results as a \c Ret. The results are left on the stack; callers
+          *  restore the stack top with an \c Impl::StackTopRestorer created
+          *  before pushing the function, so that the stack is also cleaned up
+          *  if pushing a parameter throws. See \c call() for the details.
+          */
+         template <class Ret>
+         Ret callPushedFunction (int numParams) const
+         {
+            const int base = lua_gettop (state_) - numParams - 1;
+            doCall (numParams, Impl::CallResults<Ret>::count);
+            return Impl::CallResults<Ret>::read (state_, base + 1);
+         }
+
          /// The Lua state in which this \c LuaVariable lives.
          lua_State* state_;
 
@@ -310,8 +612,28 @@ namespace Diluculum
           *  the \c key parameter appended to it.
           */
          KeyList keys_;
+
+         /** The references kept by a bound \c LuaVariable.
+          *  @note Defined in the implementation file, as no one else needs to
+          *        know its internals.
+          */
+         class Binding;
+
+         /// The binding of this variable, or null if it is not bound.
+         boost::shared_ptr<Binding> binding_;
    };
 
+
+
+   /** Invalidates the bindings of all bound <tt>LuaVariable</tt>s living in
+    *  \c state. Each of them will traverse its sequence of keys again (and
+    *  bind itself to whatever table is found) the next time it is used. This
+    *  should be called after Lua code replaces tables that might be in the
+    *  path of a bound variable.
+    *  @see LuaVariable::bind()
+    */
+   void InvalidateBindings (lua_State* state);
+
 } // namespace Diluculum
 
 #endif // _DILUCULUM_LUA_VARIABLE_HPP_
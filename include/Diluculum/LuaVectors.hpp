@@ -0,0 +1,257 @@
+/******************************************************************************\
+* LuaVectors.hpp                                                               *
+* Small vectors and matrices, efficiently usable from Lua.                     *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#ifndef _DILUCULUM_LUA_VECTORS_HPP_
+#define _DILUCULUM_LUA_VECTORS_HPP_
+
+#include <string>
+#include <Diluculum/LuaValue.hpp>
+#include <Diluculum/LuaVariable.hpp>
+
+
+namespace Diluculum
+{
+   /** A three-dimensional vector of numbers, exported to Lua (see
+    *  \c RegisterVectorClasses()). Its objects are stored inline in the Lua
+    *  userdata, and arithmetic is done by fixed-size loops over four lanes
+    *  (the fourth one is always zero), which compilers turn into SIMD
+    *  instructions when these are enabled.
+    */
+   class Vec3
+   {
+      public:
+         /// Constructs a zero vector.
+         Vec3();
+
+         /// Constructs a vector with the given components.
+         Vec3 (double x, double y, double z);
+
+         /** Constructs a vector from Lua. \c params must either be empty (for
+          *  a zero vector) or contain three numbers.
+          *  @throw LuaError If \c params is something else.
+          */
+         explicit Vec3 (const LuaValueList& params);
+
+         /// Returns the \c x component.
+         double x() const { return v_[0]; }
+
+         /// Returns the \c y component.
+         double y() const { return v_[1]; }
+
+         /// Returns the \c z component.
+         double z() const { return v_[2]; }
+
+         /// Sets the \c x component.
+         void setX (double x) { v_[0] = x; }
+
+         /// Sets the \c y component.
+         void setY (double y) { v_[1] = y; }
+
+         /// Sets the \c z component.
+         void setZ (double z) { v_[2] = z; }
+
+         /// Returns the dot product of \c this and \c other.
+         double dot (const Vec3& other) const;
+
+         /// Returns the cross product of \c this and \c other.
+         Vec3 cross (const Vec3& other) const;
+
+         /// Returns the Euclidean length of this vector.
+         double length() const;
+
+         /** Returns a vector with the same direction as \c this, but unit
+          *  length.
+          *  @throw LuaError If this is a zero vector.
+          */
+         Vec3 normalized() const;
+
+         Vec3 operator+ (const Vec3& rhs) const;
+         Vec3 operator- (const Vec3& rhs) const;
+         Vec3 operator- () const;
+
+         /// Component-wise multiplication.
+         Vec3 operator* (const Vec3& rhs) const;
+         Vec3 operator* (double rhs) const;
+         Vec3 operator/ (double rhs) const;
+         bool operator== (const Vec3& rhs) const;
+
+         /// Returns a string like <tt>"Vec3(1, 2, 3)"</tt>.
+         std::string toString() const;
+
+      private:
+         /// The components, plus a padding lane, always zero.
+         double v_[4];
+
+         friend class Mat4;
+   };
+
+
+
+   /** A four-dimensional vector of numbers, exported to Lua (see
+    *  \c RegisterVectorClasses()). Like \c Vec3, it is stored inline in the
+    *  Lua userdata, and its operations are written to be vectorized.
+    */
+   class Vec4
+   {
+      public:
+         /// Constructs a zero vector.
+         Vec4();
+
+         /// Constructs a vector with the given components.
+         Vec4 (double x, double y, double z, double w);
+
+         /** Constructs a vector from Lua. \c params must either be empty (for
+          *  a zero vector) or contain four numbers.
+          *  @throw LuaError If \c params is something else.
+          */
+         explicit Vec4 (const LuaValueList& params);
+
+         /// Returns the \c x component.
+         double x() const { return v_[0]; }
+
+         /// Returns the \c y component.
+         double y() const { return v_[1]; }
+
+         /// Returns the \c z component.
+         double z() const { return v_[2]; }
+
+         /// Returns the \c w component.
+         double w() const { return v_[3]; }
+
+         /// Sets the \c x component.
+         void setX (double x) { v_[0] = x; }
+
+         /// Sets the \c y component.
+         void setY (double y) { v_[1] = y; }
+
+         /// Sets the \c z component.
+         void setZ (double z) { v_[2] = z; }
+
+         /// Sets the \c w component.
+         void setW (double w) { v_[3] = w; }
+
+         /// Returns the dot product of \c this and \c other.
+         double dot (const Vec4& other) const;
+
+         /// Returns the Euclidean length of this vector.
+         double length() const;
+
+         /** Returns a vector with the same direction as \c this, but unit
+          *  length.
+          *  @throw LuaError If this is a zero vector.
+          */
+         Vec4 normalized() const;
+
+         Vec4 operator+ (const Vec4& rhs) const;
+         Vec4 operator- (const Vec4& rhs) const;
+         Vec4 operator- () const;
+
+         /// Component-wise multiplication.
+         Vec4 operator* (const Vec4& rhs) const;
+         Vec4 operator* (double rhs) const;
+         Vec4 operator/ (double rhs) const;
+         bool operator== (const Vec4& rhs) const;
+
+         /// Returns a string like <tt>"Vec4(1, 2, 3, 4)"</tt>.
+         std::string toString() const;
+
+      private:
+         /// The components.
+         double v_[4];
+
+         friend class Mat4;
+   };
+
+
+
+   /** A 4x4 matrix of numbers, exported to Lua (see
+    *  \c RegisterVectorClasses()). Elements are stored in column-major
+    *  order, so that multiplications are computed as sums of whole columns.
+    */
+   class Mat4
+   {
+      public:
+         /// Constructs an identity matrix.
+         Mat4();
+
+         /** Constructs a matrix from Lua. \c params must either be empty (for
+          *  an identity matrix) or contain 16 numbers, given row by row (that
+          *  is, in the order a matrix is written on paper).
+          *  @throw LuaError If \c params is something else.
+          */
+         explicit Mat4 (const LuaValueList& params);
+
+         /** Returns the element at a given row and column. Indices are
+          *  one-based, as usual in Lua.
+          *  @throw LuaError If the indices are out of range.
+          */
+         double get (int row, int col) const;
+
+         /** Sets the element at a given row and column. Indices are one-based,
+          *  as usual in Lua.
+          *  @throw LuaError If the indices are out of range.
+          */
+         void set (int row, int col, double value);
+
+         /// Returns the transpose of this matrix.
+         Mat4 transposed() const;
+
+         Mat4 operator* (const Mat4& rhs) const;
+         Vec4 operator* (const Vec4& rhs) const;
+
+         /// Transforms a point (that is, \c rhs is extended with \c w = 1).
+         Vec3 operator* (const Vec3& rhs) const;
+         Mat4 operator* (double rhs) const;
+         Mat4 operator+ (const Mat4& rhs) const;
+         bool operator== (const Mat4& rhs) const;
+
+         /// Returns a string with the elements, row by row.
+         std::string toString() const;
+
+      private:
+         /// Returns the position of an element in \c m_, checking the indices.
+         static int offset (int row, int col);
+
+         /// The elements, in column-major order.
+         double m_[16];
+   };
+
+
+
+   /** Registers \c Vec3, \c Vec4 and \c Mat4 into a Lua table. After this,
+    *  for example, <tt>table.Vec3.new (1, 2, 3)</tt> creates a \c Vec3 in
+    *  Lua. The classes support the usual arithmetic operators, \c ==,
+    *  \c tostring(), and have their components exported as properties
+    *  (<tt>v.x</tt>, <tt>v.y</tt>, etc.)
+    *  @param table The table into which the classes will be stored (as
+    *         fields named \c "Vec3", \c "Vec4" and \c "Mat4"). It will be
+    *         created if it doesn't exist.
+    */
+   void RegisterVectorClasses (LuaVariable table);
+
+} // namespace Diluculum
+
+#endif // _DILUCULUM_LUA_VECTORS_HPP_
@@ -0,0 +1,232 @@
+/******************************************************************************\
+* LuaView.hpp                                                                  *
+* A lightweight view of a value on the Lua stack.                              *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#ifndef _DILUCULUM_LUA_VIEW_HPP_
+#define _DILUCULUM_LUA_VIEW_HPP_
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <lua.hpp>
+#include <Diluculum/LuaExceptions.hpp>
+#include <Diluculum/LuaTypeTraits.hpp>
+#include <Diluculum/LuaValue.hpp>
+
+
+namespace Diluculum
+{
+   /** A lightweight view of a value living on the Lua stack. Unlike a
+    *  \c LuaValue, a \c LuaView does not hold a copy of the value: it just
+    *  refers to a stack position. So, reading a number from a \c LuaView is as
+    *  cheap as calling \c lua_tonumber(), and tables are not converted to
+    *  <tt>LuaValueMap</tt>s unless explicitly requested (with \c value()).
+    *  <p>A \c LuaView is valid only as long as the stack position it refers
+    *  to holds the same value. Typically, this means that it should not be
+    *  kept after returning from the function (or callback) that received it.
+    *  @note The \c as*() methods are strict, just like the ones in
+    *        \c LuaValue: no type conversion is performed. Among other things,
+    *        this guarantees that reading a table key through a \c LuaView
+    *        does not disturb an ongoing traversal of the table.
+    */
+   class LuaView
+   {
+      public:
+         /** Constructs a \c LuaView referring to the value at index \c index
+          *  of the stack of \c state. Negative indices are converted to the
+          *  corresponding positive ones, so that the view keeps referring to
+          *  the same value when other values are pushed.
+          */
+         LuaView (lua_State* state, int index);
+
+         /// Returns one of the <tt>LUA_T*</tt> constants from <tt>lua.h</tt>.
+         int type() const { return lua_type (state_, index_); }
+
+         /// Returns the type of the viewed value as a string.
+         std::string typeName() const { return luaL_typename (state_, index_); }
+
+         /** Return the value as a number.
+          *  @throw TypeMismatchError If the value is not a number.
+          */
+         lua_Number asNumber() const;
+
+         /** Return the value as an integer.
+          *  @throw TypeMismatchError If the value is not a number.
+          */
+         lua_Integer asInteger() const;
+
+         /** Return the value as a string. Embedded zeros are preserved.
+          *  @throw TypeMismatchError If the value is not a string.
+          */
+         std::string asString() const;
+
+         /** Return the value as a boolean.
+          *  @throw TypeMismatchError If the value is not a boolean.
+          */
+         bool asBoolean() const;
+
+         /** Return a pointer to the characters of the viewed string, without
+          *  copying them. The pointed memory is owned by Lua, and is valid as
+          *  long as the viewed value stays on the stack. The string is
+          *  null-terminated, but it may contain embedded zeros; use \c size()
+          *  to get its length.
+          *  @throw TypeMismatchError If the value is not a string.
+          */
+         const char* asStringData() const;
+
+         /** Return a pointer to the memory block of the viewed (full)
+          *  userdata, without copying it. Like with \c asStringData(), the
+          *  memory is owned by Lua and is valid as long as the viewed value
+          *  stays on the stack. Its size is given by \c size().
+          *  @throw TypeMismatchError If the value is not a (full) userdata.
+          */
+         void* asUserDataPointer() const;
+
+         /** Return the size, in bytes, of the viewed string or userdata.
+          *  @throw TypeMismatchError If the value is neither a string nor a
+          *         (full) userdata.
+          */
+         std::size_t size() const;
+
+         /** Converts the viewed value to a \c LuaValue. For tables, this
+          *  converts the whole (possibly nested) table.
+          *  @throw LuaTypeError If the value cannot be converted to a
+          *         \c LuaValue.
+          */
+         LuaValue value() const;
+
+         /** Checks whether the viewed value is equal to \c rhs. Strings,
+          *  numbers, booleans and \c nil are compared without converting the
+          *  viewed value to a \c LuaValue.
+          */
+         bool operator== (const LuaValue& rhs) const;
+
+         /// Checks whether the viewed value is different than \c rhs.
+         bool operator!= (const LuaValue& rhs) const
+         { return !(*this == rhs); }
+
+         /** Assuming that the viewed value is a table, calls
+          *  <tt>func (key, value)</tt> for each of its entries, where both
+          *  \c key and \c value are <tt>LuaView</tt>s. This allows to
+          *  traverse nested tables without converting them.
+          *  @return \c func, like \c std::for_each() does.
+          *  @throw TypeMismatchError If the viewed value is not a table.
+          */
+         template <class F>
+         F forEach (F func) const;
+
+         /// Returns the Lua state where the viewed value lives.
+         lua_State* getState() const { return state_; }
+
+         /// Returns the (positive) stack index of the viewed value.
+         int getIndex() const { return index_; }
+
+      private:
+         /// The Lua state where the viewed value lives.
+         lua_State* state_;
+
+         /// The stack index of the viewed value.
+         int index_;
+   };
+
+
+
+   /** A list of <tt>LuaView</tt>s. Functions wrapped with
+    *  \c DILUCULUM_WRAP_FUNCTION() can take one of these instead of a
+    *  \c LuaValueList, to access their parameters without copying them.
+    */
+   typedef std::vector<LuaView> LuaViewList;
+
+
+
+   /** \c LuaTypeTraits for <tt>LuaView</tt>s, so that functions bound with
+    *  \c DILUCULUM_BIND_FUNCTION() can take parameters of any type without
+    *  converting (or copying) them. Views of missing parameters have type
+    *  \c LUA_TNONE.
+    */
+   template <>
+   struct LuaTypeTraits<LuaView>
+   {
+      static void push (lua_State* ls, const LuaView& value)
+      {
+         if (value.getState() == ls)
+            lua_pushvalue (ls, value.getIndex());
+         else
+            PushLuaValue (ls, value.value());
+      }
+
+      static bool is (lua_State*, int)
+      {
+         return true;
+      }
+
+      static LuaView get (lua_State* ls, int index)
+      {
+         return LuaView (ls, index);
+      }
+   };
+
+
+
+   namespace Impl
+   {
+      /** Calls <tt>func (key, value)</tt> for each entry of the table at the
+       *  (positive) index \c index of the stack of \c ls, passing both as
+       *  <tt>LuaView</tt>s. The stack is restored even if \c func throws.
+       */
+      template <class F>
+      void ForEachInTable (lua_State* ls, int index, F& func)
+      {
+         StackTopRestorer restorer (ls, lua_gettop (ls));
+
+         if (!lua_checkstack (ls, 2))
+            throw LuaMemoryError ("Cannot grow the Lua stack.");
+
+         lua_pushnil (ls);
+         while (lua_next (ls, index) != 0)
+         {
+            const int top = lua_gettop (ls);
+            func (LuaView (ls, top - 1), LuaView (ls, top));
+            lua_settop (ls, top - 1);
+         }
+      }
+   }
+
+
+
+   // - LuaView::forEach -------------------------------------------------------
+   template <class F>
+   F LuaView::forEach (F func) const
+   {
+      if (type() != LUA_TTABLE)
+         throw TypeMismatchError ("table", typeName());
+
+      Impl::ForEachInTable (state_, index_, func);
+      return func;
+   }
+
+} // namespace Diluculum
+
+#endif // _DILUCULUM_LUA_VIEW_HPP_
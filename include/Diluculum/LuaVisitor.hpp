@@ -0,0 +1,122 @@
+/******************************************************************************\
+* LuaVisitor.hpp                                                               *
+* Event-driven (SAX-style) walking over Lua values.                            *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#ifndef _DILUCULUM_LUA_VISITOR_HPP_
+#define _DILUCULUM_LUA_VISITOR_HPP_
+
+#include <cstddef>
+#include <lua.hpp>
+#include <Diluculum/LuaUtils.hpp>
+#include <Diluculum/LuaValue.hpp>
+
+
+namespace Diluculum
+{
+   /** Receives the events generated when walking over a Lua value with
+    *  \c VisitLuaValue(), in the spirit of SAX parsers. This allows to stream
+    *  a value into something else (a serializer, a hash, a builder of some
+    *  other data structure) without building a \c LuaValue first.
+    *  <p>A non-table value generates a single event, like \c numberValue(). A
+    *  table generates \c beginTable(), then, for each of its entries,
+    *  \c key() followed by the events of the key, and \c value() followed by
+    *  the events of the value, and finally \c endTable(). Keys and values can
+    *  be tables themselves.
+    *  <p>All member functions do nothing by default, so that subclasses
+    *  override only what they care about. A visitor may throw to stop the
+    *  walk; the exception is propagated by \c VisitLuaValue().
+    */
+   class LuaValueVisitor
+   {
+      public:
+         /// Destroys the \c LuaValueVisitor.
+         virtual ~LuaValueVisitor() { }
+
+         /// Called when a table starts.
+         virtual void beginTable() { }
+
+         /// Called before the key of each table entry.
+         virtual void key() { }
+
+         /// Called before the value of each table entry.
+         virtual void value() { }
+
+         /// Called when a table ends.
+         virtual void endTable() { }
+
+         /// Called for \c nil.
+         virtual void nilValue() { }
+
+         /// Called for a boolean.
+         virtual void booleanValue (bool /*b*/) { }
+
+         /// Called for a number.
+         virtual void numberValue (lua_Number /*n*/) { }
+
+         /** Called for a string.
+          *  @param str The string data. It is valid only during this call, and
+          *         it may contain embedded zeros.
+          *  @param size The size of \c str, in bytes.
+          */
+         virtual void stringValue (const char* /*str*/,
+                                   std::size_t /*size*/) { }
+
+         /// Called for a function (either a C or a Lua function).
+         virtual void functionValue (const LuaFunction& /*func*/) { }
+
+         /** Called for a (full) userdata.
+          *  @param data The userdata contents. Valid only during this call.
+          *  @param size The size of \c data, in bytes.
+          */
+         virtual void userDataValue (const void* /*data*/,
+                                     std::size_t /*size*/) { }
+   };
+
+   /** Walks over the value at index \c index of the Lua stack of \c ls,
+    *  calling the \c visitor member functions along the way. Tables are
+    *  traversed with \c lua_next(), so the entries are visited in the order
+    *  Lua returns them. The stack is left unchanged.
+    *  <p>The walk is iterative, and respects the same \c limits as
+    *  \c ToLuaValue(). (Since each table is visited every time it is reached,
+    *  cyclic tables are reported as being too deep.)
+    *  @throw LuaTypeError If the value contains something that has no
+    *         \c LuaValueVisitor event (like a thread), or if it exceeds
+    *         \c limits. Events for everything before that point will have
+    *         already been generated.
+    */
+   void VisitLuaValue (lua_State* ls, int index, LuaValueVisitor& visitor,
+                       const ConversionLimits& limits = ConversionLimits());
+
+   /** Walks over \c value, calling the \c visitor member functions along the
+    *  way, exactly like the other \c VisitLuaValue() does for a value on the
+    *  Lua stack. Table entries are visited in the order of \c LuaValueMap.
+    *  @throw LuaTypeError If \c value exceeds \c limits.
+    */
+   void VisitLuaValue (const LuaValue& value, LuaValueVisitor& visitor,
+                       const ConversionLimits& limits = ConversionLimits());
+
+} // namespace Diluculum
+
+#endif // _DILUCULUM_LUA_VISITOR_HPP_
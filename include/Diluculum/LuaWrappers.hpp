@@ -28,12 +28,23 @@
 #define _DILUCULUM_LUA_WRAPPERS_HPP_
 
 #include <algorithm>
+#include <cstddef>
+#include <map>
+#include <new>
 #include <string>
 #include <boost/bind.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/mpl/has_xxx.hpp>
+#include <boost/type_traits/alignment_of.hpp>
+#include <boost/type_traits/remove_cv.hpp>
+#include <boost/type_traits/remove_reference.hpp>
 #include <Diluculum/CppObject.hpp>
 #include <Diluculum/LuaExceptions.hpp>
 #include <Diluculum/LuaState.hpp>
+#include <Diluculum/LuaTypeTraits.hpp>
 #include <Diluculum/LuaUtils.hpp>
+#include <Diluculum/LuaView.hpp>
+#include <Diluculum/ObjectPool.hpp>
 
 
 namespace Diluculum
@@ -52,6 +63,241 @@ namespace Diluculum
 
 
 
+      /** Calls a function wrapped by \c DILUCULUM_WRAP_FUNCTION() that takes
+       *  a \c LuaValueList, passing all the values on the stack of \c ls
+       *  (converted to <tt>LuaValue</tt>s) as parameters. The stack is
+       *  emptied before calling \c func.
+       */
+      template <class F>
+      LuaValueList CallWrappedFunction (lua_State* ls, F func)
+      {
+         const int numParams = lua_gettop (ls);
+         LuaValueList params;
+         params.reserve (numParams);
+         for (int i = 1; i <= numParams; ++i)
+            params.push_back (ToLuaValue (ls, i));
+         lua_pop (ls, numParams);
+
+         return func (params);
+      }
+
+      /** Calls a function wrapped by \c DILUCULUM_WRAP_FUNCTION() that takes
+       *  a \c LuaViewList, passing views of all the values on the stack of
+       *  \c ls as parameters. Nothing is copied, and the stack is emptied
+       *  only after \c func returns, so that the views remain valid during
+       *  the call.
+       */
+      inline LuaValueList CallWrappedFunction(
+         lua_State* ls, LuaValueList (*func)(const LuaViewList&))
+      {
+         const int numParams = lua_gettop (ls);
+         LuaViewList params;
+         params.reserve (numParams);
+         for (int i = 1; i <= numParams; ++i)
+            params.push_back (LuaView (ls, i));
+
+         LuaValueList ret = func (params);
+         lua_pop (ls, numParams);
+         return ret;
+      }
+
+
+
+      /** Creates and destroys objects instantiated in Lua for classes
+       *  exported with \c DILUCULUM_BEGIN_CLASS(). Objects are allocated
+       *  with \c new, and the userdata stores just a \c CppObject pointing
+       *  to them.
+       */
+      template <class T>
+      struct HeapObjectStorage
+      {
+         /** Creates a \c T from \c arg (the constructor parameters, or an
+          *  object to be copied), and pushes a userdata representing it
+          *  (without a metatable) onto the stack of \c ls. Returns the
+          *  \c CppObject stored in the userdata.
+          */
+         template <class Arg>
+         static CppObject* create (lua_State* ls, const Arg& arg)
+         {
+            CppObject* cppObj = static_cast<CppObject*>(
+               lua_newuserdata (ls, sizeof(CppObject)));
+            cppObj->deleteMe = false;
+            cppObj->owner = 0;
+            cppObj->ptr = new T (arg);
+            cppObj->deleteMe = true;
+            return cppObj;
+         }
+
+         /// Destroys the object stored in \c cppObj, created by \c create().
+         static void destroy (CppObject* cppObj)
+         {
+            delete static_cast<T*>(cppObj->ptr);
+         }
+
+         /** Returns the function used to push copies of objects to Lua (see
+          *  \c ClassInfo::copy). Objects allocated on the heap may be big
+          *  or non-copyable, so they are not copied.
+          */
+         static CppObject* (*copier()) (lua_State*, const T&)
+         {
+            return 0;
+         }
+      };
+
+
+
+      /** Creates and destroys objects instantiated in Lua for classes
+       *  exported with \c DILUCULUM_BEGIN_CLASS_INLINE(). Objects are
+       *  constructed inside the userdata memory block, right after the
+       *  \c CppObject (whose \c ptr points to them), and properly aligned.
+       *  Lua never moves userdata in memory, so \c ptr stays valid.
+       */
+      template <class T>
+      struct InlineObjectStorage
+      {
+         /// The alignment required by \c T.
+         static const std::size_t Alignment = boost::alignment_of<T>::value;
+
+         /** The size of the userdata memory block: enough for a \c CppObject
+          *  and a properly aligned \c T, whatever is the alignment of the
+          *  block returned by Lua.
+          */
+         static const std::size_t UserDataSize =
+            sizeof(CppObject) + Alignment - 1 + sizeof(T);
+
+         /// Same as \c HeapObjectStorage::create().
+         template <class Arg>
+         static CppObject* create (lua_State* ls, const Arg& arg)
+         {
+            void* ud = lua_newuserdata (ls, UserDataSize);
+            CppObject* cppObj = static_cast<CppObject*>(ud);
+            cppObj->deleteMe = false;
+            cppObj->owner = 0;
+
+            std::size_t addr =
+               reinterpret_cast<std::size_t>(ud) + sizeof(CppObject);
+            addr = (addr + Alignment - 1) / Alignment * Alignment;
+
+            cppObj->ptr = new (reinterpret_cast<void*>(addr)) T (arg);
+            cppObj->deleteMe = true;
+            return cppObj;
+         }
+
+         /// Same as \c HeapObjectStorage::destroy().
+         static void destroy (CppObject* cppObj)
+         {
+            static_cast<T*>(cppObj->ptr)->~T();
+         }
+
+         /** Same as \c HeapObjectStorage::copier(). Objects stored inline
+          *  are meant to be small value types, so they are copied.
+          */
+         static CppObject* (*copier()) (lua_State*, const T&)
+         {
+            return &InlineObjectStorage::template create<T>;
+         }
+      };
+
+
+
+      /** Creates and destroys objects instantiated in Lua for classes
+       *  exported with \c DILUCULUM_BEGIN_CLASS_POOLED(). Like in
+       *  \c HeapObjectStorage, the userdata stores just a \c CppObject, but
+       *  objects are constructed in memory blocks taken from an
+       *  \c ObjectPool, and their memory is given back to it when they are
+       *  destroyed.
+       */
+      template <class T, std::size_t Capacity>
+      struct PooledObjectStorage
+      {
+         /** Returns the pool used for objects of class \c T. It is shared by
+          *  all Lua states.
+          *  @note The pool is never destroyed (its memory is reclaimed by the
+          *        OS at exit). This way, Lua states destroyed during static
+          *        destruction (for instance, global <tt>LuaState</tt>s) can
+          *        still give their objects back to it.
+          */
+         static ObjectPool& pool()
+         {
+            static ObjectPool* thePool = new ObjectPool (sizeof(T), Capacity);
+            return *thePool;
+         }
+
+         /// Same as \c HeapObjectStorage::create().
+         template <class Arg>
+         static CppObject* create (lua_State* ls, const Arg& arg)
+         {
+            CppObject* cppObj = static_cast<CppObject*>(
+               lua_newuserdata (ls, sizeof(CppObject)));
+            cppObj->deleteMe = false;
+            cppObj->owner = 0;
+
+            void* block = pool().acquire();
+            try
+            {
+               cppObj->ptr = new (block) T (arg);
+            }
+            catch(...)
+            {
+               pool().release (block);
+               throw;
+            }
+
+            cppObj->deleteMe = true;
+            return cppObj;
+         }
+
+         /// Same as \c HeapObjectStorage::destroy().
+         static void destroy (CppObject* cppObj)
+         {
+            T* obj = static_cast<T*>(cppObj->ptr);
+            cppObj->ptr = 0; // the block may be reused by another object
+            obj->~T();
+            pool().release (obj);
+         }
+
+         /// Same as \c HeapObjectStorage::copier().
+         static CppObject* (*copier()) (lua_State*, const T&)
+         {
+            return 0;
+         }
+      };
+
+
+
+      /** Creates and destroys objects instantiated in Lua for classes
+       *  exported with \c DILUCULUM_BEGIN_CLASS_SHARED(). Objects are
+       *  allocated with \c new and owned by a <tt>boost::shared_ptr</tt>
+       *  stored in the userdata, so that C++ code can share their ownership.
+       */
+      template <class T>
+      struct SharedObjectStorage
+      {
+         /// Same as \c HeapObjectStorage::create().
+         template <class Arg>
+         static CppObject* create (lua_State* ls, const Arg& arg)
+         {
+            boost::shared_ptr<T> obj (new T (arg));
+            return NewSharedCppObject (ls, obj);
+         }
+
+         /** Same as \c HeapObjectStorage::destroy(). The object is destroyed
+          *  only if C++ holds no other reference to it.
+          */
+         static void destroy (CppObject* cppObj)
+         {
+            ReleaseSharedObject (cppObj);
+         }
+
+         /// Same as \c HeapObjectStorage::copier().
+         static CppObject* (*copier()) (lua_State*, const T&)
+         {
+            return 0;
+         }
+      };
+
+
+
       /** Helper class, used by the \c DILUCULUM_CLASS_METHOD() macro, as a
        *  means register a method in the table that represents a class being
        *  exported to Lua. Everything is done in the constructor. This is just
@@ -76,6 +322,800 @@ namespace Diluculum
                classTable[name] = func;
             }
       };
+
+
+
+
+      /** The functions used to read and write a property of a class exported
+       *  to Lua (see \c DILUCULUM_CLASS_PROPERTY()).
+       */
+      struct PropertyAccessors
+      {
+         /// Pushes the value of the property of \c obj onto the stack.
+         void (*get) (lua_State* ls, void* obj);
+
+         /** Sets the property of \c obj to the value at \c index. Null for
+          *  read-only properties.
+          */
+         void (*set) (lua_State* ls, void* obj, int index);
+      };
+
+      /** The properties of a class exported to Lua, indexed by their names.
+       *  There is one of these for each exported class.
+       */
+      typedef std::map<std::string, PropertyAccessors> PropertyMap;
+
+
+
+      /** Helper class, used by the \c DILUCULUM_CLASS_PROPERTY() macro (and
+       *  its variants) to register a property in the \c PropertyMap of the
+       *  class being exported. This is analogous to \c ClassTableFiller.
+       */
+      class PropertyMapFiller
+      {
+         public:
+            /** Adds a property to \c properties.
+             *  @param properties The properties of the class being exported.
+             *  @param name The name by which the property will be known in
+             *         the Lua side.
+             *  @param get The function reading the property.
+             *  @param set The function writing the property, or null if the
+             *         property is read-only.
+             */
+            PropertyMapFiller (PropertyMap& properties,
+                               const std::string& name,
+                               void (*get) (lua_State*, void*),
+                               void (*set) (lua_State*, void*, int))
+            {
+               properties[name].get = get;
+               properties[name].set = set;
+            }
+      };
+
+
+
+      /** Stores, in the registry of \c ls, a table mapping the names of the
+       *  properties in \c properties to their \c PropertyAccessors (as light
+       *  userdata). This is what \c IndexObject() and \c NewIndexObject()
+       *  use to find properties.
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      void RegisterClassProperties (lua_State* ls,
+                                    const PropertyMap& properties);
+
+      /** Stores in \c target a userdata representing \c object, an object
+       *  of a class previously registered with \c RegisterClass() in the
+       *  state where \c target lives. The object is not owned by Lua: it
+       *  will not be destroyed when the userdata is garbage-collected.
+       *  @throw LuaError If the class is not registered in the state.
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      void RegisterObject (LuaVariable target, const void* classKey,
+                           const char* className, void* object);
+
+      /** Like \c RegisterObject(), but the object is owned by \c object,
+       *  and Lua shares its ownership.
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      void RegisterSharedObject (LuaVariable target, const void* classKey,
+                                 const char* className,
+                                 const boost::shared_ptr<void>& object);
+
+      /** Registers a class exported to Lua in the state where \c target
+       *  lives, and stores the class table in \c target.
+       *  <p>The class table is built directly on the Lua stack, only once per
+       *  Lua state, and is also the metatable of the objects of the class (so
+       *  that, for instance, its \c __index field refers to itself, unless
+       *  the class has properties). It is kept in the registry, with
+       *  \c classKey as key. If the class was already registered in the
+       *  state, the existing table is reused, so that previously created
+       *  objects remain valid.
+       *  @param target Where the class table will be stored.
+       *  @param classKey An address unique to the class. The address of the
+       *         class table created by \c DILUCULUM_BEGIN_CLASS() is used.
+       *  @param className The name of the class.
+       *  @param methods The methods (and metamethods) of the class.
+       *  @param constructor The function creating objects (\c new). It gets
+       *         the class table as its single upvalue.
+       *  @param destructor The function destroying objects (\c delete and
+       *         \c __gc).
+       *  @param index The \c __index metamethod, used only if there are
+       *         properties.
+       *  @param newIndex The \c __newindex metamethod, used only if there
+       *         are properties.
+       *  @param properties The properties of the class.
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      void RegisterClass (LuaVariable target, const void* classKey,
+                          const char* className, const LuaValueMap& methods,
+                          lua_CFunction constructor, lua_CFunction destructor,
+                          lua_CFunction index, lua_CFunction newIndex,
+                          const PropertyMap& properties);
+
+      /** Implements the \c __index metamethod of classes with properties.
+       *  The object is at index 1 and the key at index 2. Members of the class
+       *  table (methods, mostly) are looked up first, then properties. The
+       *  key is used directly in raw table lookups, so nothing is allocated
+       *  and Lua's precomputed string hashes are used.
+       *  @param classKey The address identifying the class.
+       *  @param properties The class properties (its address identifies the
+       *         table registered by \c RegisterClassProperties()).
+       *  @param className The name of the class.
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      int IndexObject (lua_State* ls, const void* classKey,
+                       const PropertyMap& properties, const char* className);
+
+      /** Implements the \c __newindex metamethod of classes with properties.
+       *  The object is at index 1, the key at index 2 and the value at
+       *  index 3.
+       *  @throw LuaError If there is no writable property with that name.
+       *  @note This is not intended to be called by Diluculum users.
+       */
+      int NewIndexObject (lua_State* ls, const void* classKey,
+                          const PropertyMap& properties,
+                          const char* className);
+
+
+
+      /** The type \c T without references and \c const or \c volatile
+       *  qualifiers. This is the type whose \c LuaTypeTraits are used to
+       *  read a parameter of type \c T (like <tt>const std::string&</tt>)
+       *  or to push a return value of type \c T.
+       */
+      template <class T>
+      struct BareType
+      {
+         typedef typename boost::remove_cv<
+            typename boost::remove_reference<T>::type>::type type;
+      };
+
+
+
+      /// Defines \c has_parameter_type<T>, used by \c ParameterType.
+      BOOST_MPL_HAS_XXX_TRAIT_DEF (parameter_type)
+
+      /** The type in which a parameter of type \c T is passed from
+       *  \c GetParameter() to a bound function. By default, this is
+       *  \c BareType<T>::type (a value), but <tt>LuaTypeTraits</tt> reading
+       *  by reference tell so with a \c parameter_type typedef. This is the
+       *  case for objects of exported classes, which are passed as a
+       *  reference to the object stored in the userdata: they are not copied,
+       *  and can be modified through <tt>T&</tt> parameters.
+       */
+      template <class T,
+                bool HasParameterType = has_parameter_type<
+                   LuaTypeTraits<typename BareType<T>::type> >::value>
+      struct ParameterType
+      {
+         typedef typename BareType<T>::type type;
+      };
+
+      template <class T>
+      struct ParameterType<T, true>
+      {
+         typedef typename LuaTypeTraits<
+            typename BareType<T>::type>::parameter_type type;
+      };
+
+
+
+      /** Reads the parameter at \c index, which will be passed to a bound
+       *  function as a \c T. This is like \c LuaTypeTraits::get(), but the
+       *  error message includes the parameter number.
+       *  @throw LuaTypeError If the parameter cannot be read as a \c T.
+       */
+      template <class T>
+      typename ParameterType<T>::type GetParameter (lua_State* ls, int index)
+      {
+         try
+         {
+            return LuaTypeTraits<typename BareType<T>::type>::get (ls, index);
+         }
+         catch (TypeMismatchError& e)
+         {
+            const std::string msg = "Bad parameter #"
+               + boost::lexical_cast<std::string>(index) + ": " + e.what();
+            throw LuaTypeError (msg.c_str());
+         }
+      }
+
+
+
+      /** Calls a bound function with the parameters already read from the
+       *  stack, and pushes its return value (if any). Returns the number of
+       *  values pushed. This is what makes bound functions returning \c void
+       *  work without further specializations of the binders.
+       */
+      template <class R>
+      struct BoundFunctionCaller
+      {
+         static int call (lua_State* ls, R (*func)())
+         {
+            LuaTypeTraits<typename BareType<R>::type>::push (ls, func());
+            return 1;
+         }
+
+         template <class A1>
+         static int call (lua_State* ls, R (*func)(A1),
+                          typename ParameterType<A1>::type p1)
+         {
+            LuaTypeTraits<typename BareType<R>::type>::push (ls, func (p1));
+            return 1;
+         }
+
+         template <class A1, class A2>
+         static int call (lua_State* ls, R (*func)(A1, A2),
+                          typename ParameterType<A1>::type p1,
+                          typename ParameterType<A2>::type p2)
+         {
+            LuaTypeTraits<typename BareType<R>::type>::push (ls, func (p1, p2));
+            return 1;
+         }
+
+         template <class A1, class A2, class A3>
+         static int call (lua_State* ls, R (*func)(A1, A2, A3),
+                          typename ParameterType<A1>::type p1,
+                          typename ParameterType<A2>::type p2,
+                          typename ParameterType<A3>::type p3)
+         {
+            LuaTypeTraits<typename BareType<R>::type>::push(
+               ls, func (p1, p2, p3));
+            return 1;
+         }
+
+         template <class A1, class A2, class A3, class A4>
+         static int call (lua_State* ls, R (*func)(A1, A2, A3, A4),
+                          typename ParameterType<A1>::type p1,
+                          typename ParameterType<A2>::type p2,
+                          typename ParameterType<A3>::type p3,
+                          typename ParameterType<A4>::type p4)
+         {
+            LuaTypeTraits<typename BareType<R>::type>::push(
+               ls, func (p1, p2, p3, p4));
+            return 1;
+         }
+
+         template <class A1, class A2, class A3, class A4, class A5>
+         static int call (lua_State* ls, R (*func)(A1, A2, A3, A4, A5),
+                          typename ParameterType<A1>::type p1,
+                          typename ParameterType<A2>::type p2,
+                          typename ParameterType<A3>::type p3,
+                          typename ParameterType<A4>::type p4,
+                          typename ParameterType<A5>::type p5)
+         {
+            LuaTypeTraits<typename BareType<R>::type>::push(
+               ls, func (p1, p2, p3, p4, p5));
+            return 1;
+         }
+      };
+
+      /// \c BoundFunctionCaller for functions returning \c void.
+      template <>
+      struct BoundFunctionCaller<void>
+      {
+         static int call (lua_State*, void (*func)())
+         {
+            func();
+            return 0;
+         }
+
+         template <class A1>
+         static int call (lua_State*, void (*func)(A1),
+                          typename ParameterType<A1>::type p1)
+         {
+            func (p1);
+            return 0;
+         }
+
+         template <class A1, class A2>
+         static int call (lua_State*, void (*func)(A1, A2),
+                          typename ParameterType<A1>::type p1,
+                          typename ParameterType<A2>::type p2)
+         {
+            func (p1, p2);
+            return 0;
+         }
+
+         template <class A1, class A2, class A3>
+         static int call (lua_State*, void (*func)(A1, A2, A3),
+                          typename ParameterType<A1>::type p1,
+                          typename ParameterType<A2>::type p2,
+                          typename ParameterType<A3>::type p3)
+         {
+            func (p1, p2, p3);
+            return 0;
+         }
+
+         template <class A1, class A2, class A3, class A4>
+         static int call (lua_State*, void (*func)(A1, A2, A3, A4),
+                          typename ParameterType<A1>::type p1,
+                          typename ParameterType<A2>::type p2,
+                          typename ParameterType<A3>::type p3,
+                          typename ParameterType<A4>::type p4)
+         {
+            func (p1, p2, p3, p4);
+            return 0;
+         }
+
+         template <class A1, class A2, class A3, class A4, class A5>
+         static int call (lua_State*, void (*func)(A1, A2, A3, A4, A5),
+                          typename ParameterType<A1>::type p1,
+                          typename ParameterType<A2>::type p2,
+                          typename ParameterType<A3>::type p3,
+                          typename ParameterType<A4>::type p4,
+                          typename ParameterType<A5>::type p5)
+         {
+            func (p1, p2, p3, p4, p5);
+            return 0;
+         }
+      };
+
+
+
+      /** Calls \c Call (which reads parameters, calls the bound function and
+       *  pushes its results) translating exceptions to Lua errors, just like
+       *  the functions created by \c DILUCULUM_WRAP_FUNCTION() do.
+       */
+      template <int (*Call)(lua_State*)>
+      int ProtectedCall (lua_State* ls)
+      {
+         try
+         {
+            return Call (ls);
+         }
+         catch (LuaError& e)
+         {
+            ReportErrorFromCFunction (ls, e.what());
+            return 0;
+         }
+         catch(...)
+         {
+            ReportErrorFromCFunction(
+               ls, "Unknown exception caught by wrapper.");
+            return 0;
+         }
+      }
+
+
+
+      /** Creates <tt>lua_CFunction</tt>s for functions with signature
+       *  <tt>R (*)()</tt>. Used by \c DILUCULUM_BIND_FUNCTION().
+       */
+      template <class R>
+      struct FunctionBinder0
+      {
+         template <R (*Func)()>
+         static int call (lua_State* ls)
+         {
+            return BoundFunctionCaller<R>::call (ls, Func);
+         }
+
+         template <R (*Func)()>
+         lua_CFunction bind() const
+         {
+            return &ProtectedCall<&FunctionBinder0::template call<Func> >;
+         }
+      };
+
+      /** Creates <tt>lua_CFunction</tt>s for functions with signature
+       *  <tt>R (*)(A1)</tt>. Used by \c DILUCULUM_BIND_FUNCTION().
+       */
+      template <class R, class A1>
+      struct FunctionBinder1
+      {
+         template <R (*Func)(A1)>
+         static int call (lua_State* ls)
+         {
+            return BoundFunctionCaller<R>::call(
+               ls, Func, GetParameter<A1> (ls, 1));
+         }
+
+         template <R (*Func)(A1)>
+         lua_CFunction bind() const
+         {
+            return &ProtectedCall<&FunctionBinder1::template call<Func> >;
+         }
+      };
+
+      /** Creates <tt>lua_CFunction</tt>s for functions with signature
+       *  <tt>R (*)(A1, A2)</tt>. Used by \c DILUCULUM_BIND_FUNCTION().
+       */
+      template <class R, class A1, class A2>
+      struct FunctionBinder2
+      {
+         template <R (*Func)(A1, A2)>
+         static int call (lua_State* ls)
+         {
+            return BoundFunctionCaller<R>::call(
+               ls, Func, GetParameter<A1> (ls, 1), GetParameter<A2> (ls, 2));
+         }
+
+         template <R (*Func)(A1, A2)>
+         lua_CFunction bind() const
+         {
+            return &ProtectedCall<&FunctionBinder2::template call<Func> >;
+         }
+      };
+
+      /** Creates <tt>lua_CFunction</tt>s for functions with signature
+       *  <tt>R (*)(A1, A2, A3)</tt>. Used by \c DILUCULUM_BIND_FUNCTION().
+       */
+      template <class R, class A1, class A2, class A3>
+      struct FunctionBinder3
+      {
+         template <R (*Func)(A1, A2, A3)>
+         static int call (lua_State* ls)
+         {
+            return BoundFunctionCaller<R>::call(
+               ls, Func, GetParameter<A1> (ls, 1), GetParameter<A2> (ls, 2),
+               GetParameter<A3> (ls, 3));
+         }
+
+         template <R (*Func)(A1, A2, A3)>
+         lua_CFunction bind() const
+         {
+            return &ProtectedCall<&FunctionBinder3::template call<Func> >;
+         }
+      };
+
+      /** Creates <tt>lua_CFunction</tt>s for functions with signature
+       *  <tt>R (*)(A1, A2, A3, A4)</tt>. Used by \c DILUCULUM_BIND_FUNCTION().
+       */
+      template <class R, class A1, class A2, class A3, class A4>
+      struct FunctionBinder4
+      {
+         template <R (*Func)(A1, A2, A3, A4)>
+         static int call (lua_State* ls)
+         {
+            return BoundFunctionCaller<R>::call(
+               ls, Func, GetParameter<A1> (ls, 1), GetParameter<A2> (ls, 2),
+               GetParameter<A3> (ls, 3), GetParameter<A4> (ls, 4));
+         }
+
+         template <R (*Func)(A1, A2, A3, A4)>
+         lua_CFunction bind() const
+         {
+            return &ProtectedCall<&FunctionBinder4::template call<Func> >;
+         }
+      };
+
+      /** Creates <tt>lua_CFunction</tt>s for functions with signature
+       *  <tt>R (*)(A1, A2, A3, A4, A5)</tt>. Used by
+       *  \c DILUCULUM_BIND_FUNCTION().
+       */
+      template <class R, class A1, class A2, class A3, class A4, class A5>
+      struct FunctionBinder5
+      {
+         template <R (*Func)(A1, A2, A3, A4, A5)>
+         static int call (lua_State* ls)
+         {
+            return BoundFunctionCaller<R>::call(
+               ls, Func, GetParameter<A1> (ls, 1), GetParameter<A2> (ls, 2),
+               GetParameter<A3> (ls, 3), GetParameter<A4> (ls, 4),
+               GetParameter<A5> (ls, 5));
+         }
+
+         template <R (*Func)(A1, A2, A3, A4, A5)>
+         lua_CFunction bind() const
+         {
+            return &ProtectedCall<&FunctionBinder5::template call<Func> >;
+         }
+      };
+
+
+
+      /** The "binder" for functions that already are <tt>lua_CFunction</tt>s.
+       *  They just get protected against exceptions, just like the other
+       *  bound functions.
+       */
+      struct LuaCFunctionBinder
+      {
+         template <lua_CFunction Func>
+         lua_CFunction bind() const
+         {
+            return &ProtectedCall<Func>;
+         }
+      };
+
+      /** Returns the binder for functions with the signature of the
+       *  function passed. This exists only to deduce that signature, which
+       *  C++ does not allow to do directly for a non-type template
+       *  parameter. The function pointer itself is passed again as a
+       *  template argument to the binder's \c bind(), so that the generated
+       *  \c lua_CFunction calls it directly. Used by
+       *  \c DILUCULUM_BIND_FUNCTION().
+       */
+      inline LuaCFunctionBinder MakeFunctionBinder (lua_CFunction)
+      {
+         return LuaCFunctionBinder();
+      }
+
+      template <class R>
+      FunctionBinder0<R> MakeFunctionBinder (R (*)())
+      {
+         return FunctionBinder0<R>();
+      }
+
+      template <class R, class A1>
+      FunctionBinder1<R, A1> MakeFunctionBinder (R (*)(A1))
+      {
+         return FunctionBinder1<R, A1>();
+      }
+
+      template <class R, class A1, class A2>
+      FunctionBinder2<R, A1, A2> MakeFunctionBinder (R (*)(A1, A2))
+      {
+         return FunctionBinder2<R, A1, A2>();
+      }
+
+      template <class R, class A1, class A2, class A3>
+      FunctionBinder3<R, A1, A2, A3> MakeFunctionBinder(
+         R (*)(A1, A2, A3))
+      {
+         return FunctionBinder3<R, A1, A2, A3>();
+      }
+
+      template <class R, class A1, class A2, class A3, class A4>
+      FunctionBinder4<R, A1, A2, A3, A4> MakeFunctionBinder(
+         R (*)(A1, A2, A3, A4))
+      {
+         return FunctionBinder4<R, A1, A2, A3, A4>();
+      }
+
+      template <class R, class A1, class A2, class A3, class A4, class A5>
+      FunctionBinder5<R, A1, A2, A3, A4, A5> MakeFunctionBinder(
+         R (*)(A1, A2, A3, A4, A5))
+      {
+         return FunctionBinder5<R, A1, A2, A3, A4, A5>();
+      }
+
+
+
+      /** Calls a bound method with the parameters already read from the
+       *  stack, and pushes its return value (if any). Returns the number of
+       *  values pushed. This is the \c BoundFunctionCaller for methods.
+       */
+      template <class R>
+      struct BoundMethodCaller
+      {
+         template <class O, class M>
+         static int call (lua_State* ls, O* obj, M method)
+         {
+            LuaTypeTraits<typename BareType<R>::type>::push(
+               ls, (obj->*method)());
+            return 1;
+         }
+
+         template <class A1, class O, class M>
+         static int call (lua_State* ls, O* obj, M method,
+                          typename ParameterType<A1>::type p1)
+         {
+            LuaTypeTraits<typename BareType<R>::type>::push(
+               ls, (obj->*method)(p1));
+            return 1;
+         }
+
+         template <class A1, class A2, class O, class M>
+         static int call (lua_State* ls, O* obj, M method,
+                          typename ParameterType<A1>::type p1,
+                          typename ParameterType<A2>::type p2)
+         {
+            LuaTypeTraits<typename BareType<R>::type>::push(
+               ls, (obj->*method)(p1, p2));
+            return 1;
+         }
+
+         template <class A1, class A2, class A3, class O, class M>
+         static int call (lua_State* ls, O* obj, M method,
+                          typename ParameterType<A1>::type p1,
+                          typename ParameterType<A2>::type p2,
+                          typename ParameterType<A3>::type p3)
+         {
+            LuaTypeTraits<typename BareType<R>::type>::push(
+               ls, (obj->*method)(p1, p2, p3));
+            return 1;
+         }
+
+         template <class A1, class A2, class A3, class A4, class O, class M>
+         static int call (lua_State* ls, O* obj, M method,
+                          typename ParameterType<A1>::type p1,
+                          typename ParameterType<A2>::type p2,
+                          typename ParameterType<A3>::type p3,
+                          typename ParameterType<A4>::type p4)
+         {
+            LuaTypeTraits<typename BareType<R>::type>::push(
+               ls, (obj->*method)(p1, p2, p3, p4));
+            return 1;
+         }
+      };
+
+      /// \c BoundMethodCaller for methods returning \c void.
+      template <>
+      struct BoundMethodCaller<void>
+      {
+         template <class O, class M>
+         static int call (lua_State*, O* obj, M method)
+         {
+            (obj->*method)();
+            return 0;
+         }
+
+         template <class A1, class O, class M>
+         static int call (lua_State*, O* obj, M method,
+                          typename ParameterType<A1>::type p1)
+         {
+            (obj->*method)(p1);
+            return 0;
+         }
+
+         template <class A1, class A2, class O, class M>
+         static int call (lua_State*, O* obj, M method,
+                          typename ParameterType<A1>::type p1,
+                          typename ParameterType<A2>::type p2)
+         {
+            (obj->*method)(p1, p2);
+            return 0;
+         }
+
+         template <class A1, class A2, class A3, class O, class M>
+         static int call (lua_State*, O* obj, M method,
+                          typename ParameterType<A1>::type p1,
+                          typename ParameterType<A2>::type p2,
+                          typename ParameterType<A3>::type p3)
+         {
+            (obj->*method)(p1, p2, p3);
+            return 0;
+         }
+
+         template <class A1, class A2, class A3, class A4, class O, class M>
+         static int call (lua_State*, O* obj, M method,
+                          typename ParameterType<A1>::type p1,
+                          typename ParameterType<A2>::type p2,
+                          typename ParameterType<A3>::type p3,
+                          typename ParameterType<A4>::type p4)
+         {
+            (obj->*method)(p1, p2, p3, p4);
+            return 0;
+         }
+      };
+
+
+
+      /** Calls \c method on \c obj, reading its parameters directly from the
+       *  stack of \c ls, starting at index 2 (index 1 is \c self), and
+       *  pushing its return value (if any). Returns the number of values
+       *  pushed. Used by \c DILUCULUM_CLASS_BIND_METHOD().
+       */
+      template <class O, class C, class R>
+      int CallBoundMethod (lua_State* ls, O* obj, R (C::*method)())
+      {
+         return BoundMethodCaller<R>::call (ls, obj, method);
+      }
+
+      template <class O, class C, class R>
+      int CallBoundMethod (lua_State* ls, O* obj, R (C::*method)() const)
+      {
+         return BoundMethodCaller<R>::call (ls, obj, method);
+      }
+
+      template <class O, class C, class R, class A1>
+      int CallBoundMethod (lua_State* ls, O* obj, R (C::*method)(A1))
+      {
+         return BoundMethodCaller<R>::template call<A1>(
+            ls, obj, method, GetParameter<A1> (ls, 2));
+      }
+
+      template <class O, class C, class R, class A1>
+      int CallBoundMethod (lua_State* ls, O* obj, R (C::*method)(A1) const)
+      {
+         return BoundMethodCaller<R>::template call<A1>(
+            ls, obj, method, GetParameter<A1> (ls, 2));
+      }
+
+      template <class O, class C, class R, class A1, class A2>
+      int CallBoundMethod (lua_State* ls, O* obj, R (C::*method)(A1, A2))
+      {
+         return BoundMethodCaller<R>::template call<A1, A2>(
+            ls, obj, method, GetParameter<A1> (ls, 2),
+            GetParameter<A2> (ls, 3));
+      }
+
+      template <class O, class C, class R, class A1, class A2>
+      int CallBoundMethod (lua_State* ls, O* obj,
+                           R (C::*method)(A1, A2) const)
+      {
+         return BoundMethodCaller<R>::template call<A1, A2>(
+            ls, obj, method, GetParameter<A1> (ls, 2),
+            GetParameter<A2> (ls, 3));
+      }
+
+      template <class O, class C, class R, class A1, class A2, class A3>
+      int CallBoundMethod (lua_State* ls, O* obj,
+                           R (C::*method)(A1, A2, A3))
+      {
+         return BoundMethodCaller<R>::template call<A1, A2, A3>(
+            ls, obj, method, GetParameter<A1> (ls, 2),
+            GetParameter<A2> (ls, 3), GetParameter<A3> (ls, 4));
+      }
+
+      template <class O, class C, class R, class A1, class A2, class A3>
+      int CallBoundMethod (lua_State* ls, O* obj,
+                           R (C::*method)(A1, A2, A3) const)
+      {
+         return BoundMethodCaller<R>::template call<A1, A2, A3>(
+            ls, obj, method, GetParameter<A1> (ls, 2),
+            GetParameter<A2> (ls, 3), GetParameter<A3> (ls, 4));
+      }
+
+      template <class O, class C, class R,
+                class A1, class A2, class A3, class A4>
+      int CallBoundMethod (lua_State* ls, O* obj,
+                           R (C::*method)(A1, A2, A3, A4))
+      {
+         return BoundMethodCaller<R>::template call<A1, A2, A3, A4>(
+            ls, obj, method, GetParameter<A1> (ls, 2),
+            GetParameter<A2> (ls, 3), GetParameter<A3> (ls, 4),
+            GetParameter<A4> (ls, 5));
+      }
+
+      template <class O, class C, class R,
+                class A1, class A2, class A3, class A4>
+      int CallBoundMethod (lua_State* ls, O* obj,
+                           R (C::*method)(A1, A2, A3, A4) const)
+      {
+         return BoundMethodCaller<R>::template call<A1, A2, A3, A4>(
+            ls, obj, method, GetParameter<A1> (ls, 2),
+            GetParameter<A2> (ls, 3), GetParameter<A3> (ls, 4),
+            GetParameter<A4> (ls, 5));
+      }
+
+
+
+
+      /** Pushes the value returned by the \c getter of \c obj. Used by
+       *  \c DILUCULUM_CLASS_PROPERTY().
+       */
+      template <class O, class C, class R>
+      void CallPropertyGetter (lua_State* ls, O* obj, R (C::*getter)() const)
+      {
+         LuaTypeTraits<typename BareType<R>::type>::push (ls, (obj->*getter)());
+      }
+
+      template <class O, class C, class R>
+      void CallPropertyGetter (lua_State* ls, O* obj, R (C::*getter)())
+      {
+         LuaTypeTraits<typename BareType<R>::type>::push (ls, (obj->*getter)());
+      }
+
+      /** Calls the \c setter of \c obj with the value at \c index. Used by
+       *  \c DILUCULUM_CLASS_PROPERTY().
+       */
+      template <class O, class C, class R, class A>
+      void CallPropertySetter (lua_State* ls, O* obj, R (C::*setter)(A),
+                               int index)
+      {
+         (obj->*setter)(
+            LuaTypeTraits<typename BareType<A>::type>::get (ls, index));
+      }
+
+      /** Pushes the value of the data member \c member of \c obj. Used by
+       *  \c DILUCULUM_CLASS_MEMBER_PROPERTY().
+       */
+      template <class O, class C, class T>
+      void GetDataMember (lua_State* ls, O* obj, T C::*member)
+      {
+         LuaTypeTraits<T>::push (ls, obj->*member);
+      }
+
+      /** Sets the data member \c member of \c obj to the value at \c index.
+       *  Used by \c DILUCULUM_CLASS_MEMBER_PROPERTY().
+       */
+      template <class O, class C, class T>
+      void SetDataMember (lua_State* ls, O* obj, T C::*member, int index)
+      {
+         obj->*member = LuaTypeTraits<T>::get (ls, index);
+      }
    }
 }
 
@@ -96,6 +1136,13 @@ namespace Diluculum
  *  <p>Notice that, thanks to the use of <tt>Diluculum::LuaValueList</tt>s, the
  *  wrapped function can effectively take and return an arbitrary number of
  *  values.
+ *  <p>The wrapped function can also take a <tt>const
+ *  Diluculum::LuaViewList&</tt> instead. In this case, its parameters are not
+ *  converted to <tt>LuaValue</tt>s: they are just viewed where they are, on
+ *  the Lua stack. This is much cheaper for large strings and userdata, which
+ *  can be accessed with \c LuaView::asStringData() and
+ *  \c LuaView::asUserDataPointer() without a single copy. (The views are
+ *  valid only until the wrapped function returns.)
  *  @note The name of the created wrapper function is a decorated version of the
  *        \c FUNC parameter. The decoration scheme can be quite complicated and
  *        is subject to change in future releases of Diluculum, so don't try to
@@ -112,25 +1159,18 @@ namespace Diluculum
 #define DILUCULUM_WRAP_FUNCTION(FUNC)                                         \
 int DILUCULUM_WRAPPER_FUNCTION(FUNC) (lua_State* ls)                          \
 {                                                                             \
-   using std::for_each;                                                       \
-   using boost::bind;                                                         \
    using Diluculum::PushLuaValue;                                             \
    using Diluculum::Impl::ReportErrorFromCFunction;                           \
                                                                               \
    try                                                                        \
    {                                                                          \
-      /* Read parameters and empty the stack */                               \
-      const int numParams = lua_gettop (ls);                                  \
-      Diluculum::LuaValueList params;                                         \
-      for (int i = 1; i <= numParams; ++i)                                    \
-         params.push_back (Diluculum::ToLuaValue (ls, i));                    \
-      lua_pop (ls, numParams);                                                \
-                                                                              \
-      /* Call the wrapped function */                                         \
-      Diluculum::LuaValueList ret = FUNC (params);                            \
+      /* Read parameters, call the wrapped function, empty the stack */       \
+      Diluculum::LuaValueList ret =                                           \
+         Diluculum::Impl::CallWrappedFunction (ls, FUNC);                     \
                                                                               \
       /* Push the return values and return */                                 \
-      for_each (ret.begin(), ret.end(), bind (PushLuaValue, ls, _1));         \
+      for (std::size_t i = 0; i < ret.size(); ++i)                            \
+         PushLuaValue (ls, ret[i]);                                           \
                                                                               \
       return ret.size();                                                      \
    }                                                                          \
@@ -148,6 +1188,34 @@ int DILUCULUM_WRAPPER_FUNCTION(FUNC) (lua_State* ls)                          \
 
 
 
+/** Creates a \c lua_CFunction that calls a C++ function with an ordinary
+ *  signature, like <tt>double Func (double x, const std::string& s)</tt>.
+ *  Unlike \c DILUCULUM_WRAP_FUNCTION(), no \c LuaValue or
+ *  \c LuaValueList is involved: each parameter is read directly from the
+ *  Lua stack and the return value is pushed directly onto it, using the
+ *  appropriate \c Diluculum::LuaTypeTraits. Everything is resolved at
+ *  compile time, so calling a bound function costs little more than
+ *  calling \c Func itself.
+ *  <p>Usage example: <tt>ls["func"] = DILUCULUM_BIND_FUNCTION (Func);</tt>
+ *  @note \c Func can take up to five parameters and return \c void or any
+ *        type supported by \c Diluculum::LuaTypeTraits. It must not be
+ *        overloaded, and it must have external linkage (that is, it cannot
+ *        be \c static).
+ *  @note If \c Func already is a \c lua_CFunction, it is only wrapped to
+ *        report the exceptions it throws as Lua errors.
+ *  @note Parameters that cannot be read as the type expected by \c Func
+ *        (including missing parameters, which are \c nil) cause a Lua
+ *        error, like in \c luaL_checknumber(). Extra parameters are
+ *        ignored. As in \c DILUCULUM_WRAP_FUNCTION(), the proper way to
+ *        report errors from \c Func is by <tt>throw</tt>ing a
+ *        \c Diluculum::LuaError.
+ *  @param FUNC The function to be bound.
+ */
+#define DILUCULUM_BIND_FUNCTION(FUNC)                                         \
+   (Diluculum::Impl::MakeFunctionBinder (&FUNC).bind<&FUNC>())
+
+
+
 /** Returns the name of the table that represent the class \c CLASS.
  *  @note This is used internally. Users can ignore this macro.
  */
@@ -156,16 +1224,167 @@ Diluculum__Class_Table__ ## CLASS
 
 
 
+
+/** Returns the name of the \c Diluculum::Impl::PropertyMap holding the
+ *  properties of the class \c CLASS.
+ *  @note This is used internally. Users can ignore this macro.
+ */
+#define DILUCULUM_CLASS_PROPERTIES(CLASS) \
+Diluculum__Class_Properties__ ## CLASS
+
+
+
 /** Starts a block of class wrapping macro calls. This must be followed by calls
  *  to \c DILUCULUM_CLASS_METHOD() for each method to be exported to Lua and a
  *  final call to \c DILUCULUM_END_CLASS().
+ *  <p>Objects instantiated in Lua are allocated with \c new and
+ *  <tt>delete</tt>d when garbage-collected, or when their \c delete method
+ *  is called. Using an object after calling its \c delete method raises a
+ *  Lua error, whatever the storage of its class.
  *  @param CLASS The class being exported.
+ *  @see DILUCULUM_BEGIN_CLASS_INLINE() For storing the objects directly in
+ *       the Lua userdata.
  */
 #define DILUCULUM_BEGIN_CLASS(CLASS)                                          \
+   DILUCULUM_BEGIN_CLASS_WITH_STORAGE(                                        \
+      CLASS, Diluculum::Impl::HeapObjectStorage<CLASS>)
+
+
+
+/** Starts a block of class wrapping macro calls, just like
+ *  \c DILUCULUM_BEGIN_CLASS(), but objects instantiated in Lua are
+ *  constructed directly inside the memory block of the Lua userdata
+ *  representing them (properly aligned), and destroyed in place when
+ *  garbage-collected. This saves one memory allocation per object, and one
+ *  pointer indirection on every access to it, which is worthwhile for small
+ *  value types, like vectors or identifiers.
+ *  @param CLASS The class being exported.
+ */
+#define DILUCULUM_BEGIN_CLASS_INLINE(CLASS)                                   \
+   DILUCULUM_BEGIN_CLASS_WITH_STORAGE(                                        \
+      CLASS, Diluculum::Impl::InlineObjectStorage<CLASS>)
+
+
+
+/** Starts a block of class wrapping macro calls, just like
+ *  \c DILUCULUM_BEGIN_CLASS(), but the memory of the objects instantiated in
+ *  Lua is recycled: when an object is garbage-collected, its memory block is
+ *  kept in a pool (a \c Diluculum::ObjectPool), and used for the next object
+ *  of the class created in Lua. This saves calls to the memory allocator
+ *  when scripts create and discard lots of short-lived objects.
+ *  <p>The pool is shared by all Lua states, and can be accessed (for example,
+ *  to check its hit rate) with \c DILUCULUM_CLASS_POOL().
+ *  @param CLASS The class being exported.
+ *  @param CAPACITY The maximum number of free memory blocks kept in the pool.
+ */
+#define DILUCULUM_BEGIN_CLASS_POOLED(CLASS, CAPACITY)                         \
+namespace                                                                     \
+{                                                                             \
+   /* a name for the storage policy, without commas (for the macro below) */  \
+   typedef Diluculum::Impl::PooledObjectStorage<CLASS, CAPACITY>              \
+      Diluculum__ ## CLASS ## __PooledStorage;                                \
+}                                                                             \
+                                                                              \
+DILUCULUM_BEGIN_CLASS_WITH_STORAGE(CLASS,                                     \
+                                   Diluculum__ ## CLASS ## __PooledStorage)
+
+
+
+/** Starts a block of class wrapping macro calls, just like
+ *  \c DILUCULUM_BEGIN_CLASS(), but the objects instantiated in Lua are owned
+ *  by a <tt>boost::shared_ptr</tt>. C++ code can read them as
+ *  <tt>boost::shared_ptr<CLASS></tt> (see
+ *  <tt>LuaTypeTraits<boost::shared_ptr<T> ></tt>), keeping them alive
+ *  after Lua garbage-collects them. Calling \c delete on them in Lua just
+ *  releases the reference held by Lua.
+ *  <p>Objects of any exported class can also be shared with Lua if they are
+ *  created in C++, by pushing a <tt>boost::shared_ptr</tt> to them or with
+ *  \c DILUCULUM_REGISTER_SHARED_OBJECT().
+ *  @param CLASS The class being exported.
+ */
+#define DILUCULUM_BEGIN_CLASS_SHARED(CLASS)                                   \
+   DILUCULUM_BEGIN_CLASS_WITH_STORAGE(                                        \
+      CLASS, Diluculum::Impl::SharedObjectStorage<CLASS>)
+
+
+
+/** Returns the \c Diluculum::ObjectPool used by a class exported with
+ *  \c DILUCULUM_BEGIN_CLASS_POOLED(). Like the other macros, this can only
+ *  be used in the same file where the class was exported. For example:
+ *  <p><tt>double rate = DILUCULUM_CLASS_POOL(Point).stats().hitRate();</tt>
+ *  @param CLASS The class whose pool is desired.
+ */
+#define DILUCULUM_CLASS_POOL(CLASS) \
+   (Diluculum__ ## CLASS ## __ObjectStorage::pool())
+
+
+
+/** Starts a block of class wrapping macro calls, using \c STORAGE to create
+ *  and destroy the objects instantiated in Lua.
+ *  @note This is used internally. Users should call
+ *        \c DILUCULUM_BEGIN_CLASS() or one of its variants instead.
+ *  @param CLASS The class being exported.
+ *  @param STORAGE A class like \c Diluculum::Impl::HeapObjectStorage.
+ */
+#define DILUCULUM_BEGIN_CLASS_WITH_STORAGE(CLASS, STORAGE)                    \
 namespace                                                                     \
 {                                                                             \
    /* the table representing the class */                                     \
    Diluculum::LuaValueMap DILUCULUM_CLASS_TABLE(CLASS);                       \
+                                                                              \
+   /* the class properties */                                                 \
+   Diluculum::Impl::PropertyMap DILUCULUM_CLASS_PROPERTIES(CLASS);            \
+                                                                              \
+   /* the policy used to create and destroy objects */                        \
+   typedef STORAGE Diluculum__ ## CLASS ## __ObjectStorage;                   \
+                                                                              \
+   /* make the class known by its type (used by 'LuaTypeTraits') */           \
+   Diluculum::Impl::ClassInfoFiller<CLASS>                                    \
+      Diluculum__ ## CLASS ## __ClassInfoFiller(                              \
+         &DILUCULUM_CLASS_TABLE(CLASS), #CLASS, STORAGE::copier());           \
+}                                                                             \
+                                                                              \
+/* The '__index' and '__newindex' metamethods (used only with properties) */  \
+int Diluculum__ ## CLASS ## __Index_Wrapper_Function (lua_State* ls)          \
+{                                                                             \
+   try                                                                        \
+   {                                                                          \
+      return Diluculum::Impl::IndexObject(                                    \
+         ls, &DILUCULUM_CLASS_TABLE(CLASS), DILUCULUM_CLASS_PROPERTIES(CLASS),\
+         #CLASS);                                                             \
+   }                                                                          \
+   catch (Diluculum::LuaError& e)                                             \
+   {                                                                          \
+      Diluculum::Impl::ReportErrorFromCFunction (ls, e.what());               \
+      return 0;                                                               \
+   }                                                                          \
+   catch(...)                                                                 \
+   {                                                                          \
+      Diluculum::Impl::ReportErrorFromCFunction(                              \
+         ls, "Unknown exception caught by wrapper.");                         \
+      return 0;                                                               \
+   }                                                                          \
+}                                                                             \
+                                                                              \
+int Diluculum__ ## CLASS ## __NewIndex_Wrapper_Function (lua_State* ls)       \
+{                                                                             \
+   try                                                                        \
+   {                                                                          \
+      return Diluculum::Impl::NewIndexObject(                                 \
+         ls, &DILUCULUM_CLASS_TABLE(CLASS), DILUCULUM_CLASS_PROPERTIES(CLASS),\
+         #CLASS);                                                             \
+   }                                                                          \
+   catch (Diluculum::LuaError& e)                                             \
+   {                                                                          \
+      Diluculum::Impl::ReportErrorFromCFunction (ls, e.what());               \
+      return 0;                                                               \
+   }                                                                          \
+   catch(...)                                                                 \
+   {                                                                          \
+      Diluculum::Impl::ReportErrorFromCFunction(                              \
+         ls, "Unknown exception caught by wrapper.");                         \
+      return 0;                                                               \
+   }                                                                          \
 }                                                                             \
                                                                               \
 /* The Constructor */                                                         \
@@ -185,15 +1404,11 @@ int Diluculum__ ## CLASS ## __Constructor_Wrapper_Function (lua_State* ls)    \
       lua_pop (ls, numParams);                                                \
                                                                               \
       /* Construct the object, wrap it in a userdata, and return */           \
-      void* ud = lua_newuserdata (ls, sizeof(CppObject));                     \
-      CppObject* cppObj = reinterpret_cast<CppObject*>(ud);                   \
-      cppObj->ptr = new CLASS (params);                                       \
-      cppObj->deleteMe = true;                                                \
+      STORAGE::create (ls, params);                                           \
                                                                               \
-      lua_getglobal (ls, "__Diluculum__Class_Metatables");                    \
-      lua_getfield (ls, -1, #CLASS);                                          \
-      lua_setmetatable (ls, -3);                                              \
-      lua_pop (ls, 1); /* pop the table of metatables */                      \
+      /* the class metatable is the constructor upvalue */                    \
+      lua_pushvalue (ls, lua_upvalueindex (1));                               \
+      lua_setmetatable (ls, -2);                                              \
                                                                               \
       return 1;                                                               \
    }                                                                          \
@@ -213,18 +1428,42 @@ int Diluculum__ ## CLASS ## __Constructor_Wrapper_Function (lua_State* ls)    \
 int Diluculum__ ## CLASS ## __Destructor_Wrapper_Function (lua_State* ls)     \
 {                                                                             \
    using Diluculum::Impl::CppObject;                                          \
+   using Diluculum::Impl::ReportErrorFromCFunction;                           \
+                                                                              \
+   try                                                                        \
+   {                                                                          \
+      /* Not 'GetCppObject()': deleting twice is fine */                      \
+      if (!Diluculum::Impl::IsCppObject (ls, 1,                               \
+                                         &DILUCULUM_CLASS_TABLE(CLASS)))      \
+         throw Diluculum::TypeMismatchError (#CLASS, luaL_typename (ls, 1));  \
+                                                                              \
+      CppObject* cppObj = static_cast<CppObject*>(lua_touserdata (ls, 1));    \
+                                                                              \
+      if (cppObj->owner != 0)                                                 \
+      {                                                                       \
+         Diluculum::Impl::ReleaseSharedObject (cppObj);                       \
+      }                                                                       \
+      else if (cppObj->deleteMe)                                              \
+      {                                                                       \
+         cppObj->deleteMe = false; /* don't delete again when gc'ed! */       \
+         STORAGE::destroy (cppObj);                                           \
+      }                                                                       \
                                                                               \
-   CppObject* cppObj =                                                        \
-      reinterpret_cast<CppObject*>(lua_touserdata (ls, -1));                  \
+      /* The object is gone (or not ours anymore); make further uses fail */  \
+      cppObj->ptr = 0;                                                        \
                                                                               \
-   if (cppObj->deleteMe)                                                      \
+      return 0;                                                               \
+   }                                                                          \
+   catch (Diluculum::LuaError& e)                                             \
    {                                                                          \
-      cppObj->deleteMe = false; /* don't delete again when gc'ed! */          \
-      CLASS* pObj = reinterpret_cast<CLASS*>(cppObj->ptr);                    \
-      delete pObj;                                                            \
+      ReportErrorFromCFunction (ls, e.what());                                \
+      return 0;                                                               \
+   }                                                                          \
+   catch(...)                                                                 \
+   {                                                                          \
+      ReportErrorFromCFunction (ls, "Unknown exception caught by wrapper.");  \
+      return 0;                                                               \
    }                                                                          \
-                                                                              \
-   return 0;                                                                  \
 }
 
 
@@ -246,31 +1485,32 @@ int Diluculum__ ## CLASS ## __Destructor_Wrapper_Function (lua_State* ls)     \
 #define DILUCULUM_CLASS_METHOD(CLASS, METHOD)                                 \
 int DILUCULUM_METHOD_WRAPPER(CLASS, METHOD) (lua_State* ls)                   \
 {                                                                             \
-   using std::for_each;                                                       \
-   using boost::bind;                                                         \
    using Diluculum::PushLuaValue;                                             \
    using Diluculum::Impl::CppObject;                                          \
    using Diluculum::Impl::ReportErrorFromCFunction;                           \
                                                                               \
    try                                                                        \
    {                                                                          \
+      /* Get the object pointer, straight from the userdata */                \
+      CppObject* cppObj = Diluculum::Impl::GetCppObject(                      \
+         ls, 1, &DILUCULUM_CLASS_TABLE(CLASS), #CLASS);                       \
+      CLASS* pObj = reinterpret_cast<CLASS*>(cppObj->ptr);                    \
+                                                                              \
       /* Read parameters and empty the stack */                               \
       const int numParams = lua_gettop (ls);                                  \
-      Diluculum::LuaValue ud = Diluculum::ToLuaValue (ls, 1);                 \
       Diluculum::LuaValueList params;                                         \
+      params.reserve (numParams - 1);                                         \
       for (int i = 2; i <= numParams; ++i)                                    \
          params.push_back (Diluculum::ToLuaValue (ls, i));                    \
       lua_pop (ls, numParams);                                                \
                                                                               \
-      /* Get the object pointer and call the method */                        \
-      CppObject* cppObj =                                                     \
-         reinterpret_cast<CppObject*>(ud.asUserData().getData());             \
-      CLASS* pObj = reinterpret_cast<CLASS*>(cppObj->ptr);                    \
+      /* Call the method */                                                   \
                                                                               \
       Diluculum::LuaValueList ret = pObj->METHOD (params);                    \
                                                                               \
       /* Push the return values and return */                                 \
-      for_each (ret.begin(), ret.end(), bind (PushLuaValue, ls, _1));         \
+      for (std::size_t i = 0; i < ret.size(); ++i)                            \
+         PushLuaValue (ls, ret[i]);                                           \
                                                                               \
       return ret.size();                                                      \
    }                                                                          \
@@ -297,43 +1537,214 @@ namespace                                                                     \
 
 
 
-/** Ends a block of class wrapping macro calls (which was opened by a call to
- *  \c DILUCULUM_BEGIN_CLASS()).
- *  @param CLASS The class being exported.
+/** Exports a given class' method with an ordinary signature, like
+ *  <tt>double Class::method (double x, const std::string& s) const</tt>.
+ *  This is to \c DILUCULUM_CLASS_METHOD() what \c DILUCULUM_BIND_FUNCTION()
+ *  is to \c DILUCULUM_WRAP_FUNCTION(): parameters are read directly from
+ *  the Lua stack and the return value is pushed directly onto it, using the
+ *  appropriate \c Diluculum::LuaTypeTraits, with no \c LuaValue involved.
+ *  This macro must be called between calls to \c DILUCULUM_BEGIN_CLASS()
+ *  and \c DILUCULUM_END_CLASS().
+ *  @note \c METHOD can take up to four parameters and return \c void or any
+ *        type supported by \c Diluculum::LuaTypeTraits. It must not be
+ *        overloaded.
+ *  @param CLASS The class whose method is being exported.
+ *  @param METHOD The method being exported.
  */
-#define DILUCULUM_END_CLASS(CLASS)                                            \
-                                                                              \
-/* The function used to register the class in a 'LuaState' */                 \
-void Diluculum_Register_Class__ ## CLASS (Diluculum::LuaVariable className)   \
+#define DILUCULUM_CLASS_BIND_METHOD(CLASS, METHOD)                            \
+int DILUCULUM_METHOD_WRAPPER(CLASS, METHOD) (lua_State* ls)                   \
 {                                                                             \
-   Diluculum::LuaState ls (className.getState());                             \
+   using Diluculum::Impl::CppObject;                                          \
+   using Diluculum::Impl::ReportErrorFromCFunction;                           \
                                                                               \
-   if (ls["__Diluculum__Class_Metatables"].value().type() == LUA_TNIL)        \
-     ls["__Diluculum__Class_Metatables"] = Diluculum::EmptyLuaValueMap;       \
+   try                                                                        \
+   {                                                                          \
+      CppObject* cppObj = Diluculum::Impl::GetCppObject(                      \
+         ls, 1, &DILUCULUM_CLASS_TABLE(CLASS), #CLASS);                       \
+      CLASS* pObj = reinterpret_cast<CLASS*>(cppObj->ptr);                    \
                                                                               \
-   static bool isInited = false;                                              \
-   if (!isInited)                                                             \
+      return Diluculum::Impl::CallBoundMethod (ls, pObj, &CLASS::METHOD);     \
+   }                                                                          \
+   catch (Diluculum::LuaError& e)                                             \
    {                                                                          \
-      isInited = true;                                                        \
+      ReportErrorFromCFunction (ls, e.what());                                \
+      return 0;                                                               \
+   }                                                                          \
+   catch(...)                                                                 \
+   {                                                                          \
+      ReportErrorFromCFunction (ls, "Unknown exception caught by wrapper.");  \
+      return 0;                                                               \
+   }                                                                          \
+}                                                                             \
                                                                               \
-      DILUCULUM_CLASS_TABLE(CLASS)["classname"] = #CLASS;                     \
+namespace                                                                     \
+{                                                                             \
+   Diluculum::Impl::ClassTableFiller                                          \
+      Diluculum__ ## CLASS ## _ ## METHOD ## __ ## Filler(                    \
+         DILUCULUM_CLASS_TABLE(CLASS),                                        \
+         #METHOD,                                                             \
+         DILUCULUM_METHOD_WRAPPER(CLASS, METHOD));                            \
+}
+
+
+
+/** Exports a metamethod of a given class, like \c __add, \c __eq or
+ *  \c __tostring. This macro must be called between calls to
+ *  \c DILUCULUM_BEGIN_CLASS() and \c DILUCULUM_END_CLASS().
+ *  <p>\c FUNC is bound just like in \c DILUCULUM_BIND_FUNCTION(), so it is an
+ *  ordinary function (or static method), receiving the metamethod operands
+ *  as parameters. Objects of exported classes can be taken as parameters
+ *  (by value or by \c const reference) and returned by value, thanks to the
+ *  generic \c Diluculum::LuaTypeTraits. For instance:
+ *  <p><tt>Vec3 Add (const Vec3& a, const Vec3& b);</tt>
+ *  <p><tt>DILUCULUM_CLASS_METAMETHOD (Vec3, __add, Add);</tt>
+ *  <p>Remember that Lua passes the operands of binary operators in the order
+ *  they appear, so <tt>2 * v</tt> and <tt>v * 2</tt> call \c __mul with
+ *  parameters in different orders. When this matters, \c FUNC can be a
+ *  \c lua_CFunction, which reads the operands from the stack by itself.
+ *  @note The \c __gc, \c __index and \c __newindex metamethods are used
+ *        by Diluculum itself, and must not be exported with this macro.
+ *  @param CLASS The class whose metamethod is being exported.
+ *  @param EVENT The metamethod name, like \c __add.
+ *  @param FUNC The function implementing the metamethod.
+ */
+#define DILUCULUM_CLASS_METAMETHOD(CLASS, EVENT, FUNC)                        \
+namespace                                                                     \
+{                                                                             \
+   Diluculum::Impl::ClassTableFiller                                          \
+      Diluculum__ ## CLASS ## _ ## EVENT ## __ ## MetamethodFiller(           \
+         DILUCULUM_CLASS_TABLE(CLASS),                                        \
+         #EVENT,                                                              \
+         DILUCULUM_BIND_FUNCTION(FUNC));                                      \
+}
+
+
+
+/** Returns the name of the function used to read (if \c WHAT is \c Getter)
+ *  or write (if \c WHAT is \c Setter) a property \c NAME of the class
+ *  \c CLASS.
+ *  @note This is used internally. Users can ignore this macro.
+ */
+#define DILUCULUM_PROPERTY_ACCESSOR(CLASS, NAME, WHAT)                        \
+   Diluculum__ ## CLASS ## __ ## NAME ## __Property_ ## WHAT
+
+
+
+/** Registers the accessors of a property \c NAME of the class \c CLASS.
+ *  @note This is used internally. Users can ignore this macro.
+ */
+#define DILUCULUM_PROPERTY_FILLER(CLASS, NAME, GETTER, SETTER)                \
+namespace                                                                     \
+{                                                                             \
+   Diluculum::Impl::PropertyMapFiller                                         \
+      Diluculum__ ## CLASS ## _ ## NAME ## __ ## PropertyFiller(              \
+         DILUCULUM_CLASS_PROPERTIES(CLASS), #NAME, GETTER, SETTER);           \
+}
+
+
+
+/** Exports a property of a given class, that is, something that is accessed
+ *  in Lua like a field (<tt>obj.name</tt> and <tt>obj.name = value</tt>) but
+ *  is read and written by calling methods of the C++ object. This macro must
+ *  be called between calls to \c DILUCULUM_BEGIN_CLASS() and
+ *  \c DILUCULUM_END_CLASS().
+ *  <p>Classes with properties get \c __index and \c __newindex
+ *  metamethods implemented in C++, which look for methods first and then
+ *  for properties. Reading or writing a property does not allocate memory,
+ *  and values are converted directly with \c Diluculum::LuaTypeTraits.
+ *  @param CLASS The class whose property is being exported.
+ *  @param NAME The name of the property in Lua.
+ *  @param GETTER The method used to read the property. It must not take any
+ *         parameters.
+ *  @param SETTER The method used to write the property. It must take a
+ *         single parameter.
+ */
+#define DILUCULUM_CLASS_PROPERTY(CLASS, NAME, GETTER, SETTER)                 \
+void DILUCULUM_PROPERTY_ACCESSOR(CLASS, NAME, Getter) (lua_State* ls,        \
+                                                       void* obj)             \
+{                                                                             \
+   Diluculum::Impl::CallPropertyGetter(                                       \
+      ls, static_cast<CLASS*>(obj), &CLASS::GETTER);                          \
+}                                                                             \
                                                                               \
-      DILUCULUM_CLASS_TABLE(CLASS)["new"] =                                   \
-         Diluculum__ ## CLASS ## __Constructor_Wrapper_Function;              \
+void DILUCULUM_PROPERTY_ACCESSOR(CLASS, NAME, Setter) (lua_State* ls,        \
+                                                       void* obj, int index)  \
+{                                                                             \
+   Diluculum::Impl::CallPropertySetter(                                       \
+      ls, static_cast<CLASS*>(obj), &CLASS::SETTER, index);                   \
+}                                                                             \
                                                                               \
-      DILUCULUM_CLASS_TABLE(CLASS)["delete"] =                                \
-         Diluculum__ ## CLASS ## __Destructor_Wrapper_Function;               \
+DILUCULUM_PROPERTY_FILLER(CLASS, NAME,                                        \
+                          DILUCULUM_PROPERTY_ACCESSOR(CLASS, NAME, Getter),   \
+                          DILUCULUM_PROPERTY_ACCESSOR(CLASS, NAME, Setter))
+
+
+
+/** Exports a read-only property of a given class. This is just like
+ *  \c DILUCULUM_CLASS_PROPERTY(), but there is no setter: trying to assign
+ *  to the property in Lua raises an error.
+ *  @param CLASS The class whose property is being exported.
+ *  @param NAME The name of the property in Lua.
+ *  @param GETTER The method used to read the property.
+ */
+#define DILUCULUM_CLASS_READONLY_PROPERTY(CLASS, NAME, GETTER)                \
+void DILUCULUM_PROPERTY_ACCESSOR(CLASS, NAME, Getter) (lua_State* ls,        \
+                                                       void* obj)             \
+{                                                                             \
+   Diluculum::Impl::CallPropertyGetter(                                       \
+      ls, static_cast<CLASS*>(obj), &CLASS::GETTER);                          \
+}                                                                             \
                                                                               \
-      DILUCULUM_CLASS_TABLE(CLASS)["__gc"] =                                  \
-         Diluculum__ ## CLASS ## __Destructor_Wrapper_Function;               \
+DILUCULUM_PROPERTY_FILLER(CLASS, NAME,                                        \
+                          DILUCULUM_PROPERTY_ACCESSOR(CLASS, NAME, Getter), 0)
+
+
+
+/** Exports a public data member of a given class as a property with the
+ *  same name. This is just like \c DILUCULUM_CLASS_PROPERTY(), but the data
+ *  member is read and written directly.
+ *  @param CLASS The class whose data member is being exported.
+ *  @param MEMBER The data member being exported.
+ */
+#define DILUCULUM_CLASS_MEMBER_PROPERTY(CLASS, MEMBER)                        \
+void DILUCULUM_PROPERTY_ACCESSOR(CLASS, MEMBER, Getter) (lua_State* ls,      \
+                                                         void* obj)           \
+{                                                                             \
+   Diluculum::Impl::GetDataMember(                                            \
+      ls, static_cast<CLASS*>(obj), &CLASS::MEMBER);                          \
+}                                                                             \
                                                                               \
-      DILUCULUM_CLASS_TABLE(CLASS)["__index"] = DILUCULUM_CLASS_TABLE(CLASS); \
-   }                                                                          \
+void DILUCULUM_PROPERTY_ACCESSOR(CLASS, MEMBER, Setter) (lua_State* ls,      \
+                                                         void* obj,           \
+                                                         int index)           \
+{                                                                             \
+   Diluculum::Impl::SetDataMember(                                            \
+      ls, static_cast<CLASS*>(obj), &CLASS::MEMBER, index);                   \
+}                                                                             \
                                                                               \
-   className = DILUCULUM_CLASS_TABLE(CLASS);                                  \
+DILUCULUM_PROPERTY_FILLER(CLASS, MEMBER,                                      \
+                          DILUCULUM_PROPERTY_ACCESSOR(CLASS, MEMBER, Getter), \
+                          DILUCULUM_PROPERTY_ACCESSOR(CLASS, MEMBER, Setter))
+
+
+
+/** Ends a block of class wrapping macro calls (which was opened by a call to
+ *  \c DILUCULUM_BEGIN_CLASS()).
+ *  @param CLASS The class being exported.
+ */
+#define DILUCULUM_END_CLASS(CLASS)                                            \
                                                                               \
-   ls["__Diluculum__Class_Metatables"][#CLASS] =                              \
-      DILUCULUM_CLASS_TABLE(CLASS);                                           \
+/* The function used to register the class in a 'LuaState' */                 \
+void Diluculum_Register_Class__ ## CLASS (Diluculum::LuaVariable className)   \
+{                                                                             \
+   Diluculum::Impl::RegisterClass(                                            \
+      className, &DILUCULUM_CLASS_TABLE(CLASS), #CLASS,                       \
+      DILUCULUM_CLASS_TABLE(CLASS),                                           \
+      Diluculum__ ## CLASS ## __Constructor_Wrapper_Function,                 \
+      Diluculum__ ## CLASS ## __Destructor_Wrapper_Function,                  \
+      Diluculum__ ## CLASS ## __Index_Wrapper_Function,                       \
+      Diluculum__ ## CLASS ## __NewIndex_Wrapper_Function,                    \
+      DILUCULUM_CLASS_PROPERTIES(CLASS));                                     \
 } /* end of Diluculum_Register_Class__CLASS */
 
 
@@ -362,35 +1773,33 @@ void Diluculum_Register_Class__ ## CLASS (Diluculum::LuaVariable className)   \
  *         been previously registered in the target Lua state with a call to the
  *         \c DILUCULUM_REGISTER_CLASS() macro.
  *  @param OBJECT The object to be registered to the Lua state.
+ *  @throw Diluculum::LuaError If \c CLASS was not registered in the target Lua
+ *         state.
  */
 #define DILUCULUM_REGISTER_OBJECT(LUA_VARIABLE, CLASS, OBJECT)                \
-{                                                                             \
-   /* leave the table where 'OBJECT' is to be stored at the stack top */      \
-   LUA_VARIABLE.pushLastTable();                                              \
-                                                                              \
-   /* push the field where the object will be stored */                       \
-   Diluculum::PushLuaValue (LUA_VARIABLE.getState(),                          \
-                            LUA_VARIABLE.getKeys().back());                   \
-                                                                              \
-   /* create the userdata, set its metatable */                               \
-   void* ud = lua_newuserdata (LUA_VARIABLE.getState(),                       \
-                               sizeof(Diluculum::Impl::CppObject));           \
-                                                                              \
-   Diluculum::Impl::CppObject* cppObj =                                       \
-      reinterpret_cast<Diluculum::Impl::CppObject*>(ud);                      \
-                                                                              \
-   cppObj->ptr = &OBJECT;                                                     \
-   cppObj->deleteMe = false;                                                  \
-                                                                              \
-   lua_getglobal (LUA_VARIABLE.getState(), "__Diluculum__Class_Metatables");  \
-   lua_getfield (LUA_VARIABLE.getState(), -1, #CLASS);                        \
-   lua_setmetatable (LUA_VARIABLE.getState(), -3);                            \
-                                                                              \
-   lua_pop (LUA_VARIABLE.getState(), 1); /* pop the table of metatables */    \
-                                                                              \
-   /* store the userdata */                                                   \
-   lua_settable (LUA_VARIABLE.getState(), -3);                                \
-}
+   Diluculum::Impl::RegisterObject (LUA_VARIABLE,                             \
+                                    &DILUCULUM_CLASS_TABLE(CLASS), #CLASS,    \
+                                    &OBJECT);
+
+
+
+/** Registers an object instantiated in C++ into a Lua state, sharing its
+ *  ownership with Lua. Unlike with \c DILUCULUM_REGISTER_OBJECT(), the object
+ *  stays alive for as long as either Lua or C++ holds a reference to it.
+ *  @param LUA_VARIABLE The \c Diluculum::LuaVariable where the object will be
+ *         stored.
+ *  @param CLASS The class of the object being registered. This class must have
+ *         been previously registered in the target Lua state with a call to the
+ *         \c DILUCULUM_REGISTER_CLASS() macro.
+ *  @param SHARED_PTR A <tt>boost::shared_ptr<CLASS></tt> pointing to the
+ *         object.
+ *  @throw Diluculum::LuaError If \c CLASS was not registered in the target Lua
+ *         state.
+ */
+#define DILUCULUM_REGISTER_SHARED_OBJECT(LUA_VARIABLE, CLASS, SHARED_PTR)     \
+   Diluculum::Impl::RegisterSharedObject (LUA_VARIABLE,                       \
+                                          &DILUCULUM_CLASS_TABLE(CLASS),      \
+                                          #CLASS, SHARED_PTR);
 
 
 
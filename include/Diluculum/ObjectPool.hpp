@@ -0,0 +1,137 @@
+/******************************************************************************\
+* ObjectPool.hpp                                                               *
+* A pool of memory blocks, used to recycle objects created in Lua.             *
+*                                                                              *
+*                                                                              *
+* Copyright (C) 2005-2011 by Leandro Motta Barros.                             *
+*                                                                              *
+* Permission is hereby granted, free of charge, to any person obtaining a copy *
+* of this software and associated documentation files (the "Software"), to     *
+* deal in the Software without restriction, including without limitation the   *
+* rights to use, copy, modify, merge, publish, distribute, sublicense, and/or  *
+* sell copies of the Software, and to permit persons to whom the Software is   *
+* furnished to do so, subject to the following conditions:                     *
+*                                                                              *
+* The above copyright notice and this permission notice shall be included in   *
+* all copies or substantial portions of the Software.                          *
+*                                                                              *
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR   *
+* IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,     *
+* FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.  IN NO EVENT SHALL THE *
+* AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER       *
+* LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING      *
+* FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS *
+* IN THE SOFTWARE.                                                             *
+\******************************************************************************/
+
+#ifndef _DILUCULUM_OBJECT_POOL_HPP_
+#define _DILUCULUM_OBJECT_POOL_HPP_
+
+#include <cstddef>
+#include <boost/noncopyable.hpp>
+#include <boost/scoped_ptr.hpp>
+
+
+namespace Diluculum
+{
+   /// Statistics about the use of an \c ObjectPool.
+   struct ObjectPoolStats
+   {
+      /// Constructs an \c ObjectPoolStats with everything zeroed.
+      ObjectPoolStats()
+         : capacity(0), available(0), hits(0), misses(0), discards(0)
+      { }
+
+      /// The maximum number of free blocks kept by the pool.
+      std::size_t capacity;
+
+      /// The number of free blocks currently kept by the pool.
+      std::size_t available;
+
+      /// The number of requests served with a recycled block.
+      std::size_t hits;
+
+      /// The number of requests that required allocating a new block.
+      std::size_t misses;
+
+      /// The number of blocks freed because the pool was full.
+      std::size_t discards;
+
+      /** Returns the fraction of requests served with a recycled block (a
+       *  number between 0 and 1). Returns zero if no request was made yet.
+       */
+      double hitRate() const
+      {
+         const std::size_t requests = hits + misses;
+         return requests == 0
+            ? 0.0
+            : static_cast<double>(hits) / static_cast<double>(requests);
+      }
+   };
+
+
+
+   /** A freelist of equally sized memory blocks. Blocks given back to the pool
+    *  are kept (up to a given capacity) and handed out again in the next
+    *  requests, saving calls to the memory allocator. This is used to recycle
+    *  the memory of C++ objects instantiated in Lua, for classes exported with
+    *  \c DILUCULUM_BEGIN_CLASS_POOLED().
+    *  <p>An \c ObjectPool can be shared by Lua states running in different
+    *  threads: all its operations are thread-safe.
+    */
+   class ObjectPool: boost::noncopyable
+   {
+      public:
+         /** Constructs an \c ObjectPool.
+          *  @param blockSize The size, in bytes, of the blocks handed out by
+          *         the pool. Blocks are aligned as memory returned by
+          *         <tt>operator new</tt>.
+          *  @param capacity The maximum number of free blocks kept by the
+          *         pool. Blocks given back when the pool is full are freed.
+          */
+         ObjectPool (std::size_t blockSize, std::size_t capacity);
+
+         /// Destroys the \c ObjectPool, freeing the blocks it keeps.
+         ~ObjectPool();
+
+         /** Returns a block of memory, recycled if possible, or newly
+          *  allocated otherwise.
+          *  @throw std::bad_alloc If memory cannot be allocated.
+          */
+         void* acquire();
+
+         /** Gives back to the pool a block previously obtained with
+          *  \c acquire().
+          */
+         void release (void* block);
+
+         /** Allocates blocks until the pool keeps \c count free blocks (or is
+          *  full). This can be used to "warm up" the pool, so that even the
+          *  first requests are served without calling the allocator. These
+          *  allocations do not count in the statistics.
+          */
+         void reserve (std::size_t count);
+
+         /// Frees all the blocks kept by the pool.
+         void clear();
+
+         /// Returns the usage statistics of this pool.
+         ObjectPoolStats stats() const;
+
+         /// Zeroes the counters of requests and discards.
+         void resetStats();
+
+      private:
+         /// The pool state, which includes a mutex.
+         class State;
+
+         /// The size of the blocks handed out by the pool.
+         const std::size_t blockSize_;
+
+         /// The pool state.
+         boost::scoped_ptr<State> state_;
+   };
+
+} // namespace Diluculum
+
+#endif // _DILUCULUM_OBJECT_POOL_HPP_